@@ -0,0 +1 @@
+#cmakedefine HAVE_JACK
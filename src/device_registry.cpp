@@ -0,0 +1,325 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "device_registry.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QMetaObject>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QtGlobal>
+
+#include <Solid/Block>
+#include <Solid/Device>
+#include <Solid/DeviceNotifier>
+#include <Solid/OpticalDrive>
+
+Q_GLOBAL_STATIC(DeviceRegistry, s_registry)
+
+static QString driveType(Solid::OpticalDrive::MediumTypes mediumType)
+{
+    //TODO translate them ?
+    if(mediumType < Solid::OpticalDrive::Cdrw) {
+        return QLatin1String( "CD-ROM" );
+    } else if(mediumType < Solid::OpticalDrive::Dvd) {
+        return QLatin1String( "CDRW" );
+    } else if(mediumType < Solid::OpticalDrive::Dvdr) {
+        return QLatin1String( "DVD-ROM" );
+    } else if(mediumType < Solid::OpticalDrive::Bd) {
+        return QLatin1String( "DVDRW" );
+    } else if(mediumType < Solid::OpticalDrive::HdDvd) {
+        return QLatin1String( "Blu-ray" );
+    } else {
+        return QLatin1String( "High Density DVD" );
+    }
+}
+
+static QString driveName(Solid::OpticalDrive::MediumTypes mediumType, const QString &vendor, const QString &product)
+{
+    const QString type = driveType(mediumType);
+
+    if(!vendor.isEmpty())
+        return (QLatin1Char('[') + type + QLatin1String( " - " ) + vendor + QLatin1String( " - " ) + product + QLatin1Char( ']' ));
+    else
+        return (QLatin1Char('[') + type + QLatin1String( " - unknown vendor - " ) + product + QLatin1Char( ']' ));
+}
+
+#ifdef Q_OS_LINUX
+/*
+ * The udev database has what UDisks2, and so Solid, reports for a drive.
+ */
+static const struct {
+    const char *key;
+    Solid::OpticalDrive::MediumType type;
+} udevMedia[] = {
+    { "ID_CDROM_CD_R", Solid::OpticalDrive::Cdr },
+    { "ID_CDROM_CD_RW", Solid::OpticalDrive::Cdrw },
+    { "ID_CDROM_DVD", Solid::OpticalDrive::Dvd },
+    { "ID_CDROM_DVD_R", Solid::OpticalDrive::Dvdr },
+    { "ID_CDROM_DVD_RW", Solid::OpticalDrive::Dvdrw },
+    { "ID_CDROM_DVD_RAM", Solid::OpticalDrive::Dvdram },
+    { "ID_CDROM_DVD_PLUS_R", Solid::OpticalDrive::Dvdplusr },
+    { "ID_CDROM_DVD_PLUS_RW", Solid::OpticalDrive::Dvdplusrw },
+    { "ID_CDROM_DVD_PLUS_R_DL", Solid::OpticalDrive::Dvdplusdl },
+    { "ID_CDROM_DVD_PLUS_RW_DL", Solid::OpticalDrive::Dvdplusdlrw },
+    { "ID_CDROM_BD", Solid::OpticalDrive::Bd },
+    { "ID_CDROM_BD_R", Solid::OpticalDrive::Bdr },
+    { "ID_CDROM_BD_RE", Solid::OpticalDrive::Bdre },
+    { "ID_CDROM_HDDVD", Solid::OpticalDrive::HdDvd },
+    { "ID_CDROM_HDDVD_R", Solid::OpticalDrive::HdDvdr },
+    { "ID_CDROM_HDDVD_RW", Solid::OpticalDrive::HdDvdrw },
+};
+
+static QByteArray readSysFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll().trimmed();
+}
+
+// undo the \xNN escapes of the *_ENC properties
+static QString udevDecode(const QByteArray &value)
+{
+    QByteArray out;
+    for (int i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 3 < value.size() && value[i + 1] == 'x') {
+            out += char(value.mid(i + 2, 2).toInt(nullptr, 16));
+            i += 3;
+        } else {
+            out += value[i];
+        }
+    }
+    return QString::fromUtf8(out).trimmed();
+}
+
+static QString udevString(const QHash<QByteArray, QByteArray> &props, const char *key, const QByteArray &sysfs)
+{
+    const QByteArray enc = props.value(QByteArray(key) + "_ENC");
+    if (!enc.isEmpty())
+        return udevDecode(enc);
+
+    const QByteArray plain = props.value(key);
+    if (!plain.isEmpty())
+        return QString::fromUtf8(plain).replace(QLatin1Char('_'), QLatin1Char(' ')).trimmed();
+
+    return QString::fromUtf8(sysfs).trimmed();
+}
+#endif
+
+DeviceRegistry *DeviceRegistry::instance()
+{
+    return s_registry();
+}
+
+DeviceRegistry::DeviceRegistry()
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    if (!app) {
+        // nobody to deliver notifications, this is all we get
+        solidScan();
+        return;
+    }
+
+    if (thread() != app->thread())
+        moveToThread(app->thread());
+
+    Solid::DeviceNotifier *notifier = Solid::DeviceNotifier::instance();
+    connect(notifier, &Solid::DeviceNotifier::deviceAdded, this, &DeviceRegistry::deviceAdded);
+    connect(notifier, &Solid::DeviceNotifier::deviceRemoved, this, &DeviceRegistry::deviceRemoved);
+
+#ifdef Q_OS_LINUX
+    quickScan();
+    QMetaObject::invokeMethod(this, &DeviceRegistry::solidScan, Qt::QueuedConnection);
+#else
+    solidScan();
+#endif
+}
+
+void DeviceRegistry::quickScan()
+{
+#ifdef Q_OS_LINUX
+    const QString sysBlock = QStringLiteral("/sys/class/block/");
+    const QStringList devices = QDir(sysBlock).entryList(QStringList(QStringLiteral("sr*")),
+        QDir::Dirs | QDir::System | QDir::NoDotAndDotDot);
+
+    for (const QString &dev : devices) {
+        QHash<QByteArray, QByteArray> props;
+        QFile udev(QLatin1String("/run/udev/data/b") + QString::fromLatin1(readSysFile(sysBlock + dev + QLatin1String("/dev"))));
+        if (udev.open(QIODevice::ReadOnly)) {
+            const QList<QByteArray> lines = udev.readAll().split('\n');
+            for (const QByteArray &line : lines) {
+                const int eq = line.indexOf('=');
+                if (line.startsWith("E:") && eq > 2)
+                    props.insert(line.mid(2, eq - 2), line.mid(eq + 1));
+            }
+        }
+
+        Solid::OpticalDrive::MediumTypes media;
+        for (const auto &medium : udevMedia) {
+            if (props.value(medium.key) == "1")
+                media |= medium.type;
+        }
+
+        const QString vendor = udevString(props, "ID_VENDOR", readSysFile(sysBlock + dev + QLatin1String("/device/vendor")));
+        const QString model = udevString(props, "ID_MODEL", readSysFile(sysBlock + dev + QLatin1String("/device/model")));
+
+        QWriteLocker locker(&m_lock);
+        insert(driveName(media, vendor, model),
+            QUrl::fromUserInput(QLatin1String("/dev/") + dev),
+            QLatin1String("/org/freedesktop/UDisks2/block_devices/") + dev);
+    }
+
+    QWriteLocker locker(&m_lock);
+    rebuildNames();
+#endif
+}
+
+static bool describeDrive(const Solid::Device &device, QString *name, QUrl *url)
+{
+    const Solid::Block *b = device.as<Solid::Block>();
+    const Solid::OpticalDrive *o = device.as<Solid::OpticalDrive>();
+    if (!b || !o)
+        return false;
+
+    *name = driveName(o->supportedMedia(), device.vendor(), device.product());
+    *url = QUrl::fromUserInput(QLatin1String( b->device().toLatin1() ));
+    return true;
+}
+
+/*
+ * Replace whatever we have by Solid's view, names must match the ones
+ * Solid gives for the hotplug notifications later.
+ */
+void DeviceRegistry::solidScan()
+{
+    QStringList names, udis;
+    QList<QUrl> urls;
+    QString name;
+    QUrl url;
+
+    //get a list of all devices that are Cdrom
+    const auto devices = Solid::Device::listFromType(Solid::DeviceInterface::OpticalDrive);
+    for (const Solid::Device &device : devices) {
+        if (describeDrive(device, &name, &url)) {
+            names << name;
+            urls << url;
+            udis << device.udi();
+        }
+    }
+
+    QWriteLocker locker(&m_lock);
+    m_drives.clear();
+    m_udiToName.clear();
+    m_urls.clear();
+    for (int i = 0; i < names.size(); ++i)
+        insert(names[i], urls[i], udis[i]);
+    rebuildNames();
+}
+
+void DeviceRegistry::deviceAdded(const QString &udi)
+{
+    QString name;
+    QUrl url;
+
+    if (!describeDrive(Solid::Device(udi), &name, &url))
+        return;
+
+    QWriteLocker locker(&m_lock);
+    remove(udi);
+    insert(name, url, udi);
+    rebuildNames();
+}
+
+void DeviceRegistry::deviceRemoved(const QString &udi)
+{
+    QWriteLocker locker(&m_lock);
+    if (m_udiToName.contains(udi)) {
+        remove(udi);
+        rebuildNames();
+    }
+}
+
+void DeviceRegistry::insert(const QString &name, const QUrl &url, const QString &udi)
+{
+    m_drives.insert(name, Drive{url, udi});
+    m_udiToName.insert(udi, name);
+    m_urls.insert(url);
+}
+
+void DeviceRegistry::remove(const QString &udi)
+{
+    const QString name = m_udiToName.take(udi);
+    const auto it = m_drives.constFind(name);
+    if (it != m_drives.constEnd() && it->udi == udi) {
+        m_urls.remove(it->url);
+        m_drives.erase(it);
+    }
+}
+
+void DeviceRegistry::rebuildNames()
+{
+    m_names = m_drives.keys();
+    m_names.sort();
+}
+
+QStringList DeviceRegistry::names() const
+{
+    QReadLocker locker(&m_lock);
+    return m_names;
+}
+
+QUrl DeviceRegistry::url(const QString &name) const
+{
+    QReadLocker locker(&m_lock);
+    return m_drives.value(name).url;
+}
+
+QString DeviceRegistry::udi(const QString &name) const
+{
+    QReadLocker locker(&m_lock);
+    return m_drives.value(name).udi;
+}
+
+bool DeviceRegistry::containsUrl(const QUrl &url) const
+{
+    QReadLocker locker(&m_lock);
+    return m_urls.contains(url);
+}
+
+QString DeviceRegistry::defaultName() const
+{
+    QReadLocker locker(&m_lock);
+    return m_names.value(0);
+}
+
+QUrl DeviceRegistry::defaultUrl() const
+{
+    QReadLocker locker(&m_lock);
+    return m_names.isEmpty() ? QUrl() : m_drives.value(m_names.first()).url;
+}
+
+QString DeviceRegistry::defaultUdi() const
+{
+    QReadLocker locker(&m_lock);
+    return m_names.isEmpty() ? QString() : m_drives.value(m_names.first()).udi;
+}
+
+#include "moc_device_registry.cpp"
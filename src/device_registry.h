@@ -0,0 +1,81 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <QHash>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+
+/*
+ * The optical drives of the system, keyed by their display name,
+ * e.g. "[DVDRW - HL-DT-ST - DVDRAM GH24NSD1]".
+ *
+ * The list is first filled from sysfs and the udev database, which
+ * costs a few file reads, and then kept current by the Solid hotplug
+ * notifications.  Once the event loop runs, Solid's view replaces the
+ * quick scan.  All lookups are served from the cache under a read lock
+ * and may come from any thread.
+ */
+class DeviceRegistry : public QObject
+{
+	Q_OBJECT
+
+	public:
+		DeviceRegistry();
+
+		static DeviceRegistry *instance();
+
+		QStringList names() const;
+		QUrl url(const QString &name) const;
+		QString udi(const QString &name) const;
+		bool containsUrl(const QUrl &url) const;
+
+		QString defaultName() const;
+		QUrl defaultUrl() const;
+		QString defaultUdi() const;
+
+	private Q_SLOTS:
+		void solidScan();
+		void deviceAdded(const QString &udi);
+		void deviceRemoved(const QString &udi);
+
+	private:
+		struct Drive {
+			QUrl url;
+			QString udi;
+		};
+
+		void quickScan();
+		void insert(const QString &name, const QUrl &url, const QString &udi);
+		void remove(const QString &udi);
+		void rebuildNames();
+
+		mutable QReadWriteLock m_lock;
+		QHash<QString, Drive> m_drives;		// by name
+		QHash<QString, QString> m_udiToName;
+		QSet<QUrl> m_urls;
+		QStringList m_names;			// sorted, the first one is the default
+};
+
+#endif // DEVICE_REGISTRY_H
@@ -0,0 +1,92 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "drive_worker.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+DriveWorker::DriveWorker() :
+    m_thread(nullptr),
+    m_finished(false)
+{
+}
+
+DriveWorker::~DriveWorker()
+{
+    finish();
+}
+
+void DriveWorker::post(std::function<void()> command)
+{
+    QMutexLocker locker(&m_queueLock);
+
+    if (m_finished) {
+        locker.unlock();
+        QMutexLocker drive(&m_driveLock);
+        command();
+        return;
+    }
+
+    if (!m_thread) {
+        m_thread = QThread::create([this]() { loop(); });
+        m_thread->setObjectName(QStringLiteral("kcompactdisc drive"));
+        m_thread->start();
+    }
+
+    m_queue.enqueue(std::move(command));
+    m_wakeup.wakeOne();
+}
+
+void DriveWorker::loop()
+{
+    QMutexLocker locker(&m_queueLock);
+
+    for (;;) {
+        while (m_queue.isEmpty() && !m_finished)
+            m_wakeup.wait(&m_queueLock);
+        if (m_queue.isEmpty())
+            break;
+
+        std::function<void()> command = m_queue.dequeue();
+        locker.unlock();
+        {
+            QMutexLocker drive(&m_driveLock);
+            command();
+        }
+        locker.relock();
+    }
+}
+
+void DriveWorker::finish()
+{
+    QThread *thread;
+
+    {
+        QMutexLocker locker(&m_queueLock);
+        m_finished = true;
+        thread = m_thread;
+        m_thread = nullptr;
+        m_wakeup.wakeOne();
+    }
+
+    if (thread) {
+        thread->wait();
+        delete thread;
+    }
+}
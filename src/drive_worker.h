@@ -0,0 +1,85 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DRIVE_WORKER_H
+#define DRIVE_WORKER_H
+
+#include <QFuture>
+#include <QMutex>
+#include <QPromise>
+#include <QQueue>
+#include <QRecursiveMutex>
+#include <QWaitCondition>
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+class QThread;
+
+/*
+ * A thread per drive for the calls which may block on it for seconds:
+ * eject, close tray, open, play and volume.  Commands run one after the
+ * other in the order they were queued, each with lock() held, so others
+ * touching the drive take the lock too, or try it and come back later.
+ *
+ * The thread is started with the first command.  After finish(), or
+ * from the destructor on, commands run right away on the caller.
+ */
+class DriveWorker
+{
+	public:
+		DriveWorker();
+		~DriveWorker();
+
+		template<typename F, typename T = std::invoke_result_t<F> >
+		QFuture<T> run(F command)
+		{
+			auto promise = std::make_shared<QPromise<T> >();
+			QFuture<T> future = promise->future();
+
+			promise->start();
+			post([promise, command]() mutable {
+				if constexpr (std::is_void_v<T>)
+					command();
+				else
+					promise->addResult(command());
+				promise->finish();
+			});
+
+			return future;
+		}
+
+		// run what is queued and stop the thread
+		void finish();
+
+		QRecursiveMutex *lock() { return &m_driveLock; }
+
+	private:
+		void post(std::function<void()> command);
+		void loop();
+
+		QRecursiveMutex m_driveLock;
+		QMutex m_queueLock;
+		QWaitCondition m_wakeup;
+		QQueue<std::function<void()> > m_queue;
+		QThread *m_thread;
+		bool m_finished;
+};
+
+#endif // DRIVE_WORKER_H
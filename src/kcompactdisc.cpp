@@ -21,105 +21,150 @@
 
 #include "kcompactdisc.h"
 #include "kcompactdisc_p.h"
+#include "device_registry.h"
 
 #include <config-alsa.h>
-
-#include <QDBusInterface>
-#include <QDBusReply>
+#include <config-jack.h>
+#include <config-pipewire.h>
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QPromise>
+#include <QSaveFile>
 #include <QUrl>
 #include <QtGlobal>
 
-#include <Solid/Device>
-#include <Solid/Block>
-#include <Solid/OpticalDrive>
+#include <memory>
+#include <vector>
 
-static QMap<QString, QUrl> cdromsNameToDeviceUrl;
-static QMap<QString, QString> cdromsNameToUdi;
 static QString ___null = QString();
 
-static void refreshListOfCdromDevices()
-{
-    cdromsNameToDeviceUrl.clear();
-    cdromsNameToUdi.clear();
-    QString name, type;
-    QUrl url;
-
-    //get a list of all devices that are Cdrom
-    const auto devices = Solid::Device::listFromType(Solid::DeviceInterface::OpticalDrive);
-    for (const Solid::Device &device : devices) {
-        qDebug() << device.udi().toLatin1().constData();
-        const Solid::Block *b = device.as<Solid::Block>();
-        
-        if(!b) {
-            continue;
-        }
+/*
+ * Answers of the mediamanager, failures are remembered for a shorter time
+ * so a kded which comes up later is asked again.
+ */
+static const int urlCacheTtl = 5 * 60 * 1000;
+static const int urlCacheFailedTtl = 30 * 1000;
+static const int mediamanagerTimeout = 5000;
 
-        const Solid::OpticalDrive *o = device.as<Solid::OpticalDrive>();
-        Solid::OpticalDrive::MediumTypes mediumType = o->supportedMedia();
-
-        url = QUrl::fromUserInput(QLatin1String( b->device().toLatin1() ));
-        //TODO translate them ?
-        if(mediumType < Solid::OpticalDrive::Cdrw) {
-            type = QLatin1String( "CD-ROM" );
-        } else if(mediumType < Solid::OpticalDrive::Dvd) {
-            type = QLatin1String( "CDRW" );
-        } else if(mediumType < Solid::OpticalDrive::Dvdr) {
-            type = QLatin1String( "DVD-ROM" );
-        } else if(mediumType < Solid::OpticalDrive::Bd) {
-            type = QLatin1String( "DVDRW" );
-        } else if(mediumType < Solid::OpticalDrive::HdDvd) {
-            type = QLatin1String( "Blu-ray" );
-        } else {
-            type = QLatin1String( "High Density DVD" );
-        }
+struct ResolvedUrl {
+    QString device;     // empty if the lookup failed
+    QDeadlineTimer expires;
+};
 
-        if(!device.vendor().isEmpty())
-            name = (QLatin1Char('[') + type + QLatin1String( " - " ) + device.vendor() + QLatin1String( " - " ) + device.product() + QLatin1Char( ']' ));
-        else
-            name = (QLatin1Char('[') + type + QLatin1String( " - unknown vendor - " ) + device.product() + QLatin1Char( ']' ));
+static QMutex urlCacheMutex;
+static QHash<QString, ResolvedUrl> urlCache;
+static QHash<QString, QFuture<QString> > urlPending;
 
-        cdromsNameToDeviceUrl.insert(name, url);
-        cdromsNameToUdi.insert(name, device.udi());
-    }
-#if 0
-    if(cdromsNameToDeviceUrl.empty()) {
-        cdromsNameToDeviceUrl.insert(QString("Generic CDROM []"), QUrl::fromPath(wm_drive_default_device()));
-    }
-#endif
+static bool isMediaUrl(const QUrl &deviceUrl)
+{
+    return deviceUrl.scheme() == QLatin1String( "media" ) || deviceUrl.scheme() == QLatin1String( "system" );
 }
 
-static QMap<QString, QUrl> &getListOfCdromDevicesNamesAndUrl()
+// urlCacheMutex must be held
+static bool cachedUrlToDevice(const QUrl &deviceUrl, QString *device)
 {
-    if(cdromsNameToDeviceUrl.empty())
-        refreshListOfCdromDevices();
+    const auto it = urlCache.constFind(deviceUrl.fileName());
+    if (it == urlCache.constEnd() || it->expires.hasExpired())
+        return false;
 
-    return cdromsNameToDeviceUrl;
+    *device = it->device.isEmpty() ? deviceUrl.path() : it->device;
+    return true;
 }
 
-static QMap<QString, QString> &getListOfCdromDevicesNamesAndUdi()
+static void finishUrlLookup(const QUrl &deviceUrl, QDBusPendingCallWatcher *watcher,
+    const std::shared_ptr<QPromise<QString> > &promise)
 {
-    if(cdromsNameToUdi.empty())
-        refreshListOfCdromDevices();
+    QDBusPendingReply<QStringList> reply = *watcher;
+    QString device;
+
+    if(reply.isError() || reply.value().count() < 6) {
+        qCritical() << "Invalid reply from mediamanager";
+    } else {
+        device = reply.value()[5];
+        qDebug() << "Reply from mediamanager " << device;
+    }
 
-    return cdromsNameToUdi;
+    {
+        QMutexLocker locker(&urlCacheMutex);
+        urlCache.insert(deviceUrl.fileName(),
+            ResolvedUrl{device, QDeadlineTimer(device.isEmpty() ? urlCacheFailedTtl : urlCacheTtl)});
+        urlPending.remove(deviceUrl.fileName());
+    }
+
+    promise->addResult(device.isEmpty() ? deviceUrl.path() : device);
+    promise->finish();
+    watcher->deleteLater();
 }
 
-QString KCompactDisc::urlToDevice(const QUrl &deviceUrl)
+QFuture<QString> KCompactDisc::resolveUrlToDevice(const QUrl &deviceUrl)
 {
-    if(deviceUrl.scheme() == QLatin1String( "media" ) || deviceUrl.scheme() == QLatin1String( "system" )) {
-        qDebug() << "Asking mediamanager for " << deviceUrl.fileName();
+    if (!isMediaUrl(deviceUrl))
+        return QtFuture::makeReadyValueFuture(urlToDevice(deviceUrl));
+
+    const QString name = deviceUrl.fileName();
+    QString device;
+
+    QMutexLocker locker(&urlCacheMutex);
+    if (cachedUrlToDevice(deviceUrl, &device))
+        return QtFuture::makeReadyValueFuture(device);
+
+    const auto pending = urlPending.constFind(name);
+    if (pending != urlPending.constEnd())
+        return *pending;
+
+    auto promise = std::make_shared<QPromise<QString> >();
+    const QFuture<QString> future = promise->future();
+    promise->start();
+    urlPending.insert(name, future);
+    locker.unlock();
+
+    qDebug() << "Asking mediamanager for " << name;
+
+    QDBusMessage call = QDBusMessage::createMethodCall(QLatin1String( "org.kde.kded" ),
+        QLatin1String( "/modules/mediamanager" ), QLatin1String( "org.kde.MediaManager" ),
+        QLatin1String( "properties" ));
+    call << name;
+    auto *watcher = new QDBusPendingCallWatcher(
+        QDBusConnection::sessionBus().asyncCall(call, mediamanagerTimeout));
+
+    QCoreApplication *app = QCoreApplication::instance();
+    if (!app) {
+        // nothing would deliver the reply
+        watcher->waitForFinished();
+        finishUrlLookup(deviceUrl, watcher, promise);
+        return future;
+    }
 
-        QDBusInterface mediamanager( QLatin1String( "org.kde.kded" ), QLatin1String( "/modules/mediamanager" ), QLatin1String( "org.kde.MediaManager" ) );
-        QDBusReply<QStringList> reply = mediamanager.call(QLatin1String( "properties" ), deviceUrl.fileName());
+    watcher->moveToThread(app->thread());
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
+        [deviceUrl, promise](QDBusPendingCallWatcher *w) {
+            finishUrlLookup(deviceUrl, w, promise);
+        });
 
-        QStringList properties = reply;
-        if(!reply.isValid() || properties.count() < 6) {
-            qCritical() << "Invalid reply from mediamanager";
-            return deviceUrl.path();
-        } else {
-            qDebug() << "Reply from mediamanager " << properties[5];
-            return properties[5];
+    return future;
+}
+
+QString KCompactDisc::urlToDevice(const QUrl &deviceUrl)
+{
+    if(isMediaUrl(deviceUrl)) {
+        QString device;
+        {
+            QMutexLocker locker(&urlCacheMutex);
+            if (cachedUrlToDevice(deviceUrl, &device))
+                return device;
         }
+
+        // don't wait for kded, the answer is cached for the next call
+        const QFuture<QString> future = resolveUrlToDevice(deviceUrl);
+        return future.isFinished() ? future.result() : deviceUrl.path();
     } else if(deviceUrl.scheme() == QLatin1String( "file" )) {
         return deviceUrl.path();
     } else {
@@ -135,6 +180,12 @@ const QStringList KCompactDisc::audioSystems()
 #if defined(HAVE_ALSA)
         << QLatin1String( "alsa" )
 #endif
+#if defined(HAVE_PIPEWIRE)
+        << QLatin1String( "pipewire" )
+#endif
+#if defined(HAVE_JACK)
+        << QLatin1String( "jack" )
+#endif
 #if defined(sun) || defined(__sun__)
         << QLatin1String( "sun" )
 #endif
@@ -144,81 +195,82 @@ const QStringList KCompactDisc::audioSystems()
 
 const QStringList KCompactDisc::cdromDeviceNames()
 {
-    return getListOfCdromDevicesNamesAndUrl().keys();
+    return DeviceRegistry::instance()->names();
 }
 
 const QString KCompactDisc::defaultCdromDeviceName()
 {
-    const QStringList names = getListOfCdromDevicesNamesAndUrl().keys();
-    if (!names.isEmpty()) return names[0];
-    else return QString();
+    return DeviceRegistry::instance()->defaultName();
 }
 
 const QUrl KCompactDisc::defaultCdromDeviceUrl()
 {
-    const QList<QUrl> urls = getListOfCdromDevicesNamesAndUrl().values();
-    if (!urls.isEmpty()) return urls[0];
-    else return QUrl();
+    return DeviceRegistry::instance()->defaultUrl();
 }
 
 const QUrl KCompactDisc::cdromDeviceUrl(const QString &cdromDeviceName)
 {
-    const QMap<QString, QUrl> &nameUrls = getListOfCdromDevicesNamesAndUrl();
-    QUrl result = nameUrls.value(cdromDeviceName);
+    const QUrl imageUrl = KCompactDiscPrivate::discImageUrl(cdromDeviceName);
+    if (imageUrl.isValid())
+        return imageUrl;
+
+    const DeviceRegistry *registry = DeviceRegistry::instance();
+    QUrl result = registry->url(cdromDeviceName);
     if (!result.isValid())
     {
         const QUrl passedUrl = QUrl::fromLocalFile(cdromDeviceName);
-        for (const QUrl &url : nameUrls) {
-            if (url == passedUrl)
-            {
-                return passedUrl;
-            }
-        }
-        result = KCompactDisc::defaultCdromDeviceUrl();
+        if (registry->containsUrl(passedUrl))
+            return passedUrl;
+        result = registry->defaultUrl();
     }
     return result;
 }
 
 const QString KCompactDisc::defaultCdromDeviceUdi()
 {
-    const QStringList udis = getListOfCdromDevicesNamesAndUdi().values();
-    if (!udis.isEmpty()) return udis[0];
-    else return QString();
+    return DeviceRegistry::instance()->defaultUdi();
 }
 
 const QString KCompactDisc::cdromDeviceUdi(const QString &cdromDeviceName)
 {
-    return getListOfCdromDevicesNamesAndUdi().value(cdromDeviceName, KCompactDisc::defaultCdromDeviceUdi());
+    const QString udi = DeviceRegistry::instance()->udi(cdromDeviceName);
+    return udi.isEmpty() ? KCompactDisc::defaultCdromDeviceUdi() : udi;
 }
 
 KCompactDisc::KCompactDisc(InformationMode infoMode) :
     d_ptr(new KCompactDiscPrivate(this, KCompactDisc::defaultCdromDeviceName()))
 {
     Q_D(KCompactDisc);
+    d->m_stateSlot = KCompactDiscStateSlot::attach(this);
     d->m_infoMode = infoMode;
+    d->publishState();
 }
 
 KCompactDisc::~KCompactDisc()
 {
     stop();
     delete d_ptr;
+    KCompactDiscStateSlot::detach(this);
 }
 
 const QString &KCompactDisc::deviceVendor()
 {
     Q_D(KCompactDisc);
+    d->identifyDevice();
     return d->m_deviceVendor;
 }
 
 const QString &KCompactDisc::deviceModel()
 {
     Q_D(KCompactDisc);
+    d->identifyDevice();
     return d->m_deviceModel;
 }
 
 const QString &KCompactDisc::deviceRevision()
 {
     Q_D(KCompactDisc);
+    d->identifyDevice();
     return d->m_deviceRevision;
 }
 
@@ -237,13 +289,37 @@ const QUrl KCompactDisc::deviceUrl()
 unsigned KCompactDisc::discId()
 {
     Q_D(KCompactDisc);
-    return d->m_discId;
+    return d->m_disc.discId();
 }
 
 const QList<unsigned> &KCompactDisc::discSignature()
 {
     Q_D(KCompactDisc);
-    return d->m_trackStartFrames;
+    return d->m_disc.trackStartFrames();
+}
+
+KCompactDiscInfo KCompactDisc::discInfo()
+{
+    Q_D(KCompactDisc);
+    return d->m_disc;
+}
+
+unsigned KCompactDisc::slotCount()
+{
+    Q_D(KCompactDisc);
+    return d->slotCount();
+}
+
+unsigned KCompactDisc::currentSlot()
+{
+    Q_D(KCompactDisc);
+    return d->currentSlot();
+}
+
+KCompactDiscInfo KCompactDisc::slotInfo(unsigned slot)
+{
+    Q_D(KCompactDisc);
+    return d->slotInfo(slot);
 }
 
 const QString &KCompactDisc::discArtist()
@@ -251,7 +327,7 @@ const QString &KCompactDisc::discArtist()
     Q_D(KCompactDisc);
     if (!d->m_tracks)
         return ___null;
-    return d->m_trackArtists[0];
+    return d->m_disc.artist();
 }
 
 const QString &KCompactDisc::discTitle()
@@ -259,7 +335,7 @@ const QString &KCompactDisc::discTitle()
     Q_D(KCompactDisc);
     if (!d->m_tracks)
         return ___null;
-    return d->m_trackTitles[0];
+    return d->m_disc.title();
 }
 
 unsigned KCompactDisc::discLength()
@@ -296,9 +372,7 @@ QString KCompactDisc::trackArtist()
 QString KCompactDisc::trackArtist(unsigned track)
 {
 	Q_D(KCompactDisc);
-    if (!track)
-        return QString();
-    return d->m_trackArtists[track];
+    return d->m_disc.trackArtist(track);
 }
 
 QString KCompactDisc::trackTitle()
@@ -310,9 +384,7 @@ QString KCompactDisc::trackTitle()
 QString KCompactDisc::trackTitle(unsigned track)
 {
 	Q_D(KCompactDisc);
-    if (!track)
-        return QString();
-    return d->m_trackTitles[track];
+    return d->m_disc.trackTitle(track);
 }
 
 unsigned KCompactDisc::trackLength()
@@ -374,6 +446,16 @@ bool KCompactDisc::isAudio(unsigned track)
 }
 
 void KCompactDisc::playTrack(unsigned track)
+{
+	playTrackAsync(track);
+}
+
+void KCompactDisc::playPosition(unsigned position)
+{
+	playPositionAsync(position);
+}
+
+QFuture<void> KCompactDisc::playTrackAsync(unsigned track)
 {
 	Q_D(KCompactDisc);
 
@@ -381,18 +463,58 @@ void KCompactDisc::playTrack(unsigned track)
     d->m_trackExpectedPosition = 0;
     d->m_seek = abs(int(d->m_trackExpectedPosition - trackPosition()));
 
-	d->playTrackPosition(track, 0);
+	return d->runCommand([d, track]() { d->playTrackPosition(track, 0); });
 }
 
-void KCompactDisc::playPosition(unsigned position)
+QFuture<void> KCompactDisc::playPositionAsync(unsigned position)
 {
 	Q_D(KCompactDisc);
+	const unsigned track = d->m_track;
 
 	d->m_statusExpected = Playing;
     d->m_trackExpectedPosition = position;
     d->m_seek = abs(int(d->m_trackExpectedPosition - trackPosition()));
 
-	d->playTrackPosition(d->m_track, position);
+	return d->runCommand([d, track, position]() { d->playTrackPosition(track, position); });
+}
+
+QFuture<void> KCompactDisc::pauseAsync()
+{
+	Q_D(KCompactDisc);
+
+	if(d->m_status == KCompactDisc::Paused)
+		d->m_statusExpected = KCompactDisc::Playing;
+	else
+		d->m_statusExpected = KCompactDisc::Paused;
+
+	return d->runCommand([d]() { d->pause(); });
+}
+
+QFuture<void> KCompactDisc::stopAsync()
+{
+	Q_D(KCompactDisc);
+
+	d->m_statusExpected = KCompactDisc::Stopped;
+	return d->runCommand([d]() { d->stop(); });
+}
+
+QFuture<void> KCompactDisc::ejectAsync()
+{
+	Q_D(KCompactDisc);
+
+	d->m_statusExpected = KCompactDisc::Ejected;
+	return d->runCommand([d]() {
+		d->stop();
+		d->eject();
+	});
+}
+
+QFuture<void> KCompactDisc::closeTrayAsync()
+{
+	Q_D(KCompactDisc);
+
+	d->m_statusExpected = KCompactDisc::Stopped;
+	return d->runCommand([d]() { d->closetray(); });
 }
 
 void KCompactDisc::play()
@@ -460,30 +582,23 @@ void KCompactDisc::doCommand(KCompactDisc::DiscCommand cmd)
 		break;
 
 	case Pause:
-		if(d->m_status == KCompactDisc::Paused)
-			d->m_statusExpected = KCompactDisc::Playing;
-		else
-			d->m_statusExpected = KCompactDisc::Paused;
-
-		d->pause();
+		pauseAsync();
 		break;
 
 	case Stop:
-		d->m_statusExpected = KCompactDisc::Stopped;
-    	d->stop();
+		stopAsync();
 		break;
 
 	case Eject:
 		if(d->m_status != KCompactDisc::Ejected) {
 			if(d->m_status != KCompactDisc::Stopped) {
 				d->m_statusExpected = KCompactDisc::Ejected;
-				d->stop();
+				d->runCommand([d]() { d->stop(); });
 			} else {
-				d->eject();
+				d->runCommand([d]() { d->eject(); });
 			}
 		} else {
-			d->m_statusExpected = KCompactDisc::Stopped;
-			d->closetray();
+			closeTrayAsync();
 		}
 		break;
 
@@ -503,6 +618,186 @@ void KCompactDisc::metadataLookup()
 	d->queryMetadata();
 }
 
+void KCompactDisc::selectSlot(unsigned slot)
+{
+	selectSlotAsync(slot);
+}
+
+void KCompactDisc::scanSlots()
+{
+	Q_D(KCompactDisc);
+	d->scanSlots();
+}
+
+void KCompactDisc::scanSubchannel()
+{
+	scanSubchannelAsync();
+}
+
+int KCompactDisc::pcmTap()
+{
+	Q_D(KCompactDisc);
+	return d->pcmTap();
+}
+
+void KCompactDisc::setSilenceDetection(int threshold, unsigned minLength)
+{
+	Q_D(KCompactDisc);
+	d->setSilenceDetection(threshold, minLength);
+}
+
+QList<QPair<unsigned, unsigned>> KCompactDisc::silenceRanges(unsigned track)
+{
+	Q_D(KCompactDisc);
+	return d->silenceRanges(track);
+}
+
+/*
+ * The state slots by KCompactDisc, an open addressed table.  Readers
+ * only load the table and walk it, writers take the mutex.  A removed
+ * key leaves a tombstone for the next one, the table is never more than
+ * half full with live keys, so there is always a free cell and a key is
+ * found before an empty one.  A bigger table is published as a whole,
+ * the old ones are kept until exit since a reader may still be in one,
+ * doubling keeps them smaller than the last.
+ */
+namespace
+{
+	struct StateSlotCell
+	{
+		std::atomic<const KCompactDisc *> key { nullptr };
+		std::atomic<KCompactDiscStateSlot *> slot { nullptr };
+	};
+
+	struct StateSlotTable
+	{
+		explicit StateSlotTable(int n) : size(n), cells(new StateSlotCell[n]) { }
+
+		const int size;		// a power of two
+		int used = 0;		// live keys
+		std::unique_ptr<StateSlotCell[]> cells;
+	};
+}
+
+static const char stateSlotGone = 0;
+#define STATE_SLOT_GONE reinterpret_cast<const KCompactDisc *>(&stateSlotGone)
+
+static QMutex stateSlotsMutex;
+static std::atomic<StateSlotTable *> stateSlots { nullptr };
+static std::vector<std::unique_ptr<StateSlotTable> > stateSlotTables;
+
+static int stateSlotHash(const StateSlotTable *t, const KCompactDisc *cd)
+{
+	return int(qHash(cd) & uint(t->size - 1));
+}
+
+// writers only, there is a free cell
+static void stateSlotPut(StateSlotTable *t, const KCompactDisc *cd, KCompactDiscStateSlot *slot)
+{
+	const KCompactDisc *key;
+	int i;
+
+	for(i = stateSlotHash(t, cd); ; i = (i + 1) & (t->size - 1)) {
+		key = t->cells[i].key.load(std::memory_order_relaxed);
+		if(!key || key == STATE_SLOT_GONE)
+			break;
+	}
+	t->cells[i].slot.store(slot, std::memory_order_relaxed);
+	t->cells[i].key.store(cd, std::memory_order_release);
+	t->used++;
+}
+
+KCompactDiscStateSlot *KCompactDiscStateSlot::of(const KCompactDisc *cd)
+{
+	const StateSlotTable *t = stateSlots.load(std::memory_order_acquire);
+	int i, n;
+
+	if(!t)
+		return nullptr;
+
+	for(i = stateSlotHash(t, cd), n = 0; n < t->size; i = (i + 1) & (t->size - 1), n++) {
+		if(t->cells[i].key.load(std::memory_order_acquire) == cd)
+			return t->cells[i].slot.load(std::memory_order_relaxed);
+	}
+	return nullptr;
+}
+
+KCompactDiscStateSlot *KCompactDiscStateSlot::attach(const KCompactDisc *cd)
+{
+	QMutexLocker locker(&stateSlotsMutex);
+	StateSlotTable *t = stateSlots.load(std::memory_order_relaxed);
+	KCompactDiscStateSlot *slot, *old;
+	const KCompactDisc *key;
+	int i, n;
+
+	if(!t || 2 * (t->used + 1) > t->size) {
+		for(n = t ? t->size * 2 : 16; 2 * ((t ? t->used : 0) + 1) > n; n *= 2)
+			;
+		auto grown = std::make_unique<StateSlotTable>(n);
+		for(i = 0; t && i < t->size; i++) {
+			key = t->cells[i].key.load(std::memory_order_relaxed);
+			old = t->cells[i].slot.load(std::memory_order_relaxed);
+			if(key && key != STATE_SLOT_GONE)
+				stateSlotPut(grown.get(), key, old);
+		}
+		t = grown.get();
+		stateSlotTables.push_back(std::move(grown));
+		stateSlots.store(t, std::memory_order_release);
+	}
+
+	slot = new KCompactDiscStateSlot;
+	stateSlotPut(t, cd, slot);
+	return slot;
+}
+
+void KCompactDiscStateSlot::detach(const KCompactDisc *cd)
+{
+	QMutexLocker locker(&stateSlotsMutex);
+	StateSlotTable *t = stateSlots.load(std::memory_order_relaxed);
+	int i, n;
+
+	if(!t)
+		return;
+
+	for(i = stateSlotHash(t, cd), n = 0; n < t->size; i = (i + 1) & (t->size - 1), n++) {
+		if(t->cells[i].key.load(std::memory_order_relaxed) == cd) {
+			delete t->cells[i].slot.load(std::memory_order_relaxed);
+			t->cells[i].key.store(STATE_SLOT_GONE, std::memory_order_release);
+			t->used--;
+			return;
+		}
+	}
+}
+
+KCompactDisc::DiscState KCompactDisc::snapshot() const
+{
+	const KCompactDiscStateSlot *slot = KCompactDiscStateSlot::of(this);
+	const std::shared_ptr<const DiscState> state = slot ? slot->load() : nullptr;
+	return state ? *state : DiscState();
+}
+
+QVariantMap KCompactDisc::statistics()
+{
+	Q_D(KCompactDisc);
+	return d->statistics();
+}
+
+void KCompactDisc::resetStatistics()
+{
+	Q_D(KCompactDisc);
+	d->resetStatistics();
+}
+
+bool KCompactDisc::dumpStatistics(const QString &fileName)
+{
+	QSaveFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	file.write(QJsonDocument::fromVariant(statistics()).toJson());
+	return file.commit();
+}
+
 void KCompactDisc::setRandomPlaylist(bool random)
 {
 	Q_D(KCompactDisc);
@@ -518,6 +813,12 @@ void KCompactDisc::setLoopPlaylist(bool loop)
 	Q_EMIT loopPlaylistChanged(d->m_loopPlaylist);
 }
 
+void KCompactDisc::setAutoSkipSilence(bool skip)
+{
+	Q_D(KCompactDisc);
+	d->m_autoSkipSilence = skip;
+}
+
 void KCompactDisc::setAutoMetadataLookup(bool autoMetadata)
 {
 	Q_D(KCompactDisc);
@@ -542,18 +843,61 @@ bool KCompactDisc::setDevice(const QString &deviceName, unsigned volume,
     }
 }
 
+QFuture<bool> KCompactDisc::setDeviceAsync(const QString &deviceName, unsigned volume,
+    bool digitalPlayback, const QString &audioSystem, const QString &audioDevice)
+{
+	const QString as = digitalPlayback ? audioSystem : QLatin1String("cdin");
+	const QString ad = digitalPlayback ? audioDevice : QString();
+    qDebug() << "Device init: " << deviceName << ", " << as << ", " << ad;
+
+	return d_ptr->moveInterfaceAsync(deviceName, as, ad).then(this, [this, volume](bool ok) {
+		if(ok)
+			setVolume(volume);
+		return ok;
+	});
+}
+
 void KCompactDisc::setVolume(unsigned volume)
+{
+	setVolumeAsync(volume);
+}
+
+void KCompactDisc::setBalance(unsigned balance)
+{
+	setBalanceAsync(balance);
+}
+
+QFuture<void> KCompactDisc::setVolumeAsync(unsigned volume)
 {
 	Q_D(KCompactDisc);
     qDebug() << "change volume: " << volume;
-	d->setVolume(volume);
+	return d->runCommand([d, volume]() { d->setVolume(volume); });
 }
 
-void KCompactDisc::setBalance(unsigned balance)
+QFuture<void> KCompactDisc::setBalanceAsync(unsigned balance)
 {
 	Q_D(KCompactDisc);
     qDebug() << "change balance: " << balance;
-	d->setBalance(balance);
+	return d->runCommand([d, balance]() { d->setBalance(balance); });
+}
+
+QFuture<void> KCompactDisc::selectSlotAsync(unsigned slot)
+{
+	Q_D(KCompactDisc);
+    qDebug() << "select slot: " << slot;
+	return d->selectSlotAsync(slot);
+}
+
+QFuture<void> KCompactDisc::scanSubchannelAsync()
+{
+	Q_D(KCompactDisc);
+	return d->scanSubchannelAsync();
+}
+
+QFuture<QString> KCompactDisc::cueSheetAsync(const QString &fileName)
+{
+	Q_D(KCompactDisc);
+	return d->cueSheetAsync(fileName);
 }
 
 #include "moc_kcompactdisc.cpp"
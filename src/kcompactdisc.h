@@ -23,11 +23,15 @@
 #define KCOMPACTDISC_H
 
 #include <QObject>
+#include <QFuture>
+#include <QPair>
 #include <QStringList>
 #include <QUrl>
 #include <QTimer>
+#include <QVariantMap>
 
 #include "kcompactdisc_export.h"
+#include "kcompactdiscinfo.h"
 
 class KCompactDiscPrivate;
 
@@ -60,6 +64,7 @@ class KCompactDiscPrivate;
  *  The disc lifecycle is modelled by these signals:
  *
  * @see #discChanged(...): A new disc was inserted.
+ * @see discInfoChanged(const KCompactDiscInfo &): The disc or what is known about it changed.
  * @see discStatusString(KCompactDisc::Playing): A disc started playout.
  * @see discStatusString(KCompactDisc::Paused): A disc was paused.
  * @see discStatusString(KCompactDisc::Stopped): The disc stopped.
@@ -68,6 +73,14 @@ class KCompactDiscPrivate;
  * @see discInformation(KCompactDisc::DiscInfo info): A content for disc information is arrived.
  *
  *
+ *  A changer holds more than one disc:
+ *
+ * @see slotCount(): Number of slots, 1 for a drive of one disc.
+ * @see selectSlot(unsigned int slot): Load the disc of another slot.
+ * @see slotInfo(unsigned int slot): What is known about the disc of a slot.
+ * @see slotsChanged(): The scan of the slots found something.
+ *
+ *
  *  The volume control is modelled by these slots:
  *
  * @see setVolume(unsigned int volume): A new volume value.
@@ -86,6 +99,7 @@ class KCompactDiscPrivate;
 class KCOMPACTDISC_EXPORT KCompactDisc : public QObject
 {
     Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.KCompactDisc")
 /*
     Q_CLASSINFO("D-Bus Interface", "org.kde.KSCD")
 
@@ -151,14 +165,34 @@ public:
     {
         Cdtext,
         Cddb,
-        PhononMetadata
+        PhononMetadata,
+        Subchannel
+    };
+
+    /**
+     * What the getters tell about the disc and the playout, all as of
+     * the same status update.  See snapshot().
+     */
+    struct DiscState
+    {
+        DiscStatus status = NoDisc;
+        QString deviceName;
+        KCompactDiscInfo disc;
+        unsigned discLength = 0;        // seconds
+        unsigned discPosition = 0;      // seconds
+        unsigned tracks = 0;
+        unsigned track = 0;             // 0 if none
+        unsigned trackPosition = 0;     // seconds
+        quint64 serial = 0;             // grows with every update
     };
 
     explicit KCompactDisc(InformationMode = KCompactDisc::Synchronous);
     ~KCompactDisc() override;
 
     /**
-     * @param device Name of CD device, e.g. /dev/cdrom.
+     * @param device Name of CD device, e.g. /dev/cdrom. A disc image
+     *        (.cue sheet, raw .bin or .wav file, as path or file:/ URL)
+     *        is played as if it were a drive.
      * @param volume Playback volume.
      * @param digitalPlayback Select digital or analog playback.
      * @param audioSystem For digital playback, system to use, e.g. "phonon".
@@ -172,12 +206,66 @@ public:
         const QString &audioSystem = QString(),
         const QString &audioDevice = QString());
 
+    /**
+     * Like setDevice(), but the drive is opened or switched to by a
+     * thread of its own.  Until the future is finished there may be no
+     * device at all, a later setDevice() wins over this one.
+     */
+    QFuture<bool> setDeviceAsync(
+        const QString &device,
+        unsigned volume = 50,
+        bool digitalPlayback = true,
+        const QString &audioSystem = QString(),
+        const QString &audioDevice = QString());
+
+    /**
+     * The drive commands without waiting for the drive.  They run one
+     * after the other on a thread of the drive and the future finishes
+     * once the drive is done.  The slots give the same commands and
+     * don't wait either.
+     */
+    QFuture<void> playTrackAsync(unsigned int track);
+    QFuture<void> playPositionAsync(unsigned int position);
+    /** Pause or resume. */
+    QFuture<void> pauseAsync();
+    QFuture<void> stopAsync();
+    /** Stop and open the tray. */
+    QFuture<void> ejectAsync();
+    QFuture<void> closeTrayAsync();
+    QFuture<void> setVolumeAsync(unsigned int volume);
+    QFuture<void> setBalanceAsync(unsigned int balance);
+    /** Load the disc of another slot of a changer, see selectSlot(). */
+    QFuture<void> selectSlotAsync(unsigned int slot);
+    /** See scanSubchannel(). */
+    QFuture<void> scanSubchannelAsync();
+
+    /**
+     * CUE sheet of the disc ripped to one file, the audio from 00:02:00
+     * on.  With the index points, pregaps, ISRCs and catalogue number
+     * of the subchannel, which is scanned first if it wasn't yet.
+     *
+     * @param fileName The file the sheet refers to.
+     * @return Empty if the backend or the drive can't tell.
+     */
+    QFuture<QString> cueSheetAsync(const QString &fileName);
+
     /**
      * If the url is a media:/ or system:/ URL returns
      * the device it represents, otherwise returns device
+     *
+     * This never waits for the mediamanager.  If the answer is not
+     * cached yet the lookup is started and the path of the url is
+     * returned, use resolveUrlToDevice() to get the real answer.
      */
     static QString urlToDevice(const QUrl& url);
 
+    /**
+     * Like urlToDevice(), but delivers the answer of the mediamanager
+     * once it is there.  Answers and failures are cached, the future is
+     * already finished for a cached url.
+     */
+    static QFuture<QString> resolveUrlToDevice(const QUrl& url);
+
     /**
      * All installed audio backends.
      */
@@ -256,6 +344,31 @@ public:
      */
     const QList<unsigned> &discSignature();
 
+    /**
+     * Table of contents and texts of the disc in one value, as last
+     * sent with discInfoChanged().  Cheap to copy and keep.
+     */
+    KCompactDiscInfo discInfo();
+
+    /**
+     * Number of slots of a changer, 1 for a drive of one disc.  Slots
+     * count from 0.
+     */
+    unsigned slotCount();
+
+    /**
+     * The slot whose disc is in the drive.
+     */
+    unsigned currentSlot();
+
+    /**
+     * Table of contents and disc id of the disc in a slot, as far as the
+     * scan of the slots got, see scanSlots().  Empty for an empty slot
+     * and one not looked at yet.  For the current slot this is
+     * discInfo().
+     */
+    KCompactDiscInfo slotInfo(unsigned slot);
+
     /**
      * Artist for whole disc.
      *
@@ -380,6 +493,48 @@ public:
      */
     bool isAudio(unsigned track);
 
+    /**
+     * A descriptor of the shared memory ring digital playback copies
+     * its audio to, so visualizers or recorders in other processes can
+     * follow it without reading the disc again.  The ring keeps the
+     * last seconds of audio with their frame numbers and the time they
+     * went to the audio output, the layout is described in
+     * wmlib/include/wm_tap.h.  Map it read only, the caller owns the
+     * descriptor and may pass it on, e.g. as a QDBusUnixFileDescriptor.
+     *
+     * @return -1 unless the audio is played digitally.
+     */
+    int pcmTap();
+
+    /**
+     * Look for digital silence while the audio is played digitally.  A
+     * frame none of whose samples is further from zero than threshold
+     * is silent, 0 asks for true digital silence.  Runs of at least
+     * minLength milliseconds are kept by track, see silenceRanges() and
+     * setAutoSkipSilence().  Takes effect with the next play.
+     *
+     * @param threshold Largest sample value taken as silence, < 0 turns
+     * the detection off.
+     * @param minLength Shortest silence in milliseconds.
+     */
+    void setSilenceDetection(int threshold, unsigned minLength = 2000);
+
+    /**
+     * The silent parts of a track found so far as pairs of first frame
+     * and length in frames, in the order of the disc.  Only what was
+     * played is looked at, a track played through is known as a whole.
+     * A ripper may trim the ones at the start and end of the track.
+     */
+    QList<QPair<unsigned, unsigned>> silenceRanges(unsigned track);
+
+    /**
+     * A consistent copy of the state, as the backend published it with
+     * its last update.  Unlike the getters this may be called from any
+     * thread: it neither waits for the thread the backend runs on nor
+     * touches the drive.
+     */
+    DiscState snapshot() const;
+
 
 public Q_SLOTS:
 
@@ -442,6 +597,59 @@ public Q_SLOTS:
 
 	void metadataLookup();
 
+    /**
+     * Load the disc of another slot of a changer.  Playout stops, the
+     * disc is announced like a new one with discChanged().  A slot seen
+     * before doesn't have its table of contents read again.
+     */
+    void selectSlot(unsigned int slot);
+
+    /**
+     * Look at the other slots of a changer again.  The drive is scanned
+     * when it is opened anyway, one slot at a time while it isn't
+     * playing; slotsChanged() is sent as slots are found.
+     */
+    void scanSlots();
+
+    /**
+     * Read index points, pregaps, ISRCs and the media catalogue number
+     * from the subchannel of the disc.  That takes a few seconds, a
+     * small part of what reading the disc would, and is done once per
+     * disc.  They arrive in discInfo() with
+     * discInformation(KCompactDisc::Subchannel).
+     */
+    void scanSubchannel();
+
+    /**
+     * Performance counters of the drive backend: reads and bytes read,
+     * SCSI commands by opcode, ioctls, reader and sink events and
+     * latency histograms in microseconds, and while the drive is open
+     * for digital playback the read speed the drive was set to
+     * ("read_speed", multiples of 1x) and its read rate ("refill_kbps"),
+     * and with KCOMPACTDISC_CDDA_CACHE set the audio held in the cache
+     * ("cache_bytes") and its budget ("cache_budget").
+     * Empty if the backend keeps none.
+     *
+     * statistics() and resetStatistics() are scriptable, an application
+     * can publish them with QDBusConnection::registerObject() and
+     * QDBusConnection::ExportScriptableSlots.
+     */
+    Q_SCRIPTABLE QVariantMap statistics();
+
+    /**
+     * Restart the performance counters.
+     */
+    Q_SCRIPTABLE void resetStatistics();
+
+    /**
+     * Write statistics() as JSON to a file for offline analysis.  Not
+     * scriptable, a bus client could have it overwrite any file the
+     * application can write.
+     *
+     * @return false if the file could not be written.
+     */
+    bool dumpStatistics(const QString &fileName);
+
 
 Q_SIGNALS:
     /**
@@ -468,6 +676,12 @@ public Q_SLOTS:
     void setRandomPlaylist(bool);
     void setLoopPlaylist(bool);
 	void setAutoMetadataLookup(bool);
+    /**
+     * Go on with the next track of the playlist once playback reaches
+     * silence found by setSilenceDetection(), unless the silence is
+     * where its track starts.
+     */
+    void setAutoSkipSilence(bool);
 
 
 Q_SIGNALS:
@@ -490,12 +704,25 @@ Q_SIGNALS:
      */
     void discInformation(KCompactDisc::DiscInfo info);
 
+    /**
+     * Sent with discChanged() and discInformation(), with the disc as
+     * it is known now.  The value is shared, not copied, with every
+     * receiver.
+     */
+    void discInfoChanged(const KCompactDiscInfo &info);
+
     /**
      * A Disc status changed
      *
      */
     void discStatusChanged(KCompactDisc::DiscStatus status);
 
+    /**
+     * The slots of a changer were scanned or another one was loaded,
+     * see slotInfo().
+     */
+    void slotsChanged();
+
 
 public Q_SLOTS:
 
@@ -24,8 +24,20 @@
 #include "phonon_interface.h"
 
 
+#include <config-alsa.h>
+
+#include <QFile>
+#include <QPointer>
+
 #include <KLocalizedString>
 
+#ifdef USE_WMLIB
+extern "C"
+{
+	#include "wmlib/include/wm_image.h"
+}
+#endif
+
 Q_LOGGING_CATEGORY(CD_PLAYLIST, "cd.playlist")
 
 KCompactDiscPrivate::KCompactDiscPrivate(KCompactDisc *p, const QString& dev) :
@@ -34,7 +46,6 @@ KCompactDiscPrivate::KCompactDiscPrivate(KCompactDisc *p, const QString& dev) :
 
     m_status(KCompactDisc::NoDisc),
     m_statusExpected(KCompactDisc::NoDisc),
-    m_discId(0),
     m_discLength(0),
     m_track(0),
     m_tracks(0),
@@ -47,17 +58,16 @@ KCompactDiscPrivate::KCompactDiscPrivate(KCompactDisc *p, const QString& dev) :
     m_loopPlaylist(false),
     m_randomPlaylist(false),
     m_autoMetadata(true),
+    m_autoSkipSilence(false),
 
     m_deviceVendor(QString()),
     m_deviceModel(QString()),
     m_deviceRevision(QString()),
+    m_stateSlot(nullptr),
 
     q_ptr(p)
 {
     m_interface = QLatin1String("dummy");
-    m_trackStartFrames.clear();
-    m_trackArtists.clear();
-    m_trackTitles.clear();
     m_playlist.clear();
 }
 
@@ -66,32 +76,23 @@ bool KCompactDiscPrivate::moveInterface(const QString &deviceName,
 {
 	Q_Q(KCompactDisc);
 
-	KCompactDiscPrivate *pOld, *pNew;
+	KCompactDiscPrivate *pDummy, *pNew;
 
-    qDebug() << "switch from " << q->d_ptr->m_interface << " on " << q->d_ptr->m_deviceName;
+    qDebug() << "switch from " << m_interface << " on " << m_deviceName;
     qDebug() << "         to " << audioSystem << " on " << deviceName;
 
-	/* switch temporary to dummy implementation */
-	if(q->d_ptr != this) {
-		pOld = q->d_ptr;
-		q->d_ptr = this;
-		delete pOld;
-	}
-
-#ifdef USE_WMLIB
-	if(audioSystem == QLatin1String("phonon"))
-#endif
-		pNew = new KPhononCompactDiscPrivate(q, deviceName);
-#ifdef USE_WMLIB
-	else
-		pNew = new KWMLibCompactDiscPrivate(q, deviceName,
-			audioSystem, audioDevice);
-#endif
+	/* same backend, only another drive */
+	if(switchDevice(deviceName, audioSystem, audioDevice))
+		return true;
 
-	pNew->m_infoMode = m_infoMode;
+	pDummy = releaseInterface(deviceName);
+	pNew = newInterface(q, deviceName, audioSystem, audioDevice);
+	pNew->m_infoMode = pDummy->m_infoMode;
+	pNew->m_stateSlot = pDummy->m_stateSlot;
 
 	if(pNew->createInterface()) {
 		q->d_ptr = pNew;
+		delete pDummy;
 		return true;
 	} else {
 		delete pNew;
@@ -99,11 +100,131 @@ bool KCompactDiscPrivate::moveInterface(const QString &deviceName,
     }
 }
 
+/*
+ * Like moveInterface(), but the drive is switched or opened by the
+ * backend's thread.  Another move in the meantime wins, the backend
+ * this one was opening is dropped then.
+ */
+QFuture<bool> KCompactDiscPrivate::moveInterfaceAsync(const QString &deviceName,
+	const QString &audioSystem, const QString &audioDevice)
+{
+	Q_Q(KCompactDisc);
+
+	QPointer<KCompactDiscPrivate> self(this);
+
+    qDebug() << "switch from " << m_interface << " on " << m_deviceName;
+    qDebug() << "         to " << audioSystem << " on " << deviceName;
+
+	return switchDeviceAsync(deviceName, audioSystem, audioDevice).then(q,
+		[q, self, deviceName, audioSystem, audioDevice](bool switched) {
+		if(switched)
+			return QtFuture::makeReadyValueFuture(true);
+		if(!self || q->d_ptr != self)
+			return QtFuture::makeReadyValueFuture(false);
+
+		QPointer<KCompactDiscPrivate> pDummy = self->releaseInterface(deviceName);
+		QPointer<KCompactDiscPrivate> pNew = newInterface(q, deviceName, audioSystem, audioDevice);
+		pNew->m_infoMode = pDummy->m_infoMode;
+		pNew->m_stateSlot = pDummy->m_stateSlot;
+
+		return pNew->createInterfaceAsync().then(q, [q, pDummy, pNew](bool ok) {
+			if(ok && pNew && pDummy && q->d_ptr == pDummy) {
+				q->d_ptr = pNew;
+				delete pDummy.data();
+				return true;
+			}
+			delete pNew.data();
+			return false;
+		});
+	}).unwrap();
+}
+
+KCompactDiscPrivate *KCompactDiscPrivate::newInterface(KCompactDisc *q, const QString &deviceName,
+	const QString &audioSystem, const QString &audioDevice)
+{
+#ifdef USE_WMLIB
+	/* phonon can't read disc images, libworkman plays them itself */
+	const bool image = discImageUrl(deviceName).isValid();
+
+	if(audioSystem == QLatin1String("phonon") && !image)
+#endif
+		return new KPhononCompactDiscPrivate(q, deviceName);
+#ifdef USE_WMLIB
+	else if(audioSystem == QLatin1String("phonon"))
+		return new KWMLibCompactDiscPrivate(q, deviceName,
+#if defined(HAVE_ALSA)
+			QLatin1String("alsa"), QString());
+#else
+			QLatin1String("cdin"), QString());
+#endif
+	else
+		return new KWMLibCompactDiscPrivate(q, deviceName,
+			audioSystem, audioDevice);
+#endif
+}
+
+/*
+ * This is q->d_ptr, switch temporary to dummy implementation and let
+ * the old backend release the drive before a new one opens it.  Returns
+ * the dummy, nothing of this may be touched afterwards.
+ */
+KCompactDiscPrivate *KCompactDiscPrivate::releaseInterface(const QString &deviceName)
+{
+	Q_Q(KCompactDisc);
+
+	KCompactDiscPrivate *pDummy = new KCompactDiscPrivate(q, deviceName);
+	pDummy->m_infoMode = m_infoMode;
+	pDummy->m_stateSlot = m_stateSlot;
+	q->d_ptr = pDummy;
+	delete this;
+
+	return pDummy;
+}
+
 bool KCompactDiscPrivate::createInterface()
 {
 	return true;
 }
 
+QFuture<bool> KCompactDiscPrivate::createInterfaceAsync()
+{
+	return QtFuture::makeReadyValueFuture(createInterface());
+}
+
+bool KCompactDiscPrivate::switchDevice(const QString &, const QString &, const QString &)
+{
+	return false;
+}
+
+QFuture<bool> KCompactDiscPrivate::switchDeviceAsync(const QString &, const QString &, const QString &)
+{
+	return QtFuture::makeReadyValueFuture(false);
+}
+
+QFuture<void> KCompactDiscPrivate::runCommand(std::function<void()> command)
+{
+	command();
+	return QtFuture::makeReadyVoidFuture();
+}
+
+QUrl KCompactDiscPrivate::discImageUrl(const QString &deviceName)
+{
+#ifdef USE_WMLIB
+	/*
+	 * a .cue sheet, .bin or .wav file, given as path or file:/ URL, as
+	 * libworkman tells them, any other file isn't taken for an image
+	 */
+	const QUrl url = QUrl::fromUserInput(deviceName, QString(), QUrl::AssumeLocalFile);
+	if(url.isLocalFile() && wm_image_probe(QFile::encodeName(url.toLocalFile()).constData()))
+		return url;
+#else
+	// only libworkman plays images
+	Q_UNUSED(deviceName);
+#endif
+
+	return QUrl();
+}
+
 void KCompactDiscPrivate::make_playlist()
 {
 	/* koz: 15/01/00. I want a random list that does not repeat tracks. Ie, */
@@ -201,11 +322,11 @@ bool KCompactDiscPrivate::skipStatusChange(KCompactDisc::DiscStatus status)
 	if(m_status != status) {
 		if(status == KCompactDisc::Stopped) {
 			if(m_statusExpected == KCompactDisc::Ejected) {
-				eject();
+				runCommand([this]() { eject(); });
 			} else if(m_statusExpected != KCompactDisc::Stopped) {
 				unsigned track = getNextTrackInPlaylist();
 				if(track) {
-					playTrackPosition(track, 0);
+					runCommand([this, track]() { playTrackPosition(track, 0); });
 					return true;
 				}
 			}
@@ -242,15 +363,43 @@ void KCompactDiscPrivate::clearDiscInfo()
 {
 	Q_Q(KCompactDisc);
 
-	m_discId = 0;
 	m_discLength = 0;
 	m_seek = 0;
 	m_track = 0;
 	m_tracks = 0;
-	m_trackArtists.clear();
-	m_trackTitles.clear();
-	m_trackStartFrames.clear();
+	m_disc = KCompactDiscInfo();
+	publishState();
 	Q_EMIT q->discChanged(m_tracks);
+	Q_EMIT q->discInfoChanged(m_disc);
+}
+
+void KCompactDiscPrivate::setDiscInfo(const KCompactDiscInfo &disc, KCompactDisc::DiscInfo source)
+{
+	Q_Q(KCompactDisc);
+
+	m_disc = disc;
+	publishState();
+	Q_EMIT q->discInformation(source);
+	Q_EMIT q->discInfoChanged(m_disc);
+}
+
+/*
+ * Called wherever the backend changed the state, before it tells so,
+ * by the thread the backend updates it on.
+ */
+void KCompactDiscPrivate::publishState()
+{
+	auto state = std::make_shared<KCompactDisc::DiscState>();
+	state->status = m_status;
+	state->deviceName = m_deviceName;
+	state->disc = m_disc;
+	state->discLength = m_discLength;
+	state->discPosition = m_discPosition;
+	state->tracks = m_tracks;
+	state->track = m_track;
+	state->trackPosition = m_trackPosition;
+	state->serial = m_stateSlot->nextSerial();
+	m_stateSlot->store(std::move(state));
 }
 
 unsigned KCompactDiscPrivate::trackLength(unsigned)
@@ -305,4 +454,65 @@ void KCompactDiscPrivate::queryMetadata()
 {
 }
 
+unsigned KCompactDiscPrivate::slotCount()
+{
+	return 1;
+}
+
+unsigned KCompactDiscPrivate::currentSlot()
+{
+	return 0;
+}
+
+KCompactDiscInfo KCompactDiscPrivate::slotInfo(unsigned slot)
+{
+	return slot ? KCompactDiscInfo() : m_disc;
+}
+
+QFuture<void> KCompactDiscPrivate::selectSlotAsync(unsigned)
+{
+	return QtFuture::makeReadyVoidFuture();
+}
+
+void KCompactDiscPrivate::scanSlots()
+{
+}
+
+QFuture<void> KCompactDiscPrivate::scanSubchannelAsync()
+{
+	return QtFuture::makeReadyVoidFuture();
+}
+
+QFuture<QString> KCompactDiscPrivate::cueSheetAsync(const QString &)
+{
+	return QtFuture::makeReadyValueFuture(QString());
+}
+
+int KCompactDiscPrivate::pcmTap()
+{
+	return -1;
+}
+
+void KCompactDiscPrivate::setSilenceDetection(int, unsigned)
+{
+}
+
+QList<QPair<unsigned, unsigned>> KCompactDiscPrivate::silenceRanges(unsigned)
+{
+	return QList<QPair<unsigned, unsigned>>();
+}
+
+QVariantMap KCompactDiscPrivate::statistics()
+{
+	return QVariantMap();
+}
+
+void KCompactDiscPrivate::resetStatistics()
+{
+}
+
+void KCompactDiscPrivate::identifyDevice()
+{
+}
+
 #include "moc_kcompactdisc_p.cpp"
@@ -21,16 +21,25 @@
 #ifndef KCOMPACTDISC_P_H
 #define KCOMPACTDISC_P_H
 
+#include <QFuture>
 #include <QString>
 #include <QList>
+#include <QUrl>
+#include <QVariantMap>
 #include <QLoggingCategory>
 #include <QtGlobal>
 #include <QRandomGenerator>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+
 #include "kcompactdisc.h"
 
 Q_DECLARE_LOGGING_CATEGORY(CD_PLAYLIST)
 
+class KCompactDiscStateSlot;
+
 class KCompactDiscPrivate : public QObject
 {
 	Q_OBJECT
@@ -40,7 +49,15 @@ class KCompactDiscPrivate : public QObject
         ~KCompactDiscPrivate() override { }
 	
 		bool moveInterface(const QString &, const QString &, const QString &);
+		QFuture<bool> moveInterfaceAsync(const QString &, const QString &, const QString &);
+		// go to another drive keeping the backend, false if it can't
+		virtual bool switchDevice(const QString &, const QString &, const QString &);
+		virtual QFuture<bool> switchDeviceAsync(const QString &, const QString &, const QString &);
 		virtual bool createInterface();
+		virtual QFuture<bool> createInterfaceAsync();
+
+		// run a command touching the drive, on the drive's thread if the backend has one
+		virtual QFuture<void> runCommand(std::function<void()>);
 
 		QString m_interface;
 		KCompactDisc::InformationMode m_infoMode;
@@ -48,7 +65,6 @@ class KCompactDiscPrivate : public QObject
 	
 		KCompactDisc::DiscStatus m_status;
 		KCompactDisc::DiscStatus m_statusExpected;
-		unsigned m_discId;
 		unsigned m_discLength;
 		unsigned m_track;
 		unsigned m_tracks;
@@ -57,23 +73,25 @@ class KCompactDiscPrivate : public QObject
 		unsigned m_trackExpectedPosition;
 		int m_seek;
 	
-		QList<unsigned> m_trackStartFrames;
-		QStringList m_trackArtists;
-		QStringList m_trackTitles;
+		KCompactDiscInfo m_disc;
 	
 		QRandomGenerator m_randSequence;
 		QList<unsigned> m_playlist;
 		bool m_loopPlaylist;
 		bool m_randomPlaylist;
 		bool m_autoMetadata;
+		bool m_autoSkipSilence;
 	
 		void make_playlist();
 		unsigned getNextTrackInPlaylist();
 		unsigned getPrevTrackInPlaylist();
 		bool skipStatusChange(KCompactDisc::DiscStatus);
 		static const QString discStatusI18n(KCompactDisc::DiscStatus);
+		static QUrl discImageUrl(const QString &);
 
 		void clearDiscInfo();
+		// take the disc's new texts and tell so
+		void setDiscInfo(const KCompactDiscInfo &, KCompactDisc::DiscInfo);
 
 		virtual unsigned trackLength(unsigned);
 		virtual bool isTrackAudio(unsigned);
@@ -89,17 +107,99 @@ class KCompactDiscPrivate : public QObject
 		virtual unsigned balance();
 
 		virtual void queryMetadata();
+
+		// a drive of one disc has the one slot 0
+		virtual unsigned slotCount();
+		virtual unsigned currentSlot();
+		virtual KCompactDiscInfo slotInfo(unsigned);
+		virtual QFuture<void> selectSlotAsync(unsigned);
+		virtual void scanSlots();
+
+		virtual QFuture<void> scanSubchannelAsync();
+		virtual QFuture<QString> cueSheetAsync(const QString &);
+
+		virtual int pcmTap();
+		// digital playback only
+		virtual void setSilenceDetection(int, unsigned);
+		virtual QList<QPair<unsigned, unsigned>> silenceRanges(unsigned);
+		virtual QVariantMap statistics();
+		virtual void resetStatistics();
+
+		// make the current state what snapshot() returns
+		void publishState();
+		// of the KCompactDisc, handed on to the next backend
+		KCompactDiscStateSlot *m_stateSlot;
+
+		// fill m_deviceVendor & co. when first asked for
+		virtual void identifyDevice();
 	
 		QString m_deviceVendor;
 		QString m_deviceModel;
 		QString m_deviceRevision;
 
+	private:
+		static KCompactDiscPrivate *newInterface(KCompactDisc *, const QString &,
+			const QString &, const QString &);
+		KCompactDiscPrivate *releaseInterface(const QString &);
+
 	public:
 		Q_DECLARE_PUBLIC(KCompactDisc)
 		KCompactDisc * const q_ptr;
 };
 
 
+/*
+ * The state snapshot() returns.  It belongs to the KCompactDisc, not to
+ * the backend, so a reader never follows d_ptr.  A published state is
+ * never changed, the backend swaps in a new one.  Readers share no lock
+ * with the backend or other slots, though the standard library may
+ * guard an atomic shared_ptr with a short spinlock of its own.
+ */
+class KCompactDiscStateSlot
+{
+	public:
+		std::shared_ptr<const KCompactDisc::DiscState> load() const
+		{
+#ifdef __cpp_lib_atomic_shared_ptr
+			return m_state.load(std::memory_order_acquire);
+#else
+			return std::atomic_load_explicit(&m_state, std::memory_order_acquire);
+#endif
+		}
+
+		void store(std::shared_ptr<const KCompactDisc::DiscState> state)
+		{
+#ifdef __cpp_lib_atomic_shared_ptr
+			m_state.store(std::move(state), std::memory_order_release);
+#else
+			std::atomic_store_explicit(&m_state, std::move(state), std::memory_order_release);
+#endif
+		}
+
+		quint64 nextSerial()
+		{
+			return ++m_serial;
+		}
+
+		/*
+		 * The slot of cd.  It's kept aside by the KCompactDisc pointer,
+		 * a member would change the size of the exported class.  of()
+		 * only loads, attach() and detach() publish a new table when
+		 * it has to grow.
+		 */
+		static KCompactDiscStateSlot *of(const KCompactDisc *cd);
+		static KCompactDiscStateSlot *attach(const KCompactDisc *cd);
+		static void detach(const KCompactDisc *cd);
+
+	private:
+#ifdef __cpp_lib_atomic_shared_ptr
+		std::atomic<std::shared_ptr<const KCompactDisc::DiscState> > m_state;
+#else
+		std::shared_ptr<const KCompactDisc::DiscState> m_state;
+#endif
+		std::atomic<quint64> m_serial { 0 };
+};
+
 #define SEC2FRAMES(sec) ((sec) * 75)
 #define FRAMES2SEC(frames) ((frames) / 75)
 #define MS2SEC(ms) ((ms) / 1000)
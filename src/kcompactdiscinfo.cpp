@@ -0,0 +1,282 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "kcompactdiscinfo.h"
+
+#include <QSharedData>
+
+#include <KLocalizedString>
+
+/*
+ * One array per field rather than one struct per track.  The texts of
+ * all tracks are kept back to back in one string, artist and title of
+ * track n are pool[offsets[2n - 2], offsets[2n - 1]) and
+ * pool[offsets[2n - 1], offsets[2n]).  An empty text is shown as the
+ * default, so a disc without texts has an empty pool and no offsets.
+ */
+class KCompactDiscInfoData : public QSharedData
+{
+public:
+    unsigned tracks = 0;
+    unsigned discId = 0;
+    QList<unsigned> frames;     // tracks + 1 with the lead-out, or none
+    QList<quint8> flags;        // by track, the first is track 1's
+    QString artist;             // the disc's, never empty for a disc
+    QString title;
+    QString pool;
+    QList<quint32> offsets;
+    // from the subchannel, by track or none
+    QString mcn;
+    QStringList isrcs;
+    QList<unsigned> pregaps;
+    QList<QList<unsigned>> indexes;
+
+    QStringView text(unsigned track, unsigned which) const
+    {
+        const qsizetype i = 2 * (track - 1) + which;
+
+        if (offsets.isEmpty())
+            return QStringView();
+        return QStringView(pool).mid(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    void setTexts(const QStringList &artists, const QStringList &titles);
+};
+
+void KCompactDiscInfoData::setTexts(const QStringList &artists, const QStringList &titles)
+{
+    QString newPool;
+    QList<quint32> newOffsets;
+    bool any = false;
+
+    artist = artists.value(0);
+    if (artist.isEmpty())
+        artist = i18n("Unknown Artist");
+    title = titles.value(0);
+    if (title.isEmpty())
+        title = i18n("Unknown Title");
+
+    newOffsets.reserve(2 * tracks + 1);
+    newOffsets.append(0);
+    for (unsigned i = 1; i <= tracks; ++i) {
+        const QString a = artists.value(i);
+        const QString t = titles.value(i);
+
+        newPool += a;
+        newOffsets.append(newPool.size());
+        newPool += t;
+        newOffsets.append(newPool.size());
+        any = any || !a.isEmpty() || !t.isEmpty();
+    }
+
+    if (any) {
+        newPool.squeeze();
+        pool = newPool;
+        offsets = newOffsets;
+    } else {
+        pool.clear();
+        offsets.clear();
+    }
+}
+
+static const QSharedDataPointer<KCompactDiscInfoData> &noDisc()
+{
+    static const QSharedDataPointer<KCompactDiscInfoData> data(new KCompactDiscInfoData);
+    return data;
+}
+
+KCompactDiscInfo::KCompactDiscInfo() :
+    d(noDisc())
+{
+}
+
+KCompactDiscInfo::KCompactDiscInfo(unsigned tracks, unsigned discId,
+                                   const QList<unsigned> &trackStartFrames,
+                                   const QList<TrackFlags> &trackFlags) :
+    d(new KCompactDiscInfoData)
+{
+    d->tracks = tracks;
+    d->discId = discId;
+    if ((unsigned)trackStartFrames.size() == tracks + 1)
+        d->frames = trackStartFrames;
+
+    d->flags.reserve(tracks);
+    for (unsigned i = 0; i < tracks; ++i)
+        d->flags.append(i < (unsigned)trackFlags.size() ? quint8(trackFlags[i].toInt()) : 0);
+
+    d->setTexts(QStringList(), QStringList());
+}
+
+KCompactDiscInfo::KCompactDiscInfo(const KCompactDiscInfo &) = default;
+KCompactDiscInfo::KCompactDiscInfo(KCompactDiscInfo &&) noexcept = default;
+KCompactDiscInfo &KCompactDiscInfo::operator=(const KCompactDiscInfo &) = default;
+KCompactDiscInfo &KCompactDiscInfo::operator=(KCompactDiscInfo &&) noexcept = default;
+KCompactDiscInfo::~KCompactDiscInfo() = default;
+
+bool KCompactDiscInfo::isEmpty() const
+{
+    return !d->tracks;
+}
+
+unsigned KCompactDiscInfo::tracks() const
+{
+    return d->tracks;
+}
+
+unsigned KCompactDiscInfo::discId() const
+{
+    return d->discId;
+}
+
+const QList<unsigned> &KCompactDiscInfo::trackStartFrames() const
+{
+    return d->frames;
+}
+
+unsigned KCompactDiscInfo::length() const
+{
+    if (d->frames.isEmpty())
+        return 0;
+    return d->frames.last() - d->frames.first();
+}
+
+unsigned KCompactDiscInfo::trackLength(unsigned track) const
+{
+    if (d->frames.isEmpty() || !track || track > d->tracks)
+        return 0;
+    return d->frames[track] - d->frames[track - 1];
+}
+
+KCompactDiscInfo::TrackFlags KCompactDiscInfo::trackFlags(unsigned track) const
+{
+    if (!track || track > d->tracks)
+        return TrackFlags();
+    return TrackFlags::fromInt(d->flags[track - 1]);
+}
+
+const QString &KCompactDiscInfo::artist() const
+{
+    return d->artist;
+}
+
+const QString &KCompactDiscInfo::title() const
+{
+    return d->title;
+}
+
+QString KCompactDiscInfo::trackArtist(unsigned track) const
+{
+    if (!track || track > d->tracks)
+        return QString();
+
+    const QStringView text = d->text(track, 0);
+    return text.isEmpty() ? i18n("Unknown Artist") : text.toString();
+}
+
+QString KCompactDiscInfo::trackTitle(unsigned track) const
+{
+    if (!track || track > d->tracks)
+        return QString();
+
+    const QStringView text = d->text(track, 1);
+    return text.isEmpty() ? ki18n("Track %1").subs(track, 2).toString() : text.toString();
+}
+
+KCompactDiscInfo KCompactDiscInfo::withTexts(const QStringList &artists, const QStringList &titles) const
+{
+    KCompactDiscInfo info(*this);
+
+    if (isEmpty())
+        return info;
+    info.d->setTexts(artists, titles);
+    return info;
+}
+
+KCompactDiscInfo KCompactDiscInfo::withText(unsigned track, const QString &artist, const QString &title) const
+{
+    QStringList artists, titles;
+
+    if (isEmpty() || track > d->tracks)
+        return *this;
+
+    artists.reserve(d->tracks + 1);
+    titles.reserve(d->tracks + 1);
+    artists.append(d->artist);
+    titles.append(d->title);
+    for (unsigned i = 1; i <= d->tracks; ++i) {
+        artists.append(d->text(i, 0).toString());
+        titles.append(d->text(i, 1).toString());
+    }
+    artists[track] = artist;
+    titles[track] = title;
+
+    return withTexts(artists, titles);
+}
+
+QString KCompactDiscInfo::mediaCatalogNumber() const
+{
+    return d->mcn;
+}
+
+QString KCompactDiscInfo::trackIsrc(unsigned track) const
+{
+    if (!track || track > d->tracks)
+        return QString();
+    return d->isrcs.value(track - 1);
+}
+
+unsigned KCompactDiscInfo::trackPregap(unsigned track) const
+{
+    if (!track || track > d->tracks)
+        return 0;
+    return d->pregaps.value(track - 1);
+}
+
+QList<unsigned> KCompactDiscInfo::trackIndexes(unsigned track) const
+{
+    if (!track || track > d->tracks)
+        return QList<unsigned>();
+    if ((unsigned)d->indexes.size() == d->tracks)
+        return d->indexes[track - 1];
+    if (d->frames.isEmpty())
+        return QList<unsigned>();
+    return QList<unsigned>{ d->frames[track - 1] };
+}
+
+KCompactDiscInfo KCompactDiscInfo::withSubchannel(const QString &mediaCatalogNumber,
+                                                  const QStringList &isrcs,
+                                                  const QList<unsigned> &pregaps,
+                                                  const QList<QList<unsigned>> &indexes) const
+{
+    KCompactDiscInfo info(*this);
+
+    if (isEmpty())
+        return info;
+
+    info.d->mcn = mediaCatalogNumber;
+    info.d->isrcs = isrcs;
+    info.d->pregaps = pregaps;
+    info.d->indexes = (unsigned)indexes.size() == d->tracks ? indexes : QList<QList<unsigned>>();
+    return info;
+}
+
+bool KCompactDiscInfo::isSameDisc(const KCompactDiscInfo &other) const
+{
+    return d == other.d || (d->tracks == other.d->tracks && d->discId == other.d->discId &&
+                            d->frames == other.d->frames && d->flags == other.d->flags);
+}
@@ -0,0 +1,188 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KCOMPACTDISCINFO_H
+#define KCOMPACTDISCINFO_H
+
+#include <QFlags>
+#include <QList>
+#include <QMetaType>
+#include <QSharedDataPointer>
+#include <QString>
+#include <QStringList>
+
+#include "kcompactdisc_export.h"
+
+class KCompactDiscInfoData;
+
+/**
+ * What is known about a disc: its table of contents and the texts
+ * found for it.
+ *
+ * A disc is read once when it is inserted.  The value is implicitly
+ * shared and never changed afterwards, copying it around, keeping it in
+ * a cache or sending it with a queued signal costs a reference count.
+ * When CD-TEXT or other metadata arrives, a new value is made with
+ * withTexts() or withText().
+ *
+ * Track numbers start at 1, the texts of track 0 are the disc's.
+ */
+class KCOMPACTDISC_EXPORT KCompactDiscInfo
+{
+public:
+    enum TrackFlag
+    {
+        DataTrack = 0x1,
+        PreEmphasis = 0x2
+    };
+    Q_DECLARE_FLAGS(TrackFlags, TrackFlag)
+
+    /**
+     * No disc.
+     */
+    KCompactDiscInfo();
+
+    /**
+     * A disc without texts.
+     *
+     * @param tracks Number of tracks.
+     * @param discId CDDB id, 0 if unknown.
+     * @param trackStartFrames Start of each track and then of the
+     *        lead-out, empty if the drive doesn't tell.
+     * @param trackFlags Flags by track, the first for track 1.
+     */
+    explicit KCompactDiscInfo(unsigned tracks, unsigned discId = 0,
+                              const QList<unsigned> &trackStartFrames = QList<unsigned>(),
+                              const QList<TrackFlags> &trackFlags = QList<TrackFlags>());
+
+    KCompactDiscInfo(const KCompactDiscInfo &);
+    KCompactDiscInfo(KCompactDiscInfo &&) noexcept;
+    KCompactDiscInfo &operator=(const KCompactDiscInfo &);
+    KCompactDiscInfo &operator=(KCompactDiscInfo &&) noexcept;
+    ~KCompactDiscInfo();
+
+    bool isEmpty() const;
+
+    unsigned tracks() const;
+
+    /**
+     * CDDB id, 0 if unknown.
+     */
+    unsigned discId() const;
+
+    /**
+     * Start frames of the tracks and of the lead-out, as
+     * KCompactDisc::discSignature().
+     */
+    const QList<unsigned> &trackStartFrames() const;
+
+    /**
+     * @return Length in frames, 0 if the table of contents is unknown.
+     */
+    unsigned length() const;
+    unsigned trackLength(unsigned track) const;
+
+    TrackFlags trackFlags(unsigned track) const;
+
+    /**
+     * @return Disc artist, "Unknown Artist" if there is none.
+     */
+    const QString &artist() const;
+
+    /**
+     * @return Disc title, "Unknown Title" if there is none.
+     */
+    const QString &title() const;
+
+    /**
+     * @return Artist of the track, "Unknown Artist" if there is none,
+     *         a null string if there is no such track.
+     */
+    QString trackArtist(unsigned track) const;
+
+    /**
+     * @return Title of the track, "Track <n>" if there is none, a null
+     *         string if there is no such track.
+     */
+    QString trackTitle(unsigned track) const;
+
+    /**
+     * The same disc with all texts replaced.
+     *
+     * @param artists The disc's artist, then one by track.  Empty
+     *        strings and missing entries fall back to the defaults.
+     * @param titles Likewise.
+     */
+    KCompactDiscInfo withTexts(const QStringList &artists, const QStringList &titles) const;
+
+    /**
+     * The same disc with the texts of one track, or of the disc if
+     * track is 0, replaced.
+     */
+    KCompactDiscInfo withText(unsigned track, const QString &artist, const QString &title) const;
+
+    /**
+     * @return Media catalogue number (UPC/EAN), empty if the disc has
+     *         none or the subchannel wasn't scanned.
+     */
+    QString mediaCatalogNumber() const;
+
+    /**
+     * @return ISRC of the track, empty if none is known.
+     */
+    QString trackIsrc(unsigned track) const;
+
+    /**
+     * @return Frames of the pregap (INDEX 00) before the track, 0 if
+     *         unknown.  Track 1's counts from 00:00:00, so it is at least
+     *         150 once known.
+     */
+    unsigned trackPregap(unsigned track) const;
+
+    /**
+     * @return Start frames of INDEX 01 and any further index points of
+     *         the track.  Only INDEX 01 unless the subchannel was scanned.
+     */
+    QList<unsigned> trackIndexes(unsigned track) const;
+
+    /**
+     * The same disc with what the scan of the subchannel found, see
+     * KCompactDisc::scanSubchannel().
+     *
+     * @param pregaps Pregap frames by track, the first for track 1.
+     * @param indexes Index points by track, INDEX 01 first.
+     */
+    KCompactDiscInfo withSubchannel(const QString &mediaCatalogNumber,
+                                    const QStringList &isrcs,
+                                    const QList<unsigned> &pregaps,
+                                    const QList<QList<unsigned>> &indexes) const;
+
+    /**
+     * Same disc, i.e. same table of contents.  The texts aren't
+     * compared.
+     */
+    bool isSameDisc(const KCompactDiscInfo &) const;
+
+private:
+    QSharedDataPointer<KCompactDiscInfoData> d;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KCompactDiscInfo::TrackFlags)
+Q_DECLARE_METATYPE(KCompactDiscInfo)
+
+#endif // KCOMPACTDISCINFO_H
@@ -25,8 +25,6 @@
 
 #include <QtGlobal>
 
-#include <KLocalizedString>
-
 #include <phonon/Global>
 #include <phonon/MediaObject>
 #include <phonon/AudioOutput>
@@ -234,8 +232,6 @@ unsigned KPhononCompactDiscPrivate::balance()
 
 void KPhononCompactDiscPrivate::queryMetadata()
 {
-	Q_Q(KCompactDisc);
-
 	if(!producer())
 		return;
 
@@ -243,13 +239,14 @@ void KPhononCompactDiscPrivate::queryMetadata()
     qDebug() << "METADATA";
     //qDebug() << data;
 
-	m_trackArtists[0] = data.take(QLatin1String( "ARTIST" ));
-	m_trackTitles[0] = data.take(QLatin1String( "ALBUM" ));
+	const QString discArtist = data.take(QLatin1String( "ARTIST" ));
+	const QString discTitle = data.take(QLatin1String( "ALBUM" ));
+	KCompactDiscInfo disc = m_disc.withText(0, discArtist, discTitle);
 
-	m_trackArtists[m_track] = data.take(QLatin1String( "ARTIST" ));
-	m_trackTitles[m_track] = data.take(QLatin1String( "TITLE" ));
+	if(m_track)
+		disc = disc.withText(m_track, data.take(QLatin1String( "ARTIST" )), data.take(QLatin1String( "TITLE" )));
 
-	Q_EMIT q->discInformation(KCompactDisc::PhononMetadata);
+	setDiscInfo(disc, KCompactDisc::PhononMetadata);
 }
 
 KCompactDisc::DiscStatus KPhononCompactDiscPrivate::discStatusTranslate(Phonon::State state)
@@ -280,6 +277,7 @@ void KPhononCompactDiscPrivate::tick(qint64 t)
 	if(track != m_track) {
 		m_track = track;
 		m_discLength = trackLength(m_track);
+		publishState();
 		Q_EMIT q->playoutTrackChanged(m_track);
 
 		/* phonon gives us Metadata only per Track */
@@ -289,6 +287,7 @@ void KPhononCompactDiscPrivate::tick(qint64 t)
 
 	m_trackPosition = MS2SEC(t);
 	m_discPosition = m_trackPosition;
+	publishState();
 	// Update the current playing position.
 	if(m_seek) {
         qDebug() << "seek: " << m_seek << " trackPosition " << m_trackPosition;
@@ -329,16 +328,12 @@ void KPhononCompactDiscPrivate::stateChanged(Phonon::State newstate, Phonon::Sta
 				if(m_tracks > 0) {
                     qDebug() << "New disc with " << m_tracks << " tracks";
 
+					m_disc = KCompactDiscInfo(m_tracks);
 					make_playlist();
 
-					m_trackArtists.append(i18n("Unknown Artist"));
-					m_trackTitles.append(i18n("Unknown Title"));
-					for(unsigned i = 1; i <= m_tracks; ++i) {
-						m_trackArtists.append(i18n("Unknown Artist"));
-						m_trackTitles.append(ki18n("Track %1").subs(i, 2).toString());
-					}
-
+					publishState();
 					Q_EMIT q->discChanged(m_tracks);
+					Q_EMIT q->discInfoChanged(m_disc);
 
 					if(m_autoMetadata)
 						queryMetadata();
@@ -347,6 +342,7 @@ void KPhononCompactDiscPrivate::stateChanged(Phonon::State newstate, Phonon::Sta
 
 			break;
 		}
+		publishState();
 	}
 }
 
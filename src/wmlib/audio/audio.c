@@ -18,14 +18,20 @@
 
 #include "audio.h"
 #include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
 
 #include <config-alsa.h>
+#include <config-jack.h>
+#include <config-pipewire.h>
 
 #include <string.h>
 
 struct audio_oops *setup_phonon(const char *dev, const char *ctl);
 struct audio_oops *setup_arts(const char *dev, const char *ctl);
 struct audio_oops *setup_alsa(const char *dev, const char *ctl);
+struct audio_oops *setup_pipewire(const char *dev, const char *ctl);
+struct audio_oops *setup_jack(const char *dev, const char *ctl);
+struct audio_oops *setup_null(const char *dev, const char *ctl);
 
 struct audio_oops *setup_soundsystem(const char *ss, const char *dev, const char *ctl)
 {
@@ -38,6 +44,8 @@ struct audio_oops *setup_soundsystem(const char *ss, const char *dev, const char
     ERRORLOG("audio: phonon has own reader and output driver.\n");
     return NULL;
   }
+  if(!strcmp(ss, "null"))
+    return setup_null(dev, ctl);
 #ifdef USE_ARTS
   if(!strcmp(ss, "arts"))
     return setup_arts(dev, ctl);
@@ -46,6 +54,14 @@ struct audio_oops *setup_soundsystem(const char *ss, const char *dev, const char
   if(!strcmp(ss, "alsa"))
     return setup_alsa(dev, ctl);
 #endif
+#if defined(HAVE_PIPEWIRE)
+  if(!strcmp(ss, "pipewire"))
+    return setup_pipewire(dev, ctl);
+#endif
+#if defined(HAVE_JACK)
+  if(!strcmp(ss, "jack"))
+    return setup_jack(dev, ctl);
+#endif
 #if defined(sun) || defined(__sun__)
   if(!strcmp(ss, "sun"))
     return setup_sun_audio(dev, ctl);
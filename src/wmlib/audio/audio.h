@@ -24,6 +24,13 @@
 #endif
 struct wm_cdda_block;
 
+/*
+ * Pull mode: copies up to bytes of audio to buf and returns how many,
+ * 0 while there is nothing to play.  It never blocks, so it may be
+ * called from a realtime callback.
+ */
+typedef long (*wmaudio_fill_t)(char *buf, long bytes);
+
 struct audio_oops {
   int (*wmaudio_open)(void);
   int (*wmaudio_close)(void);
@@ -32,6 +39,18 @@ struct audio_oops {
   int (*wmaudio_stop)(void);
   int (*wmaudio_state)(struct wm_cdda_block*);
   int (*wmaudio_balvol)(int, int *, int *);
+  /*
+   * Optional.  The sink calls fill whenever it wants audio, instead of
+   * wmaudio_play being called by a player thread.  Returns 0 if the sink
+   * pulls from now on.  With NULL it stops and returns once fill isn't
+   * running any more.
+   */
+  int (*wmaudio_pull)(wmaudio_fill_t fill);
+  /*
+   * Optional.  Samples handed over that weren't heard yet, the
+   * position is reported that much behind.
+   */
+  long (*wmaudio_delay)(void);
 };
 
 #ifdef __cplusplus
@@ -40,6 +59,19 @@ struct audio_oops {
 
 struct audio_oops *setup_soundsystem(const char *, const char *, const char *);
 
+/*
+ * Counters of the "null" soundsystem, latency is measured from the
+ * reader filling a block to the player handing it over (nanoseconds).
+ */
+struct audio_null_stats {
+  long blocks;
+  long long bytes;
+  long long latency_sum;
+  long long latency_max;
+};
+
+void audio_null_get_stats(struct audio_null_stats *stats, int reset);
+
 #ifdef __cplusplus
     }
 #endif
@@ -25,6 +25,8 @@
 #include "audio.h"
 #include "../include/wm_struct.h"
 #include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
+#include "../include/wm_stats.h"
 
 #include <config-alsa.h>
 
@@ -34,10 +36,16 @@
 #define _DEFAULT_SOURCE /* stop glibc whining about the previous line */
 
 #include <alsa/asoundlib.h>
+#include <pthread.h>
 
 static char *device = NULL;
 static snd_pcm_t *handle;
 
+/* pull mode, see alsa_pull() */
+static pthread_t pull_thread;
+static wmaudio_fill_t pull_fill = NULL;
+static int pull_quit = 0;
+
 static snd_pcm_format_t format = SND_PCM_FORMAT_S16;    /* sample format */
 
 #if (SND_LIB_MAJOR < 1)
@@ -67,6 +75,7 @@ int alsa_open(void);
 int alsa_close(void);
 int alsa_stop(void);
 int alsa_play(struct wm_cdda_block *blk);
+int alsa_pull(wmaudio_fill_t fill);
 int alsa_state(struct wm_cdda_block *blk);
 struct audio_oops* setup_alsa(const char *dev, const char *ctl);
 
@@ -252,24 +261,23 @@ int alsa_close( void )
 }
 
 /*
- * Play some audio and pass a status message upstream, if applicable.
- * Returns 0 on success.
+ * Write all frames, waiting for room in the buffer.  Returns 0 on
+ * success.
  */
-int
-alsa_play(struct wm_cdda_block *blk)
+static int
+alsa_write(signed short *ptr, int frames)
 {
-  signed short *ptr;
-  int err = 0, frames;
+  int err = 0;
 
-  ptr = (signed short *)blk->buf;
-  frames = blk->buflen / (channels * 2);
-  DEBUGLOG("play %i frames, %lu bytes\n", frames, blk->buflen);
   while (frames > 0) {
     err = snd_pcm_writei(handle, ptr, frames);
 
-    if (err == -EAGAIN)
+    if (err == -EAGAIN) {
+      snd_pcm_wait(handle, 100);
       continue;
+    }
     if(err == -EPIPE) {
+      wm_stats_xrun();
       err = snd_pcm_prepare(handle);
       continue;
     } else if (err < 0)
@@ -280,6 +288,22 @@ alsa_play(struct wm_cdda_block *blk)
     DEBUGLOG("played %i, rest %i\n", err, frames);
   }
 
+  return err < 0 ? err : 0;
+}
+
+/*
+ * Play some audio and pass a status message upstream, if applicable.
+ * Returns 0 on success.
+ */
+int
+alsa_play(struct wm_cdda_block *blk)
+{
+  int err, frames;
+
+  frames = blk->buflen / (channels * 2);
+  DEBUGLOG("play %i frames, %lu bytes\n", frames, blk->buflen);
+  err = alsa_write((signed short *)blk->buf, frames);
+
   if (err < 0) {
     ERRORLOG("alsa_write failed: %s\n", snd_strerror(err));
     err = snd_pcm_prepare(handle);
@@ -317,13 +341,71 @@ alsa_stop( void )
   return err;
 }
 
+/*
+ * Pull mode: a period at a time, as soon as the device has room for it.
+ * The blocking write is what paces the loop.
+ */
+static void *
+alsa_pull_loop(void *arg)
+{
+  long bytes = period_size * channels * 2;
+  char *buf = malloc(bytes);
+  long n;
+  int err;
+
+  (void)arg;
+  if (!buf)
+    return NULL;
+
+  while (!pull_quit) {
+    n = pull_fill(buf, bytes);
+    if (n <= 0) {
+      /* stopped, paused or the reader is late */
+      wm_susleep(10000);
+      continue;
+    }
+
+    if ((err = alsa_write((signed short *)buf, n / (channels * 2))) < 0) {
+      ERRORLOG("alsa_write failed: %s\n", snd_strerror(err));
+      snd_pcm_prepare(handle);
+    }
+  }
+
+  free(buf);
+  return NULL;
+}
+
+int
+alsa_pull(wmaudio_fill_t fill)
+{
+  if (!fill) {
+    if (pull_fill) {
+      pull_quit = 1;
+      pthread_join(pull_thread, NULL);
+      pull_fill = NULL;
+    }
+    return 0;
+  }
+
+  pull_fill = fill;
+  pull_quit = 0;
+  if (pthread_create(&pull_thread, NULL, alsa_pull_loop, NULL)) {
+    ERRORLOG("alsa: can't start the pull thread\n");
+    pull_fill = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
 static struct audio_oops alsa_oops = {
   .wmaudio_open    = alsa_open,
   .wmaudio_close   = alsa_close,
   .wmaudio_play    = alsa_play,
   .wmaudio_stop    = alsa_stop,
   .wmaudio_state   = NULL,
-  .wmaudio_balvol  = NULL
+  .wmaudio_balvol  = NULL,
+  .wmaudio_pull    = alsa_pull
 };
 
 struct audio_oops*
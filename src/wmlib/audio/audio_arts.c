@@ -21,6 +21,8 @@
 #ifdef USE_ARTS
 
 #include "audio.h"
+#include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
 
 #include <artsc.h>
 
@@ -0,0 +1,515 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License version 2 as published by the Free Software Foundation.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * "jack" soundsystem, two output ports connected to the first physical
+ * playback ports.  The device is the name of the JACK server, empty for
+ * the default one.  No server is started.
+ *
+ * The process callback takes the audio straight from the CDDA ring
+ * (pull mode), converts it to float and, if the graph doesn't run at
+ * 44.1 kHz, resamples it by linear interpolation.  It doesn't lock or
+ * allocate, the buffers are sized whenever JACK changes the buffer size
+ * or the rate.  Xruns and the time spent in the callback are counted
+ * for the drive.
+ */
+
+#define _DEFAULT_SOURCE /* strdup */
+
+#include "audio.h"
+#include "../include/wm_struct.h"
+#include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
+#include "../include/wm_stats.h"
+
+#include <config-jack.h>
+
+#ifdef HAVE_JACK
+
+#include <jack/jack.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CD_RATE 44100
+#define CD_STRIDE 4
+
+static char *server = NULL;
+static jack_client_t *client = NULL;
+static jack_port_t *port[2];
+
+/* what the process callback takes its audio from */
+static wmaudio_fill_t jackout_source = NULL;
+static int jackout_busy = 0;
+static int jackout_xruns = 0;		/* not counted yet */
+static jack_nframes_t jackout_latency_frames = 0;
+
+/*
+ * Buffers of the callback.  pcm gets the samples from the ring, rs
+ * holds them as float for the resampler.  rs_pos is where the next
+ * output frame is between rs[][0] and rs[][1].
+ */
+static jack_nframes_t graph_rate = CD_RATE;
+static jack_nframes_t graph_frames = 0;
+static short *pcm = NULL;
+static float *rs[2] = { NULL, NULL };
+static long rs_have = 0;
+static double rs_pos = 0;
+static double rs_step = 1.0;
+
+/*
+ * push mode, the audio staged for the callback.  The player stages a
+ * block while the callback still has the rest of the last one, so a
+ * period that crosses the end of a block doesn't run dry.
+ */
+static pthread_mutex_t staged_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t staged_taken = PTHREAD_COND_INITIALIZER;
+static char *staged_buf = NULL;
+static long staged_size = 0;
+static long staged_len = 0;
+static long staged_off = 0;
+static long staged_block = 0;		/* bytes of the last block staged */
+static int staged_stop = 0;
+
+int jackout_open(void);
+int jackout_close(void);
+int jackout_play(struct wm_cdda_block *blk);
+int jackout_stop(void);
+int jackout_pull(wmaudio_fill_t fill);
+long jackout_delay(void);
+struct audio_oops *setup_jack(const char *dev, const char *ctl);
+
+/*
+ * Interleaved signed 16 bit stereo to one float buffer per channel.
+ */
+static void
+jackout_convert(const short *in, float *left, float *right, long frames)
+{
+  const float scale = 1.0f / 32768.0f;
+  long i = 0;
+
+#ifdef __SSE2__
+  const __m128 vscale = _mm_set1_ps(scale);
+  __m128i v, lo, hi;
+  __m128 flo, fhi;
+
+  for (; i + 4 <= frames; i += 4) {
+    /* L0 R0 L1 R1 L2 R2 L3 R3, sign extended to two times four int32 */
+    v = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+    lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    flo = _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale);
+    fhi = _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale);
+    _mm_storeu_ps(left + i, _mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(right + i, _mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+#endif
+
+  for (; i < frames; i++) {
+    left[i] = in[2 * i] * scale;
+    right[i] = in[2 * i + 1] * scale;
+  }
+}
+
+/*
+ * The fill function of push mode.  Never waits for the player, a
+ * contended lock just means silence for this cycle.
+ */
+static long
+jackout_staged_fill(char *buf, long bytes)
+{
+  long n;
+
+  if (pthread_mutex_trylock(&staged_lock))
+    return 0;
+
+  n = staged_len - staged_off;
+  if (n > bytes)
+    n = bytes;
+  if (n > 0) {
+    memcpy(buf, staged_buf + staged_off, n);
+    staged_off += n;
+    if (staged_len - staged_off < staged_block)
+      pthread_cond_signal(&staged_taken);
+  }
+
+  pthread_mutex_unlock(&staged_lock);
+  return n > 0 ? n : 0;
+}
+
+/* up to frames of 44.1 kHz audio into pcm */
+static long
+jackout_take(long frames)
+{
+  wmaudio_fill_t fill;
+  long n = 0;
+
+  /* jackout_pull(NULL) waits for this to drop */
+  __atomic_store_n(&jackout_busy, 1, __ATOMIC_SEQ_CST);
+  fill = __atomic_load_n(&jackout_source, __ATOMIC_SEQ_CST);
+  if (fill)
+    n = fill((char *)pcm, frames * CD_STRIDE) / CD_STRIDE;
+  __atomic_store_n(&jackout_busy, 0, __ATOMIC_RELEASE);
+
+  return n;
+}
+
+static int
+jackout_process(jack_nframes_t nframes, void *arg)
+{
+  long long start = wm_monotonic_nsec();
+  float *out[2];
+  long need, n, i, j;
+  double p;
+  int c, xruns;
+
+  (void)arg;
+  out[0] = jack_port_get_buffer(port[0], nframes);
+  out[1] = jack_port_get_buffer(port[1], nframes);
+
+  if (graph_rate == CD_RATE) {
+    n = jackout_take(nframes);
+    jackout_convert(pcm, out[0], out[1], n);
+    for (c = 0; c < 2; c++)
+      memset(out[c] + n, 0, (nframes - n) * sizeof(float));
+  } else {
+    /* every output frame needs the input frames before and after it */
+    need = (long)(rs_pos + nframes * rs_step) + 2;
+    if (need > rs_have) {
+      n = jackout_take(need - rs_have);
+      jackout_convert(pcm, rs[0] + rs_have, rs[1] + rs_have, n);
+      /* silence while the ring is dry */
+      for (c = 0; c < 2; c++)
+        memset(rs[c] + rs_have + n, 0, (need - rs_have - n) * sizeof(float));
+      rs_have = need;
+    }
+
+    for (c = 0; c < 2; c++) {
+      for (i = 0, p = rs_pos; i < (long)nframes; i++, p += rs_step) {
+        j = (long)p;
+        out[c][i] = rs[c][j] + (float)(p - j) * (rs[c][j + 1] - rs[c][j]);
+      }
+    }
+
+    rs_pos += nframes * rs_step;
+    j = (long)rs_pos;
+    for (c = 0; c < 2; c++)
+      memmove(rs[c], rs[c] + j, (rs_have - j) * sizeof(float));
+    rs_have -= j;
+    rs_pos -= j;
+  }
+
+  /* this thread is bound to the drive's stats once it pulled */
+  for (xruns = __atomic_exchange_n(&jackout_xruns, 0, __ATOMIC_ACQ_REL); xruns > 0; xruns--)
+    wm_stats_xrun();
+  wm_stats_sink_time(start);
+
+  return 0;
+}
+
+/*
+ * Size the buffers for the graph, JACK doesn't run the process callback
+ * meanwhile.
+ */
+static int
+jackout_resize(jack_nframes_t frames, jack_nframes_t rate)
+{
+  long size;
+  short *p;
+  float *f;
+  int c;
+
+  graph_frames = frames;
+  graph_rate = rate;
+  rs_step = (double)CD_RATE / rate;
+  rs_have = 0;
+  rs_pos = 0;
+
+  size = (long)(frames * rs_step) + 4;
+  p = realloc(pcm, size * CD_STRIDE);
+  if (!p)
+    return -1;
+  pcm = p;
+  for (c = 0; c < 2; c++) {
+    f = realloc(rs[c], size * sizeof(float));
+    if (!f)
+      return -1;
+    rs[c] = f;
+  }
+
+  DEBUGLOG("jack: %u frames at %u Hz\n", frames, rate);
+  return 0;
+}
+
+static int
+jackout_buffer_size(jack_nframes_t frames, void *arg)
+{
+  (void)arg;
+  return jackout_resize(frames, graph_rate);
+}
+
+static int
+jackout_sample_rate(jack_nframes_t rate, void *arg)
+{
+  (void)arg;
+  return jackout_resize(graph_frames, rate);
+}
+
+static int
+jackout_xrun(void *arg)
+{
+  (void)arg;
+  __atomic_add_fetch(&jackout_xruns, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static void
+jackout_latency(jack_latency_callback_mode_t mode, void *arg)
+{
+  jack_latency_range_t range;
+
+  (void)arg;
+  if (mode != JackPlaybackLatency)
+    return;
+
+  jack_port_get_latency_range(port[0], JackPlaybackLatency, &range);
+  __atomic_store_n(&jackout_latency_frames, range.max, __ATOMIC_RELAXED);
+}
+
+static void
+jackout_shutdown(void *arg)
+{
+  (void)arg;
+  ERRORLOG("jack: the server went away\n");
+}
+
+int
+jackout_open(void)
+{
+  jack_status_t status;
+  const char **ports;
+  int i;
+
+  DEBUGLOG("jackout_open\n");
+
+  if (server)
+    client = jack_client_open("kcompactdisc", JackNoStartServer | JackServerName, &status, server);
+  else
+    client = jack_client_open("kcompactdisc", JackNoStartServer, &status);
+  if (!client) {
+    ERRORLOG("jack: can't connect to the server, status 0x%x\n", (unsigned)status);
+    jackout_close();
+    return -1;
+  }
+
+  port[0] = jack_port_register(client, "out_l", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+  port[1] = jack_port_register(client, "out_r", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+  if (!port[0] || !port[1] ||
+      jackout_resize(jack_get_buffer_size(client), jack_get_sample_rate(client))) {
+    ERRORLOG("jack: can't set up the ports\n");
+    jackout_close();
+    return -1;
+  }
+
+  jack_set_process_callback(client, jackout_process, NULL);
+  jack_set_buffer_size_callback(client, jackout_buffer_size, NULL);
+  jack_set_sample_rate_callback(client, jackout_sample_rate, NULL);
+  jack_set_xrun_callback(client, jackout_xrun, NULL);
+  jack_set_latency_callback(client, jackout_latency, NULL);
+  jack_on_shutdown(client, jackout_shutdown, NULL);
+
+  if (jack_activate(client)) {
+    ERRORLOG("jack: can't activate the client\n");
+    jackout_close();
+    return -1;
+  }
+
+  ports = jack_get_ports(client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+  for (i = 0; ports && ports[i] && i < 2; i++) {
+    if (jack_connect(client, jack_port_name(port[i]), ports[i]))
+      ERRORLOG("jack: can't connect to %s\n", ports[i]);
+  }
+  if (ports)
+    jack_free(ports);
+
+  return 0;
+}
+
+int
+jackout_close(void)
+{
+  int c;
+
+  DEBUGLOG("jackout_close\n");
+
+  if (client) {
+    jack_deactivate(client);
+    jack_client_close(client);
+    client = NULL;
+  }
+
+  free(pcm);
+  pcm = NULL;
+  for (c = 0; c < 2; c++) {
+    free(rs[c]);
+    rs[c] = NULL;
+  }
+  free(staged_buf);
+  staged_buf = NULL;
+  staged_size = staged_len = staged_off = staged_block = 0;
+  free(server);
+  server = NULL;
+
+  return 0;
+}
+
+/*
+ * Stage the block behind what is left of the last one, once that is
+ * less than a block.  Waiting for it is what paces the player.  The
+ * block that ends the play waits until all of it has been taken.
+ */
+int
+jackout_play(struct wm_cdda_block *blk)
+{
+  char *buf;
+  long left;
+
+  __atomic_store_n(&jackout_source, jackout_staged_fill, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&staged_lock);
+  staged_stop = 0;
+  if (blk->status != WM_CDM_PLAYING) {
+    /* no audio in it, the play is over once the rest has been taken */
+    staged_block = 1;
+    while (staged_off < staged_len && !staged_stop)
+      pthread_cond_wait(&staged_taken, &staged_lock);
+    staged_block = 0;
+    pthread_mutex_unlock(&staged_lock);
+    return 0;
+  }
+  while (staged_len - staged_off >= staged_block && staged_block && !staged_stop)
+    pthread_cond_wait(&staged_taken, &staged_lock);
+  if (staged_stop) {
+    /* dropped like what was staged */
+    pthread_mutex_unlock(&staged_lock);
+    return 0;
+  }
+
+  left = staged_len - staged_off;
+  if (left)
+    memmove(staged_buf, staged_buf + staged_off, left);
+  if (left + (long)blk->buflen > staged_size) {
+    buf = realloc(staged_buf, left + blk->buflen);
+    if (!buf) {
+      pthread_mutex_unlock(&staged_lock);
+      blk->status = WM_CDM_CDDAERROR;
+      return -1;
+    }
+    staged_buf = buf;
+    staged_size = left + blk->buflen;
+  }
+
+  memcpy(staged_buf + left, blk->buf, blk->buflen);
+  staged_len = left + blk->buflen;
+  staged_off = 0;
+  staged_block = blk->buflen;
+  pthread_mutex_unlock(&staged_lock);
+
+  return 0;
+}
+
+/*
+ * Drop what is staged, the graph holds no more than a period.
+ */
+int
+jackout_stop(void)
+{
+  DEBUGLOG("jackout_stop\n");
+
+  pthread_mutex_lock(&staged_lock);
+  staged_len = staged_off = 0;
+  staged_stop = 1;
+  pthread_cond_broadcast(&staged_taken);
+  pthread_mutex_unlock(&staged_lock);
+
+  return 0;
+}
+
+int
+jackout_pull(wmaudio_fill_t fill)
+{
+  __atomic_store_n(&jackout_source, fill, __ATOMIC_SEQ_CST);
+  if (!fill) {
+    while (__atomic_load_n(&jackout_busy, __ATOMIC_SEQ_CST))
+      wm_susleep(1000);
+  }
+
+  return 0;
+}
+
+/*
+ * Samples handed over that weren't heard yet, in the staged block and
+ * downstream of our ports.
+ */
+long
+jackout_delay(void)
+{
+  long frames;
+
+  frames = (long)__atomic_load_n(&jackout_latency_frames, __ATOMIC_RELAXED) * CD_RATE / graph_rate;
+
+  pthread_mutex_lock(&staged_lock);
+  frames += (staged_len - staged_off) / CD_STRIDE;
+  pthread_mutex_unlock(&staged_lock);
+
+  return frames;
+}
+
+static struct audio_oops jackout_oops = {
+  .wmaudio_open    = jackout_open,
+  .wmaudio_close   = jackout_close,
+  .wmaudio_play    = jackout_play,
+  .wmaudio_stop    = jackout_stop,
+  .wmaudio_state   = NULL,
+  .wmaudio_balvol  = NULL,
+  .wmaudio_pull    = jackout_pull,
+  .wmaudio_delay   = jackout_delay
+};
+
+struct audio_oops *
+setup_jack(const char *dev, const char *ctl)
+{
+  (void)ctl;
+  DEBUGLOG("setup_jack\n");
+
+  if (client)
+    jackout_close();
+
+  /* jackout_open() cleans up after itself */
+  server = (dev && *dev) ? strdup(dev) : NULL;
+  if (jackout_open())
+    return NULL;
+
+  return &jackout_oops;
+}
+
+#endif /* HAVE_JACK */
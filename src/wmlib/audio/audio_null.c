@@ -0,0 +1,100 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License version 2 as published by the Free Software Foundation.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * "null" soundsystem, drops every block as soon as the player hands it
+ * over.  Used to measure the CDDA pipeline without an audio device.
+ */
+
+#include "audio.h"
+#include "../include/wm_struct.h"
+#include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
+
+#include <string.h>
+#include <pthread.h>
+
+static pthread_mutex_t null_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct audio_null_stats null_stats;
+
+static int null_open(void)
+{
+  return 0;
+}
+
+static int null_close(void)
+{
+  return 0;
+}
+
+/*
+ * Account the block and throw the samples away.
+ */
+static int null_play(struct wm_cdda_block *blk)
+{
+  long long latency;
+
+  if (blk->status != WM_CDM_PLAYING || blk->buflen <= 0)
+    return 0;
+
+  latency = blk->stamp ? wm_monotonic_nsec() - blk->stamp : 0;
+
+  pthread_mutex_lock(&null_lock);
+  null_stats.blocks++;
+  null_stats.bytes += blk->buflen;
+  null_stats.latency_sum += latency;
+  if (latency > null_stats.latency_max)
+    null_stats.latency_max = latency;
+  pthread_mutex_unlock(&null_lock);
+
+  return 0;
+}
+
+static int null_stop(void)
+{
+  return 0;
+}
+
+static struct audio_oops null_oops = {
+  .wmaudio_open    = null_open,
+  .wmaudio_close   = null_close,
+  .wmaudio_play    = null_play,
+  .wmaudio_pause   = NULL,
+  .wmaudio_stop    = null_stop,
+  .wmaudio_state   = NULL,
+  .wmaudio_balvol  = NULL
+};
+
+void audio_null_get_stats(struct audio_null_stats *stats, int reset)
+{
+  pthread_mutex_lock(&null_lock);
+  if (stats)
+    *stats = null_stats;
+  if (reset)
+    memset(&null_stats, 0, sizeof(null_stats));
+  pthread_mutex_unlock(&null_lock);
+}
+
+struct audio_oops *setup_null(const char *dev, const char *ctl)
+{
+  (void)dev;
+  (void)ctl;
+
+  DEBUGLOG("setup_null\n");
+
+  return &null_oops;
+}
@@ -0,0 +1,441 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License version 2 as published by the Free Software Foundation.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * "pipewire" soundsystem, a native pw_stream.  The stream asks for
+ * S16LE stereo at 44.1 kHz and for the graph to run at that rate, so
+ * nothing gets resampled on the way.  The device is the name of the
+ * node to play to, empty for the default one.
+ *
+ * The stream's process callback runs on PipeWire's data thread and
+ * fills its buffers straight from the CDDA ring (pull mode).  When
+ * the player pushes instead, each block is staged here until the
+ * callback took it.
+ */
+
+#define _DEFAULT_SOURCE /* strdup */
+
+#include "audio.h"
+#include "../include/wm_struct.h"
+#include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
+
+#include <config-pipewire.h>
+
+#ifdef HAVE_PIPEWIRE
+
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SINK_RATE 44100
+#define SINK_CHANNELS 2
+#define SINK_STRIDE (SINK_CHANNELS * 2)
+
+static char *device = NULL;
+static struct pw_thread_loop *loop = NULL;
+static struct pw_stream *stream = NULL;
+
+/* what the process callback takes its audio from */
+static wmaudio_fill_t pipewire_fill = NULL;
+static int pipewire_fill_busy = 0;
+
+/*
+ * push mode, the audio staged for the callback.  The player stages a
+ * block while the callback still has the rest of the last one, so a
+ * period that crosses the end of a block doesn't run dry.
+ */
+static pthread_mutex_t staged_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t staged_taken = PTHREAD_COND_INITIALIZER;
+static char *staged_buf = NULL;
+static long staged_size = 0;
+static long staged_len = 0;
+static long staged_off = 0;
+static long staged_block = 0;		/* bytes of the last block staged */
+static int staged_stop = 0;
+
+int pipewire_open(void);
+int pipewire_close(void);
+int pipewire_play(struct wm_cdda_block *blk);
+int pipewire_pause(void);
+int pipewire_stop(void);
+int pipewire_pull(wmaudio_fill_t fill);
+long pipewire_delay(void);
+struct audio_oops *setup_pipewire(const char *dev, const char *ctl);
+
+/*
+ * The fill function of push mode.  Never waits for the player, a
+ * contended lock just means silence for this cycle.
+ */
+static long
+pipewire_staged_fill(char *buf, long bytes)
+{
+  long n;
+
+  if (pthread_mutex_trylock(&staged_lock))
+    return 0;
+
+  n = staged_len - staged_off;
+  if (n > bytes)
+    n = bytes;
+  if (n > 0) {
+    memcpy(buf, staged_buf + staged_off, n);
+    staged_off += n;
+    if (staged_len - staged_off < staged_block)
+      pthread_cond_signal(&staged_taken);
+  }
+
+  pthread_mutex_unlock(&staged_lock);
+  return n > 0 ? n : 0;
+}
+
+static void
+pipewire_on_process(void *data)
+{
+  struct pw_buffer *b;
+  struct spa_data *sd;
+  wmaudio_fill_t fill;
+  long want, n = 0;
+
+  (void)data;
+  if (!(b = pw_stream_dequeue_buffer(stream)))
+    return;
+
+  sd = &b->buffer->datas[0];
+  if (!sd->data) {
+    pw_stream_queue_buffer(stream, b);
+    return;
+  }
+
+  want = sd->maxsize - sd->maxsize % SINK_STRIDE;
+#if PW_CHECK_VERSION(0, 3, 49)
+  if (b->requested && (long)b->requested * SINK_STRIDE < want)
+    want = b->requested * SINK_STRIDE;
+#endif
+
+  /* pipewire_pull(NULL) waits for this to drop */
+  __atomic_store_n(&pipewire_fill_busy, 1, __ATOMIC_SEQ_CST);
+  fill = __atomic_load_n(&pipewire_fill, __ATOMIC_SEQ_CST);
+  if (fill)
+    n = fill(sd->data, want);
+  __atomic_store_n(&pipewire_fill_busy, 0, __ATOMIC_RELEASE);
+
+  /* keep the graph going with silence while there is nothing to play */
+  if (n < want)
+    memset((char *)sd->data + n, 0, want - n);
+
+  sd->chunk->offset = 0;
+  sd->chunk->stride = SINK_STRIDE;
+  sd->chunk->size = want;
+  pw_stream_queue_buffer(stream, b);
+}
+
+static void
+pipewire_on_state_changed(void *data, enum pw_stream_state old,
+                    enum pw_stream_state state, const char *error)
+{
+  (void)data;
+  (void)old;
+  DEBUGLOG("pipewire: stream %s\n", pw_stream_state_as_string(state));
+  if (state == PW_STREAM_STATE_ERROR)
+    ERRORLOG("pipewire: stream failed: %s\n", error ? error : "unknown error");
+}
+
+static const struct pw_stream_events stream_events = {
+  PW_VERSION_STREAM_EVENTS,
+  .state_changed = pipewire_on_state_changed,
+  .process = pipewire_on_process,
+};
+
+int
+pipewire_open(void)
+{
+  struct spa_audio_info_raw info;
+  const struct spa_pod *params[1];
+  struct pw_properties *props;
+  uint8_t pod[1024];
+  struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(pod, sizeof(pod));
+  int err;
+
+  DEBUGLOG("pipewire_open\n");
+
+  loop = pw_thread_loop_new("kcompactdisc-pw", NULL);
+  if (!loop) {
+    ERRORLOG("pipewire: can't create the loop\n");
+    return -1;
+  }
+
+  props = pw_properties_new(
+    PW_KEY_MEDIA_TYPE, "Audio",
+    PW_KEY_MEDIA_CATEGORY, "Playback",
+    PW_KEY_MEDIA_ROLE, "Music",
+    PW_KEY_APP_NAME, "KCompactDisc",
+    NULL);
+  /* run the graph at the CD rate if the daemon allows it */
+  pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", SINK_RATE);
+  pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", SINK_RATE / 20, SINK_RATE);
+  if (device && *device)
+#ifdef PW_KEY_TARGET_OBJECT
+    pw_properties_set(props, PW_KEY_TARGET_OBJECT, device);
+#else
+    pw_properties_set(props, PW_KEY_NODE_TARGET, device);
+#endif
+
+  stream = pw_stream_new_simple(pw_thread_loop_get_loop(loop), "CD Audio",
+                                props, &stream_events, NULL);
+  if (!stream) {
+    ERRORLOG("pipewire: can't create the stream\n");
+    pw_thread_loop_destroy(loop);
+    loop = NULL;
+    return -1;
+  }
+
+  memset(&info, 0, sizeof(info));
+  info.format = SPA_AUDIO_FORMAT_S16_LE;
+  info.rate = SINK_RATE;
+  info.channels = SINK_CHANNELS;
+  info.position[0] = SPA_AUDIO_CHANNEL_FL;
+  info.position[1] = SPA_AUDIO_CHANNEL_FR;
+  params[0] = spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info);
+
+  /* inactive until there is something to play */
+  err = pw_stream_connect(stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+                          PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS |
+                          PW_STREAM_FLAG_RT_PROCESS | PW_STREAM_FLAG_INACTIVE,
+                          params, 1);
+  if (err < 0 || pw_thread_loop_start(loop) < 0) {
+    ERRORLOG("pipewire: can't connect the stream: %s\n", spa_strerror(err));
+    pw_stream_destroy(stream);
+    stream = NULL;
+    pw_thread_loop_destroy(loop);
+    loop = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+pipewire_close(void)
+{
+  DEBUGLOG("pipewire_close\n");
+
+  if (loop)
+    pw_thread_loop_stop(loop);
+  if (stream)
+    pw_stream_destroy(stream);
+  if (loop)
+    pw_thread_loop_destroy(loop);
+  stream = NULL;
+  loop = NULL;
+
+  free(staged_buf);
+  staged_buf = NULL;
+  staged_size = staged_len = staged_off = staged_block = 0;
+  free(device);
+  device = NULL;
+
+  return 0;
+}
+
+static void
+pipewire_set_active(int active)
+{
+  pw_thread_loop_lock(loop);
+  pw_stream_set_active(stream, active);
+  pw_thread_loop_unlock(loop);
+}
+
+/*
+ * Stage the block behind what is left of the last one, once that is
+ * less than a block.  Waiting for it is what paces the player.  The
+ * block that ends the play waits until all of it has been taken.
+ */
+int
+pipewire_play(struct wm_cdda_block *blk)
+{
+  char *buf;
+  long left;
+
+  pthread_mutex_lock(&staged_lock);
+  if (!__atomic_load_n(&pipewire_fill, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_unlock(&staged_lock);
+    __atomic_store_n(&pipewire_fill, pipewire_staged_fill, __ATOMIC_RELEASE);
+    pipewire_set_active(1);
+    pthread_mutex_lock(&staged_lock);
+  }
+
+  staged_stop = 0;
+  if (blk->status != WM_CDM_PLAYING) {
+    /* no audio in it, the play is over once the rest has been taken */
+    staged_block = 1;
+    while (staged_off < staged_len && !staged_stop)
+      pthread_cond_wait(&staged_taken, &staged_lock);
+    staged_block = 0;
+    pthread_mutex_unlock(&staged_lock);
+    return 0;
+  }
+  while (staged_len - staged_off >= staged_block && staged_block && !staged_stop)
+    pthread_cond_wait(&staged_taken, &staged_lock);
+  if (staged_stop) {
+    /* dropped like what was staged */
+    pthread_mutex_unlock(&staged_lock);
+    return 0;
+  }
+
+  left = staged_len - staged_off;
+  if (left)
+    memmove(staged_buf, staged_buf + staged_off, left);
+  if (left + (long)blk->buflen > staged_size) {
+    buf = realloc(staged_buf, left + blk->buflen);
+    if (!buf) {
+      pthread_mutex_unlock(&staged_lock);
+      blk->status = WM_CDM_CDDAERROR;
+      return -1;
+    }
+    staged_buf = buf;
+    staged_size = left + blk->buflen;
+  }
+
+  memcpy(staged_buf + left, blk->buf, blk->buflen);
+  staged_len = left + blk->buflen;
+  staged_off = 0;
+  staged_block = blk->buflen;
+  pthread_mutex_unlock(&staged_lock);
+
+  return 0;
+}
+
+/*
+ * Drop what PipeWire still holds.  The stream stays active and plays
+ * silence, there is nothing to fill with until the play goes on.
+ */
+int
+pipewire_pause(void)
+{
+  DEBUGLOG("pipewire_pause\n");
+
+  pw_thread_loop_lock(loop);
+  pw_stream_flush(stream, false);
+  pw_thread_loop_unlock(loop);
+
+  return 0;
+}
+
+/*
+ * Drop what is staged as well.
+ */
+int
+pipewire_stop(void)
+{
+  DEBUGLOG("pipewire_stop\n");
+
+  pthread_mutex_lock(&staged_lock);
+  staged_len = staged_off = 0;
+  staged_stop = 1;
+  pthread_cond_broadcast(&staged_taken);
+  pthread_mutex_unlock(&staged_lock);
+
+  return pipewire_pause();
+}
+
+int
+pipewire_pull(wmaudio_fill_t fill)
+{
+  if (!fill) {
+    pipewire_set_active(0);
+    __atomic_store_n(&pipewire_fill, NULL, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pipewire_fill_busy, __ATOMIC_SEQ_CST))
+      wm_susleep(1000);
+    return 0;
+  }
+
+  __atomic_store_n(&pipewire_fill, fill, __ATOMIC_SEQ_CST);
+  pipewire_set_active(1);
+  return 0;
+}
+
+/*
+ * Samples handed over that weren't heard yet: queued in our buffers,
+ * in the graph and in the device.
+ */
+long
+pipewire_delay(void)
+{
+  struct pw_time t;
+  long frames;
+
+#if PW_CHECK_VERSION(0, 3, 50)
+  if (pw_stream_get_time_n(stream, &t, sizeof(t)) < 0)
+#else
+  if (pw_stream_get_time(stream, &t) < 0)
+#endif
+    return 0;
+
+  frames = t.queued / SINK_STRIDE;
+  if (t.rate.denom && t.delay > 0)
+    frames += t.delay * SINK_RATE * t.rate.num / t.rate.denom;
+
+  pthread_mutex_lock(&staged_lock);
+  frames += (staged_len - staged_off) / SINK_STRIDE;
+  pthread_mutex_unlock(&staged_lock);
+
+  return frames;
+}
+
+static struct audio_oops pipewire_oops = {
+  .wmaudio_open    = pipewire_open,
+  .wmaudio_close   = pipewire_close,
+  .wmaudio_play    = pipewire_play,
+  .wmaudio_pause   = pipewire_pause,
+  .wmaudio_stop    = pipewire_stop,
+  .wmaudio_state   = NULL,
+  .wmaudio_balvol  = NULL,
+  .wmaudio_pull    = pipewire_pull,
+  .wmaudio_delay   = pipewire_delay
+};
+
+struct audio_oops *
+setup_pipewire(const char *dev, const char *ctl)
+{
+  static int pipewire_initialized = 0;
+
+  (void)ctl;
+  DEBUGLOG("setup_pipewire\n");
+
+  if (!pipewire_initialized) {
+    pw_init(NULL, NULL);
+    pipewire_initialized = 1;
+  }
+
+  if (stream)
+    pipewire_close();
+
+  device = (dev && *dev) ? strdup(dev) : NULL;
+  if (pipewire_open()) {
+    free(device);
+    device = NULL;
+    return NULL;
+  }
+
+  return &pipewire_oops;
+}
+
+#endif /* HAVE_PIPEWIRE */
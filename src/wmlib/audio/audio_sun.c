@@ -24,6 +24,8 @@
 #if defined(sun) || defined(__sun__)
 
 #include "audio.h"
+#include "../include/wm_config.h"
+#include "../include/wm_helpers.h"
 
 #include <stdio.h>
 #include <malloc.h>
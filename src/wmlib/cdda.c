@@ -17,22 +17,36 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define _DEFAULT_SOURCE /* clock_gettime, CLOCK_REALTIME */
+
 #include <string.h>
 #include <sys/poll.h>
-#include <sys/wait.h>
 #include <arpa/inet.h> /* For htonl(3) */
 #include <stdio.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
 #include "include/wm_config.h"
 #include "include/wm_struct.h"
 #include "include/wm_cdda.h"
 #include "include/wm_cdrom.h"
+#include "include/wm_cddb.h"
+#include "include/wm_cdda_cache.h"
+#include "include/wm_deemph.h"
 #include "include/wm_helpers.h"
 #include "include/wm_scsi.h"
+#include "include/wm_uring.h"
+#include "include/wm_sched.h"
+#include "include/wm_silence.h"
+#include "include/wm_stats.h"
+#include "include/wm_tap.h"
+#include "include/wm_trace.h"
 #include "audio/audio.h"
 
 #include <pthread.h>
 
+#define WM_MSG_CLASS WM_MSG_CLASS_CDROM
+
 static pthread_t thread_read;
 static pthread_t thread_play;
 
@@ -40,6 +54,7 @@ static pthread_t thread_play;
    by rate 44100 HZ, 588 samples are 1/75 sec
    if we read 15 frames(8820 samples), we get in each block, data for 1/5 sec */
 #define COUNT_CDDA_FRAMES_PER_BLOCK 15
+#define CDDA_FRAMESIZE (588 * 4)
 
 /* Only Linux and Sun define the number of blocks explicitly; assume all
    other systems are like Linux and have 10 blocks.
@@ -48,9 +63,117 @@ static pthread_t thread_play;
 #define COUNT_CDDA_BLOCKS 10
 #endif
 
+/* reads of one block before it's concealed, and how many blocks in
+   a row may be concealed (1 sec) before playback stops */
+#define COUNT_CDDA_RETRIES 3
+#define COUNT_CDDA_CONCEALED 5
+
+/* msec without playback before sink and threads go away again, <0 never */
+#define CDDA_IDLE_MSEC 30000
+
+/* shortest silence kept as a range, unless told otherwise */
+#define CDDA_SILENCE_MSEC 2000
+#define CDDA_MAX_TRACKS 99
+
+/*
+ * Read speed governor, see cdda_govern().  Speeds are multiples of 1x,
+ * the governor doubles or halves them between MIN and MAX.
+ */
+#define CDDA_1X_KBPS 176
+#define CDDA_SPEED_MIN 2
+#define CDDA_SPEED_START 8
+#define CDDA_SPEED_MAX 32
+#define CDDA_LOW_WATER (COUNT_CDDA_BLOCKS / 3)
+#define CDDA_HIGH_WATER (COUNT_CDDA_BLOCKS - 1)
+/* msec the ring has to stay full before slowing down, and low before a
+   ring that wasn't full yet speeds up */
+#define CDDA_SPEED_DOWN_MSEC 5000
+#define CDDA_SPEED_UP_MSEC 1000
+
 static struct wm_cdda_block blks[COUNT_CDDA_BLOCKS];
 static pthread_mutex_t blks_mutex[COUNT_CDDA_BLOCKS];
 static pthread_cond_t wakeup_audio;
+static pthread_cond_t block_played;
+
+/* for what is shared with a pulling sink or the tap without a lock */
+#ifdef __GNUC__
+#define CDDA_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define CDDA_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define CDDA_LOAD(x) (x)
+#define CDDA_STORE(x, v) ((x) = (v))
+#endif
+
+/*
+ * The drive is opened for CDDA, the sink set up and the threads started
+ * on the first play only, see cdda_start().  A drive switch only swaps
+ * the drive under them, see wm_cdda_detach().
+ */
+static int cdda_running = 0;
+static int cdda_attached = 0;
+static int cdda_quit = 0;
+static int cdda_idle_msec = CDDA_IDLE_MSEC;
+static long long cdda_idle_since = 0;
+
+static int cdda_speed_pin = 0;		/* fixed speed instead of the governor */
+
+/* governor state, kept by the reader */
+static int cdda_speed = 0;		/* last one set, 0 is as fast as it goes */
+static int cdda_refill_kbps = 0;	/* average read rate of the drive */
+static int cdda_speed_full = 0;		/* the ring was full since the last change */
+static long long cdda_speed_since = 0;
+static int cdda_speed_refused = 0;	/* the drive took neither command this play */
+
+/*
+ * Cache mode, see cdda_prefetch().  Only the reader uses the cache, it
+ * is replaced or flushed by cdda_play() while the reader is parked.
+ */
+static struct wm_cdda_cache *cache = NULL;
+static long cache_want = 0;		/* budget in bytes, 0 is off */
+static long cache_have = 0;		/* the budget cache was made with */
+static int cache_tracks = 0;		/* read ahead into the next tracks */
+static unsigned long cache_disc = 0;	/* disc id of what is cached */
+static int prefetch_until = -1;		/* limit prefetching got to */
+static char prefetch_buf[WM_CDDA_CACHE_CHUNK * CDDA_FRAMESIZE];
+
+/*
+ * Silence detection, see wm_silence.h.  Like the cache it is set up
+ * again by cdda_play() once the settings changed.
+ */
+static struct wm_silence *silence = NULL;
+static int silence_want[2] = { -1, 0 };	/* threshold, <0 is off, and frames */
+static int silence_have[2] = { -1, 0 };
+
+/* de-emphasis of the tracks which need it, the reader's own */
+static int deemph_on = 1;
+static struct wm_deemph deemph;
+static int deemph_next = -1;		/* frame the filter carries on at */
+
+/* set by the reader while it waits for a play, under park_mutex */
+static pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int cdda_parked = 0;
+
+/*
+ * Pull mode, see cdda_fill().  The sink takes the audio straight from
+ * the ring and there is no player thread.  The position is only used
+ * by whoever calls cdda_fill().
+ */
+static int cdda_pull = 1;		/* let a sink pull if it can */
+static int cdda_pulling = 0;
+static struct wm_drive *fill_drive = NULL;
+static unsigned cdda_plays = 0;		/* bumped by every cdda_play() */
+static unsigned fill_play = 0;		/* the play the position belongs to */
+static int fill_block = 0;
+static long fill_offset = 0;		/* bytes of fill_block taken */
+static int fill_started = 0;		/* got audio from this play already */
+static int fill_dry = 0;		/* the underrun was counted */
+
+/*
+ * End of the audio the sink got and the frame its track started at, so
+ * a sink which knows its delay gets the position it is playing.
+ */
+static int sent_frame = 0;
+static int sent_track_frame = 0;
 
 /*
  * This is non-null if we're saving audio to a file.
@@ -63,6 +186,23 @@ static FILE *output = NULL;
  */
 static struct audio_oops *oops = NULL;
 
+/*
+ * Optional io_uring read engine, NULL means CDROMREADAUDIO & co.
+ */
+static struct wm_uring *uring = NULL;
+
+/*
+ * PCM tap for other processes, made on the first wm_cd_get_cdda_tap()
+ * and kept until wm_cdda_destroy().  The player publishes to it.
+ */
+static struct wm_tap *tap = NULL;
+
+/*
+ * Status query of the drive itself, used while the CDDA player is idle.
+ */
+static int (*drive_status)(struct wm_drive *d, int oldmode,
+  int *mode, int *frame, int *track, int *ind) = NULL;
+
 /*
  * Audio file header format.
  */
@@ -76,10 +216,45 @@ struct auheader {
 	u_32 channels;
 };
 
+static int cdda_start(struct wm_drive *d);
+static void cdda_teardown(struct wm_drive *d);
+static void cdda_hooks(struct wm_drive *d);
+static void cdda_cache_setup(struct wm_drive *d);
+static void cdda_silence_setup(struct wm_drive *d);
+
+/*
+ * Called with every status poll, so this is where an idle sink goes away.
+ */
+static void cdda_check_idle(struct wm_drive *d)
+{
+    long long now;
+
+    if (!cdda_running || cdda_idle_msec < 0)
+        return;
+
+    if (d->command == WM_CDM_PLAYING || d->command == WM_CDM_PAUSED) {
+        cdda_idle_since = 0;
+        return;
+    }
+
+    now = wm_monotonic_nsec();
+    if (!cdda_idle_since)
+        cdda_idle_since = now;
+    else if (now - cdda_idle_since >= cdda_idle_msec * 1000000LL)
+        cdda_teardown(d);
+}
+
 static int cdda_status(struct wm_drive *d, int oldmode,
   int *mode, int *frame, int *track, int *ind)
 {
     if (d->cddax) {
+        cdda_check_idle(d);
+
+        /* no audio in flight, let the drive tell about tray and disc */
+        if (drive_status && d->status != WM_CDM_PLAYING && d->status != WM_CDM_PAUSED &&
+            d->status != WM_CDM_TRACK_DONE && d->status != WM_CDM_CDDAERROR)
+            return drive_status(d, oldmode, mode, frame, track, ind);
+
         if(d->status)
           *mode = d->status;
         else
@@ -89,6 +264,11 @@ static int cdda_status(struct wm_drive *d, int oldmode,
             *track = d->track;
             *ind = d->index;
             *frame = d->frame;
+            if (oops->wmaudio_delay && sent_frame) {
+                *frame = sent_frame - oops->wmaudio_delay() / (CDDA_FRAMESIZE / 4);
+                if (*frame < sent_track_frame)
+                    *frame = sent_track_frame;
+            }
         } else if (*mode == WM_CDM_CDDAERROR) {
             /*
              * An error near the end of the CD probably
@@ -105,7 +285,12 @@ static int cdda_status(struct wm_drive *d, int oldmode,
 
 static int cdda_play(struct wm_drive *d, int start, int end)
 {
+    int i;
+
     if (d->cddax) {
+        if (cdda_start(d))
+            return -1;
+
         d->command = WM_CDM_STOPPED;
         oops->wmaudio_stop();
 
@@ -113,12 +298,29 @@ static int cdda_play(struct wm_drive *d, int start, int end)
         while(d->status != d->command)
             wm_susleep(1000);
 
+        /*
+         * Drop what is left of the last play now, the reader is parked.
+         * Neither the player nor a pulling sink may see it once the
+         * command is back to playing.
+         */
+        for (i = 0; i < COUNT_CDDA_BLOCKS; i++) {
+            (void) pthread_mutex_lock(&blks_mutex[i]);
+            CDDA_STORE(blks[i].pending, 0);
+            (void) pthread_mutex_unlock(&blks_mutex[i]);
+        }
+        CDDA_STORE(cdda_plays, cdda_plays + 1);
+
+        cdda_cache_setup(d);
+        cdda_silence_setup(d);
+
 		d->current_position = start;
 		d->ending_position = end;
 
         d->track =  -1;
         d->index =  0;
         d->frame = start;
+        sent_frame = 0;
+        sent_track_frame = start;
         d->status = d->command = WM_CDM_PLAYING;
 
         return 0;
@@ -129,7 +331,7 @@ static int cdda_play(struct wm_drive *d, int start, int end)
 
 static int cdda_pause(struct wm_drive *d)
 {
-    if (d->cddax) {
+    if (d->cddax && cdda_running) {
         if(WM_CDM_PLAYING == d->command) {
             d->command = WM_CDM_PAUSED;
             if(oops->wmaudio_pause)
@@ -147,8 +349,10 @@ static int cdda_pause(struct wm_drive *d)
 static int cdda_stop(struct wm_drive *d)
 {
     if (d->cddax) {
-        d->command = WM_CDM_STOPPED;
-        oops->wmaudio_stop();
+        if (cdda_running) {
+            d->command = WM_CDM_STOPPED;
+            oops->wmaudio_stop();
+        }
         return 0;
     }
 
@@ -157,7 +361,7 @@ static int cdda_stop(struct wm_drive *d)
 
 static int cdda_set_volume(struct wm_drive *d, int left, int right)
 {
-    if (d->cddax) {
+    if (d->cddax && cdda_running) {
          if(oops->wmaudio_balvol && !oops->wmaudio_balvol(1, &left, &right))
             return 0;
     }
@@ -167,7 +371,7 @@ static int cdda_set_volume(struct wm_drive *d, int left, int right)
 
 static int cdda_get_volume(struct wm_drive *d, int *left, int *right)
 {
-    if (d->cddax) {
+    if (d->cddax && cdda_running) {
         if(oops->wmaudio_balvol && !oops->wmaudio_balvol(0, left, right))
             return 0;
     }
@@ -237,24 +441,396 @@ static int get_next_block(int x)
     return (y < COUNT_CDDA_BLOCKS)?y:0;
 }
 
+/*
+ * Called by the reader with blks_mutex[i] held.  The lock chain alone
+ * doesn't keep the reader from lapping the player, so wait until the
+ * block was played.  The timeout lets a stop or pause through, and is
+ * all a pulling sink has to wake the reader: 20 ms against a ring of
+ * seconds.
+ */
+static void wait_block_played(struct wm_drive *d, int i)
+{
+    struct timespec ts;
+
+    while (blks[i].pending && d->command == WM_CDM_PLAYING) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 20000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&block_played, &blks_mutex[i], &ts);
+    }
+}
+
+/*
+ * Undo the pre-emphasis of the tracks that have it in the block just
+ * read, before it goes to the sink, the tap or a file.  The cache keeps
+ * the audio as read.  The filter carries on from the last block unless
+ * there was a seek or another track in between.
+ */
+static void cdda_deemphasize(struct wm_drive *d, struct wm_cdda_block *b, long bytes)
+{
+    const struct wm_trackinfo *trk = d->thiscd.trk;
+    int frame = b->frame, end = b->frame + bytes / CDDA_FRAMESIZE;
+    short *pcm;
+    int t, to;
+
+    if (!trk)
+        return;
+
+    while (frame < end) {
+        /* track t is [trk[t - 1].start, trk[t].start) */
+        for (t = d->thiscd.ntracks; t > 1 && frame < trk[t - 1].start; t--)
+            ;
+        to = (t < d->thiscd.ntracks && trk[t].start < end) ? trk[t].start : end;
+
+        if (trk[t - 1].preemphasis) {
+            pcm = (short *)(b->buf + (frame - b->frame) * CDDA_FRAMESIZE);
+            if (frame != deemph_next)
+                wm_deemph_reset(&deemph, pcm);
+            wm_deemph_run(&deemph, pcm, to - frame);
+            deemph_next = to;
+            wm_stats_add(d->stats, WM_STATS_DEEMPHASIZED, to - frame);
+        }
+        frame = to;
+    }
+}
+
+/*
+ * Read the next block, a failed read is retried a few times and then
+ * replaced by silence.  Only a longer run of bad blocks stops playback.
+ * The fault layer only sits under the proto hooks, so it keeps the
+ * io_uring engine out of the way.
+ */
+static long cdda_read_block(struct wm_drive *d, struct wm_cdda_block *block, int *concealed)
+{
+    long result;
+    long long start;
+    int retry, nframes;
+
+    if (cache && d->current_position < d->ending_position) {
+        nframes = d->ending_position - d->current_position;
+        if (nframes > d->frames_at_once)
+            nframes = d->frames_at_once;
+        if (!wm_cdda_cache_read(cache, d->current_position, nframes, block->buf)) {
+            block->track = -1;
+            block->index = 0;
+            block->frame = d->current_position;
+            block->status = WM_CDM_PLAYING;
+            block->buflen = nframes * CDDA_FRAMESIZE;
+            d->current_position += nframes;
+            wm_stats_add(d->stats, WM_STATS_CACHE_HITS, 1);
+            *concealed = 0;
+            return block->buflen;
+        }
+        wm_stats_add(d->stats, WM_STATS_CACHE_MISSES, 1);
+    }
+
+    for (retry = 0; ; retry++) {
+        wm_sched_enter(d, WM_SCHED_AUDIO);
+        start = wm_monotonic_nsec();
+        if (uring && !d->fault)
+            result = wm_uring_read(uring, d, block);
+        else
+            result = d->proto.cdda_read(d, block);
+        wm_sched_leave(d);
+        wm_stats_time(d->stats, WM_STATS_HIST_READ, start);
+        wm_stats_add(d->stats, WM_STATS_READS, 1);
+        WM_TRACE_SPAN("cdda_read", start, d->current_position);
+
+        if (result != 0 || block->status != WM_CDM_CDDAERROR)
+            break;
+        wm_stats_add(d->stats, WM_STATS_READ_ERRORS, 1);
+        if (retry == COUNT_CDDA_RETRIES)
+            break;
+
+        wm_stats_add(d->stats, WM_STATS_RETRIES, 1);
+        WM_TRACE_INSTANT("retry", d->current_position);
+
+        wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
+            "cdda: read at frame %d failed, retry %d\n", d->current_position, retry + 1);
+    }
+
+    if (result > 0) {
+        wm_stats_add(d->stats, WM_STATS_BYTES_READ, result);
+        if (cache && block->status == WM_CDM_PLAYING)
+            wm_stats_add(d->stats, WM_STATS_CACHE_EVICTIONS,
+                wm_cdda_cache_write(cache, block->frame, result / CDDA_FRAMESIZE, block->buf));
+        *concealed = 0;
+        return result;
+    }
+
+    if (block->status != WM_CDM_CDDAERROR || ++*concealed > COUNT_CDDA_CONCEALED)
+        return result;
+
+    if (d->ending_position && d->current_position + d->frames_at_once > d->ending_position)
+        nframes = d->ending_position - d->current_position;
+    else
+        nframes = d->frames_at_once;
+
+    wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+        "cdda: %d frames at %d unreadable, playing silence\n", nframes, d->current_position);
+
+    memset(block->buf, 0, nframes * CDDA_FRAMESIZE);
+    block->track = -1;
+    block->index = 0;
+    block->frame = d->current_position;
+    block->status = WM_CDM_PLAYING;
+    block->buflen = nframes * CDDA_FRAMESIZE;
+
+    WM_TRACE_INSTANT("concealed", d->current_position);
+    d->current_position += nframes;
+    wm_stats_add(d->stats, WM_STATS_CONCEALED, 1);
+
+    return block->buflen;
+}
+
+/*
+ * A drive that takes neither SET CD SPEED nor SET STREAMING keeps its
+ * own speed, the governor leaves it alone until the next play.
+ */
+static int cdda_set_speed(struct wm_drive *d, int speed)
+{
+    int kbps = speed > 0 ? speed * CDDA_1X_KBPS : -1;
+
+    if (wm_scsi_set_speed(d, kbps) && wm_scsi_set_streaming(d, kbps)) {
+        DEBUGLOG("cdda: drive keeps its speed\n");
+        cdda_speed_refused = 1;
+        return -1;
+    }
+
+    cdda_speed = speed;
+    cdda_speed_full = 0;
+    cdda_speed_since = wm_monotonic_nsec();
+    wm_stats_add(d->stats, WM_STATS_SPEED_CHANGES, 1);
+    WM_TRACE_COUNTER("read_speed", speed);
+    return 0;
+}
+
+/*
+ * Pick the slowest speed that keeps the ring above the low-water mark,
+ * called after each read with the number of filled blocks.  A full ring
+ * steps the speed down after a while, a low one doubles it right away
+ * once the ring had been full, e.g. after a seek or a run of retries.
+ */
+static void cdda_govern(struct wm_drive *d, int filled)
+{
+    long long now;
+
+    if (cdda_speed_refused)
+        return;
+    if (cdda_speed_pin) {
+        if (cdda_speed != cdda_speed_pin)
+            cdda_set_speed(d, cdda_speed_pin);
+        return;
+    }
+    /* cache mode reads at full speed and then not at all */
+    if (cache)
+        return;
+
+    now = wm_monotonic_nsec();
+    if (filled >= CDDA_HIGH_WATER) {
+        if (!cdda_speed_full) {
+            cdda_speed_full = 1;
+            cdda_speed_since = now;
+        } else if (cdda_speed > CDDA_SPEED_MIN &&
+            now - cdda_speed_since >= CDDA_SPEED_DOWN_MSEC * 1000000LL) {
+            cdda_set_speed(d, cdda_speed / 2);
+        }
+    } else if (filled <= CDDA_LOW_WATER && cdda_speed < CDDA_SPEED_MAX &&
+        (cdda_speed_full || now - cdda_speed_since >= CDDA_SPEED_UP_MSEC * 1000000LL)) {
+        cdda_set_speed(d, cdda_speed * 2);
+    }
+}
+
+/*
+ * Where cache mode reads ahead to: the end of the current track, or of
+ * cache_tracks tracks after it, as far as the budget goes.  The player
+ * is usually told to play a single track, the next ones are read ahead
+ * regardless.
+ */
+static int cdda_prefetch_limit(struct wm_drive *d)
+{
+    /* the chunk being played and the one the limit falls into */
+    long room = wm_cdda_cache_budget(cache) / CDDA_FRAMESIZE - 2 * WM_CDDA_CACHE_CHUNK;
+    int t, limit;
+
+    for (t = d->thiscd.ntracks;
+        t > 1 && d->current_position < wm_cd_gettrackstart(d, t); t--)
+        ;
+    t += 1 + cache_tracks;
+    limit = (t <= d->thiscd.ntracks) ? wm_cd_gettrackstart(d, t) :
+        d->thiscd.trk[d->thiscd.ntracks].start;
+
+    if (limit > d->current_position + room)
+        limit = d->current_position + room;
+    return limit;
+}
+
+/*
+ * Cache mode: while the ring is full, read ahead into the cache a chunk
+ * at a time at full speed, until the player takes block j.  Once all is
+ * cached up to the limit the drive has nothing left to do and spins
+ * down, replays and seeks within the cached range don't wake it.  The
+ * reader's position is borrowed for the reads and put back.
+ */
+static void cdda_prefetch(struct wm_drive *d, int j)
+{
+    struct wm_cdda_block tmp;
+    int pos = d->current_position, end = d->ending_position, frames = d->frames_at_once;
+    int from, limit = cdda_prefetch_limit(d);
+    long result;
+    long long start;
+
+    if (limit == prefetch_until)
+        return;
+
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.buf = prefetch_buf;
+
+    while (blks[j].pending && d->command == WM_CDM_PLAYING) {
+        from = wm_cdda_cache_missing(cache, pos, limit);
+        if (from >= limit) {
+            prefetch_until = limit;
+            WM_TRACE_INSTANT("prefetch done", limit);
+            break;
+        }
+
+        d->current_position = from;
+        d->ending_position = (from / WM_CDDA_CACHE_CHUNK + 1) * WM_CDDA_CACHE_CHUNK;
+        if (d->ending_position > limit)
+            d->ending_position = limit;
+        d->frames_at_once = WM_CDDA_CACHE_CHUNK;
+
+        wm_sched_enter(d, WM_SCHED_AUDIO);
+        start = wm_monotonic_nsec();
+        result = d->proto.cdda_read(d, &tmp);
+        wm_sched_leave(d);
+        WM_TRACE_SPAN("prefetch", start, from);
+
+        if (result <= 0 || tmp.status != WM_CDM_PLAYING) {
+            /* the reader retries or conceals it when it gets there */
+            prefetch_until = limit;
+            break;
+        }
+        wm_stats_add(d->stats, WM_STATS_BYTES_READ, result);
+        wm_stats_add(d->stats, WM_STATS_CACHE_PREFETCHED, 1);
+        wm_stats_add(d->stats, WM_STATS_CACHE_EVICTIONS,
+            wm_cdda_cache_write(cache, tmp.frame, result / CDDA_FRAMESIZE, tmp.buf));
+    }
+
+    d->current_position = pos;
+    d->ending_position = end;
+    d->frames_at_once = frames;
+}
+
+/*
+ * Called by cdda_play() with the reader parked: bring the cache in line
+ * with the configured budget and drop it if another disc is in.
+ */
+static void cdda_cache_setup(struct wm_drive *d)
+{
+    unsigned long disc;
+
+    if (cache_have != cache_want) {
+        wm_cdda_cache_free(cache);
+        cache = wm_cdda_cache_new(cache_want);
+        cache_have = cache_want;
+        cache_disc = 0;
+    }
+
+    if (cache && (disc = cddb_discid(d)) != cache_disc) {
+        wm_cdda_cache_flush(cache);
+        cache_disc = disc;
+    }
+    prefetch_until = -1;
+}
+
+/*
+ * Also with the reader parked: make the detector match the settings and
+ * tell it the disc.
+ */
+static void cdda_silence_setup(struct wm_drive *d)
+{
+    int starts[CDDA_MAX_TRACKS + 1];
+    int i, n;
+
+    if (silence_have[0] != silence_want[0] || silence_have[1] != silence_want[1]) {
+        wm_silence_free(silence);
+        silence = silence_want[0] >= 0 ? wm_silence_new(silence_want[0], silence_want[1]) : NULL;
+        silence_have[0] = silence_want[0];
+        silence_have[1] = silence_want[1];
+    }
+    if (!silence || !d->thiscd.trk)
+        return;
+
+    /* tracks past the last one kept end at the lead-out */
+    n = d->thiscd.ntracks;
+    if (n > CDDA_MAX_TRACKS)
+        n = CDDA_MAX_TRACKS;
+    for (i = 0; i < n; i++)
+        starts[i] = d->thiscd.trk[i].start;
+    starts[n] = d->thiscd.trk[d->thiscd.ntracks].start;
+    wm_silence_disc(silence, cddb_discid(d), n, starts);
+}
+
 static void *cdda_fct_read(void* arg)
 {
     struct wm_drive *d = (struct wm_drive *)arg;
-    int i, j, wakeup;
+    int i, j, wakeup, concealed, filled, rate;
     long result;
+    long long start;
 
-    while (d->blocks) {
-        while(d->command != WM_CDM_PLAYING) {
+    WM_TRACE_THREAD("cdda reader");
+
+    while (!cdda_quit) {
+        for (;;) {
+            (void) pthread_mutex_lock(&park_mutex);
+            cdda_parked = (d->command != WM_CDM_PLAYING && !cdda_quit);
+            (void) pthread_mutex_unlock(&park_mutex);
+            if (!cdda_parked)
+                break;
             d->status = d->command;
             wm_susleep(1000);
         }
+        if (cdda_quit)
+            break;
+
+        /* fill the empty ring quickly, then let the governor slow down */
+        cdda_speed_refused = 0;
+        if (cdda_speed_pin)
+            cdda_set_speed(d, cdda_speed_pin);
+        else
+            cdda_set_speed(d, cache ? 0 : CDDA_SPEED_START);
 
         i = 0;
         (void) pthread_mutex_lock(&blks_mutex[i]);
         wakeup = 1;
+        concealed = 0;
 
         while(d->command == WM_CDM_PLAYING) {
-            result = gen_cdda_read(d, &blks[i]);
+            start = wm_monotonic_nsec();
+            result = cdda_read_block(d, &blks[i], &concealed);
+            /* concealed blocks are silent, but not on the disc */
+            if (silence && result > 0 && !concealed && blks[i].status == WM_CDM_PLAYING)
+                wm_stats_add(d->stats, WM_STATS_SILENT_FRAMES,
+                    wm_silence_feed(silence, blks[i].frame, blks[i].buf, result / CDDA_FRAMESIZE));
+            if (deemph_on && result > 0 && blks[i].status == WM_CDM_PLAYING)
+                cdda_deemphasize(d, &blks[i], result);
+            blks[i].stamp = wm_monotonic_nsec();
+            CDDA_STORE(blks[i].pending, 1);
+            if (result > 0 && blks[i].stamp > start) {
+                rate = (int)(result * 1000000LL / (blks[i].stamp - start));
+                cdda_refill_kbps = cdda_refill_kbps ? (cdda_refill_kbps * 7 + rate) / 8 : rate;
+            }
+
+            for (j = 0, filled = 0; j < COUNT_CDDA_BLOCKS; j++)
+                filled += blks[j].pending;
+            wm_stats_add(d->stats, WM_STATS_RING_FILL, filled);
+            wm_stats_add(d->stats, WM_STATS_RING_SAMPLES, 1);
+            WM_TRACE_COUNTER("ring_fill", filled);
+            cdda_govern(d, filled);
             if (result <= 0 && blks[i].status != WM_CDM_TRACK_DONE) {
                 ERRORLOG("cdda: wmcdda_read failed, stop playing\n");
                 d->command = WM_CDM_STOPPED;
@@ -265,7 +841,10 @@ static void *cdda_fct_read(void* arg)
             }
 
             j = get_next_block(i);
+            if (cache)
+                cdda_prefetch(d, j);
             (void) pthread_mutex_lock(&blks_mutex[j]);
+            wait_block_played(d, j);
 
             if(wakeup) {
                 wakeup = 0;
@@ -284,34 +863,105 @@ static void *cdda_fct_read(void* arg)
     return 0;
 }
 
+/*
+ * Block b went to the sink.  cdda_fill() calls this from the sink's
+ * realtime callback, so it only stores: no lock, no syscall, no sink
+ * hook.  The reader isn't woken, it finds pending cleared within the
+ * timeout of wait_block_played().
+ */
+static void cdda_block_taken(struct wm_drive *d, struct wm_cdda_block *b)
+{
+    if (b->status == WM_CDM_PLAYING) {
+        if (b->track != d->track)
+            sent_track_frame = b->frame;
+        sent_frame = b->frame + b->buflen / CDDA_FRAMESIZE;
+    }
+
+    d->frame = b->frame;
+    d->track = b->track;
+    d->index = b->index;
+    if ((d->status = b->status) == WM_CDM_TRACK_DONE)
+        d->command = WM_CDM_STOPPED;
+
+    CDDA_STORE(b->pending, 0);
+}
+
+/*
+ * Block b went to the sink by the player, which wakes the reader.
+ */
+static void cdda_block_played(struct wm_drive *d, struct wm_cdda_block *b)
+{
+    if (oops->wmaudio_state)
+        oops->wmaudio_state(b);
+
+    cdda_block_taken(d, b);
+    pthread_cond_signal(&block_played);
+}
+
 static void *cdda_fct_play(void* arg)
 {
     struct wm_drive *d = (struct wm_drive *)arg;
-    int i = 0;
+    int i = 0, resync = 1;
+    long long start;
+    struct timespec ts;
+    struct wm_tap *tapped;
 
-    while (d->blocks) {
-        if(d->command != WM_CDM_PLAYING) {
+    /* let the sink count xruns for this drive */
+    wm_stats_bind(d->stats);
+    WM_TRACE_THREAD("cdda player");
+
+    while (!cdda_quit) {
+        if(d->command != WM_CDM_PLAYING || resync) {
+            /*
+             * The reader starts each play with block 0.  Wait for it
+             * rather than for the wakeup alone, the player may come
+             * here only after the reader sent it, e.g. when the first
+             * play follows right after cdda_start().
+             */
             i = 0;
+            resync = 0;
             (void) pthread_mutex_lock(&blks_mutex[i]);
-            pthread_cond_wait(&wakeup_audio, &blks_mutex[i]);
+            /* cdda_teardown() sets cdda_quit under this lock */
+            while (!cdda_quit && (d->command != WM_CDM_PLAYING || !blks[i].pending)) {
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += 20000000;
+                if (ts.tv_nsec >= 1000000000) {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&wakeup_audio, &blks_mutex[i], &ts);
+            }
+            if (cdda_quit) {
+                (void) pthread_mutex_unlock(&blks_mutex[i]);
+                break;
+            }
         } else {
             i = get_next_block(i);
-            (void) pthread_mutex_lock(&blks_mutex[i]);
+            if (pthread_mutex_trylock(&blks_mutex[i])) {
+                /* the reader is still at it */
+                wm_stats_add(d->stats, WM_STATS_UNDERRUNS, 1);
+                start = wm_monotonic_nsec();
+                (void) pthread_mutex_lock(&blks_mutex[i]);
+                WM_TRACE_SPAN("underrun", start, i);
+            }
+            if (!blks[i].pending) {
+                /* the reader started over, don't play what is left */
+                (void) pthread_mutex_unlock(&blks_mutex[i]);
+                resync = 1;
+                continue;
+            }
         }
 
+        start = wm_monotonic_nsec();
+        if (blks[i].status == WM_CDM_PLAYING && (tapped = CDDA_LOAD(tap)))
+            wm_tap_publish(tapped, &blks[i], start);
         if (oops->wmaudio_play(&blks[i])) {
             oops->wmaudio_stop();
             ERRORLOG("cdda: wmaudio_play failed\n");
             d->command = WM_CDM_STOPPED;
         }
-        if (oops->wmaudio_state)
-            oops->wmaudio_state(&blks[i]);
-
-        d->frame = blks[i].frame;
-        d->track = blks[i].track;
-        d->index = blks[i].index;
-        if ((d->status = blks[i].status) == WM_CDM_TRACK_DONE)
-            d->command = WM_CDM_STOPPED;
+        WM_TRACE_SPAN("audio_play", start, blks[i].buflen);
+        cdda_block_played(d, &blks[i]);
 
         (void) pthread_mutex_unlock(&blks_mutex[i]);
     }
@@ -320,56 +970,305 @@ static void *cdda_fct_play(void* arg)
 }
 
 /*
- * Try to initialize the CDDA slave.  Returns 0 on success.
+ * The sink side of pull mode, called by the sink from its own thread or
+ * callback for up to bytes of audio.  Never blocks: whatever the reader
+ * has ready is copied, 0 means there is nothing to play right now.  The
+ * ring is a single producer, single consumer queue here, a block
+ * belongs to the sink while it is pending and the reader doesn't touch
+ * it until cdda_block_taken() cleared that.
  */
-int wm_cdda_init(struct wm_drive *d)
+static long cdda_fill(char *buf, long bytes)
 {
-	int ret = 0;
+    struct wm_drive *d = fill_drive;
+    struct wm_cdda_block *b;
+    struct wm_tap *tapped;
+    unsigned plays;
+    long done = 0, n;
+
+    /* count xruns of the sink's thread for this drive */
+    wm_stats_bind(d->stats);
+
+    plays = CDDA_LOAD(cdda_plays);
+    if (plays != fill_play || d->command != WM_CDM_PLAYING) {
+        fill_play = plays;
+        fill_block = 0;
+        fill_offset = 0;
+        fill_started = 0;
+        fill_dry = 0;
+    }
+    if (d->command != WM_CDM_PLAYING || cdda_quit)
+        return 0;
 
-	if (d->cddax) {
-		wm_cdda_destroy(d);
+    while (done < bytes) {
+        b = &blks[fill_block];
+        if (!CDDA_LOAD(b->pending)) {
+            /* the sink asks again soon, count the underrun once */
+            if (fill_started && !fill_dry) {
+                wm_stats_add(d->stats, WM_STATS_UNDERRUNS, 1);
+                WM_TRACE_INSTANT("underrun", fill_block);
+                fill_dry = 1;
+            }
+            break;
+        }
 
-		wm_susleep(1000);
-		d->blocks = 0;
-		wm_susleep(1000);
-	}
+        if (b->status != WM_CDM_PLAYING) {
+            /* end of the play or a read error, no audio in it */
+            cdda_block_taken(d, b);
+            break;
+        }
 
-	memset(blks, 0, sizeof(blks));
+        if (!fill_offset && (tapped = CDDA_LOAD(tap)))
+            wm_tap_publish(tapped, b, wm_monotonic_nsec());
+
+        n = b->buflen - fill_offset;
+        if (n > bytes - done)
+            n = bytes - done;
+        memcpy(buf + done, b->buf + fill_offset, n);
+        done += n;
+        fill_offset += n;
+        fill_started = 1;
+        fill_dry = 0;
+
+        if (fill_offset >= b->buflen) {
+            cdda_block_taken(d, b);
+            fill_offset = 0;
+            fill_block = get_next_block(fill_block);
+        }
+    }
 
-	d->blocks = blks;
-	d->frames_at_once = COUNT_CDDA_FRAMES_PER_BLOCK;
-	d->numblocks = COUNT_CDDA_BLOCKS;
-	d->status = WM_CDM_UNKNOWN;
+    return done;
+}
 
-	if ((ret = gen_cdda_init(d)))
+/*
+ * Open the drive for reading audio.
+ */
+static int cdda_attach_drive(struct wm_drive *d)
+{
+	int ret;
+
+	if (d->proto.cdda_init && (ret = d->proto.cdda_init(d)))
 		return ret;
 
-	if ((ret = gen_cdda_open(d)))
+	if ((ret = d->proto.cdda_open(d)))
 		return ret;
 
-	wm_scsi_set_speed(d, 4);
+	/* the reader sets the speed with each play, see cdda_govern() */
+	if (wm_uring_requested()) {
+		uring = wm_uring_open(d, WM_URING_DEPTH);
+		if (!uring)
+			ERRORLOG("cdda: io_uring engine unavailable, using ioctl reads\n");
+	}
+
+	cdda_attached = 1;
+	return 0;
+}
+
+static void cdda_detach_drive(struct wm_drive *d)
+{
+	if (!cdda_attached)
+		return;
+
+	wm_uring_close(uring);
+	uring = NULL;
+	d->proto.cdda_close(d);
+	wm_scsi_set_speed(d, -1);
+	cdda_speed = 0;
+	cdda_refill_kbps = 0;
+	cdda_attached = 0;
+}
+
+/*
+ * Open the drive for CDDA, set up the sink and start reader and player.
+ * Does nothing if they are up already.
+ */
+static int cdda_start(struct wm_drive *d)
+{
+	long long start = wm_monotonic_nsec();
+	int ret;
+
+	if (cdda_running)
+		return 0;
+
+	if ((ret = cdda_attach_drive(d)))
+		return ret;
 
 	oops = setup_soundsystem(d->soundsystem, d->sounddevice, d->ctldevice);
 	if (!oops) {
 		ERRORLOG("cdda: setup_soundsystem failed\n");
-		gen_cdda_close(d);
-		return -1;
+		goto start_failed;
 	}
 
+	cdda_quit = 0;
+	d->command = WM_CDM_STOPPED;
+
 	if(pthread_create(&thread_read, NULL, cdda_fct_read, d)) {
 		ERRORLOG("error by create pthread");
 		oops->wmaudio_close();
-		gen_cdda_close(d);
-		return -1;
+		goto start_failed;
 	}
 
-	if(pthread_create(&thread_play, NULL, cdda_fct_play, d)) {
+	/* a sink which can pull the audio needs no player */
+	fill_drive = d;
+	cdda_pulling = cdda_pull && oops->wmaudio_pull && !oops->wmaudio_pull(cdda_fill);
+	if (!cdda_pulling && pthread_create(&thread_play, NULL, cdda_fct_play, d)) {
 		ERRORLOG("error by create pthread");
+		cdda_quit = 1;
+		pthread_join(thread_read, NULL);
 		oops->wmaudio_close();
-		gen_cdda_close(d);
+		goto start_failed;
+	}
+
+	cdda_running = 1;
+	cdda_idle_since = 0;
+
+	wm_stats_add(d->stats, WM_STATS_CDDA_STARTS, 1);
+	wm_stats_add(d->stats, WM_STATS_CDDA_START_USEC, (wm_monotonic_nsec() - start) / 1000);
+	WM_TRACE_SPAN("cdda_start", start, 0);
+
+	return 0;
+
+start_failed:
+	cdda_detach_drive(d);
+	return -1;
+}
+
+/*
+ * Stop and join the threads, close the sink and give the drive back.
+ */
+static void cdda_teardown(struct wm_drive *d)
+{
+	if (!cdda_running)
+		return;
+
+	d->command = WM_CDM_STOPPED;
+	oops->wmaudio_stop();
+
+	(void) pthread_mutex_lock(&blks_mutex[0]);
+	cdda_quit = 1;
+	pthread_cond_broadcast(&wakeup_audio);
+	(void) pthread_mutex_unlock(&blks_mutex[0]);
+
+	pthread_join(thread_read, NULL);
+	if (cdda_pulling)
+		oops->wmaudio_pull(NULL);
+	else
+		pthread_join(thread_play, NULL);
+	cdda_pulling = 0;
+
+	cdda_detach_drive(d);
+	oops->wmaudio_close();
+
+	cdda_running = 0;
+	/* let the drive report again */
+	d->status = WM_CDM_UNKNOWN;
+
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "cdda: idle, sink and threads stopped\n");
+}
+
+/*
+ * Set up CDDA playback for the drive.  Nothing is opened or started
+ * before the first play, see cdda_start().  Returns 0 on success.
+ */
+int wm_cdda_init(struct wm_drive *d)
+{
+	const char *env;
+
+	if (d->cddax)
+		wm_cdda_destroy(d);
+
+	memset(blks, 0, sizeof(blks));
+
+	d->blocks = blks;
+	d->frames_at_once = COUNT_CDDA_FRAMES_PER_BLOCK;
+	d->numblocks = COUNT_CDDA_BLOCKS;
+	d->status = WM_CDM_UNKNOWN;
+
+	if (!d->proto.cdda_open || !d->proto.cdda_read || !d->proto.cdda_close)
 		return -1;
+
+	if ((env = getenv("KCOMPACTDISC_CDDA_IDLE")) && *env)
+		cdda_idle_msec = atoi(env);
+	if ((env = getenv("KCOMPACTDISC_CDDA_SPEED")) && *env)
+		cdda_speed_pin = atoi(env);
+	/* 0 keeps the player thread even for sinks which can pull */
+	if ((env = getenv("KCOMPACTDISC_CDDA_PULL")) && *env)
+		cdda_pull = atoi(env);
+	/* MB[,tracks] */
+	if ((env = getenv("KCOMPACTDISC_CDDA_CACHE")) && *env) {
+		char *end;
+		int mbytes = strtol(env, &end, 10);
+		wm_cd_set_cdda_cache(d, mbytes, *end == ',' ? atoi(end + 1) : 0);
+	}
+	if ((env = getenv("KCOMPACTDISC_CDDA_DEEMPHASIS")) && *env)
+		deemph_on = atoi(env);
+	/* threshold[,msec] */
+	if ((env = getenv("KCOMPACTDISC_CDDA_SILENCE")) && *env) {
+		char *end;
+		int threshold = strtol(env, &end, 10);
+		wm_cd_set_cdda_silence(d, threshold, *end == ',' ? atoi(end + 1) : 0);
 	}
 
+	cdda_hooks(d);
+	d->cddax = (void *)1;
+
+	return 0;
+}
+
+/*
+ * Stop playback and give the drive back, the sink and the threads stay
+ * up for the next drive.  The reader is parked before the drive closes.
+ */
+void wm_cdda_detach(struct wm_drive *d)
+{
+	int parked = 0;
+
+	if (!cdda_running || !cdda_attached)
+		return;
+
+	(void) pthread_mutex_lock(&park_mutex);
+	d->command = WM_CDM_STOPPED;
+	(void) pthread_mutex_unlock(&park_mutex);
+	oops->wmaudio_stop();
+
+	while (!parked) {
+		(void) pthread_mutex_lock(&park_mutex);
+		parked = cdda_parked;
+		(void) pthread_mutex_unlock(&park_mutex);
+		if (!parked)
+			wm_susleep(1000);
+	}
+
+	cdda_detach_drive(d);
+	d->status = WM_CDM_UNKNOWN;
+}
+
+/*
+ * Take over the drive d has been switched to.  If that fails, the sink
+ * and threads go away as well and d is left without CDDA.
+ */
+int wm_cdda_attach(struct wm_drive *d)
+{
+	d->status = WM_CDM_UNKNOWN;
+
+	if (!d->proto.cdda_open || !d->proto.cdda_read || !d->proto.cdda_close)
+		goto attach_failed;
+
+	if (cdda_running && !cdda_attached && cdda_attach_drive(d))
+		goto attach_failed;
+
+	cdda_hooks(d);
+	return 0;
+
+attach_failed:
+	ERRORLOG("cdda: cannot read audio from %s\n", d->cd_device);
+	wm_cdda_destroy(d);
+	return -1;
+}
+
+static void cdda_hooks(struct wm_drive *d)
+{
+	if (d->proto.get_drive_status != cdda_status)
+		drive_status = d->proto.get_drive_status;
 	d->proto.get_drive_status = cdda_status;
 	d->proto.pause = cdda_pause;
 	d->proto.resume = NULL;
@@ -379,27 +1278,121 @@ int wm_cdda_init(struct wm_drive *d)
 	d->proto.get_volume = cdda_get_volume;
 	d->proto.scale_volume = NULL;
 	d->proto.unscale_volume = NULL;
+}
 
-	d->cddax = (void *)1;
+int wm_cdda_destroy(struct wm_drive *d)
+{
+	wm_cdda_cache_free(cache);
+	cache = NULL;
+	cache_have = 0;
+	wm_silence_free(silence);
+	silence = NULL;
+	silence_have[0] = -1;
 
+	if (d->cddax) {
+		cdda_teardown(d);
+
+		d->numblocks = 0;
+		d->blocks = NULL;
+		d->cddax = NULL;
+	}
+
+	/* the player is gone, readers keep their mapping */
+	wm_tap_free(tap);
+	tap = NULL;
 	return 0;
 }
 
-int wm_cdda_destroy(struct wm_drive *d)
+int wm_cd_get_cdda_tap(void *p)
 {
-    if (d->cddax) {
-		wm_scsi_set_speed(d, -1);
+	struct wm_drive *d = (struct wm_drive *)p;
+	struct wm_tap *t;
 
-		d->command = WM_CDM_STOPPED;
-		oops->wmaudio_stop();
-		wm_susleep(2000);
-		gen_cdda_close(d);
-		oops->wmaudio_close();
+	if (!d || !d->cddax)
+		return -1;
 
-		d->numblocks = 0;
-        d->blocks = NULL;
-        wait(NULL);
-        d->cddax = NULL;
-    }
-    return 0;
+	if (!tap) {
+		t = wm_tap_new(COUNT_CDDA_FRAMES_PER_BLOCK * CDDA_FRAMESIZE);
+		if (!t)
+			return -1;
+		CDDA_STORE(tap, t);
+	}
+	return wm_tap_fd(tap);
+}
+
+int wm_cd_set_cdda_idle(void *p, int msec)
+{
+	(void)p;
+	cdda_idle_msec = msec;
+	return 0;
+}
+
+int wm_cd_set_cdda_speed(void *p, int speed)
+{
+	(void)p;
+	cdda_speed_pin = speed > 0 ? speed : 0;
+	return 0;
+}
+
+int wm_cd_set_cdda_cache(void *p, int mbytes, int tracks)
+{
+	(void)p;
+	cache_want = mbytes > 0 ? mbytes * 1024L * 1024L : 0;
+	cache_tracks = tracks > 0 ? tracks : 0;
+	return 0;
+}
+
+int wm_cd_get_cdda_cache(void *p, long *bytes, long *budget)
+{
+	(void)p;
+	if (!cache)
+		return -1;
+
+	*bytes = wm_cdda_cache_bytes(cache);
+	*budget = wm_cdda_cache_budget(cache);
+	return 0;
+}
+
+int wm_cd_set_cdda_deemphasis(void *p, int on)
+{
+	(void)p;
+	deemph_on = on;
+	return 0;
+}
+
+int wm_cd_set_cdda_silence(void *p, int threshold, int msec)
+{
+	(void)p;
+	silence_want[0] = threshold;
+	silence_want[1] = (msec > 0 ? msec : CDDA_SILENCE_MSEC) * 75 / 1000;
+	return 0;
+}
+
+int wm_cd_get_cdda_silence(void *p, int track, int *starts, int *lengths, int max)
+{
+	(void)p;
+	if (!silence)
+		return -1;
+	return wm_silence_ranges(silence, track, starts, lengths, max);
+}
+
+int wm_cd_get_cdda_silence_at(void *p)
+{
+	struct wm_drive *d = (struct wm_drive *)p;
+
+	if (!d || !silence)
+		return -1;
+	return wm_silence_at(silence, d->thiscd.cur_frame);
+}
+
+int wm_cd_get_cdda_speed(void *p, int *speed, int *refill_kbps)
+{
+	struct wm_drive *d = (struct wm_drive *)p;
+
+	if (!d || !d->cddax || !cdda_attached)
+		return -1;
+
+	*speed = cdda_speed;
+	*refill_kbps = cdda_refill_kbps;
+	return 0;
 }
@@ -0,0 +1,275 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * CDDA sector cache.  Chunks hang in a hash table by chunk number and
+ * in a list from the most to the least recently used one.  They are
+ * allocated as needed until the budget is spent, from then on the
+ * least recently used one is reused.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_cdda_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_FRAMESIZE (588 * 4)
+#define CACHE_CHUNK_BYTES (WM_CDDA_CACHE_CHUNK * CACHE_FRAMESIZE)
+
+struct cache_chunk {
+	struct cache_chunk *hnext;	/* hash chain */
+	struct cache_chunk *prev, *next;	/* LRU list */
+	int key;			/* first frame / WM_CDDA_CACHE_CHUNK */
+	int nvalid;
+	unsigned char valid[WM_CDDA_CACHE_CHUNK];
+	unsigned char data[CACHE_CHUNK_BYTES];
+};
+
+struct wm_cdda_cache {
+	struct cache_chunk **hash;
+	unsigned int hash_mask;
+	struct cache_chunk *head, *tail;	/* most, least recently used */
+	int nchunks;
+	int max_chunks;
+};
+
+static unsigned int cache_hash(struct wm_cdda_cache *c, int key)
+{
+	return ((unsigned int)key * 2654435761U) & c->hash_mask;
+}
+
+static struct cache_chunk *cache_find(struct wm_cdda_cache *c, int key)
+{
+	struct cache_chunk *ch;
+
+	for (ch = c->hash[cache_hash(c, key)]; ch; ch = ch->hnext)
+		if (ch->key == key)
+			return ch;
+	return NULL;
+}
+
+static void cache_unlink(struct wm_cdda_cache *c, struct cache_chunk *ch)
+{
+	if (ch->prev)
+		ch->prev->next = ch->next;
+	else
+		c->head = ch->next;
+	if (ch->next)
+		ch->next->prev = ch->prev;
+	else
+		c->tail = ch->prev;
+}
+
+static void cache_push(struct wm_cdda_cache *c, struct cache_chunk *ch)
+{
+	ch->prev = NULL;
+	ch->next = c->head;
+	if (c->head)
+		c->head->prev = ch;
+	else
+		c->tail = ch;
+	c->head = ch;
+}
+
+static void cache_touch(struct wm_cdda_cache *c, struct cache_chunk *ch)
+{
+	if (c->head != ch) {
+		cache_unlink(c, ch);
+		cache_push(c, ch);
+	}
+}
+
+static void cache_unhash(struct wm_cdda_cache *c, struct cache_chunk *ch)
+{
+	struct cache_chunk **p = &c->hash[cache_hash(c, ch->key)];
+
+	while (*p != ch)
+		p = &(*p)->hnext;
+	*p = ch->hnext;
+}
+
+/*
+ * A chunk for key, a new one while the budget lasts, else the least
+ * recently used one.
+ */
+static struct cache_chunk *cache_get(struct wm_cdda_cache *c, int key, int *dropped)
+{
+	struct cache_chunk *ch = cache_find(c, key);
+
+	if (ch) {
+		cache_touch(c, ch);
+		return ch;
+	}
+
+	if (c->nchunks < c->max_chunks) {
+		if (!(ch = malloc(sizeof(struct cache_chunk))))
+			return NULL;
+		c->nchunks++;
+	} else {
+		ch = c->tail;
+		cache_unlink(c, ch);
+		cache_unhash(c, ch);
+		(*dropped)++;
+	}
+
+	ch->key = key;
+	ch->nvalid = 0;
+	memset(ch->valid, 0, sizeof(ch->valid));
+	ch->hnext = c->hash[cache_hash(c, key)];
+	c->hash[cache_hash(c, key)] = ch;
+	cache_push(c, ch);
+
+	return ch;
+}
+
+struct wm_cdda_cache *wm_cdda_cache_new(long bytes)
+{
+	struct wm_cdda_cache *c;
+	unsigned int size = 1;
+
+	if (bytes < CACHE_CHUNK_BYTES)
+		return NULL;
+
+	if (!(c = calloc(1, sizeof(struct wm_cdda_cache))))
+		return NULL;
+
+	c->max_chunks = bytes / CACHE_CHUNK_BYTES;
+	while (size < (unsigned int)c->max_chunks * 2)
+		size <<= 1;
+	c->hash_mask = size - 1;
+	if (!(c->hash = calloc(size, sizeof(struct cache_chunk *)))) {
+		free(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+void wm_cdda_cache_flush(struct wm_cdda_cache *c)
+{
+	struct cache_chunk *ch, *next;
+
+	if (!c)
+		return;
+
+	for (ch = c->head; ch; ch = next) {
+		next = ch->next;
+		free(ch);
+	}
+	c->head = c->tail = NULL;
+	c->nchunks = 0;
+	memset(c->hash, 0, (c->hash_mask + 1) * sizeof(struct cache_chunk *));
+}
+
+void wm_cdda_cache_free(struct wm_cdda_cache *c)
+{
+	if (!c)
+		return;
+
+	wm_cdda_cache_flush(c);
+	free(c->hash);
+	free(c);
+}
+
+int wm_cdda_cache_read(struct wm_cdda_cache *c, int frame, int nframes, void *buf)
+{
+	struct cache_chunk *ch;
+	unsigned char *out = buf;
+	int f, off, n;
+
+	/* all there? */
+	for (f = frame; f < frame + nframes; f += n) {
+		off = f % WM_CDDA_CACHE_CHUNK;
+		n = WM_CDDA_CACHE_CHUNK - off;
+		if (n > frame + nframes - f)
+			n = frame + nframes - f;
+		if (!(ch = cache_find(c, f / WM_CDDA_CACHE_CHUNK)))
+			return -1;
+		if (ch->nvalid < WM_CDDA_CACHE_CHUNK &&
+			memchr(ch->valid + off, 0, n))
+			return -1;
+	}
+
+	for (f = frame; f < frame + nframes; f += n) {
+		off = f % WM_CDDA_CACHE_CHUNK;
+		n = WM_CDDA_CACHE_CHUNK - off;
+		if (n > frame + nframes - f)
+			n = frame + nframes - f;
+		ch = cache_find(c, f / WM_CDDA_CACHE_CHUNK);
+		cache_touch(c, ch);
+		memcpy(out, ch->data + off * CACHE_FRAMESIZE, n * CACHE_FRAMESIZE);
+		out += n * CACHE_FRAMESIZE;
+	}
+
+	return 0;
+}
+
+int wm_cdda_cache_write(struct wm_cdda_cache *c, int frame, int nframes, const void *buf)
+{
+	struct cache_chunk *ch;
+	const unsigned char *in = buf;
+	int f, off, n, i, dropped = 0;
+
+	for (f = frame; f < frame + nframes; f += n) {
+		off = f % WM_CDDA_CACHE_CHUNK;
+		n = WM_CDDA_CACHE_CHUNK - off;
+		if (n > frame + nframes - f)
+			n = frame + nframes - f;
+		if (!(ch = cache_get(c, f / WM_CDDA_CACHE_CHUNK, &dropped)))
+			break;
+		memcpy(ch->data + off * CACHE_FRAMESIZE, in, n * CACHE_FRAMESIZE);
+		for (i = off; i < off + n; i++) {
+			if (!ch->valid[i]) {
+				ch->valid[i] = 1;
+				ch->nvalid++;
+			}
+		}
+		in += n * CACHE_FRAMESIZE;
+	}
+
+	return dropped;
+}
+
+int wm_cdda_cache_missing(struct wm_cdda_cache *c, int frame, int limit)
+{
+	struct cache_chunk *ch;
+	int f = frame;
+
+	while (f < limit) {
+		ch = cache_find(c, f / WM_CDDA_CACHE_CHUNK);
+		if (!ch || !ch->valid[f % WM_CDDA_CACHE_CHUNK])
+			return f;
+		cache_touch(c, ch);
+		if (ch->nvalid == WM_CDDA_CACHE_CHUNK)
+			f = (f / WM_CDDA_CACHE_CHUNK + 1) * WM_CDDA_CACHE_CHUNK;
+		else
+			f++;
+	}
+
+	return limit;
+}
+
+long wm_cdda_cache_bytes(struct wm_cdda_cache *c)
+{
+	return c ? (long)c->nchunks * CACHE_CHUNK_BYTES : 0;
+}
+
+long wm_cdda_cache_budget(struct wm_cdda_cache *c)
+{
+	return c ? (long)c->max_chunks * CACHE_CHUNK_BYTES : 0;
+}
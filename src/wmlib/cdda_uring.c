@@ -0,0 +1,550 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * io_uring CDDA engine.
+ *
+ * CDROMREADAUDIO is synchronous, so the drive idles while a block is
+ * handed to the player and the next ioctl is issued.  Here the reads go
+ * through the sg v3 write/read interface of the SCSI generic node instead:
+ * every READ CD is a linked pair of ring entries, write(2) of the sg_io_hdr
+ * followed by read(2) of its reply, and up to "depth" of them stay queued
+ * ahead of the current position.  Completions are reaped in batches.
+ *
+ * A disc image has no SCSI generic node, its frames are read from the
+ * image files with one ring entry each.  What isn't stored as played
+ * (gaps, data tracks, byte swapped files) still goes through the image
+ * backend, so one image compares both engines.
+ */
+
+#define _DEFAULT_SOURCE /* realpath */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_helpers.h"
+#include "include/wm_image.h"
+#include "include/wm_uring.h"
+
+#include <config-uring.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_PLATFORM
+
+int wm_uring_requested(void)
+{
+	const char *engine = getenv("KCOMPACTDISC_CDDA_ENGINE");
+
+	return engine && !strcmp(engine, "uring");
+}
+
+#if defined(__linux__) && defined(HAVE_LIBURING)
+
+#include <liburing.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/cdrom.h>
+#include <scsi/sg.h>
+
+#define URING_SENSE_LEN    32
+#define URING_BATCH        16
+#define URING_TIMEOUT_MS   10000
+
+/* user_data tags, stored in the low bits of the request pointer */
+#define URING_TAG_CMD      0
+#define URING_TAG_REPLY    1
+#define URING_TAG_IMAGE    2
+#define URING_TAG_MASK     3
+
+enum { SLOT_FREE, SLOT_BUSY, SLOT_DONE };
+
+struct uring_read {
+	int state;
+	int status;          /* WM_CDM_PLAYING on success */
+	int position;        /* first frame */
+	int nframes;
+	int error;
+	unsigned char cdb[12];
+	unsigned char sense[URING_SENSE_LEN];
+	struct sg_io_hdr cmd;    /* handed to write(2) */
+	struct sg_io_hdr reply;  /* filled by read(2) */
+	char *buf;
+};
+
+struct wm_uring {
+	struct io_uring ring;
+	int sg_fd;           /* -1 for an image */
+	int depth;
+	int head;            /* oldest read in flight */
+	int queued;          /* reads in flight */
+	int next_position;   /* frame the next queued read starts at */
+	int next_pack_id;
+	long buflen;
+	struct uring_read *reads;
+};
+
+static void *uring_tag(void *p, uintptr_t tag)
+{
+	return (void *)((uintptr_t)p | tag);
+}
+
+/*
+ * Find the SCSI generic node behind a block device, /dev/sr0 gives
+ * /sys/class/block/sr0/device/scsi_generic/sgN.  It is opened blocking,
+ * with O_NONBLOCK the read(2) of a reply not there yet fails with EAGAIN
+ * instead of waiting in the ring.
+ */
+static int uring_open_sg(const char *device)
+{
+	char path[PATH_MAX];
+	char *real, *name;
+	struct dirent *de;
+	DIR *dir;
+	int fd = -1;
+
+	real = realpath(device, NULL);
+	if (!real)
+		return -1;
+
+	name = strrchr(real, '/');
+	name = name ? name + 1 : real;
+	if (!strncmp(name, "sg", 2)) {
+		fd = open(real, O_RDWR);
+		free(real);
+		return fd;
+	}
+
+	snprintf(path, sizeof(path), "/sys/class/block/%s/device/scsi_generic", name);
+	free(real);
+
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "/dev/%s", de->d_name);
+		fd = open(path, O_RDWR);
+		break;
+	}
+	closedir(dir);
+
+	return fd;
+}
+
+static int uring_sense_status(const struct uring_read *r)
+{
+	int key, asc;
+
+	if ((r->sense[0] & 0x7f) >= 0x72) {
+		key = r->sense[1] & 0x0f;
+		asc = r->sense[2];
+	} else {
+		key = r->sense[2] & 0x0f;
+		asc = r->sense[12];
+	}
+
+	/* NOT READY, MEDIUM NOT PRESENT */
+	if (key == 0x02 && asc == 0x3a)
+		return WM_CDM_EJECTED;
+
+	return WM_CDM_CDDAERROR;
+}
+
+static void uring_complete(struct io_uring_cqe *cqe)
+{
+	uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+	struct uring_read *r;
+
+	switch (data & URING_TAG_MASK) {
+	case URING_TAG_CMD:
+		r = (struct uring_read *)data;
+		if (cqe->res < 0)
+			r->error = -cqe->res;
+		break;
+
+	case URING_TAG_REPLY:
+		/* a failed command cancels its reply, so this always comes last */
+		r = (struct uring_read *)(data & ~(uintptr_t)URING_TAG_MASK);
+		if (cqe->res < 0 && !r->error)
+			r->error = -cqe->res;
+
+		if (r->error == ENXIO || r->error == ENOMEDIUM)
+			r->status = WM_CDM_EJECTED;
+		else if (r->error)
+			r->status = WM_CDM_CDDAERROR;
+		else if ((r->reply.info & SG_INFO_OK_MASK) != SG_INFO_OK)
+			r->status = uring_sense_status(r);
+		else
+			r->status = WM_CDM_PLAYING;
+
+		r->state = SLOT_DONE;
+		break;
+
+	case URING_TAG_IMAGE:
+		r = (struct uring_read *)(data & ~(uintptr_t)URING_TAG_MASK);
+		if (cqe->res == r->nframes * CD_FRAMESIZE_RAW)
+			r->status = WM_CDM_PLAYING;
+		else
+			r->status = WM_CDM_CDDAERROR;
+
+		r->state = SLOT_DONE;
+		break;
+	}
+}
+
+/*
+ * Submit whatever is queued and process the available completions,
+ * waiting for at least one if wait is set.
+ */
+static int uring_reap(struct wm_uring *u, int wait)
+{
+	struct io_uring_cqe *cqes[URING_BATCH];
+	unsigned n, i;
+	int ret;
+
+	do {
+		ret = wait ? io_uring_submit_and_wait(&u->ring, 1)
+		           : io_uring_submit(&u->ring);
+	} while (ret == -EINTR);
+	if (ret < 0) {
+		ERRORLOG("cdda_uring: submit failed: %s\n", strerror(-ret));
+		return ret;
+	}
+
+	n = io_uring_peek_batch_cqe(&u->ring, cqes, URING_BATCH);
+	for (i = 0; i < n; i++)
+		uring_complete(cqes[i]);
+	io_uring_cq_advance(&u->ring, n);
+
+	return n;
+}
+
+/* a READ CD of n frames at next_position, as a linked write and read */
+static void uring_queue_sg(struct wm_uring *u, struct uring_read *r, int n)
+{
+	struct io_uring_sqe *sqe;
+	int lba = u->next_position - CD_MSF_OFFSET;
+
+	memset(r->cdb, 0, sizeof(r->cdb));
+	r->cdb[0] = 0xbe;        /* READ CD */
+	r->cdb[1] = 0x04;        /* expected sector type CD-DA */
+	r->cdb[2] = (lba >> 24) & 0xff;
+	r->cdb[3] = (lba >> 16) & 0xff;
+	r->cdb[4] = (lba >> 8) & 0xff;
+	r->cdb[5] = lba & 0xff;
+	r->cdb[6] = (n >> 16) & 0xff;
+	r->cdb[7] = (n >> 8) & 0xff;
+	r->cdb[8] = n & 0xff;
+	r->cdb[9] = 0x10;        /* user data only */
+
+	memset(&r->cmd, 0, sizeof(r->cmd));
+	r->cmd.interface_id = 'S';
+	r->cmd.dxfer_direction = SG_DXFER_FROM_DEV;
+	r->cmd.cmd_len = sizeof(r->cdb);
+	r->cmd.mx_sb_len = sizeof(r->sense);
+	r->cmd.dxfer_len = n * CD_FRAMESIZE_RAW;
+	r->cmd.dxferp = r->buf;
+	r->cmd.cmdp = r->cdb;
+	r->cmd.sbp = r->sense;
+	r->cmd.timeout = URING_TIMEOUT_MS;
+	r->cmd.pack_id = u->next_pack_id++;
+	r->cmd.usr_ptr = r;
+	/* with SG_SET_FORCE_PACK_ID the reply is picked by pack_id */
+	r->reply = r->cmd;
+
+	sqe = io_uring_get_sqe(&u->ring);
+	io_uring_prep_write(sqe, u->sg_fd, &r->cmd, sizeof(r->cmd), 0);
+	io_uring_sqe_set_data(sqe, uring_tag(r, URING_TAG_CMD));
+	sqe->flags |= IOSQE_IO_LINK;
+
+	sqe = io_uring_get_sqe(&u->ring);
+	io_uring_prep_read(sqe, u->sg_fd, &r->reply, sizeof(r->reply), 0);
+	io_uring_sqe_set_data(sqe, uring_tag(r, URING_TAG_REPLY));
+}
+
+/*
+ * A read of at most *n frames at next_position from the image file, 0
+ * if they aren't stored there as they are played.
+ */
+static int uring_queue_image(struct wm_uring *u, struct wm_drive *d,
+	struct uring_read *r, int *n)
+{
+	struct io_uring_sqe *sqe;
+	long long offset;
+	int fd, stored;
+
+	stored = wm_image_extent(d, u->next_position, &fd, &offset);
+	if (stored <= 0)
+		return 0;
+	if (*n > stored)
+		*n = stored;
+
+	sqe = io_uring_get_sqe(&u->ring);
+	io_uring_prep_read(sqe, fd, r->buf, *n * CD_FRAMESIZE_RAW, offset);
+	io_uring_sqe_set_data(sqe, uring_tag(r, URING_TAG_IMAGE));
+
+	return 1;
+}
+
+static int uring_queue_read(struct wm_uring *u, struct wm_drive *d)
+{
+	struct uring_read *r;
+	int n;
+
+	n = d->frames_at_once;
+	if (d->ending_position && u->next_position + n > d->ending_position)
+		n = d->ending_position - u->next_position;
+	if (n <= 0 || io_uring_sq_space_left(&u->ring) < 2)
+		return 0;
+
+	r = &u->reads[(u->head + u->queued) % u->depth];
+
+	if (u->sg_fd >= 0)
+		uring_queue_sg(u, r, n);
+	else if (!uring_queue_image(u, d, r, &n))
+		return 0;
+
+	r->state = SLOT_BUSY;
+	r->status = WM_CDM_UNKNOWN;
+	r->error = 0;
+	r->position = u->next_position;
+	r->nframes = n;
+
+	u->next_position += n;
+	u->queued++;
+
+	return 1;
+}
+
+/*
+ * Wait for and throw away all reads in flight.  SG commands can't be
+ * aborted, but none of them takes longer than a few sectors do.
+ */
+static void uring_drain(struct wm_uring *u)
+{
+	struct uring_read *r;
+
+	while (u->queued) {
+		r = &u->reads[u->head];
+		while (r->state != SLOT_DONE)
+			if (uring_reap(u, 1) < 0)
+				return;
+
+		r->state = SLOT_FREE;
+		u->head = (u->head + 1) % u->depth;
+		u->queued--;
+	}
+}
+
+/* the SCSI generic node of the drive, set up for the v3 interface */
+static int uring_setup_sg(struct wm_drive *d)
+{
+	int fd, version = 0, one = 1;
+
+	fd = uring_open_sg(d->cd_device);
+	if (fd < 0) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"cdda_uring: no SCSI generic node for %s\n", d->cd_device);
+		return -1;
+	}
+
+	if (ioctl(fd, SG_GET_VERSION_NUM, &version) < 0 || version < 30000 ||
+	    ioctl(fd, SG_SET_FORCE_PACK_ID, &one) < 0) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"cdda_uring: sg driver too old\n");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+struct wm_uring *wm_uring_open(struct wm_drive *d, int depth)
+{
+	struct wm_uring *u;
+	long long offset;
+	int fd, ret, i;
+
+	if (depth < 1)
+		depth = WM_URING_DEPTH;
+
+	u = calloc(1, sizeof(*u));
+	if (!u)
+		return NULL;
+
+	/* an image is read from its files, a drive through its sg node */
+	if (wm_image_extent(d, 0, &fd, &offset) >= 0) {
+		u->sg_fd = -1;
+	} else if ((u->sg_fd = uring_setup_sg(d)) < 0) {
+		free(u);
+		return NULL;
+	}
+
+	ret = io_uring_queue_init(2 * depth, &u->ring, 0);
+	if (ret < 0) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"cdda_uring: io_uring_queue_init: %s\n", strerror(-ret));
+		if (u->sg_fd >= 0)
+			close(u->sg_fd);
+		free(u);
+		return NULL;
+	}
+
+	u->depth = depth;
+	u->buflen = d->frames_at_once * CD_FRAMESIZE_RAW;
+	u->reads = calloc(depth, sizeof(*u->reads));
+	if (!u->reads)
+		goto nomem;
+
+	for (i = 0; i < depth; i++) {
+		u->reads[i].buf = malloc(u->buflen);
+		if (!u->reads[i].buf)
+			goto nomem;
+	}
+
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
+		"cdda_uring: reading %s with %i commands in flight\n", d->cd_device, depth);
+
+	return u;
+
+nomem:
+	ERRORLOG("cdda_uring: ENOMEM\n");
+	wm_uring_close(u);
+	return NULL;
+}
+
+void wm_uring_close(struct wm_uring *u)
+{
+	int i;
+
+	if (!u)
+		return;
+
+	if (u->reads) {
+		uring_drain(u);
+		for (i = 0; i < u->depth; i++)
+			free(u->reads[i].buf);
+		free(u->reads);
+	}
+
+	io_uring_queue_exit(&u->ring);
+	if (u->sg_fd >= 0)
+		close(u->sg_fd);
+	free(u);
+}
+
+int wm_uring_read(struct wm_uring *u, struct wm_drive *d, struct wm_cdda_block *block)
+{
+	struct uring_read *r;
+	char *buf;
+
+	/* Hit the end of the CD, probably. */
+	if (d->current_position >= d->ending_position) {
+		block->status = WM_CDM_TRACK_DONE;
+		return 0;
+	}
+
+	/* cdda_play() moved us, the reads ahead are of no use */
+	if (u->queued) {
+		r = &u->reads[u->head];
+		if (r->position != d->current_position ||
+		    r->position + r->nframes > d->ending_position)
+			uring_drain(u);
+	}
+	if (!u->queued)
+		u->next_position = d->current_position;
+
+	while (u->queued < u->depth && uring_queue_read(u, d))
+		;
+
+	/* nothing the ring can read here, a gap of an image, the backend reads it */
+	if (!u->queued)
+		return d->proto.cdda_read(d, block);
+
+	r = &u->reads[u->head];
+	while (r->state != SLOT_DONE) {
+		if (uring_reap(u, 1) < 0) {
+			block->status = WM_CDM_CDDAERROR;
+			return 0;
+		}
+	}
+
+	r->state = SLOT_FREE;
+	u->head = (u->head + 1) % u->depth;
+	u->queued--;
+
+	if (r->status != WM_CDM_PLAYING) {
+		block->status = r->status;
+		uring_drain(u);
+		return 0;
+	}
+
+	/* hand over the filled buffer, both come from frames_at_once sized allocations */
+	buf = block->buf;
+	block->buf = r->buf;
+	r->buf = buf;
+
+	block->track =  -1;
+	block->index =  0;
+	block->frame  = r->position;
+	block->status = WM_CDM_PLAYING;
+	block->buflen = r->nframes * CD_FRAMESIZE_RAW;
+
+	d->current_position = r->position + r->nframes;
+
+	/* keep the drive busy while the caller deals with this block */
+	if (uring_queue_read(u, d))
+		uring_reap(u, 0);
+
+	return block->buflen;
+}
+
+#else /* __linux__ && HAVE_LIBURING */
+
+struct wm_uring *wm_uring_open(struct wm_drive *d, int depth)
+{
+	(void)d;
+	(void)depth;
+	wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+		"cdda_uring: built without io_uring support\n");
+	return NULL;
+}
+
+void wm_uring_close(struct wm_uring *u)
+{
+	(void)u;
+}
+
+int wm_uring_read(struct wm_uring *u, struct wm_drive *d, struct wm_cdda_block *block)
+{
+	(void)u;
+	(void)d;
+	(void)block;
+	return -1;
+}
+
+#endif /* __linux__ && HAVE_LIBURING */
@@ -45,6 +45,8 @@
 #include "include/wm_helpers.h"
 #include "include/wm_cddb.h"
 #include "include/wm_cdrom.h"
+#include "include/wm_stats.h"
+#include "include/wm_trace.h"
 
 /*
  * Subroutine from cddb_discid
@@ -69,18 +71,28 @@ static int cddb_sum(int n)
  */
 unsigned long cddb_discid(struct wm_drive *pdrive)
 {
-	int	i,
-		t,
-		n = 0, tracks;
+	unsigned long discid;
+	long long start = wm_monotonic_nsec();
 
-    tracks = wm_cd_getcountoftracks(pdrive);
-	if(!tracks)
+	if(!wm_cd_getcountoftracks(pdrive) || !pdrive->thiscd.trk)
 		return (unsigned)-1;
 
+	discid = cddb_discid_toc(pdrive->thiscd.ntracks, pdrive->thiscd.trk);
+	wm_stats_time(pdrive->stats, WM_STATS_HIST_METADATA, start);
+	WM_TRACE_SPAN("discid", start, 0);
+	return discid;
+} /* cddb_discid() */
+
+unsigned long cddb_discid_toc(int tracks, const struct wm_trackinfo *trk)
+{
+	int	i,
+		t,
+		n = 0;
+
 	/* For backward compatibility this algorithm must not change */
 	for (i = 0; i < tracks; i++) {
 
-		n += cddb_sum(wm_cd_gettrackstart(pdrive, i + 1));
+		n += cddb_sum(trk[i].start);
 	/*
 	 * Just for demonstration (See below)
 	 *
@@ -100,7 +112,7 @@ unsigned long cddb_discid(struct wm_drive *pdrive)
          * fields.
          */
 
-        t = (wm_cd_gettrackstart(pdrive, tracks + 1)) - (wm_cd_gettrackstart(pdrive, 1));
+        t = trk[tracks].start - trk[0].start;
 	return ((n % 0xff) << 24 | t << 8 | tracks);
-} /* cddb_discid() */
+} /* cddb_discid_toc() */
 
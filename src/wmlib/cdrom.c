@@ -31,10 +31,17 @@
 #include "include/wm_struct.h"
 #include "include/wm_cddb.h"
 #include "include/wm_cdrom.h"
+#include "include/wm_changer.h"
 #include "include/wm_platform.h"
 #include "include/wm_helpers.h"
 #include "include/wm_cdtext.h"
+#include "include/wm_image.h"
+#include "include/wm_fault.h"
+#include "include/wm_stats.h"
+#include "include/wm_sched.h"
+#include "include/wm_trace.h"
 #include "include/wm_scsi.h"
+#include "include/wm_subq.h"
 
 #include <errno.h>
 #include <stdio.h>
@@ -112,6 +119,62 @@ int wm_get_cur_pos_abs(void *p)
 	return pdrive->thiscd.cur_pos_abs;
 }
 
+/*
+ * Set up the hooks for pdrive->cd_device, a drive or a disc image, and
+ * open it.
+ */
+static int drive_attach(struct wm_drive *pdrive)
+{
+	const char *env;
+	int err;
+
+	pdrive->fd = -1;
+
+	pdrive->proto.open = gen_open;
+	pdrive->proto.close = gen_close;
+	pdrive->proto.get_trackcount = gen_get_trackcount;
+	pdrive->proto.get_cdlen = gen_get_cdlen;
+	pdrive->proto.get_trackinfo = gen_get_trackinfo;
+	pdrive->proto.get_trackcontrol = NULL;
+	pdrive->proto.get_drive_status = gen_get_drive_status;
+	pdrive->proto.pause = gen_pause;
+	pdrive->proto.resume = gen_resume;
+	pdrive->proto.stop = gen_stop;
+	pdrive->proto.play = gen_play;
+	pdrive->proto.eject = gen_eject;
+	pdrive->proto.closetray = gen_closetray;
+	pdrive->proto.scsi = gen_scsi;
+	pdrive->proto.set_volume = gen_set_volume;
+	pdrive->proto.get_volume = gen_get_volume;
+	pdrive->proto.scale_volume = gen_scale_volume;
+	pdrive->proto.unscale_volume = gen_unscale_volume;
+#ifdef WMLIB_CDDA_BUILD
+	pdrive->proto.cdda_init = gen_cdda_init;
+	pdrive->proto.cdda_open = gen_cdda_open;
+	pdrive->proto.cdda_read = gen_cdda_read;
+	pdrive->proto.cdda_close = gen_cdda_close;
+#else
+	pdrive->proto.cdda_init = NULL;
+	pdrive->proto.cdda_open = NULL;
+	pdrive->proto.cdda_read = NULL;
+	pdrive->proto.cdda_close = NULL;
+#endif
+	/* a plain drive unless gen_init() knows better */
+	pdrive->proto.get_slots = NULL;
+	pdrive->proto.get_slot_status = NULL;
+	pdrive->proto.select_slot = NULL;
+
+	if (wm_image_probe(pdrive->cd_device))
+		wm_image_setup(pdrive);
+	else if((err = gen_init(pdrive)) < 0)
+		return err;
+
+	if ((env = getenv("KCOMPACTDISC_FAULTS")) && *env)
+		wm_cd_fault_config(pdrive, env);
+
+	return pdrive->proto.open(pdrive);
+}
+
 /*
  * init the workmanlib
  */
@@ -120,10 +183,15 @@ int wm_cd_init(const char *cd_device, const char *soundsystem,
 {
 	int err;
 	struct wm_drive *pdrive;
+	const char *env;
+	long long start = wm_monotonic_nsec();
 
 	if(!ppdrive)
 		return -1;
 
+	if ((env = getenv("KCOMPACTDISC_TRACE")) && *env && !wm_trace_on)
+		wm_trace_start();
+
 	pdrive = *ppdrive = (struct wm_drive *)malloc(sizeof(struct wm_drive));
 	if(!pdrive)
 		return -1;
@@ -139,50 +207,32 @@ int wm_cd_init(const char *cd_device, const char *soundsystem,
 		err = -ENOMEM;
 		goto init_failed;
 	}
-	pdrive->fd = -1;
-
-	pdrive->proto.open = gen_open;
-	pdrive->proto.close = gen_close;
-	pdrive->proto.get_trackcount = gen_get_trackcount;
-	pdrive->proto.get_cdlen = gen_get_cdlen;
-	pdrive->proto.get_trackinfo = gen_get_trackinfo;
-	pdrive->proto.get_drive_status = gen_get_drive_status;
-	pdrive->proto.pause = gen_pause;
-	pdrive->proto.resume = gen_resume;
-	pdrive->proto.stop = gen_stop;
-	pdrive->proto.play = gen_play;
-	pdrive->proto.eject = gen_eject;
-	pdrive->proto.closetray = gen_closetray;
-	pdrive->proto.scsi = gen_scsi;
-	pdrive->proto.set_volume = gen_set_volume;
-	pdrive->proto.get_volume = gen_get_volume;
-	pdrive->proto.scale_volume = gen_scale_volume;
-	pdrive->proto.unscale_volume = gen_unscale_volume;
+	pdrive->stats = wm_stats_new();
+	pdrive->sched = wm_sched_new();
 	pdrive->oldmode = WM_CDM_UNKNOWN;
 
-	if((err = gen_init(pdrive)) < 0)
-		goto init_failed;
+	if ((err = drive_attach(pdrive)) < 0)
+		goto open_failed;
+	wm_changer_probe(pdrive);
 
-	if ((err = pdrive->proto.open(pdrive)) < 0)
+	/* the drive type is probed on demand, see probe_drive() */
+	if(pdrive->cdda && pdrive->proto.cdda_read && (err = wm_cdda_init(pdrive)))
 		goto open_failed;
 
-	/* Can we figure out the drive type? */
-	if (wm_scsi_get_drive_type(pdrive)) {
-		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "plat_open(): inquiry failed\n");
-	}
+	err = wm_cd_status(pdrive);
+	wm_stats_add(pdrive->stats, WM_STATS_INIT_USEC, (wm_monotonic_nsec() - start) / 1000);
+	WM_TRACE_SPAN("init", start, err);
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS, "init: status after %lld usec\n",
+		(wm_monotonic_nsec() - start) / 1000);
 
-	/* let it override some functions */
-	fixup_drive_struct(pdrive);
-#ifdef WMLIB_CDDA_BUILD
-	if(pdrive->cdda && (err = wm_cdda_init(pdrive)))
-		goto open_failed;
-#endif
-	return wm_cd_status(pdrive);
+	return err;
 
 open_failed:
 	wm_cd_destroy(pdrive);
 
 init_failed:
+	wm_stats_free(pdrive->stats);
+	wm_sched_free(pdrive->sched);
 	free(pdrive->cd_device);
 	free(pdrive->soundsystem);
 	free(pdrive->sounddevice);
@@ -195,33 +245,145 @@ init_failed:
 int wm_cd_destroy(void *p)
 {
 	struct wm_drive *pdrive = (struct wm_drive *)p;
+	const char *env;
+
 	free_cdtext();
 
 	if(pdrive->cdda)
 		wm_cdda_destroy(pdrive);
 
+	wm_changer_free(pdrive);
+	wm_subq_free(pdrive);
 	pdrive->proto.close(pdrive);
+	wm_fault_destroy(pdrive);
+	wm_stats_free(pdrive->stats);
+	pdrive->stats = NULL;
+	wm_sched_free(pdrive->sched);
+	pdrive->sched = NULL;
+
+	if ((env = getenv("KCOMPACTDISC_TRACE")) && *env)
+		wm_trace_export(env);
 
 	return 0;
 }
+
+/*
+ * Close the current drive and open cd_device in its place.  Playback
+ * stops, but a running CDDA sink and its threads carry on with the new
+ * drive, only the drive specific state is set up again.  Fault settings
+ * other than KCOMPACTDISC_FAULTS do not survive the switch.
+ */
+int wm_cd_switch_device(void *p, const char *cd_device)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	long long start = wm_monotonic_nsec();
+	char *dev;
+	int err;
+
+	if (!pdrive)
+		return -1;
+
+	dev = strdup(cd_device ? cd_device : DEFAULT_CD_DEVICE);
+	if (!dev)
+		return -ENOMEM;
+
+	if (pdrive->cddax)
+		wm_cdda_detach(pdrive);
+	else if (pdrive->thiscd.cur_cdmode == WM_CDM_PLAYING ||
+		pdrive->thiscd.cur_cdmode == WM_CDM_PAUSED)
+		pdrive->proto.stop(pdrive);
+
+	free_cdtext();
+	wm_changer_free(pdrive);
+	wm_subq_free(pdrive);
+	pdrive->proto.close(pdrive);
+	wm_fault_destroy(pdrive);
+
+	free(pdrive->thiscd.trk);
+	memset(&pdrive->thiscd, 0, sizeof(pdrive->thiscd));
+	pdrive->cur_cdmode = 0;
+	pdrive->oldmode = WM_CDM_UNKNOWN;
+	memset(pdrive->vendor, 0, sizeof(pdrive->vendor));
+	memset(pdrive->model, 0, sizeof(pdrive->model));
+	memset(pdrive->revision, 0, sizeof(pdrive->revision));
+	pdrive->probed = 0;
+	pdrive->aux = pdrive->daux = NULL;
+
+	free(pdrive->cd_device);
+	pdrive->cd_device = dev;
+	wm_sched_invalidate(pdrive);
+
+	if ((err = drive_attach(pdrive)) < 0) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"switch: cannot open %s\n", pdrive->cd_device);
+		/* nothing to read from, don't keep the sink waiting */
+		wm_cdda_destroy(pdrive);
+		return err;
+	}
+	wm_changer_probe(pdrive);
+
+	/* back to CDDA if an earlier switch failed */
+	if (pdrive->cddax)
+		wm_cdda_attach(pdrive);
+	else if (pdrive->cdda && pdrive->proto.cdda_read)
+		wm_cdda_init(pdrive);
+
+	err = wm_cd_status(pdrive);
+	wm_stats_add(pdrive->stats, WM_STATS_SWITCHES, 1);
+	wm_stats_add(pdrive->stats, WM_STATS_SWITCH_USEC, (wm_monotonic_nsec() - start) / 1000);
+	WM_TRACE_SPAN("switch", start, err);
+
+	return err;
+}
+/*
+ * The INQUIRY is only needed for the drive name and the fixups of a few
+ * old drives, so it waits until one of them is needed.
+ */
+static void probe_drive(struct wm_drive *d)
+{
+	struct wm_drive_proto before;
+
+	if (d->probed)
+		return;
+	d->probed = 1;
+
+	/* Can we figure out the drive type? */
+	if (wm_scsi_get_drive_type(d)) {
+		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "plat_open(): inquiry failed\n");
+	}
+
+	/* let it override some functions, the CDDA volume stays though */
+	before = d->proto;
+	fixup_drive_struct(d);
+	if (d->cddax) {
+		d->proto.set_volume = before.set_volume;
+		d->proto.get_volume = before.get_volume;
+		d->proto.scale_volume = before.scale_volume;
+		d->proto.unscale_volume = before.unscale_volume;
+	}
+}
+
 /*
- * Give information about the drive we found during wmcd_open()
+ * Give information about the drive, probed on first use
  */
 const char *wm_drive_vendor(void *p)
 {
 	struct wm_drive *pdrive = (struct wm_drive *)p;
+	probe_drive(pdrive);
   	return pdrive->vendor?pdrive->vendor:"";
 }
 
 const char *wm_drive_model(void *p)
 {
 	struct wm_drive *pdrive = (struct wm_drive *)p;
+	probe_drive(pdrive);
 	return pdrive->model?pdrive->model:"";
 }
 
 const char *wm_drive_revision(void *p)
 {
 	struct wm_drive *pdrive = (struct wm_drive *)p;
+	probe_drive(pdrive);
 	return pdrive->revision?pdrive->revision:"";
 }
 
@@ -262,71 +424,97 @@ fail:
 } /* find_drive_struct() */
 
 /*
- * read_toc()
+ * wm_read_toc()
  *
- * Read the table of contents from the CD.  Return a pointer to a wm_cdinfo
- * struct containing the relevant information (minus artist/cdname/etc.)
- * This is a static struct.  Returns NULL if there was an error.
+ * Read the table of contents from the CD into a wm_cdinfo struct, the
+ * one of the drive or, for a changer slot, another one.  Returns -1 if
+ * there was an error.
  *
  * XXX allocates one trackinfo too many.
  */
-static int read_toc(struct wm_drive *pdrive)
+int wm_read_toc(struct wm_drive *pdrive, struct wm_cdinfo *cd)
 {
 	int    i;
 	int    pos;
+	int    control;
+	long long start = wm_monotonic_nsec();
 
 	if(!pdrive->proto.get_trackcount ||
-		pdrive->proto.get_trackcount(pdrive, &pdrive->thiscd.ntracks) < 0) {
+		pdrive->proto.get_trackcount(pdrive, &cd->ntracks) < 0) {
 		return -1 ;
 	}
 
-	pdrive->thiscd.length = 0;
-	pdrive->thiscd.cur_cdmode = WM_CDM_UNKNOWN;
-	pdrive->thiscd.cd_cur_balance = WM_BALANCE_SYMMETRED;
+	cd->length = 0;
+	cd->cur_cdmode = WM_CDM_UNKNOWN;
+	cd->cd_cur_balance = WM_BALANCE_SYMMETRED;
 
-	if (pdrive->thiscd.trk != NULL)
-		free(pdrive->thiscd.trk);
+	if (cd->trk != NULL)
+		free(cd->trk);
 
-	pdrive->thiscd.trk = malloc((pdrive->thiscd.ntracks + 1) * sizeof(struct wm_trackinfo));
-	if (pdrive->thiscd.trk == NULL) {
+	cd->trk = malloc((cd->ntracks + 1) * sizeof(struct wm_trackinfo));
+	if (cd->trk == NULL) {
 		perror("malloc");
 		return -1;
 	}
 
-	for (i = 0; i < pdrive->thiscd.ntracks; i++) {
+	for (i = 0; i < cd->ntracks; i++) {
 		if(!pdrive->proto.get_trackinfo ||
-			pdrive->proto.get_trackinfo(pdrive, i + 1, &pdrive->thiscd.trk[i].data,
-			&pdrive->thiscd.trk[i].start) < 0) {
+			pdrive->proto.get_trackinfo(pdrive, i + 1, &cd->trk[i].data,
+			&cd->trk[i].start) < 0) {
 			return -1;
 		}
+		/* else the subchannel scan may tell, see wm_cd_scan_subq() */
+		cd->trk[i].preemphasis = !cd->trk[i].data && pdrive->proto.get_trackcontrol &&
+			!pdrive->proto.get_trackcontrol(pdrive, i + 1, &control) &&
+			(control & WM_SUBQ_PREEMPHASIS);
 
-		pdrive->thiscd.trk[i].length = pdrive->thiscd.trk[i].start / 75;
+		cd->trk[i].length = cd->trk[i].start / 75;
 
-		pdrive->thiscd.trk[i].track = i + 1;
+		cd->trk[i].track = i + 1;
 		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "track %i, start frame %i\n",
-			pdrive->thiscd.trk[i].track, pdrive->thiscd.trk[i].start);
+			cd->trk[i].track, cd->trk[i].start);
 	}
 
 	if(!pdrive->proto.get_cdlen ||
-		pdrive->proto.get_cdlen(pdrive, &pdrive->thiscd.trk[i].start) < 0) {
+		pdrive->proto.get_cdlen(pdrive, &cd->trk[i].start) < 0) {
 		return -1;
 	}
-	pdrive->thiscd.trk[i].length = pdrive->thiscd.trk[i].start / 75;
+	cd->trk[i].preemphasis = 0;
+	cd->trk[i].length = cd->trk[i].start / 75;
 
 	/* Now compute actual track lengths. */
-	pos = pdrive->thiscd.trk[0].length;
-	for (i = 0; i < pdrive->thiscd.ntracks; i++) {
-		pdrive->thiscd.trk[i].length = pdrive->thiscd.trk[i+1].length - pos;
-		pos = pdrive->thiscd.trk[i+1].length;
-		if (pdrive->thiscd.trk[i].data)
-			pdrive->thiscd.trk[i].length = (pdrive->thiscd.trk[i + 1].start - pdrive->thiscd.trk[i].start) * 2;
+	pos = cd->trk[0].length;
+	for (i = 0; i < cd->ntracks; i++) {
+		cd->trk[i].length = cd->trk[i+1].length - pos;
+		pos = cd->trk[i+1].length;
+		if (cd->trk[i].data)
+			cd->trk[i].length = (cd->trk[i + 1].start - cd->trk[i].start) * 2;
 	}
 
-	pdrive->thiscd.length = pdrive->thiscd.trk[pdrive->thiscd.ntracks].length;
+	cd->length = cd->trk[cd->ntracks].length;
 
+	wm_stats_time(pdrive->stats, WM_STATS_HIST_METADATA, start);
+	WM_TRACE_SPAN("read_toc", start, cd->ntracks);
 	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "read_toc() successful\n");
 	return 0;
-} /* read_toc() */
+} /* wm_read_toc() */
+
+static int read_toc(struct wm_drive *pdrive)
+{
+	return wm_read_toc(pdrive, &pdrive->thiscd);
+}
+
+/*
+ * wm_cd_read_toc(pdrive)
+ *
+ * Re-read the table of contents, normally done by wm_cd_status() when a
+ * disc shows up.
+ */
+int wm_cd_read_toc(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	return read_toc(pdrive);
+}
 
 /*
  * wm_cd_status(pdrive)
@@ -340,9 +528,10 @@ int wm_cd_status(void *p)
 {
 	struct wm_drive *pdrive = (struct wm_drive *)p;
 	int mode = -1, tmp;
+	long long start = wm_monotonic_nsec();
 
 	if(!pdrive->proto.get_drive_status ||
-		(tmp = pdrive->proto.get_drive_status(pdrive, pdrive->oldmode, &mode,
+		(tmp = wm_sched_drive_status(pdrive, pdrive->oldmode, &mode,
 		&pdrive->thiscd.cur_frame,
 		&pdrive->thiscd.curtrack,
 		&pdrive->thiscd.cur_index)) < 0) {
@@ -357,12 +546,18 @@ int wm_cd_status(void *p)
 	if(WM_CDS_NO_DISC(pdrive->oldmode) && WM_CDS_DISC_READY(mode)) {
 		/* device changed */
 		pdrive->thiscd.ntracks = 0;
+		wm_subq_free(pdrive);
 
-		if(read_toc(pdrive) || 0 == pdrive->thiscd.ntracks) {
+		if(!wm_changer_restore(pdrive)) {
+			/* a changer slot seen before */
+			get_glob_cdtext(pdrive, 1);
+		} else if(read_toc(pdrive) || 0 == pdrive->thiscd.ntracks) {
 
 			mode = WM_CDM_NO_DISC;
-		} else /* refresh cdtext info */
+		} else { /* refresh cdtext info */
+			wm_changer_remember(pdrive);
 			get_glob_cdtext(pdrive, 1);
+		}
 
 		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
 			"device status changed() from %s to %s\n",
@@ -428,6 +623,9 @@ int wm_cd_status(void *p)
 	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
 		"wm_cd_status returns %s\n", gen_status(pdrive->thiscd.cur_cdmode));
 
+	wm_stats_time(pdrive->stats, WM_STATS_HIST_STATUS, start);
+	WM_TRACE_SPAN("status", start, pdrive->status);
+
 	return pdrive->thiscd.cur_cdmode;
 }
 
@@ -490,6 +688,16 @@ int wm_cd_gettrackdata(void *p, int track)
   return pdrive->thiscd.trk[CARRAY(track)].data;
 }
 
+int wm_cd_gettrackpreemphasis(void *p, int track)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+
+	if (track < 1 || track > pdrive->thiscd.ntracks || !pdrive->thiscd.trk)
+		return 0;
+
+	return pdrive->thiscd.trk[CARRAY(track)].preemphasis;
+}
+
 /*
  * wm_cd_play(starttrack, pos, endtrack)
  *
@@ -539,11 +747,13 @@ int wm_cd_play(void *p, int start, int pos, int end)
 		return -1;
 	}
 
+	/*
+	 * The end frame isn't played, by PLAY AUDIO MSF nor by the CDDA
+	 * reader, so the leadout itself ends the last track.
+	 */
 	play_start = pdrive->thiscd.trk[CARRAY(start)].start + pos * 75;
-	play_end = (end == pdrive->thiscd.ntracks) ? pdrive->thiscd.length * 75 :
-		pdrive->thiscd.trk[CARRAY(end)].start - 1;
-
-	--play_end;
+	play_end = (end == pdrive->thiscd.ntracks) ? pdrive->thiscd.trk[end].start :
+		pdrive->thiscd.trk[CARRAY(end)].start;
 
 	if (play_start >= play_end)
 		play_start = play_end-1;
@@ -552,6 +762,7 @@ int wm_cd_play(void *p, int start, int pos, int end)
 		pdrive->proto.play(pdrive, play_start, play_end);
 	else
 		return -1;
+	wm_sched_invalidate(pdrive);
 
 		/* So we don't update the display with the old frame number */
 	wm_cd_status(pdrive);
@@ -569,7 +780,7 @@ int wm_cd_pause(void *p)
 {
 	struct wm_drive *pdrive = (struct wm_drive *)p;
 	static int paused_pos;
-	int status;
+	int status, err = -1;
 
 	status = wm_cd_status(pdrive);
 	if(WM_CDS_NO_DISC(status))
@@ -578,15 +789,16 @@ int wm_cd_pause(void *p)
 	if(WM_CDM_PLAYING == pdrive->thiscd.cur_cdmode) {
 		paused_pos = pdrive->thiscd.cur_pos_rel;
 		if(pdrive->proto.pause)
-			return pdrive->proto.pause(pdrive);
+			err = pdrive->proto.pause(pdrive);
 	} else if(WM_CDM_PAUSED == status) {
 		if(pdrive->proto.resume)
-			return pdrive->proto.resume(pdrive);
+			err = pdrive->proto.resume(pdrive);
 		else if(pdrive->proto.play)
-			return pdrive->proto.play(pdrive, pdrive->thiscd.cur_pos_rel, -1);
+			err = pdrive->proto.play(pdrive, pdrive->thiscd.cur_pos_rel, -1);
 	}
+	wm_sched_invalidate(pdrive);
 
-	return -1;
+	return err;
 } /* wm_cd_pause() */
 
 /*
@@ -607,6 +819,7 @@ int wm_cd_stop(void *p)
 
 		if(pdrive->proto.stop)
 			pdrive->proto.stop(pdrive);
+		wm_sched_invalidate(pdrive);
 
 		status = wm_cd_status(pdrive);
 	}
@@ -625,8 +838,10 @@ int wm_cd_eject(void *p)
 	struct wm_drive *pdrive = (struct wm_drive *)p;
 	int err = -1;
 
+	probe_drive(pdrive);
 	if(pdrive->proto.eject)
 		err = pdrive->proto.eject(pdrive);
+	wm_sched_invalidate(pdrive);
 
 	if (err < 0) {
 		if (err == -3) {
@@ -663,6 +878,7 @@ int wm_cd_closetray(void *p)
 #else
 	err = 0;
 #endif
+	wm_sched_invalidate(pdrive);
 
 	return (err ? 0 : ((wm_cd_status(pdrive) == 2) ? 1 : 0));
 } /* wm_cd_closetray() */
@@ -697,6 +913,7 @@ int wm_cd_volume(void *p, int vol, int bal)
 	int left, right;
 	const int bal1 = (vol - WM_VOLUME_MUTE)/(WM_BALANCE_ALL_RIGHTS - WM_BALANCE_SYMMETRED);
 
+	probe_drive(pdrive);
 /*
  * Set "left" and "right" to volume-slider values accounting for the
  * balance setting.
@@ -735,6 +952,7 @@ int wm_cd_getvolume(void *p)
 	struct wm_drive *pdrive = (struct wm_drive *)p;
 	int left, right;
 
+	probe_drive(pdrive);
 	if(!pdrive->proto.get_volume ||
 		pdrive->proto.get_volume(pdrive, &left, &right) < 0 || left == -1)
 		return -1;
@@ -763,6 +981,7 @@ int wm_cd_getbalance(void *p)
 	struct wm_drive *pdrive = (struct wm_drive *)p;
 	int left, right;
 
+	probe_drive(pdrive);
 	if(!pdrive->proto.get_volume ||
 		pdrive->proto.get_volume(pdrive, &left, &right) < 0 || left == -1)
 		return WM_BALANCE_SYMMETRED;
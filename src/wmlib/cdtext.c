@@ -32,6 +32,8 @@
 #include "include/wm_helpers.h"
 #include "include/wm_cdtext.h"
 #include "include/wm_scsi.h"
+#include "include/wm_stats.h"
+#include "include/wm_trace.h"
 
 #define WM_MSG_CLASS WM_MSG_CLASS_MISC
 
@@ -84,6 +86,7 @@ int free_cdtext_info(struct cdtext_info* cdtextinfo)
       if(cdtextinfo->blocks[i])
       {
         free_cdtext_info_block(cdtextinfo->blocks[i]);
+        free(cdtextinfo->blocks[i]);
       }
     }
     memset(cdtextinfo, 0, sizeof(struct cdtext_info));
@@ -221,6 +224,7 @@ struct cdtext_info *get_glob_cdtext(struct wm_drive *d, int redo)
   struct cdtext_pack_data_header *pack, *pack_previous;
   cdtext_string *p_componente;
   struct cdtext_info_block *lp_block;
+  long long start;
 
   if(!redo && wm_cdtext_info.valid) {
     wm_lib_message(WM_MSG_LEVEL_DEBUG | WM_MSG_CLASS, "CDTEXT DEBUG: recycle cdtext\n");
@@ -233,6 +237,7 @@ struct cdtext_info *get_glob_cdtext(struct wm_drive *d, int redo)
   p_componente = 0;
   buffer = 0;
   buffer_length = 0;
+  start = wm_monotonic_nsec();
 
   ret = wm_scsi_get_cdtext(d, &buffer, &buffer_length);
   if(!ret)
@@ -293,6 +298,7 @@ struct cdtext_info *get_glob_cdtext(struct wm_drive *d, int redo)
           if(MAX_LANGUAGE_BLOCKS <= j)
           {
             free_cdtext_info(&wm_cdtext_info);
+            free(buffer);
             wm_lib_message(WM_MSG_LEVEL_ERROR | WM_MSG_CLASS,
               "CDTEXT ERROR: more as 8 languageblocks defined\n");
             return NULL;
@@ -307,6 +313,7 @@ struct cdtext_info *get_glob_cdtext(struct wm_drive *d, int redo)
               wm_lib_message(WM_MSG_LEVEL_ERROR | WM_MSG_CLASS,
                 "CDTEXT ERROR: out of memory, cannot create a new language block\n");
               free_cdtext_info(&wm_cdtext_info);
+              free(buffer);
               return NULL /*ENOMEM*/;
             }
             else
@@ -411,11 +418,15 @@ struct cdtext_info *get_glob_cdtext(struct wm_drive *d, int redo)
       }
       i += sizeof(struct cdtext_pack_data_header);
     } /* while */
+
+    free(buffer);
   }
 
   if(0 == ret && wm_cdtext_info.count_of_valid_packs > 0)
     wm_cdtext_info.valid = 1;
 
+  wm_stats_time(d->stats, WM_STATS_HIST_METADATA, start);
+  WM_TRACE_SPAN("cdtext", start, 0);
   return &wm_cdtext_info;
 }
 
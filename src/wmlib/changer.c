@@ -0,0 +1,477 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Changer slots, see wm_changer.h.
+ *
+ * The slot table is under the lock of the changer.  The scan loads
+ * another slot only while it holds the drive in the scheduler, and
+ * loads the selected slot again before it lets go, so everybody else
+ * finds the disc they expect.  It does so one slot at a time in the
+ * lowest class, and not at all while the disc plays.
+ */
+
+#define _DEFAULT_SOURCE /* clock_gettime */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_cdrom.h"
+#include "include/wm_cddb.h"
+#include "include/wm_changer.h"
+#include "include/wm_helpers.h"
+#include "include/wm_sched.h"
+#include "include/wm_stats.h"
+#include "include/wm_trace.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_MISC
+
+/* how often the scan looks whether the disc stopped playing, in sec */
+#define CHANGER_IDLE_POLL 1
+
+struct changer_slot {
+	int tracks;			/* -1 not looked at yet, 0 empty */
+	unsigned long discid;
+	struct wm_trackinfo *trk;	/* tracks + 1, the last the lead-out */
+	int length;			/* seconds */
+};
+
+struct wm_changer {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		/* stop or rescan */
+	int nslots;
+	int current;
+	unsigned serial;
+	struct changer_slot *slots;
+
+	pthread_t thread;
+	int scanning;			/* the thread works on the slots */
+	int joinable;			/* ... or did and wasn't joined yet */
+	int stop;
+};
+
+static void slot_forget(struct changer_slot *s)
+{
+	free(s->trk);
+	s->trk = NULL;
+	s->tracks = -1;
+	s->discid = 0;
+	s->length = 0;
+}
+
+/* called with c->lock held, trk is taken over */
+static void slot_set(struct wm_changer *c, int slot, int tracks,
+	struct wm_trackinfo *trk, int length)
+{
+	struct changer_slot *s = &c->slots[slot];
+
+	free(s->trk);
+	s->tracks = tracks;
+	s->trk = trk;
+	s->length = length;
+	s->discid = tracks > 0 ? cddb_discid_toc(tracks, trk) : 0;
+	c->serial++;
+}
+
+static struct wm_trackinfo *toc_copy(const struct wm_trackinfo *trk, int tracks)
+{
+	struct wm_trackinfo *copy = malloc((tracks + 1) * sizeof(*copy));
+
+	if (copy)
+		memcpy(copy, trk, (tracks + 1) * sizeof(*copy));
+	return copy;
+}
+
+/* loading another slot would end the playback */
+static int drive_busy(struct wm_drive *d)
+{
+	int mode = *(volatile int *)&d->thiscd.cur_cdmode;
+
+	return mode == WM_CDM_PLAYING || mode == WM_CDM_PAUSED ||
+		mode == WM_CDM_FORWARD || mode == WM_CDM_TRACK_DONE;
+}
+
+/*
+ * Read the TOC of slot into cd, with the drive held.  Any other slot
+ * than home is loaded for it, and home again afterwards.  Returns the
+ * number of tracks, 0 for an empty or unreadable slot.
+ */
+static int changer_read_slot(struct wm_drive *d, int slot, int home, struct wm_cdinfo *cd)
+{
+	int changed, tracks = 0;
+
+	if (d->proto.get_slot_status(d, slot, &changed) != WM_CDM_STOPPED)
+		return 0;
+
+	if (slot == home || !d->proto.select_slot(d, slot)) {
+		if (!wm_read_toc(d, cd))
+			tracks = cd->ntracks;
+	}
+
+	if (slot != home && d->proto.select_slot(d, home))
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"changer: can't load slot %d again\n", home);
+
+	return tracks;
+}
+
+static void *changer_scan(void *arg)
+{
+	struct wm_drive *d = arg;
+	struct wm_changer *c = d->changer;
+	struct wm_cdinfo cd;
+	struct timespec ts;
+	long long start;
+	int slot, home, tracks;
+
+	WM_TRACE_THREAD("changer scan");
+
+	pthread_mutex_lock(&c->lock);
+	while (!c->stop) {
+		for (slot = 0; slot < c->nslots && c->slots[slot].tracks >= 0; slot++)
+			;
+		if (slot == c->nslots)
+			break;
+
+		if (drive_busy(d)) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += CHANGER_IDLE_POLL;
+			pthread_cond_timedwait(&c->wake, &c->lock, &ts);
+			continue;
+		}
+		pthread_mutex_unlock(&c->lock);
+
+		start = wm_monotonic_nsec();
+		wm_sched_enter(d, WM_SCHED_BACKGROUND);
+		/* a play may have come in while the scan waited */
+		if (drive_busy(d)) {
+			wm_sched_leave(d);
+			pthread_mutex_lock(&c->lock);
+			continue;
+		}
+
+		pthread_mutex_lock(&c->lock);
+		home = c->current;
+		pthread_mutex_unlock(&c->lock);
+
+		memset(&cd, 0, sizeof(cd));
+		tracks = changer_read_slot(d, slot, home, &cd);
+		wm_sched_invalidate(d);
+		wm_sched_leave(d);
+
+		if (tracks <= 0) {
+			free(cd.trk);
+			cd.trk = NULL;
+			tracks = 0;
+		}
+		wm_stats_add(d->stats, WM_STATS_SLOTS_SCANNED, 1);
+		WM_TRACE_SPAN("scan slot", start, slot);
+		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+			"changer: slot %d has %d tracks\n", slot, tracks);
+
+		pthread_mutex_lock(&c->lock);
+		slot_set(c, slot, tracks, cd.trk, cd.length);
+	}
+	c->scanning = 0;
+	pthread_mutex_unlock(&c->lock);
+
+	return NULL;
+}
+
+void wm_changer_probe(struct wm_drive *d)
+{
+	struct wm_changer *c;
+	int slots, current, i;
+
+	if (d->changer || !d->proto.get_slots || !d->proto.get_slot_status ||
+		!d->proto.select_slot)
+		return;
+	if (d->proto.get_slots(d, &slots, &current) || slots < 2)
+		return;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return;
+	c->slots = calloc(slots, sizeof(*c->slots));
+	if (!c->slots) {
+		free(c);
+		return;
+	}
+	for (i = 0; i < slots; i++)
+		c->slots[i].tracks = -1;
+	c->nslots = slots;
+	c->current = current >= 0 && current < slots ? current : 0;
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->wake, NULL);
+	d->changer = c;
+
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
+		"changer: %d slots, slot %d loaded\n", slots, c->current);
+}
+
+void wm_changer_free(struct wm_drive *d)
+{
+	struct wm_changer *c = d->changer;
+	int i;
+
+	if (!c)
+		return;
+
+	/* a slot being read is finished first */
+	pthread_mutex_lock(&c->lock);
+	c->stop = 1;
+	pthread_cond_broadcast(&c->wake);
+	pthread_mutex_unlock(&c->lock);
+	if (c->joinable)
+		pthread_join(c->thread, NULL);
+
+	for (i = 0; i < c->nslots; i++)
+		slot_forget(&c->slots[i]);
+	free(c->slots);
+	pthread_cond_destroy(&c->wake);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+	d->changer = NULL;
+}
+
+int wm_changer_restore(struct wm_drive *d)
+{
+	struct wm_changer *c = d->changer;
+	struct changer_slot *s;
+	struct wm_trackinfo *trk = NULL;
+	int slot, changed = 0;
+
+	if (!c)
+		return -1;
+
+	pthread_mutex_lock(&c->lock);
+	slot = c->current;
+	pthread_mutex_unlock(&c->lock);
+
+	/* the disc may have been swapped while the slot was out */
+	if (d->proto.get_slot_status(d, slot, &changed) != WM_CDM_STOPPED || changed) {
+		pthread_mutex_lock(&c->lock);
+		if (c->slots[slot].tracks >= 0) {
+			slot_forget(&c->slots[slot]);
+			c->serial++;
+		}
+		pthread_mutex_unlock(&c->lock);
+		return -1;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	s = &c->slots[slot];
+	if (s->tracks > 0 && (trk = toc_copy(s->trk, s->tracks))) {
+		free(d->thiscd.trk);
+		d->thiscd.trk = trk;
+		d->thiscd.ntracks = s->tracks;
+		d->thiscd.length = s->length;
+		d->thiscd.cur_cdmode = WM_CDM_UNKNOWN;
+		d->thiscd.cd_cur_balance = WM_BALANCE_SYMMETRED;
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	if (!trk)
+		return -1;
+
+	wm_stats_add(d->stats, WM_STATS_SLOT_TOC_REUSED, 1);
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+		"changer: TOC of slot %d taken from the scan\n", slot);
+	return 0;
+}
+
+void wm_changer_remember(struct wm_drive *d)
+{
+	struct wm_changer *c = d->changer;
+	struct wm_trackinfo *trk;
+
+	if (!c || d->thiscd.ntracks < 1 || !d->thiscd.trk)
+		return;
+
+	trk = toc_copy(d->thiscd.trk, d->thiscd.ntracks);
+	if (!trk)
+		return;
+
+	pthread_mutex_lock(&c->lock);
+	slot_set(c, c->current, d->thiscd.ntracks, trk, d->thiscd.length);
+	pthread_mutex_unlock(&c->lock);
+}
+
+int wm_cd_changer_slots(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+
+	return pdrive->changer ? pdrive->changer->nslots : 1;
+}
+
+int wm_cd_changer_current(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	struct wm_changer *c = pdrive->changer;
+	int slot;
+
+	if (!c)
+		return 0;
+
+	pthread_mutex_lock(&c->lock);
+	slot = c->current;
+	pthread_mutex_unlock(&c->lock);
+
+	return slot;
+}
+
+int wm_cd_changer_select(void *p, int slot)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	struct wm_changer *c = pdrive->changer;
+	long long start = wm_monotonic_nsec();
+	int err;
+
+	if (!c || slot < 0 || slot >= c->nslots)
+		return (!c && slot == 0) ? 0 : -1;
+	if (slot == wm_cd_changer_current(pdrive))
+		return 0;
+
+	/* don't let the CDDA reader run into the next disc */
+	wm_cd_stop(pdrive);
+
+	wm_sched_enter(pdrive, WM_SCHED_CONTROL);
+	err = pdrive->proto.select_slot(pdrive, slot);
+	if (!err) {
+		pthread_mutex_lock(&c->lock);
+		c->current = slot;
+		c->serial++;
+		pthread_mutex_unlock(&c->lock);
+	}
+	wm_sched_invalidate(pdrive);
+	wm_sched_leave(pdrive);
+
+	if (err) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"changer: can't load slot %d\n", slot);
+		return -1;
+	}
+
+	/* wm_cd_status() takes it as a new disc, see wm_changer_restore() */
+	free_cdtext();
+	pdrive->oldmode = WM_CDM_NO_DISC;
+
+	wm_stats_add(pdrive->stats, WM_STATS_SLOT_SWITCHES, 1);
+	WM_TRACE_SPAN("select slot", start, slot);
+
+	return wm_cd_status(pdrive);
+}
+
+int wm_cd_changer_scan(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	struct wm_changer *c = pdrive->changer;
+	int i, err = 0;
+
+	if (!c)
+		return -1;
+
+	pthread_mutex_lock(&c->lock);
+	for (i = 0; i < c->nslots; i++) {
+		if (i != c->current)
+			slot_forget(&c->slots[i]);
+	}
+	c->serial++;
+
+	if (!c->scanning && !c->stop) {
+		/* it is done with the slots, gone in a moment */
+		if (c->joinable)
+			pthread_join(c->thread, NULL);
+		c->joinable = 0;
+
+		if (pthread_create(&c->thread, NULL, changer_scan, pdrive)) {
+			wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+				"changer: can't start the scan\n");
+			err = -1;
+		} else {
+			c->scanning = c->joinable = 1;
+		}
+	}
+	pthread_cond_broadcast(&c->wake);
+	pthread_mutex_unlock(&c->lock);
+
+	return err;
+}
+
+int wm_cd_changer_slot_toc(void *p, int slot, unsigned long *discid,
+	int *starts, int *data, int max)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	struct wm_changer *c = pdrive->changer;
+	const struct wm_trackinfo *trk;
+	int i, tracks;
+
+	if (!c) {
+		/* the drive's one disc */
+		if (slot != 0)
+			return -1;
+		tracks = wm_cd_getcountoftracks(pdrive);
+		trk = pdrive->thiscd.trk;
+		if (tracks > 0 && discid)
+			*discid = cddb_discid_toc(tracks, trk);
+		for (i = 0; tracks > 0 && trk && i <= tracks && i < max; i++) {
+			if (starts)
+				starts[i] = trk[i].start;
+			if (data)
+				data[i] = trk[i].data;
+		}
+		return tracks;
+	}
+
+	if (slot < 0 || slot >= c->nslots)
+		return -1;
+
+	pthread_mutex_lock(&c->lock);
+	tracks = c->slots[slot].tracks;
+	trk = c->slots[slot].trk;
+	if (tracks > 0 && discid)
+		*discid = c->slots[slot].discid;
+	for (i = 0; tracks > 0 && i <= tracks && i < max; i++) {
+		if (starts)
+			starts[i] = trk[i].start;
+		if (data)
+			data[i] = trk[i].data;
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return tracks;
+}
+
+unsigned wm_cd_changer_serial(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	struct wm_changer *c = pdrive->changer;
+	unsigned serial;
+
+	if (!c)
+		return 0;
+
+	pthread_mutex_lock(&c->lock);
+	serial = c->serial;
+	pthread_mutex_unlock(&c->lock);
+
+	return serial;
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * De-emphasis filter, see wm_deemph.h.
+ *
+ * y[n] = B0 x[n] + B1 x[n-1] + A y[n-1], unity gain at DC.  The
+ * coefficients are the minimax fit in dB of a first order section to
+ * (1 + s 15us) / (1 + s 50us) at 44.1 kHz, the bilinear transform is
+ * off by more than 2 dB at the top.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_deemph.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define DEEMPH_B0 0.46029338f
+#define DEEMPH_B1 -0.08607653f
+#define DEEMPH_A 0.62578316f
+
+static short deemph_clip(float y)
+{
+	if (y >= 32767.0f)
+		return 32767;
+	if (y <= -32768.0f)
+		return -32768;
+	return (short)(y < 0 ? y - 0.5f : y + 0.5f);
+}
+
+void wm_deemph_reset(struct wm_deemph *f, const short *pcm)
+{
+	f->x[0] = f->y[0] = pcm[0];
+	f->x[1] = f->y[1] = pcm[1];
+}
+
+/*
+ * The vector loop takes two frames at a time, a vector is L0 R0 L1 R1.
+ * Their FIR parts are independent, the recursion is unrolled over the
+ * two: y0 = v0 + A y-1 and y1 = v1 + A v0 + A^2 y-1.
+ */
+void wm_deemph_run(struct wm_deemph *f, short *pcm, int nframes)
+{
+	int i = 0, c;
+	float x, y;
+#ifdef __SSE2__
+	const __m128 b0 = _mm_set1_ps(DEEMPH_B0), b1 = _mm_set1_ps(DEEMPH_B1);
+	const __m128 a = _mm_set1_ps(DEEMPH_A);
+	const __m128 aa = _mm_setr_ps(DEEMPH_A, DEEMPH_A, DEEMPH_A * DEEMPH_A, DEEMPH_A * DEEMPH_A);
+	const __m128 zero = _mm_setzero_ps();
+	/* the last frame is in the upper half */
+	__m128 px = _mm_setr_ps(0, 0, f->x[0], f->x[1]);
+	__m128 py = _mm_setr_ps(0, 0, f->y[0], f->y[1]);
+	__m128 in[2], v;
+	__m128i s, out[2];
+	float last[4];
+	int k;
+
+	for (; i + 4 <= nframes; i += 4) {
+		/* L0 R0 L1 R1 L2 R2 L3 R3, sign extended and converted */
+		s = _mm_loadu_si128((const __m128i *)(pcm + 2 * i));
+		in[0] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+		in[1] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+
+		for (k = 0; k < 2; k++) {
+			v = _mm_add_ps(_mm_mul_ps(b0, in[k]),
+				_mm_mul_ps(b1, _mm_shuffle_ps(px, in[k], _MM_SHUFFLE(1, 0, 3, 2))));
+			v = _mm_add_ps(v, _mm_mul_ps(a, _mm_movelh_ps(zero, v)));
+			py = _mm_add_ps(v, _mm_mul_ps(aa, _mm_shuffle_ps(py, py, _MM_SHUFFLE(3, 2, 3, 2))));
+			px = in[k];
+			out[k] = _mm_cvtps_epi32(py);
+		}
+		/* saturates */
+		_mm_storeu_si128((__m128i *)(pcm + 2 * i), _mm_packs_epi32(out[0], out[1]));
+	}
+
+	_mm_storeu_ps(last, px);
+	f->x[0] = last[2];
+	f->x[1] = last[3];
+	_mm_storeu_ps(last, py);
+	f->y[0] = last[2];
+	f->y[1] = last[3];
+#endif
+
+	for (; i < nframes; i++) {
+		for (c = 0; c < 2; c++) {
+			x = pcm[2 * i + c];
+			y = DEEMPH_B0 * x + DEEMPH_B1 * f->x[c] + DEEMPH_A * f->y[c];
+			f->x[c] = x;
+			f->y[c] = y;
+			pcm[2 * i + c] = deemph_clip(y);
+		}
+	}
+}
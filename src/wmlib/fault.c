@@ -0,0 +1,370 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Fault injection layer.  The hooks of the backend are saved and replaced
+ * by wrappers which delay or fail CDDA reads according to the spec, see
+ * wm_fault.h.  Nothing reaches the hardware, a simulated eject only
+ * reports the tray as open until wm_cd_closetray().
+ */
+
+#define _DEFAULT_SOURCE /* strdup, strtok_r */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_cdrom.h"
+#include "include/wm_helpers.h"
+#include "include/wm_fault.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_MISC
+
+#define FAULT_MSF_OFFSET 150
+
+enum {
+	FAULT_LATENCY_NONE,
+	FAULT_LATENCY_FIXED,
+	FAULT_LATENCY_UNIFORM,
+	FAULT_LATENCY_NORMAL
+};
+
+struct fault_range {
+	int first;
+	int last;
+};
+
+struct fault_config {
+	unsigned long seed;
+	int latency;
+	double lat_a, lat_b;	/* usec: value, min/max or mean/sd */
+	double stall_p;
+	int stall_usec;
+	int spinup_usec;
+	int spindown_usec;
+	double eio_p;
+	int nbad;
+	struct fault_range bad[WM_FAULT_MAX_BAD];
+	int eject_at;		/* LBA, -1 off */
+};
+
+struct wm_fault {
+	struct wm_drive_proto lower;	/* the wrapped backend */
+	pthread_mutex_t lock;
+
+	struct fault_config cfg;
+	struct wm_fault_stats stats;
+	unsigned long long rng;
+
+	int spinning;
+	long long last_io;
+	int ejected;
+};
+
+/*
+ * xorshift64*, uniform in [0, 1)
+ */
+static double fault_random(struct wm_fault *f)
+{
+	f->rng ^= f->rng >> 12;
+	f->rng ^= f->rng << 25;
+	f->rng ^= f->rng >> 27;
+	return ((f->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int fault_latency(struct wm_fault *f)
+{
+	double v = 0.0;
+	int i;
+
+	switch (f->cfg.latency) {
+	case FAULT_LATENCY_FIXED:
+		v = f->cfg.lat_a;
+		break;
+	case FAULT_LATENCY_UNIFORM:
+		v = f->cfg.lat_a + (f->cfg.lat_b - f->cfg.lat_a) * fault_random(f);
+		break;
+	case FAULT_LATENCY_NORMAL:
+		/* Irwin-Hall, close enough and no libm */
+		for (i = 0; i < 12; i++)
+			v += fault_random(f);
+		v = f->cfg.lat_a + (v - 6.0) * f->cfg.lat_b;
+		break;
+	}
+
+	return v > 0.0 ? (int)v : 0;
+}
+
+/*
+ * Parse one "key=value" item of the spec into cfg.
+ */
+static int fault_parse_item(struct fault_config *cfg, char *item)
+{
+	char *value, *end;
+
+	if (!(value = strchr(item, '=')))
+		return -1;
+	*value++ = '\0';
+
+	if (!strcmp(item, "seed")) {
+		cfg->seed = strtoul(value, &end, 0);
+	} else if (!strcmp(item, "latency")) {
+		if (!strncmp(value, "fixed:", 6)) {
+			cfg->latency = FAULT_LATENCY_FIXED;
+			cfg->lat_a = strtod(value + 6, &end);
+		} else if (!strncmp(value, "uniform:", 8) || !strncmp(value, "normal:", 7)) {
+			cfg->latency = value[0] == 'u' ? FAULT_LATENCY_UNIFORM : FAULT_LATENCY_NORMAL;
+			cfg->lat_a = strtod(strchr(value, ':') + 1, &end);
+			if (*end != ':')
+				return -1;
+			cfg->lat_b = strtod(end + 1, &end);
+		} else {
+			return -1;
+		}
+	} else if (!strcmp(item, "stall")) {
+		cfg->stall_p = strtod(value, &end);
+		if (*end != ':')
+			return -1;
+		cfg->stall_usec = strtol(end + 1, &end, 10);
+	} else if (!strcmp(item, "spinup")) {
+		cfg->spinup_usec = strtol(value, &end, 10);
+	} else if (!strcmp(item, "spindown")) {
+		cfg->spindown_usec = strtol(value, &end, 10);
+	} else if (!strcmp(item, "eio")) {
+		cfg->eio_p = strtod(value, &end);
+	} else if (!strcmp(item, "bad")) {
+		if (cfg->nbad == WM_FAULT_MAX_BAD)
+			return -1;
+		cfg->bad[cfg->nbad].first = strtol(value, &end, 10);
+		cfg->bad[cfg->nbad].last = cfg->bad[cfg->nbad].first;
+		if (*end == '-')
+			cfg->bad[cfg->nbad].last = strtol(end + 1, &end, 10);
+		cfg->nbad++;
+	} else if (!strcmp(item, "eject")) {
+		cfg->eject_at = strtol(value, &end, 10);
+	} else {
+		return -1;
+	}
+
+	return (end == value || *end) ? -1 : 0;
+}
+
+static int fault_parse(struct fault_config *cfg, const char *spec)
+{
+	char *copy, *item, *save;
+	int ret = 0;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->seed = 1;
+	cfg->eject_at = -1;
+
+	if (!(copy = strdup(spec)))
+		return -1;
+
+	for (item = strtok_r(copy, ", ", &save); item && !ret; item = strtok_r(NULL, ", ", &save)) {
+		if ((ret = fault_parse_item(cfg, item)))
+			wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+				"fault: cannot parse '%s'\n", item);
+	}
+
+	free(copy);
+	return ret;
+}
+
+static int fault_cdda_read(struct wm_drive *d, struct wm_cdda_block *block)
+{
+	struct wm_fault *f = d->fault;
+	int first, last, i, delay = 0, fail = 0;
+	long long now;
+
+	/* the end of the range isn't a read */
+	if (!f->ejected && d->current_position >= d->ending_position)
+		return f->lower.cdda_read(d, block);
+
+	first = d->current_position - FAULT_MSF_OFFSET;
+	last = first + d->frames_at_once - 1;
+	if (d->ending_position && d->current_position + d->frames_at_once > d->ending_position)
+		last = d->ending_position - FAULT_MSF_OFFSET - 1;
+
+	pthread_mutex_lock(&f->lock);
+	if (f->ejected) {
+		pthread_mutex_unlock(&f->lock);
+		block->status = WM_CDM_EJECTED;
+		return 0;
+	}
+
+	f->stats.reads++;
+
+	now = wm_monotonic_nsec();
+	if (f->cfg.spinup_usec && (!f->spinning || (f->cfg.spindown_usec &&
+		now - f->last_io > f->cfg.spindown_usec * 1000LL))) {
+		delay += f->cfg.spinup_usec;
+		f->stats.spinups++;
+	}
+	f->spinning = 1;
+
+	delay += fault_latency(f);
+	if (f->cfg.stall_p > 0.0 && fault_random(f) < f->cfg.stall_p) {
+		delay += f->cfg.stall_usec;
+		f->stats.stalls++;
+	}
+	f->stats.delay_usec += delay;
+
+	if (f->cfg.eject_at >= first && f->cfg.eject_at <= last) {
+		f->cfg.eject_at = -1;
+		f->ejected = 1;
+		f->stats.ejects++;
+		fail = WM_CDM_EJECTED;
+	}
+	for (i = 0; !fail && i < f->cfg.nbad; i++) {
+		if (f->cfg.bad[i].first <= last && f->cfg.bad[i].last >= first) {
+			f->stats.bad++;
+			fail = WM_CDM_CDDAERROR;
+		}
+	}
+	if (!fail && f->cfg.eio_p > 0.0 && fault_random(f) < f->cfg.eio_p) {
+		f->stats.eio++;
+		fail = WM_CDM_CDDAERROR;
+	}
+	pthread_mutex_unlock(&f->lock);
+
+	if (delay)
+		wm_susleep(delay);
+
+	pthread_mutex_lock(&f->lock);
+	f->last_io = wm_monotonic_nsec();
+	pthread_mutex_unlock(&f->lock);
+
+	if (fail) {
+		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+			"fault: read at LBA %d fails with %d\n", first, fail);
+		block->status = fail;
+		return 0;
+	}
+
+	return f->lower.cdda_read(d, block);
+}
+
+static int fault_get_drive_status(struct wm_drive *d, int oldmode,
+	int *mode, int *pos, int *track, int *ind)
+{
+	struct wm_fault *f = d->fault;
+
+	if (f->ejected) {
+		*mode = WM_CDM_EJECTED;
+		return 0;
+	}
+
+	return f->lower.get_drive_status(d, oldmode, mode, pos, track, ind);
+}
+
+static int fault_closetray(struct wm_drive *d)
+{
+	struct wm_fault *f = d->fault;
+
+	pthread_mutex_lock(&f->lock);
+	f->spinning = 0;
+	if (f->ejected) {
+		f->ejected = 0;
+		pthread_mutex_unlock(&f->lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&f->lock);
+
+	return f->lower.closetray ? f->lower.closetray(d) : -1;
+}
+
+void wm_fault_destroy(struct wm_drive *d)
+{
+	struct wm_fault *f = d->fault;
+
+	if (!f)
+		return;
+
+	if (d->proto.cdda_read == fault_cdda_read)
+		d->proto.cdda_read = f->lower.cdda_read;
+	if (d->proto.get_drive_status == fault_get_drive_status)
+		d->proto.get_drive_status = f->lower.get_drive_status;
+	if (d->proto.closetray == fault_closetray)
+		d->proto.closetray = f->lower.closetray;
+
+	d->fault = NULL;
+	pthread_mutex_destroy(&f->lock);
+	free(f);
+}
+
+int wm_cd_fault_config(void *p, const char *spec)
+{
+	struct wm_drive *d = (struct wm_drive *)p;
+	struct wm_fault *f;
+	struct fault_config cfg;
+
+	/* cdda.c may have picked up the wrappers, so they stay until the end */
+	if (!spec)
+		spec = "";
+	if (!*spec && !d->fault)
+		return 0;
+
+	if (fault_parse(&cfg, spec))
+		return -1;
+
+	if (!(f = d->fault)) {
+		if (!d->proto.cdda_read || !d->proto.get_drive_status)
+			return -1;
+
+		f = calloc(1, sizeof(*f));
+		if (!f)
+			return -1;
+
+		pthread_mutex_init(&f->lock, NULL);
+		f->lower = d->proto;
+		d->fault = f;
+
+		d->proto.cdda_read = fault_cdda_read;
+		d->proto.get_drive_status = fault_get_drive_status;
+		d->proto.closetray = fault_closetray;
+	}
+
+	pthread_mutex_lock(&f->lock);
+	f->cfg = cfg;
+	f->rng = (cfg.seed + 1) * 0x9E3779B97F4A7C15ULL;
+	if (!f->rng)
+		f->rng = 1;
+	memset(&f->stats, 0, sizeof(f->stats));
+	f->spinning = 0;
+	f->ejected = 0;
+	pthread_mutex_unlock(&f->lock);
+
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS, "fault: using '%s'\n", spec);
+	return 0;
+}
+
+int wm_cd_fault_stats(void *p, struct wm_fault_stats *stats)
+{
+	struct wm_drive *d = (struct wm_drive *)p;
+
+	if (!d->fault)
+		return -1;
+
+	pthread_mutex_lock(&d->fault->lock);
+	*stats = d->fault->stats;
+	pthread_mutex_unlock(&d->fault->lock);
+
+	return 0;
+}
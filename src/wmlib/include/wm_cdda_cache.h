@@ -0,0 +1,55 @@
+#ifndef WM_CDDA_CACHE_H
+#define WM_CDDA_CACHE_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * CDDA sector cache (cdda_cache.c)
+ *
+ * Audio frames by frame number, kept in chunks of one second which are
+ * dropped least recently used first once the budget is spent.  A frame
+ * is either cached as a whole or not at all.  Not thread safe, the
+ * CDDA reader is the only user.
+ */
+
+/* frames per chunk, also the most CDROMREADAUDIO takes at once */
+#define WM_CDDA_CACHE_CHUNK 75
+
+struct wm_cdda_cache;
+
+/* NULL if the budget doesn't hold a single chunk */
+struct wm_cdda_cache *wm_cdda_cache_new(long bytes);
+void wm_cdda_cache_free(struct wm_cdda_cache *c);
+void wm_cdda_cache_flush(struct wm_cdda_cache *c);
+
+/* copy nframes frames starting at frame to buf, -1 unless all are cached */
+int wm_cdda_cache_read(struct wm_cdda_cache *c, int frame, int nframes, void *buf);
+
+/* store nframes frames from buf, returns the number of chunks dropped */
+int wm_cdda_cache_write(struct wm_cdda_cache *c, int frame, int nframes, const void *buf);
+
+/*
+ * First frame in [frame, limit) that isn't cached, limit if there is
+ * none.  The chunks before it count as used, so reading ahead doesn't
+ * push out what is about to be played.
+ */
+int wm_cdda_cache_missing(struct wm_cdda_cache *c, int frame, int limit);
+
+long wm_cdda_cache_bytes(struct wm_cdda_cache *c);	/* in use */
+long wm_cdda_cache_budget(struct wm_cdda_cache *c);
+
+#endif /* WM_CDDA_CACHE_H */
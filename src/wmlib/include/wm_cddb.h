@@ -22,6 +22,11 @@
  *
  */
 
+struct wm_drive;
+struct wm_trackinfo;
+
 unsigned long cddb_discid(struct wm_drive *);
+/* the same for a TOC of tracks + 1 entries, the last the lead-out */
+unsigned long cddb_discid_toc(int tracks, const struct wm_trackinfo *trk);
 
 #endif /* WM_CDDB_H */
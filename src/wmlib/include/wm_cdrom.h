@@ -48,8 +48,49 @@ const char *wm_drive_default_device();
 int    wm_cd_init(const char *cd_device, const char *soundsystem,
   const char *sounddevice, const char *ctldevice, void **);
 int    wm_cd_destroy(void *);
+/* move the handle to another drive, the CDDA sink and threads are kept */
+int    wm_cd_switch_device(void *, const char *cd_device);
 
 int    wm_cd_status(void *);
+int    wm_cd_read_toc(void *);
+/* msec of idle time before the CDDA sink and threads are stopped, <0 never */
+int    wm_cd_set_cdda_idle(void *, int msec);
+/* fixed CDDA read speed in multiples of 1x, 0 lets it follow the ring fill */
+int    wm_cd_set_cdda_speed(void *, int speed);
+/* the read speed last set and the read rate of the drive in kB/s */
+int    wm_cd_get_cdda_speed(void *, int *speed, int *refill_kbps);
+/*
+ * Cache mode: read the current track and the next tracks ahead into at
+ * most mbytes of memory, then leave the drive alone.  0 mbytes turns it
+ * off, the setting takes effect with the next play.
+ */
+int    wm_cd_set_cdda_cache(void *, int mbytes, int tracks);
+int    wm_cd_get_cdda_cache(void *, long *bytes, long *budget);
+/*
+ * Undo the pre-emphasis of the tracks that have it while playing them
+ * digitally, see wm_deemph.h.  On unless turned off.
+ */
+int    wm_cd_set_cdda_deemphasis(void *, int on);
+/*
+ * Look for digital silence in the CDDA audio, see wm_silence.h.  Frames
+ * with no sample further from zero than threshold are silent, runs of
+ * at least msec (0 for the default of 2 seconds) are kept as ranges.
+ * A threshold < 0 turns it off, takes effect with the next play.
+ */
+int    wm_cd_set_cdda_silence(void *, int threshold, int msec);
+/*
+ * The silent ranges of a track found so far, their first frames and
+ * lengths, max at most.  Returns how many there are, -1 if it's off.
+ */
+int    wm_cd_get_cdda_silence(void *, int track, int *starts, int *lengths, int max);
+/* first frame of the silent range being played, -1 if none */
+int    wm_cd_get_cdda_silence_at(void *);
+/*
+ * Descriptor of the shared memory ring the CDDA player copies its audio
+ * to, see wm_tap.h.  Owned by the library, dup() it to hand it out.
+ * -1 without digital playback or where there is no memfd.
+ */
+int    wm_cd_get_cdda_tap(void *);
 int    wm_cd_getcurtrack(void *);
 int    wm_cd_getcurtracklen(void *);
 int    wm_get_cur_pos_rel(void *);
@@ -59,6 +100,43 @@ int    wm_cd_getcountoftracks(void *);
 int    wm_cd_gettracklen(void *, int track);
 int    wm_cd_gettrackstart(void *, int track);
 int    wm_cd_gettrackdata(void *, int track);
+/* 1 if the audio of the track has pre-emphasis, which CDDA playback undoes */
+int    wm_cd_gettrackpreemphasis(void *, int track);
+
+/*
+ * Disc changers, see wm_changer.h.  Slots count from 0, a drive of one
+ * disc has one slot.
+ */
+int    wm_cd_changer_slots(void *);
+int    wm_cd_changer_current(void *);
+/* load another slot, playback stops */
+int    wm_cd_changer_select(void *, int slot);
+/* forget what is known of the other slots and scan them again */
+int    wm_cd_changer_scan(void *);
+/*
+ * What is known of a slot: the number of tracks, 0 if it is empty, -1
+ * if it has not been looked at yet.  starts gets the start frames of the
+ * tracks and of the lead-out, data the data flags, max entries at most.
+ * Any of the pointers may be NULL.
+ */
+int    wm_cd_changer_slot_toc(void *, int slot, unsigned long *discid,
+  int *starts, int *data, int max);
+/* changes whenever a slot was scanned or another one was loaded */
+unsigned wm_cd_changer_serial(void *);
+
+/*
+ * Index points, pregaps, ISRCs and the MCN from the Q subchannel, see
+ * wm_subq.h.  The scan takes a few seconds and is done once per disc,
+ * wm_cd_get_subq() is NULL until then.
+ */
+struct wm_subq;
+int    wm_cd_scan_subq(void *);
+const struct wm_subq *wm_cd_get_subq(void *);
+/*
+ * CUE sheet of the disc ripped to one file from 00:02:00 on, scanning
+ * it first if needed.  malloc()ed, NULL on failure.
+ */
+char  *wm_cd_cue_sheet(void *, const char *file_name);
 
 int    wm_cd_play(void *, int start, int pos, int end);
 int    wm_cd_pause(void *);
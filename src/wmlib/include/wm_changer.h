@@ -0,0 +1,49 @@
+#ifndef WM_CHANGER_H
+#define WM_CHANGER_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Disc changers (changer.c)
+ *
+ * A changer holds several discs, one of them loaded into the drive.
+ * The TOC and disc id of each slot are kept once read, either when the
+ * slot was loaded or by a scan that visits the slots in the background
+ * while the drive is idle.  A slot whose TOC is known is not read again
+ * when it is loaded, unless the changer reports its disc as changed.
+ *
+ * The interface for the applications is in wm_cdrom.h.
+ */
+
+#include "wm_struct.h"
+
+/* set up d->changer if the drive has more than one slot */
+void wm_changer_probe(struct wm_drive *d);
+
+/* stop the scan and forget the slots */
+void wm_changer_free(struct wm_drive *d);
+
+/*
+ * A disc showed up in the drive: fill d->thiscd from what is known of
+ * the loaded slot.  0 if it could, else the TOC has to be read.
+ */
+int wm_changer_restore(struct wm_drive *d);
+
+/* d->thiscd has just been read, keep it for the loaded slot */
+void wm_changer_remember(struct wm_drive *d);
+
+#endif /* WM_CHANGER_H */
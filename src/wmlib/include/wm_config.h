@@ -350,21 +350,18 @@
 
 #include <stdio.h>
 
+/*
+ * Both go through wm_lib_message(), which needs wm_helpers.h, and are
+ * dropped before their arguments are evaluated unless the verbosity
+ * asks for them.
+ */
 #define DEBUG
 #ifdef DEBUG
- #if defined(__SUNPRO_C) || defined(__SUNPRO_CC)
-  #define DEBUGLOG(...) fprintf(stderr, __VA_ARGS__)
- #else
-  #define DEBUGLOG(fmt, args...) fprintf(stderr, fmt, ##args)
- #endif
-#else
- #define DEBUGLOG(fmt, args...)
-#endif
-#if defined(__SUNPRO_C) || defined(__SUNPRO_CC)
- #define ERRORLOG(...) fprintf(stderr, __VA_ARGS__)
+ #define DEBUGLOG(...) wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS_ALL, __VA_ARGS__)
 #else
- #define ERRORLOG(fmt, args...) fprintf(stderr, fmt, ##args)
+ #define DEBUGLOG(...)
 #endif
+#define ERRORLOG(...) wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS_ALL, __VA_ARGS__)
 
 #endif /* WM_CONFIG_H */
 
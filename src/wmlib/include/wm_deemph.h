@@ -0,0 +1,47 @@
+#ifndef WM_DEEMPH_H
+#define WM_DEEMPH_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * De-emphasis (deemph.c)
+ *
+ * Tracks with the pre-emphasis flag were mastered with the treble
+ * raised by the 50/15 usec shelf, up to 10 dB, and have to be played
+ * with it taken back down.  The filter is a first order IIR shelf for
+ * 44.1 kHz, within 0.1 dB of the analogue curve from 20 Hz to 20 kHz.
+ * Stereo 16 bit frames are filtered in place, with SSE2 two frames to
+ * a vector.
+ */
+
+/* the last frame in and out, left and right */
+struct wm_deemph {
+	float x[2];
+	float y[2];
+};
+
+/*
+ * Start over at the frame pcm points to, e.g. after a seek, as if the
+ * audio had stayed at that level so far.  Without a step from zero the
+ * start doesn't click.
+ */
+void wm_deemph_reset(struct wm_deemph *f, const short *pcm);
+
+/* filter nframes frames of pcm, carrying on from the last call */
+void wm_deemph_run(struct wm_deemph *f, short *pcm, int nframes);
+
+#endif /* WM_DEEMPH_H */
@@ -0,0 +1,69 @@
+#ifndef WM_FAULT_H
+#define WM_FAULT_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Fault injection (fault.c)
+ *
+ * A layer between libworkman and the drive backend that makes a healthy
+ * drive or disc image misbehave in a repeatable way.  It is configured by
+ * a comma separated spec, e.g.
+ *
+ *   seed=7,latency=normal:2000:500,spinup=1500000,eio=0.02,bad=12000-12100
+ *
+ * seed=N                   PRNG seed, same seed gives the same faults
+ * latency=fixed:U          delay every CDDA read by U microseconds,
+ * latency=uniform:MIN:MAX  or by a uniform or normal distribution
+ * latency=normal:MEAN:SD
+ * stall=P:U                stall a read for U microseconds with probability P
+ * spinup=U                 delay the first read, and the first after
+ * spindown=U               U microseconds of idle time
+ * eio=P                    fail a read with probability P
+ * bad=FIRST-LAST           unreadable LBA range, may be repeated
+ * eject=LBA                eject the disc when the reader gets there
+ *
+ * wm_cd_init() applies KCOMPACTDISC_FAULTS if it is set.
+ */
+
+#include "wm_struct.h"
+
+#define WM_FAULT_MAX_BAD 16
+
+struct wm_fault_stats {
+	long reads;        /* CDDA reads passed to the backend */
+	long eio;          /* reads failed at random */
+	long bad;          /* reads failed in a bad range */
+	long stalls;
+	long spinups;
+	long ejects;
+	long long delay_usec;  /* total injected delay */
+};
+
+/*
+ * Install or reconfigure the fault layer, an empty spec turns all faults
+ * off.  Returns -1 on a malformed spec, the old configuration stays then.
+ */
+int wm_cd_fault_config(void *p, const char *spec);
+
+/* Counters since the last configuration, -1 without fault layer. */
+int wm_cd_fault_stats(void *p, struct wm_fault_stats *stats);
+
+/* Called by wm_cd_destroy(). */
+void wm_fault_destroy(struct wm_drive *d);
+
+#endif /* WM_FAULT_H */
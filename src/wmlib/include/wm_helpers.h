@@ -92,6 +92,18 @@ void 		wm_lib_message( unsigned int level, const char *format, ... )
     __attribute__ ((format(printf,2,3)))
 #endif
     ; /* put out a message on stderr */
+
+/*
+ * Filter before the call, so the arguments of a suppressed message
+ * are not even evaluated.
+ */
+extern int	wm_lib_verbosity;
+#define wm_lib_message_enabled(level) \
+	(((level) & WM_MSG_LEVEL_ALL) <= (wm_lib_verbosity & WM_MSG_LEVEL_ALL) && \
+	 ((level) & wm_lib_verbosity & WM_MSG_CLASS_ALL))
+#define wm_lib_message(level, ...) \
+	do { if (wm_lib_message_enabled(level)) (wm_lib_message)(level, __VA_ARGS__); } while (0)
 int		wm_susleep( int usec );
+long long	wm_monotonic_nsec( void );	/* CLOCK_MONOTONIC in nanoseconds */
 
 #endif /* WM_HELPERS_H */
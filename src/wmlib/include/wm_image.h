@@ -0,0 +1,58 @@
+#ifndef WM_IMAGE_H
+#define WM_IMAGE_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Disc images as virtual drives (plat_image.c)
+ *
+ * A .cue sheet (FILE BINARY/MOTOROLA/WAVE) or a single raw or WAVE file
+ * can be passed to wm_cd_init() in place of a device node.
+ */
+
+#include "wm_struct.h"
+
+/*
+ * Returns nonzero if path names a disc image rather than a drive, a
+ * .cue, .bin, .img, .raw, .cdr or .wav file or one with a WAVE header.
+ */
+int wm_image_probe(const char *path);
+
+/*
+ * Point the drive prototype at the image backend, called by wm_cd_init().
+ */
+int wm_image_setup(struct wm_drive *d);
+
+/*
+ * Where the samples of frame are stored, for engines reading the files
+ * themselves.  Sets *fd and *offset and returns how many frames follow
+ * there as they are played.  Returns 0 if frame has to go through the
+ * cdda_read hook (gaps, data tracks, MOTOROLA files, no disc) and -1 if
+ * the drive isn't an image.  The simulated timing doesn't apply.
+ */
+int wm_image_extent(struct wm_drive *d, int frame, int *fd, long long *offset);
+
+/*
+ * Simulate drive timing: seek_usec for every non sequential read and a
+ * read speed as multiple of 1x (75 frames per second), 0 reads as fast
+ * as the page cache allows.  Initial values come from
+ * KCOMPACTDISC_IMAGE_SEEK_USEC and KCOMPACTDISC_IMAGE_READ_SPEED.
+ * Returns -1 if the drive isn't an image.
+ */
+int wm_cd_image_set_timing(void *p, int seek_usec, int read_speed);
+
+#endif /* WM_IMAGE_H */
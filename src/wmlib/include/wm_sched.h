@@ -0,0 +1,70 @@
+#ifndef WM_SCHED_H
+#define WM_SCHED_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Per drive command scheduler (sched.c)
+ *
+ * The CDDA reader, the thread polling wm_cd_status() and whoever asks
+ * for CD-TEXT or changes the volume all talk to the same drive.  Every
+ * ioctl and SCSI command waits here for its turn, one at a time.  When
+ * the drive comes free it goes to the waiter of the most urgent class,
+ * first come first served within a class.  Each class has a deadline,
+ * a waiter past it goes before all others so nothing starves; the late
+ * grants are counted as deadline misses.
+ *
+ * A thread holding the drive may enter again, e.g. sendscsi() and the
+ * passthrough ioctl under it.
+ */
+
+#include "wm_struct.h"
+
+enum wm_sched_class {
+	WM_SCHED_AUDIO,		/* CDDA reads, the ring is waiting */
+	WM_SCHED_CONTROL,	/* play, stop, eject, volume, speed */
+	WM_SCHED_STATUS,	/* subchannel and drive status polls */
+	WM_SCHED_METADATA,	/* TOC, CD-TEXT, INQUIRY */
+	WM_SCHED_BACKGROUND,	/* the changer scan, whenever nobody else waits */
+	WM_SCHED_CLASSES
+};
+
+/* how long a command of a class may wait for the drive, in usec */
+#define WM_SCHED_DEADLINES { 5000, 50000, 250000, 2000000, 60000000 }
+
+/* a status younger than this is handed to the next poll, in usec */
+#define WM_SCHED_STATUS_REUSE 20000
+
+struct wm_sched *wm_sched_new(void);
+void wm_sched_free(struct wm_sched *s);
+
+/* both pass straight through without a scheduler */
+void wm_sched_enter(struct wm_drive *d, enum wm_sched_class c);
+void wm_sched_leave(struct wm_drive *d);
+
+/*
+ * proto.get_drive_status() for wm_cd_status().  Polls that come in
+ * while one is on the drive wait for its answer, and a recent answer
+ * is reused, as long as they ask with the same oldmode.
+ */
+int wm_sched_drive_status(struct wm_drive *d, int oldmode, int *mode,
+	int *pos, int *track, int *ind);
+
+/* a command changed the drive state, the next poll has to ask it */
+void wm_sched_invalidate(struct wm_drive *d);
+
+#endif /* WM_SCHED_H */
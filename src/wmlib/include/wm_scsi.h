@@ -42,5 +42,11 @@ int	wm_scsi_get_drive_type( struct wm_drive *d);
 int wm_scsi_get_cdtext( struct wm_drive *d,
 	unsigned char **pp_buffer, int *p_buffer_length );
 int wm_scsi_set_speed( struct wm_drive *d, int read_speed );
+int wm_scsi_set_streaming( struct wm_drive *d, int read_speed );
+int wm_scsi_get_current_slot( struct wm_drive *d );
+int wm_scsi_read_subq( struct wm_drive *d, int lba, int frames,
+	unsigned char *buf );
+int wm_scsi_get_mcn( struct wm_drive *d, char *mcn );
+int wm_scsi_get_isrc( struct wm_drive *d, int track, char *isrc );
 
 #endif /* WM_SCSI_H */
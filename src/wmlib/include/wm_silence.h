@@ -0,0 +1,61 @@
+#ifndef WM_SILENCE_H
+#define WM_SILENCE_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Digital silence in the CDDA audio (silence.c)
+ *
+ * A frame is silent if none of its samples is further from zero than
+ * the threshold, 0 asks for true digital silence.  The reader passes
+ * every block it read through wm_silence_feed(), which follows runs of
+ * silent frames along the disc.  A run of at least the minimum length
+ * is kept as a range of its track, runs end at track boundaries.  The
+ * ranges of a disc grow as more of it is played and are forgotten with
+ * the disc.
+ *
+ * Testing a frame is an OR of compares over its samples, with SSE2 or
+ * NEON eight samples at a time.  Thread safe, the reader feeds while
+ * the application asks.
+ */
+
+struct wm_silence;
+
+/* NULL if out of memory */
+struct wm_silence *wm_silence_new(int threshold, int min_frames);
+void wm_silence_free(struct wm_silence *s);
+
+/*
+ * The disc about to be played, starts are the first frames of its
+ * tracks and of the lead-out.  The ranges go if it's another disc.
+ */
+void wm_silence_disc(struct wm_silence *s, unsigned long discid,
+	int ntracks, const int *starts);
+
+/* nframes frames of audio from frame on, returns how many are silent */
+int wm_silence_feed(struct wm_silence *s, int frame, const void *buf, int nframes);
+
+/*
+ * The ranges of a track found so far, first frames and lengths, max at
+ * most, in the order of the disc.  Returns how many there are.
+ */
+int wm_silence_ranges(struct wm_silence *s, int track, int *starts, int *lengths, int max);
+
+/* first frame of the range frame is in, -1 if it isn't in one */
+int wm_silence_at(struct wm_silence *s, int frame);
+
+#endif /* WM_SILENCE_H */
@@ -0,0 +1,115 @@
+#ifndef WM_STATS_H
+#define WM_STATS_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Per drive performance counters (stats.c)
+ *
+ * Every thread counts into its own shard of the drive's counters, a
+ * snapshot adds the shards up.  Latencies go into log-linear histograms
+ * of microseconds, 8 buckets per power of two.
+ */
+
+struct wm_stats;
+
+enum wm_stats_counter {
+	WM_STATS_READS,		/* CDDA block reads */
+	WM_STATS_READ_ERRORS,
+	WM_STATS_BYTES_READ,
+	WM_STATS_RETRIES,
+	WM_STATS_CONCEALED,	/* blocks replaced by silence */
+	WM_STATS_RING_FILL,	/* sum of filled blocks, sampled per read */
+	WM_STATS_RING_SAMPLES,
+	WM_STATS_UNDERRUNS,	/* player had to wait for the reader */
+	WM_STATS_XRUNS,		/* reported by the audio sink */
+	WM_STATS_IOCTLS,
+	WM_STATS_SCSI,
+	WM_STATS_INIT_USEC,	/* wm_cd_init() until the first status */
+	WM_STATS_CDDA_STARTS,	/* sink and threads brought up */
+	WM_STATS_CDDA_START_USEC,
+	WM_STATS_SWITCHES,	/* wm_cd_switch_device() */
+	WM_STATS_SWITCH_USEC,
+	WM_STATS_SCHED_WAITS,	/* commands that had to wait for the drive */
+	WM_STATS_SCHED_MISSES,	/* ... longer than the deadline of their class */
+	WM_STATS_STATUS_COALESCED,	/* polls answered without the drive */
+	WM_STATS_SPEED_CHANGES,	/* CDDA read speed set */
+	WM_STATS_CACHE_HITS,	/* blocks played from the cache */
+	WM_STATS_CACHE_MISSES,
+	WM_STATS_CACHE_PREFETCHED,	/* chunks read ahead */
+	WM_STATS_CACHE_EVICTIONS,
+	WM_STATS_SLOTS_SCANNED,	/* changer slots read by the background scan */
+	WM_STATS_SLOT_SWITCHES,	/* wm_cd_changer_select() */
+	WM_STATS_SLOT_TOC_REUSED,	/* ... and other loads that took a known TOC */
+	WM_STATS_SUBQ_READS,	/* Q subchannel probes of wm_cd_scan_subq() */
+	WM_STATS_SUBQ_SCAN_USEC,
+	WM_STATS_SILENT_FRAMES,	/* CDDA frames found silent, see wm_silence.h */
+	WM_STATS_DEEMPHASIZED,	/* CDDA frames run through the de-emphasis filter */
+	WM_STATS_COUNTERS
+};
+
+enum wm_stats_hist {
+	WM_STATS_HIST_READ,	/* one CDDA block read */
+	WM_STATS_HIST_SCSI,	/* one SCSI command */
+	WM_STATS_HIST_STATUS,	/* wm_cd_status() */
+	WM_STATS_HIST_METADATA,	/* TOC, CD-TEXT and disc id */
+	WM_STATS_HIST_AUDIO_WAIT,	/* CDDA read waiting for the drive */
+	WM_STATS_HIST_SINK_CALLBACK,	/* one realtime callback of the audio sink */
+	WM_STATS_HISTS
+};
+
+#define WM_STATS_BUCKETS 256
+#define WM_STATS_IOCTL_OTHER 256
+
+struct wm_stats_snapshot {
+	long long counter[WM_STATS_COUNTERS];
+	long long scsi[256];		/* by opcode */
+	long long ioctl[257];		/* CDROM* ioctls by number, then others */
+	long long hist[WM_STATS_HISTS][WM_STATS_BUCKETS];
+};
+
+struct wm_stats *wm_stats_new(void);
+void wm_stats_free(struct wm_stats *s);
+
+/* all of these accept s == NULL */
+void wm_stats_add(struct wm_stats *s, enum wm_stats_counter c, long long v);
+void wm_stats_time(struct wm_stats *s, enum wm_stats_hist h, long long start_nsec);
+void wm_stats_scsi(struct wm_stats *s, unsigned char opcode, long long start_nsec);
+void wm_stats_ioctl(struct wm_stats *s, unsigned long request);
+
+/*
+ * Audio sinks don't know their drive, they count into the stats the
+ * calling thread was bound to.
+ */
+void wm_stats_bind(struct wm_stats *s);
+void wm_stats_xrun(void);
+void wm_stats_sink_time(long long start_nsec);
+
+const char *wm_stats_counter_name(int c);
+const char *wm_stats_hist_name(int h);
+
+/* lower and upper (exclusive) bound of a histogram bucket in usec */
+long long wm_stats_bucket_low(int bucket);
+long long wm_stats_bucket_high(int bucket);
+
+/* value at or below which fraction p of the samples are, in usec */
+long long wm_stats_percentile(const long long *hist, double p);
+
+int wm_cd_get_stats(void *p, struct wm_stats_snapshot *snap);
+int wm_cd_reset_stats(void *p);
+
+#endif /* WM_STATS_H */
@@ -39,6 +39,7 @@ struct wm_trackinfo
 	int	start;		/* Starting position (f+s*75+m*60*75) */
 	int	track;		/* Physical track number */
 	int	data;		/* Flag: data track */
+	int	preemphasis;	/* Flag: audio with pre-emphasis */
 };
 
 struct wm_cdinfo
@@ -62,6 +63,13 @@ struct wm_cdinfo
  * These functions should never be seen outside libworkman. So I don't care
  * about the wm_ naming convention here.
  */
+struct wm_cdda_block;
+struct wm_fault;
+struct wm_stats;
+struct wm_sched;
+struct wm_changer;
+struct wm_subq;
+
 struct wm_drive_proto
 {
 	int (*open)(struct wm_drive *d);
@@ -69,6 +77,8 @@ struct wm_drive_proto
 	int (*get_trackcount)(struct wm_drive *d, int *tracks);
 	int (*get_cdlen)(struct wm_drive *d, int *frames);
 	int (*get_trackinfo)(struct wm_drive *d, int track, int *data, int *startframe);
+	/* control bits of a track as in Q, see wm_subq.h; NULL if the TOC has none */
+	int (*get_trackcontrol)(struct wm_drive *d, int track, int *control);
 	int (*get_drive_status)(struct wm_drive *d, int oldmode, int *mode, int *pos, int *track, int *ind);
 	int (*pause)(struct wm_drive *d);
 	int (*resume)(struct wm_drive *d);
@@ -81,6 +91,18 @@ struct wm_drive_proto
 	int (*get_volume)(struct wm_drive *d, int *left, int *right);
 	int (*scale_volume)(int *left, int *right);
 	int (*unscale_volume)(int *left, int *right);
+
+	/* digital extraction, NULL where the platform has none */
+	int (*cdda_init)(struct wm_drive *d);
+	int (*cdda_open)(struct wm_drive *d);
+	int (*cdda_read)(struct wm_drive *d, struct wm_cdda_block *block);
+	int (*cdda_close)(struct wm_drive *d);
+
+	/* disc changers, NULL for a drive of one disc; slots count from 0 */
+	int (*get_slots)(struct wm_drive *d, int *slots, int *current);
+	/* WM_CDM_STOPPED if a disc is in the slot, else WM_CDM_NO_DISC */
+	int (*get_slot_status)(struct wm_drive *d, int slot, int *changed);
+	int (*select_slot)(struct wm_drive *d, int slot);
 };
 
 /* forward declaration */
@@ -111,11 +133,13 @@ struct wm_cdda_block
     unsigned char status;
     unsigned char track;
     unsigned char index;
-    unsigned char reserved;
+    unsigned char pending;   /* filled by the reader, not played yet */
 
     int   frame;
     char *buf;
     long  buflen;
+
+    long long stamp;   /* wm_monotonic_nsec() when the reader filled it */
 };
 
 #ifdef WMLIB_CDDA_BUILD
@@ -147,6 +171,7 @@ struct wm_drive
 	char  vendor[9];      /* Vendor name */
 	char  model[17];      /* Drive model */
 	char  revision[5];    /* Revision of the drive */
+	int   probed;         /* INQUIRY done, see probe_drive() */
 	void  *aux;           /* Pointer to optional platform-specific info */
 
 	struct wm_cdinfo thiscd;
@@ -156,6 +181,11 @@ struct wm_drive
 	int    fd;            /* file descriptor */
 	void  *daux;          /* Pointer to optional drive-specific info etc. */
 	struct wm_drive_proto proto;
+	struct wm_fault *fault;	/* fault injection layer, see wm_fault.h */
+	struct wm_stats *stats;	/* performance counters, see wm_stats.h */
+	struct wm_sched *sched;	/* command scheduler, see wm_sched.h */
+	struct wm_changer *changer;	/* slots of a changer, see wm_changer.h */
+	struct wm_subq *subq;		/* index map of the disc, see wm_subq.h */
 
 	/* cdda section */
     unsigned char status;
@@ -181,7 +211,12 @@ int sony_fixup(struct wm_drive *d);
 struct cdtext_info* get_glob_cdtext(struct wm_drive*, int);
 void free_cdtext(void);
 
+/* read the TOC of the loaded disc into cd, see read_toc() */
+int wm_read_toc(struct wm_drive *d, struct wm_cdinfo *cd);
+
 int wm_cdda_init(struct wm_drive *d);
 int wm_cdda_destroy(struct wm_drive *d);
+void wm_cdda_detach(struct wm_drive *d);
+int wm_cdda_attach(struct wm_drive *d);
 
 #endif /* WM_STRUCT_H */
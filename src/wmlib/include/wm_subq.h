@@ -0,0 +1,63 @@
+#ifndef WM_SUBQ_H
+#define WM_SUBQ_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * The Q subchannel of a disc beyond its TOC (subq.c): index points,
+ * pregaps, ISRCs, the media catalogue number and the control bits of
+ * each track.
+ *
+ * Index numbers only grow along a disc, so every boundary is found by
+ * a binary search over the Q subchannel of single frames, read with
+ * READ CD without the audio.  A disc takes a few thousand such reads,
+ * a few seconds on most drives.  The map is kept with the drive until
+ * another disc is read.
+ *
+ * The map is plain data for the applications, see wm_cd_get_subq().
+ */
+
+struct wm_drive;
+
+#define WM_SUBQ_MAX_INDEX	99
+
+/* control bits of Q */
+#define WM_SUBQ_PREEMPHASIS	0x1
+#define WM_SUBQ_COPY		0x2
+#define WM_SUBQ_DATA		0x4
+#define WM_SUBQ_FOUR_CHANNEL	0x8
+
+struct wm_subq_track {
+	int control;
+	int pregap;		/* frames of INDEX 00 before INDEX 01 */
+	int nindex;		/* INDEX 01 and up */
+	int index[WM_SUBQ_MAX_INDEX];	/* frames, index[0] is the TOC's start */
+	char isrc[13];		/* empty if none */
+};
+
+struct wm_subq {
+	unsigned long discid;
+	int ntracks;
+	int leadout;		/* frame */
+	char mcn[14];		/* empty if none */
+	struct wm_subq_track *tracks;	/* in the same allocation */
+};
+
+/* forget the map, the disc went */
+void wm_subq_free(struct wm_drive *d);
+
+#endif /* WM_SUBQ_H */
@@ -0,0 +1,109 @@
+#ifndef WM_TAP_H
+#define WM_TAP_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * PCM tap (tap.c)
+ *
+ * The CDDA player publishes every block it hands to the sink into a ring
+ * in a sealed memfd.  Other processes map the descriptor read only and
+ * follow the ring at their own pace, the player never waits for them.
+ *
+ * The file starts with struct wm_tap_header, slot n of the ring is at
+ * WM_TAP_HEADER_SIZE + n * slot_size and its audio data_offset bytes
+ * into the slot.  Block b goes to slot b % slots.  Its seq is 2b+1
+ * while the player writes it and 2b+2 once it is complete, so a reader
+ * checks seq before and after using a block to know it wasn't
+ * overwritten meanwhile, a reader falling behind by more than the ring
+ * just misses blocks.  head is the number of blocks published, and the
+ * player does a FUTEX_WAKE on wake after each one.
+ *
+ * Linux only, elsewhere wm_tap_new() fails.
+ */
+
+#include <stdint.h>
+
+#define WM_TAP_MAGIC		0x5043444bU	/* "KDCP" */
+#define WM_TAP_VERSION		1
+#define WM_TAP_SLOTS		64		/* about 13 s of audio */
+#define WM_TAP_HEADER_SIZE	4096
+
+struct wm_tap_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t slot_size;
+	uint32_t data_offset;
+	uint32_t rate;		/* 44100 */
+	uint32_t channels;	/* 2 */
+	uint32_t bits;		/* 16, signed and in host byte order */
+	uint64_t head;
+	uint32_t wake;
+	uint32_t reserved;
+};
+
+struct wm_tap_slot {
+	uint64_t seq;
+	int64_t stamp;		/* CLOCK_MONOTONIC nsec it went to the sink */
+	int32_t frame;		/* of the first sample */
+	uint32_t bytes;
+	uint8_t track;
+	uint8_t index;
+	uint8_t reserved[6];
+};
+
+struct wm_cdda_block;
+
+/* the player side */
+struct wm_tap;
+
+struct wm_tap *wm_tap_new(long block_bytes);
+void wm_tap_free(struct wm_tap *t);
+int wm_tap_fd(struct wm_tap *t);		/* still owned by the tap */
+void wm_tap_publish(struct wm_tap *t, const struct wm_cdda_block *block, long long stamp);
+
+/* the consumer side, a reader belongs to one thread */
+struct wm_tap_reader;
+
+struct wm_tap_block {
+	const void *data;	/* in the mapping, not copied */
+	long bytes;
+	int frame;
+	int track;
+	int index;
+	long long stamp;
+	uint64_t seq;
+};
+
+/* maps fd, which may be closed afterwards, and starts with the next block */
+struct wm_tap_reader *wm_tap_attach(int fd);
+void wm_tap_detach(struct wm_tap_reader *r);
+
+/* 1 and the oldest block not read yet, 0 if there is none */
+int wm_tap_next(struct wm_tap_reader *r, struct wm_tap_block *b);
+
+/* 0 if the player overwrote b since wm_tap_next(), it then counts as skipped */
+int wm_tap_valid(struct wm_tap_reader *r, const struct wm_tap_block *b);
+
+/* wait up to msec for a block, 1 if there is one to read */
+int wm_tap_wait(struct wm_tap_reader *r, int msec);
+
+/* blocks that were overwritten before this reader got to them */
+long long wm_tap_skipped(struct wm_tap_reader *r);
+
+#endif /* WM_TAP_H */
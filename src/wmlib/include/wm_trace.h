@@ -0,0 +1,71 @@
+#ifndef WM_TRACE_H
+#define WM_TRACE_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Tracing (trace.c)
+ *
+ * A trace point stores a small binary record in a ring owned by the
+ * calling thread, it never takes a lock or touches stdio.  When a ring
+ * is full the oldest records are overwritten.  wm_trace_export() writes
+ * whatever the rings hold as Chrome trace event JSON, which
+ * chrome://tracing and ui.perfetto.dev open directly.
+ *
+ * Without WM_TRACE the trace points compile to nothing, with it they
+ * cost a load and a branch while tracing is off.  Names must be string
+ * literals, only the pointer is recorded.
+ *
+ * KCOMPACTDISC_TRACE=file starts tracing in wm_cd_init() and writes
+ * the file in wm_cd_destroy().
+ */
+
+#define WM_TRACE_RING		8192	/* records per thread, power of two */
+#define WM_TRACE_THREADS	32	/* rings kept at most */
+
+extern int wm_trace_on;
+
+void wm_trace_start(void);
+void wm_trace_stop(void);
+int wm_trace_export(const char *path);
+
+/*
+ * phase is one of the Chrome event types 'X' (span from start until
+ * now), 'i' (instant) or 'C' (counter), arg ends up in the args of
+ * the event.  Use the macros below instead.
+ */
+void wm_trace_event(char phase, const char *name, long long start, long long arg);
+
+/* name of the calling thread in the exported trace */
+void wm_trace_thread_name(const char *name);
+
+#if defined(WM_TRACE) && defined(__GNUC__)
+#define WM_TRACE_SPAN(name, start, arg) \
+	do { if (wm_trace_on) wm_trace_event('X', (name), (start), (arg)); } while (0)
+#define WM_TRACE_INSTANT(name, arg) \
+	do { if (wm_trace_on) wm_trace_event('i', (name), 0, (arg)); } while (0)
+#define WM_TRACE_COUNTER(name, value) \
+	do { if (wm_trace_on) wm_trace_event('C', (name), 0, (value)); } while (0)
+#define WM_TRACE_THREAD(name) wm_trace_thread_name(name)
+#else
+#define WM_TRACE_SPAN(name, start, arg) ((void)(start))
+#define WM_TRACE_INSTANT(name, arg) ((void)0)
+#define WM_TRACE_COUNTER(name, value) ((void)0)
+#define WM_TRACE_THREAD(name) ((void)0)
+#endif
+
+#endif /* WM_TRACE_H */
@@ -0,0 +1,50 @@
+#ifndef WM_URING_H
+#define WM_URING_H
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * io_uring based CDDA engine.  Audio frames are read through the SCSI
+ * generic node of the drive with several READ CD commands kept in flight,
+ * or straight from the files of a disc image.  Only available on Linux
+ * when built against liburing, wm_uring_open() returns NULL otherwise.
+ */
+
+#include "wm_struct.h"
+
+/* number of READ CD commands kept in flight per drive */
+#define WM_URING_DEPTH 4
+
+struct wm_uring;
+
+/*
+ * Returns nonzero if the engine was selected with
+ * KCOMPACTDISC_CDDA_ENGINE=uring.
+ */
+int wm_uring_requested(void);
+
+struct wm_uring *wm_uring_open(struct wm_drive *d, int depth);
+void wm_uring_close(struct wm_uring *u);
+
+/*
+ * Same contract as gen_cdda_read(): fills block with the frames at
+ * d->current_position and advances it. A change of d->current_position
+ * between calls drops the reads queued ahead.
+ */
+int wm_uring_read(struct wm_uring *u, struct wm_drive *d, struct wm_cdda_block *block);
+
+#endif /* WM_URING_H */
@@ -0,0 +1,1323 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Virtual drive backed by a disc image.
+ *
+ * The image files are mapped read only, the TOC and CD-TEXT come from the
+ * cue sheet.  Analog playback is simulated with a monotonic clock, digital
+ * playback reads the mapped samples through the usual cdda hooks.
+ */
+
+#define _DEFAULT_SOURCE /* strdup, strcasecmp, madvise */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_cdrom.h"
+#include "include/wm_platform.h"
+#include "include/wm_helpers.h"
+#include "include/wm_image.h"
+#include "include/wm_subq.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_PLATFORM
+
+#define SCMD_TEST_UNIT_READY	0x00
+#define SCMD_INQUIRY		0x12
+#define SCMD_START_STOP		0x1b
+#define SCMD_READ_SUBCHANNEL	0x42
+#define SCMD_READ_TOC		0x43
+#define SCMD_GET_CONFIGURATION	0x46
+#define SCMD_SET_CD_SPEED	0xbb
+#define SCMD_READ_CD		0xbe
+
+#define IMAGE_FRAMESIZE		2352
+#define IMAGE_MSF_OFFSET	150
+#define IMAGE_MAX_TRACKS	99
+#define IMAGE_MAX_INDEX		98	/* INDEX 02 to 99 */
+#define IMAGE_MAX_TEXT		159	/* cdtext_string holds 160 */
+#define IMAGE_1X_KBPS		176
+
+struct image_file {
+	int fd;
+	unsigned char *map;
+	size_t size;
+	size_t data_offset;	/* start of the samples, past a WAVE header */
+	size_t data_size;
+	int swap;		/* MOTOROLA (big endian) samples */
+};
+
+struct image_track {
+	int file;
+	int sector_size;
+	int data;
+	int preemphasis;
+	int pregap;		/* PREGAP frames, not stored in the file */
+	int postgap;
+	int index0;		/* file frame of INDEX 00, -1 if none */
+	int index1;		/* file frame of INDEX 01 */
+	int start;		/* absolute frame of INDEX 01 */
+	int gap;		/* frames of INDEX 00 before start */
+	int nindex;
+	int index[IMAGE_MAX_INDEX];	/* INDEX 02 on, file then absolute frames */
+	char isrc[13];
+	char *title;
+	char *performer;
+};
+
+struct image_segment {
+	int start;		/* absolute frame */
+	int length;
+	int file;		/* -1 for generated silence */
+	size_t offset;		/* byte offset of start in the file */
+	int sector_size;
+};
+
+struct wm_image {
+	struct image_file files[IMAGE_MAX_TRACKS];
+	int nfiles;
+	struct image_track tracks[IMAGE_MAX_TRACKS];
+	int ntracks;
+	struct image_segment *segments;
+	int nsegments;
+	int leadout;
+
+	char *title;
+	char *performer;
+	char catalog[14];
+
+	unsigned char *cdtext;	/* READ TOC format 5 reply */
+	int cdtext_len;
+
+	/* simulated analog playback */
+	int mode;
+	int play_pos;		/* position at play_clock */
+	int play_end;
+	struct timespec play_clock;
+	int left, right;
+
+	/* simulated drive timing */
+	int seek_usec;
+	int read_speed;
+	int max_speed;
+	int next_read;
+};
+
+/*--------------------------------------------------------------------------*
+ * Image files
+ *--------------------------------------------------------------------------*/
+
+static unsigned int le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/*
+ * Find the samples of a RIFF WAVE file, only CD audio layout
+ * (PCM, 2 channels, 16 bit, 44100 Hz) is accepted.
+ */
+static int image_wave(struct image_file *f)
+{
+	const unsigned char *p = f->map;
+	size_t pos = 12, len;
+	int fmt_ok = 0;
+
+	if (f->size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+		return -1;
+
+	while (pos + 8 <= f->size) {
+		len = le32(p + pos + 4);
+		if (!memcmp(p + pos, "fmt ", 4) && len >= 16 && pos + 24 <= f->size) {
+			fmt_ok = le16(p + pos + 8) == 1 && le16(p + pos + 10) == 2 &&
+				le32(p + pos + 12) == 44100 && le16(p + pos + 22) == 16;
+		} else if (!memcmp(p + pos, "data", 4)) {
+			f->data_offset = pos + 8;
+			f->data_size = f->size - f->data_offset;
+			if (len < f->data_size)
+				f->data_size = len;
+			return fmt_ok ? 0 : -1;
+		}
+		pos += 8 + len + (len & 1);
+	}
+
+	return -1;
+}
+
+static int image_map_file(struct image_file *f, const char *path, const char *type)
+{
+	struct stat st;
+
+	f->fd = open(path, O_RDONLY);
+	if (f->fd < 0 || fstat(f->fd, &st) < 0 || st.st_size == 0) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"image: cannot open %s\n", path);
+		return -1;
+	}
+
+	f->size = st.st_size;
+	f->map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+	if (f->map == MAP_FAILED) {
+		f->map = NULL;
+		return -1;
+	}
+	madvise(f->map, f->size, MADV_SEQUENTIAL);
+
+	f->data_offset = 0;
+	f->data_size = f->size;
+	f->swap = !strcasecmp(type, "MOTOROLA");
+
+	if (!strcasecmp(type, "WAVE") && image_wave(f)) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"image: %s is no 44.1 kHz 16 bit stereo PCM WAVE file\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void image_free(struct wm_image *img)
+{
+	int i;
+
+	for (i = 0; i < img->nfiles; i++) {
+		if (img->files[i].map)
+			munmap(img->files[i].map, img->files[i].size);
+		if (img->files[i].fd >= 0)
+			close(img->files[i].fd);
+	}
+	for (i = 0; i < img->ntracks; i++) {
+		free(img->tracks[i].title);
+		free(img->tracks[i].performer);
+	}
+	free(img->title);
+	free(img->performer);
+	free(img->segments);
+	free(img->cdtext);
+	free(img);
+}
+
+/*--------------------------------------------------------------------------*
+ * Cue sheet
+ *--------------------------------------------------------------------------*/
+
+/*
+ * Copy the next word or "quoted string" of *line to buf.
+ */
+static char *cue_token(char **line, char *buf, size_t buflen)
+{
+	char *s = *line, *d = buf;
+	int quoted;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	if (!*s)
+		return NULL;
+
+	quoted = (*s == '"');
+	if (quoted)
+		s++;
+
+	while (*s && (quoted ? *s != '"' : !isspace((unsigned char)*s))) {
+		if (d < buf + buflen - 1)
+			*d++ = *s;
+		s++;
+	}
+	if (quoted && *s)
+		s++;
+	*d = '\0';
+	*line = s;
+
+	return buf;
+}
+
+/* mm:ss:ff to frames */
+static int cue_msf(const char *s)
+{
+	int m, sec, f;
+
+	if (sscanf(s, "%d:%d:%d", &m, &sec, &f) != 3)
+		return -1;
+
+	return (m * 60 + sec) * 75 + f;
+}
+
+static void cue_string(char **dst, const char *src)
+{
+	free(*dst);
+	*dst = strndup(src, IMAGE_MAX_TEXT);
+}
+
+static int cue_sector_size(const char *mode)
+{
+	if (!strcasecmp(mode, "MODE1/2048") || !strcasecmp(mode, "MODE2/2048"))
+		return 2048;
+	if (!strcasecmp(mode, "MODE2/2324"))
+		return 2324;
+	if (!strcasecmp(mode, "MODE2/2336") || !strcasecmp(mode, "CDI/2336"))
+		return 2336;
+	if (!strcasecmp(mode, "CDG"))
+		return 2448;
+
+	return IMAGE_FRAMESIZE;
+}
+
+static int image_parse_cue(struct wm_image *img, const char *cue)
+{
+	char line[1024], tok[512], name[512], path[1024];
+	const char *slash;
+	struct image_track *t = NULL;
+	int file = -1, num, frame, dirlen, n;
+	char *p;
+	FILE *f;
+
+	f = fopen(cue, "r");
+	if (!f)
+		return -1;
+
+	slash = strrchr(cue, '/');
+	dirlen = slash ? (int)(slash - cue + 1) : 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		p = line;
+		if (!cue_token(&p, tok, sizeof(tok)))
+			continue;
+
+		if (!strcasecmp(tok, "FILE")) {
+			if (!cue_token(&p, name, sizeof(name)) || img->nfiles == IMAGE_MAX_TRACKS)
+				goto bad;
+			if (!cue_token(&p, tok, sizeof(tok)))
+				strcpy(tok, "BINARY");
+
+			if (name[0] == '/')
+				n = snprintf(path, sizeof(path), "%s", name);
+			else
+				n = snprintf(path, sizeof(path), "%.*s%s", dirlen, cue, name);
+			if (n < 0 || n >= (int)sizeof(path)) {
+				wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+					"image: path of %s in %s too long\n", name, cue);
+				fclose(f);
+				return -1;
+			}
+
+			file = img->nfiles++;
+			img->files[file].fd = -1;
+			if (image_map_file(&img->files[file], path, tok))
+				goto bad;
+
+		} else if (!strcasecmp(tok, "TRACK")) {
+			if (file < 0 || img->ntracks == IMAGE_MAX_TRACKS ||
+			    !cue_token(&p, tok, sizeof(tok)) || !cue_token(&p, tok, sizeof(tok)))
+				goto bad;
+
+			t = &img->tracks[img->ntracks++];
+			t->file = file;
+			t->sector_size = cue_sector_size(tok);
+			t->data = strcasecmp(tok, "AUDIO") != 0;
+			t->index0 = t->index1 = -1;
+
+		} else if (!strcasecmp(tok, "INDEX")) {
+			if (!t || !cue_token(&p, tok, sizeof(tok)))
+				goto bad;
+			num = atoi(tok);
+			if (!cue_token(&p, tok, sizeof(tok)) || (frame = cue_msf(tok)) < 0)
+				goto bad;
+
+			if (num == 0) {
+				t->index0 = frame;
+			} else if (num == 1) {
+				/*
+				 * "Noncompliant" sheets put INDEX 00 at the end of the
+				 * previous file, those frames stay with the previous track.
+				 */
+				if (t->file != file) {
+					t->file = file;
+					t->index0 = -1;
+				}
+				t->index1 = frame;
+			} else if (num == t->nindex + 2 && t->nindex < IMAGE_MAX_INDEX) {
+				t->index[t->nindex++] = frame;
+			}
+
+		} else if (!strcasecmp(tok, "PREGAP") || !strcasecmp(tok, "POSTGAP")) {
+			if (!t || !cue_token(&p, name, sizeof(name)) || (frame = cue_msf(name)) < 0)
+				goto bad;
+			if (!strcasecmp(tok, "PREGAP"))
+				t->pregap = frame;
+			else
+				t->postgap = frame;
+
+		} else if (!strcasecmp(tok, "FLAGS")) {
+			while (t && cue_token(&p, tok, sizeof(tok)))
+				if (!strcasecmp(tok, "PRE"))
+					t->preemphasis = 1;
+
+		} else if (!strcasecmp(tok, "ISRC")) {
+			/* one that doesn't fit is broken, not cut short */
+			if (t && cue_token(&p, tok, sizeof(tok)) && strlen(tok) < sizeof(t->isrc))
+				strcpy(t->isrc, tok);
+
+		} else if (!strcasecmp(tok, "CATALOG")) {
+			if (cue_token(&p, tok, sizeof(tok)) && strlen(tok) < sizeof(img->catalog))
+				strcpy(img->catalog, tok);
+
+		} else if (!strcasecmp(tok, "TITLE")) {
+			if (cue_token(&p, tok, sizeof(tok)))
+				cue_string(t ? &t->title : &img->title, tok);
+
+		} else if (!strcasecmp(tok, "PERFORMER")) {
+			if (cue_token(&p, tok, sizeof(tok)))
+				cue_string(t ? &t->performer : &img->performer, tok);
+		}
+		/* REM, SONGWRITER, CDTEXTFILE and friends are ignored */
+	}
+	fclose(f);
+
+	for (num = 0; num < img->ntracks; num++) {
+		if (img->tracks[num].index1 < 0) {
+			wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+				"image: track %i of %s has no INDEX 01\n", num + 1, cue);
+			return -1;
+		}
+	}
+
+	return img->ntracks ? 0 : -1;
+
+bad:
+	wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+		"image: cannot parse %s: %s", cue, line);
+	fclose(f);
+	return -1;
+}
+
+/*
+ * 1 if the file starts with a RIFF WAVE header, whatever its name.
+ */
+static int image_is_wave(const char *path)
+{
+	unsigned char p[12];
+	int fd, n;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	n = read(fd, p, sizeof(p));
+	close(fd);
+
+	return n == (int)sizeof(p) && !memcmp(p, "RIFF", 4) && !memcmp(p + 8, "WAVE", 4);
+}
+
+/*
+ * A lone .bin or .wav file is one audio track.
+ */
+static int image_single_file(struct wm_image *img, const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	img->nfiles = 1;
+	img->files[0].fd = -1;
+	if (image_map_file(&img->files[0], path,
+	    ((ext && !strcasecmp(ext, ".wav")) || image_is_wave(path)) ? "WAVE" : "BINARY"))
+		return -1;
+
+	img->ntracks = 1;
+	img->tracks[0].sector_size = IMAGE_FRAMESIZE;
+	img->tracks[0].index0 = -1;
+
+	return 0;
+}
+
+/*
+ * Lay out the tracks on the disc, starting at 00:02:00.  Every track
+ * gets a segment of its file, PREGAP and POSTGAP become silence.
+ */
+static int image_layout(struct wm_image *img)
+{
+	struct image_segment *seg;
+	struct image_track *t;
+	struct image_file *f;
+	int i, j, first, next, prev_first = 0, pos = IMAGE_MSF_OFFSET;
+	size_t base = 0, end;
+	long length;
+
+	img->segments = calloc(3 * img->ntracks, sizeof(*img->segments));
+	if (!img->segments)
+		return -1;
+
+	for (i = 0; i < img->ntracks; i++) {
+		t = &img->tracks[i];
+		f = &img->files[t->file];
+		first = t->index0 >= 0 ? t->index0 : t->index1;
+
+		if (i > 0 && img->tracks[i - 1].file == t->file)
+			base += (size_t)(first - prev_first) * img->tracks[i - 1].sector_size;
+		else
+			base = f->data_offset + (size_t)first * t->sector_size;
+
+		end = f->data_offset + f->data_size;
+		if (i + 1 < img->ntracks && img->tracks[i + 1].file == t->file) {
+			next = img->tracks[i + 1].index0 >= 0 ?
+				img->tracks[i + 1].index0 : img->tracks[i + 1].index1;
+			length = next - first;
+		} else {
+			length = base < end ? (long)((end - base) / t->sector_size) : 0;
+		}
+
+		if (length <= 0 || base + (size_t)length * t->sector_size > end) {
+			wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+				"image: track %i exceeds its file\n", i + 1);
+			return -1;
+		}
+
+		if (t->pregap) {
+			seg = &img->segments[img->nsegments++];
+			seg->start = pos;
+			seg->length = t->pregap;
+			seg->file = -1;
+			pos += t->pregap;
+		}
+
+		seg = &img->segments[img->nsegments++];
+		seg->start = pos;
+		seg->length = length;
+		seg->file = t->file;
+		seg->offset = base;
+		seg->sector_size = t->sector_size;
+
+		t->start = pos + (t->index1 - first);
+		t->gap = t->pregap + (t->index1 - first);
+		for (j = 0; j < t->nindex; j++)
+			t->index[j] = t->start + (t->index[j] - t->index1);
+		pos += length;
+
+		if (t->postgap) {
+			seg = &img->segments[img->nsegments++];
+			seg->start = pos;
+			seg->length = t->postgap;
+			seg->file = -1;
+			pos += t->postgap;
+		}
+
+		prev_first = first;
+	}
+
+	img->leadout = pos;
+
+	return 0;
+}
+
+/*--------------------------------------------------------------------------*
+ * CD-TEXT, as returned by READ TOC format 5
+ *--------------------------------------------------------------------------*/
+
+static unsigned short cdtext_crc(const unsigned char *p, int len)
+{
+	unsigned short crc = 0;
+	int i, b;
+
+	for (i = 0; i < len; i++) {
+		crc ^= p[i] << 8;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+
+	return ~crc;
+}
+
+static int cdtext_emit(struct wm_image *img, unsigned char *pack)
+{
+	unsigned char *tmp;
+	unsigned short crc = cdtext_crc(pack, 16);
+
+	pack[16] = crc >> 8;
+	pack[17] = crc & 0xff;
+
+	tmp = realloc(img->cdtext, img->cdtext_len + 18);
+	if (!tmp)
+		return -1;
+	img->cdtext = tmp;
+	memcpy(img->cdtext + img->cdtext_len, pack, 18);
+	img->cdtext_len += 18;
+
+	return 0;
+}
+
+/*
+ * One string per entry (album, then the tracks), each NUL terminated,
+ * cut into 12 byte packs.  Packs carry the entry their first character
+ * belongs to and how many characters of it went into previous packs.
+ */
+static int cdtext_add(struct wm_image *img, int type, const char **strings, int *seq)
+{
+	unsigned char pack[18];
+	int i, fill = 0, any = 0;
+	size_t j, n;
+
+	for (i = 0; i <= img->ntracks; i++)
+		any |= strings[i] && *strings[i];
+	if (!any)
+		return 0;
+
+	for (i = 0; i <= img->ntracks; i++) {
+		const char *s = strings[i] ? strings[i] : "";
+
+		n = strlen(s) + 1;
+		for (j = 0; j < n; j++) {
+			if (!fill) {
+				memset(pack, 0, sizeof(pack));
+				pack[0] = type;
+				pack[1] = i;
+				pack[2] = (*seq)++;
+				pack[3] = j < 15 ? j : 15;
+			}
+			pack[4 + fill++] = s[j];
+			if (fill == 12) {
+				if (cdtext_emit(img, pack))
+					return -1;
+				fill = 0;
+			}
+		}
+	}
+
+	return fill ? cdtext_emit(img, pack) : 0;
+}
+
+static int image_build_cdtext(struct wm_image *img)
+{
+	const char *strings[IMAGE_MAX_TRACKS + 1];
+	unsigned char *tmp;
+	int i, seq = 0, len;
+
+	/* room for the READ TOC header */
+	img->cdtext = malloc(4);
+	if (!img->cdtext)
+		return -1;
+	img->cdtext_len = 4;
+
+	strings[0] = img->title;
+	for (i = 0; i < img->ntracks; i++)
+		strings[i + 1] = img->tracks[i].title;
+	if (cdtext_add(img, 0x80, strings, &seq))
+		return -1;
+
+	strings[0] = img->performer;
+	for (i = 0; i < img->ntracks; i++)
+		strings[i + 1] = img->tracks[i].performer;
+	if (cdtext_add(img, 0x81, strings, &seq))
+		return -1;
+
+	strings[0] = img->catalog;
+	for (i = 0; i < img->ntracks; i++)
+		strings[i + 1] = img->tracks[i].isrc;
+	if (cdtext_add(img, 0x8e, strings, &seq))
+		return -1;
+
+	if (img->cdtext_len == 4) {
+		free(img->cdtext);
+		img->cdtext = NULL;
+		img->cdtext_len = 0;
+		return 0;
+	}
+
+	len = img->cdtext_len - 2;
+	tmp = img->cdtext;
+	tmp[0] = (len >> 8) & 0xff;
+	tmp[1] = len & 0xff;
+	tmp[2] = tmp[3] = 0;
+
+	return 0;
+}
+
+/*--------------------------------------------------------------------------*
+ * Reading
+ *--------------------------------------------------------------------------*/
+
+static const struct image_segment *image_find(const struct wm_image *img, int frame)
+{
+	int lo = 0, hi = img->nsegments - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (frame < img->segments[mid].start)
+			hi = mid - 1;
+		else if (frame >= img->segments[mid].start + img->segments[mid].length)
+			lo = mid + 1;
+		else
+			return &img->segments[mid];
+	}
+
+	return NULL;
+}
+
+static void image_swab(unsigned char *dst, const unsigned char *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		dst[i] = src[i + 1];
+		dst[i + 1] = src[i];
+	}
+}
+
+static int image_read_frames(struct wm_image *img, int frame, int nframes, unsigned char *buf)
+{
+	const struct image_segment *seg;
+	const struct image_file *f;
+	const unsigned char *src;
+	int n;
+
+	while (nframes > 0) {
+		seg = image_find(img, frame);
+		if (!seg)
+			return -1;
+
+		n = seg->start + seg->length - frame;
+		if (n > nframes)
+			n = nframes;
+
+		if (seg->file < 0 || seg->sector_size != IMAGE_FRAMESIZE) {
+			/* gaps and data tracks play as silence */
+			memset(buf, 0, (size_t)n * IMAGE_FRAMESIZE);
+		} else {
+			f = &img->files[seg->file];
+			src = f->map + seg->offset + (size_t)(frame - seg->start) * IMAGE_FRAMESIZE;
+			if (f->swap)
+				image_swab(buf, src, (size_t)n * IMAGE_FRAMESIZE);
+			else
+				memcpy(buf, src, (size_t)n * IMAGE_FRAMESIZE);
+		}
+
+		buf += (size_t)n * IMAGE_FRAMESIZE;
+		frame += n;
+		nframes -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Sleep as long as a drive would take for the read.
+ */
+static void image_delay(struct wm_image *img, int frame, int nframes)
+{
+	long usec = 0;
+
+	if (img->seek_usec && frame != img->next_read)
+		usec += img->seek_usec;
+	if (img->read_speed > 0)
+		usec += (long)nframes * 1000000 / (75 * img->read_speed);
+	img->next_read = frame + nframes;
+
+	if (usec)
+		wm_susleep(usec);
+}
+
+/*--------------------------------------------------------------------------*
+ * wm_drive_proto
+ *--------------------------------------------------------------------------*/
+
+static int image_open(struct wm_drive *d)
+{
+	struct wm_image *img;
+	const char *ext, *env;
+	int ret;
+
+	if (d->aux)
+		return 0;
+
+	img = calloc(1, sizeof(*img));
+	if (!img)
+		return -ENOMEM;
+
+	img->mode = WM_CDM_STOPPED;
+	img->left = img->right = WM_VOLUME_MAXIMAL;
+
+	ext = strrchr(d->cd_device, '.');
+	if (ext && !strcasecmp(ext, ".cue"))
+		ret = image_parse_cue(img, d->cd_device);
+	else
+		ret = image_single_file(img, d->cd_device);
+
+	if (ret || image_layout(img) || image_build_cdtext(img)) {
+		image_free(img);
+		return -EINVAL;
+	}
+
+	if ((env = getenv("KCOMPACTDISC_IMAGE_SEEK_USEC")))
+		img->seek_usec = atoi(env);
+	if ((env = getenv("KCOMPACTDISC_IMAGE_READ_SPEED")))
+		img->read_speed = img->max_speed = atoi(env);
+
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+		"image: %s, %i tracks, leadout %i\n", d->cd_device, img->ntracks, img->leadout);
+
+	d->aux = img;
+
+	return 0;
+}
+
+static int image_close(struct wm_drive *d)
+{
+	if (d->aux) {
+		image_free(d->aux);
+		d->aux = NULL;
+	}
+
+	return 0;
+}
+
+static int image_get_trackcount(struct wm_drive *d, int *tracks)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	*tracks = img->ntracks;
+	return 0;
+}
+
+static int image_get_trackinfo(struct wm_drive *d, int track, int *data, int *startframe)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img || track < 1 || track > img->ntracks)
+		return -1;
+
+	*data = img->tracks[track - 1].data;
+	*startframe = img->tracks[track - 1].start;
+	return 0;
+}
+
+static int image_get_trackcontrol(struct wm_drive *d, int track, int *control)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img || track < 1 || track > img->ntracks)
+		return -1;
+
+	*control = (img->tracks[track - 1].data ? WM_SUBQ_DATA : 0) |
+		(img->tracks[track - 1].preemphasis ? WM_SUBQ_PREEMPHASIS : 0);
+	return 0;
+}
+
+static int image_get_cdlen(struct wm_drive *d, int *frames)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	*frames = img->leadout;
+	return 0;
+}
+
+static int image_position(struct wm_image *img)
+{
+	struct timespec now;
+	long long ns;
+
+	if (img->mode != WM_CDM_PLAYING)
+		return img->play_pos;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_sec - img->play_clock.tv_sec) * 1000000000LL +
+		(now.tv_nsec - img->play_clock.tv_nsec);
+
+	return img->play_pos + (int)(ns * 75 / 1000000000LL);
+}
+
+static int image_get_drive_status(struct wm_drive *d, int oldmode,
+	int *mode, int *pos, int *track, int *ind)
+{
+	struct wm_image *img = d->aux;
+	int p, t;
+
+	(void)oldmode;
+
+	if (!img) {
+		*mode = WM_CDM_NO_DISC;
+		return 0;
+	}
+
+	switch (img->mode) {
+	case WM_CDM_PLAYING:
+		p = image_position(img);
+		if (p >= img->play_end) {
+			img->mode = WM_CDM_STOPPED;
+			img->play_pos = 0;
+			*mode = WM_CDM_TRACK_DONE;
+			return 0;
+		}
+		*mode = WM_CDM_PLAYING;
+		break;
+
+	case WM_CDM_PAUSED:
+		p = img->play_pos;
+		*mode = WM_CDM_PAUSED;
+		break;
+
+	default:
+		*mode = img->mode;
+		return 0;
+	}
+
+	for (t = img->ntracks; t > 1 && p < img->tracks[t - 1].start; t--)
+		;
+	*pos = p;
+	*track = t;
+	*ind = p < img->tracks[t - 1].start ? 0 : 1;
+
+	return 0;
+}
+
+static int image_play(struct wm_drive *d, int start, int end)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img || img->mode == WM_CDM_EJECTED)
+		return -1;
+
+	if (end < 0 || end > img->leadout)
+		end = img->leadout;
+	if (start < IMAGE_MSF_OFFSET || start >= end)
+		return -1;
+
+	img->play_pos = start;
+	img->play_end = end;
+	clock_gettime(CLOCK_MONOTONIC, &img->play_clock);
+	img->mode = WM_CDM_PLAYING;
+
+	return 0;
+}
+
+static int image_pause(struct wm_drive *d)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img || img->mode != WM_CDM_PLAYING)
+		return -1;
+
+	img->play_pos = image_position(img);
+	img->mode = WM_CDM_PAUSED;
+	return 0;
+}
+
+static int image_resume(struct wm_drive *d)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img || img->mode != WM_CDM_PAUSED)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &img->play_clock);
+	img->mode = WM_CDM_PLAYING;
+	return 0;
+}
+
+static int image_stop(struct wm_drive *d)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	if (img->mode != WM_CDM_EJECTED)
+		img->mode = WM_CDM_STOPPED;
+	img->play_pos = 0;
+	return 0;
+}
+
+static int image_eject(struct wm_drive *d)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	img->mode = WM_CDM_EJECTED;
+	img->play_pos = 0;
+	return 0;
+}
+
+static int image_closetray(struct wm_drive *d)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	if (img->mode == WM_CDM_EJECTED)
+		img->mode = WM_CDM_STOPPED;
+	return 0;
+}
+
+static int image_set_volume(struct wm_drive *d, int left, int right)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	img->left = left;
+	img->right = right;
+	return 0;
+}
+
+static int image_get_volume(struct wm_drive *d, int *left, int *right)
+{
+	struct wm_image *img = d->aux;
+
+	if (!img)
+		return -1;
+
+	*left = img->left;
+	*right = img->right;
+	return 0;
+}
+
+static unsigned char bcd(int n)
+{
+	return (n / 10) << 4 | n % 10;
+}
+
+static void msf_bcd(unsigned char *p, int frame)
+{
+	p[0] = bcd(frame / (60 * 75));
+	p[1] = bcd(frame / 75 % 60);
+	p[2] = bcd(frame % 75);
+}
+
+/*
+ * Formatted Q of an absolute frame as READ CD returns it.  Every 100th
+ * frame has the catalogue number instead of the position, as on a
+ * pressed disc.
+ */
+static void image_subq(struct wm_image *img, int frame, unsigned char *q)
+{
+	const struct image_track *t;
+	int i, index;
+
+	memset(q, 0, 16);
+	for (i = img->ntracks - 1; i > 0; i--) {
+		if (frame >= img->tracks[i].start - img->tracks[i].gap)
+			break;
+	}
+	t = &img->tracks[i];
+
+	if (img->catalog[0] && frame % 100 == 50) {
+		q[0] = 0x02;
+		for (i = 0; i < 13 && img->catalog[i]; i += 2)
+			q[1 + i / 2] = (img->catalog[i] - '0') << 4 |
+				(img->catalog[i + 1] ? img->catalog[i + 1] - '0' : 0);
+		msf_bcd(q + 7, frame);
+		return;
+	}
+
+	for (index = 1; index - 1 < t->nindex && t->index[index - 1] <= frame; index++)
+		;
+	if (frame < t->start)
+		index = 0;
+
+	q[0] = (t->data ? 0x40 : 0) | (t->preemphasis ? 0x10 : 0) | 0x01;
+	q[1] = bcd(i + 1);
+	q[2] = bcd(index);
+	msf_bcd(q + 3, frame < t->start ? t->start - frame : frame - t->start);
+	msf_bcd(q + 7, frame);
+}
+
+/*
+ * The few commands libworkman sends through sendscsi().
+ */
+static int image_scsi(struct wm_drive *d, unsigned char *cdb, int cdb_len,
+	void *ret_buf, int ret_buflen, int get_reply)
+{
+	struct wm_image *img = d->aux;
+	unsigned char *buf = ret_buf;
+	int kbps, lba, n, i;
+
+	/* the commands are known by their opcode, replies always filled in */
+	(void)cdb_len;
+	(void)get_reply;
+
+	if (!img)
+		return -1;
+
+	switch (cdb[0]) {
+	case SCMD_TEST_UNIT_READY:
+		return img->mode == WM_CDM_EJECTED ? -1 : 0;
+
+	case SCMD_INQUIRY:
+		if (!buf || ret_buflen < 36)
+			return -1;
+		memset(buf, 0, ret_buflen);
+		buf[0] = 0x05;		/* CD/DVD device */
+		buf[4] = 31;
+		memcpy(buf + 8, "KCD     Disc image      1.0 ", 28);
+		return 0;
+
+	case SCMD_GET_CONFIGURATION:
+		if (!buf || ret_buflen < 8)
+			return -1;
+		memset(buf, 0, ret_buflen);
+		buf[3] = 4;
+		buf[7] = 0x08;		/* current profile CD-ROM */
+		return 0;
+
+	case SCMD_READ_TOC:
+		if ((cdb[2] & 0x0f) != 5 || !img->cdtext || !buf)
+			return -1;
+		memset(buf, 0, ret_buflen);
+		memcpy(buf, img->cdtext, ret_buflen < img->cdtext_len ? ret_buflen : img->cdtext_len);
+		return 0;
+
+	case SCMD_START_STOP:
+		if (cdb[4] & 0x02)
+			return (cdb[4] & 0x01) ? image_closetray(d) : image_eject(d);
+		return 0;
+
+	case SCMD_READ_CD:
+		/* the Q subchannel alone, nothing else is read this way */
+		lba = (cdb[2] << 24) | (cdb[3] << 16) | (cdb[4] << 8) | cdb[5];
+		n = (cdb[6] << 16) | (cdb[7] << 8) | cdb[8];
+		if (cdb[9] || (cdb[10] & 0x07) != 0x02 || !buf || ret_buflen < n * 16 ||
+		    lba < 0 || lba + IMAGE_MSF_OFFSET + n > img->leadout)
+			return -1;
+		for (i = 0; i < n; i++)
+			image_subq(img, lba + IMAGE_MSF_OFFSET + i, buf + i * 16);
+		return 0;
+
+	case SCMD_READ_SUBCHANNEL:
+		if (!buf || ret_buflen < 24)
+			return -1;
+		memset(buf, 0, ret_buflen);
+		buf[4] = cdb[3];
+		if (cdb[3] == 2) {
+			if (img->catalog[0]) {
+				buf[8] = 0x80;
+				memcpy(buf + 9, img->catalog, 13);
+			}
+			return 0;
+		}
+		if (cdb[3] == 3 && cdb[6] >= 1 && cdb[6] <= img->ntracks) {
+			buf[6] = cdb[6];
+			if (img->tracks[cdb[6] - 1].isrc[0]) {
+				buf[8] = 0x80;
+				memcpy(buf + 9, img->tracks[cdb[6] - 1].isrc, 12);
+			}
+			return 0;
+		}
+		return -1;
+
+	case SCMD_SET_CD_SPEED:
+		/* only matters when drive timing is simulated */
+		if (img->max_speed > 0) {
+			kbps = (cdb[2] << 8) | cdb[3];
+			img->read_speed = kbps / IMAGE_1X_KBPS;
+			if (kbps == 0xffff || img->read_speed > img->max_speed)
+				img->read_speed = img->max_speed;
+			if (img->read_speed < 1)
+				img->read_speed = 1;
+		}
+		return 0;
+	}
+
+	return -1;
+}
+
+static int image_cdda_open(struct wm_drive *d)
+{
+	int i;
+
+	if (!d->aux)
+		return -1;
+
+	for (i = 0; i < d->numblocks; i++) {
+		d->blocks[i].buflen = d->frames_at_once * IMAGE_FRAMESIZE;
+		d->blocks[i].buf = malloc(d->blocks[i].buflen);
+		if (!d->blocks[i].buf) {
+			ERRORLOG("image_cdda_open: ENOMEM\n");
+			return -ENOMEM;
+		}
+	}
+
+	d->status = WM_CDM_UNKNOWN;
+	return 0;
+}
+
+/*
+ * Same contract as gen_cdda_read().
+ */
+static int image_cdda_read(struct wm_drive *d, struct wm_cdda_block *block)
+{
+	struct wm_image *img = d->aux;
+	int nframes;
+
+	if (!img)
+		return -1;
+
+	if (img->mode == WM_CDM_EJECTED) {
+		block->status = WM_CDM_EJECTED;
+		return 0;
+	}
+
+	/* Hit the end of the CD, probably. */
+	if (d->current_position >= d->ending_position) {
+		block->status = WM_CDM_TRACK_DONE;
+		return 0;
+	}
+
+	if (d->ending_position && d->current_position + d->frames_at_once > d->ending_position)
+		nframes = d->ending_position - d->current_position;
+	else
+		nframes = d->frames_at_once;
+
+	image_delay(img, d->current_position, nframes);
+	if (image_read_frames(img, d->current_position, nframes, (unsigned char *)block->buf)) {
+		block->status = WM_CDM_CDDAERROR;
+		return 0;
+	}
+
+	block->track =  -1;
+	block->index =  0;
+	block->frame  = d->current_position;
+	block->status = WM_CDM_PLAYING;
+	block->buflen = nframes * IMAGE_FRAMESIZE;
+
+	d->current_position = d->current_position + nframes;
+
+	return block->buflen;
+}
+
+static int image_cdda_close(struct wm_drive *d)
+{
+	int i;
+
+	for (i = 0; i < d->numblocks; i++) {
+		free(d->blocks[i].buf);
+		d->blocks[i].buf = 0;
+		d->blocks[i].buflen = 0;
+	}
+
+	return 0;
+}
+
+int wm_image_extent(struct wm_drive *d, int frame, int *fd, long long *offset)
+{
+	const struct image_segment *seg;
+	struct wm_image *img;
+
+	if (!d || d->proto.open != image_open)
+		return -1;
+
+	img = d->aux;
+	if (!img || img->mode == WM_CDM_EJECTED)
+		return 0;
+
+	seg = image_find(img, frame);
+	if (!seg || seg->file < 0 || seg->sector_size != IMAGE_FRAMESIZE ||
+	    img->files[seg->file].swap)
+		return 0;
+
+	*fd = img->files[seg->file].fd;
+	*offset = seg->offset + (long long)(frame - seg->start) * IMAGE_FRAMESIZE;
+
+	return seg->start + seg->length - frame;
+}
+
+/*
+ * A regular file counts by its extension or a WAVE header only, any
+ * other file would be played as raw audio.
+ */
+int wm_image_probe(const char *path)
+{
+	static const char *const exts[] = {
+		".cue", ".bin", ".img", ".raw", ".cdr", ".wav", NULL
+	};
+	const char *ext;
+	struct stat st;
+	int i;
+
+	if (!path || stat(path, &st) || !S_ISREG(st.st_mode))
+		return 0;
+
+	ext = strrchr(path, '.');
+	for (i = 0; ext && exts[i]; i++)
+		if (!strcasecmp(ext, exts[i]))
+			return 1;
+
+	return image_is_wave(path);
+}
+
+int wm_image_setup(struct wm_drive *d)
+{
+	d->proto.open = image_open;
+	d->proto.close = image_close;
+	d->proto.get_trackcount = image_get_trackcount;
+	d->proto.get_cdlen = image_get_cdlen;
+	d->proto.get_trackinfo = image_get_trackinfo;
+	d->proto.get_trackcontrol = image_get_trackcontrol;
+	d->proto.get_drive_status = image_get_drive_status;
+	d->proto.pause = image_pause;
+	d->proto.resume = image_resume;
+	d->proto.stop = image_stop;
+	d->proto.play = image_play;
+	d->proto.eject = image_eject;
+	d->proto.closetray = image_closetray;
+	d->proto.scsi = image_scsi;
+	d->proto.set_volume = image_set_volume;
+	d->proto.get_volume = image_get_volume;
+	d->proto.scale_volume = NULL;
+	d->proto.unscale_volume = NULL;
+	d->proto.cdda_init = NULL;
+	d->proto.cdda_open = image_cdda_open;
+	d->proto.cdda_read = image_cdda_read;
+	d->proto.cdda_close = image_cdda_close;
+
+	return 0;
+}
+
+int wm_cd_image_set_timing(void *p, int seek_usec, int read_speed)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	struct wm_image *img;
+
+	if (!pdrive || pdrive->proto.open != image_open || !pdrive->aux)
+		return -1;
+
+	img = pdrive->aux;
+	img->seek_usec = seek_usec > 0 ? seek_usec : 0;
+	img->read_speed = img->max_speed = read_speed > 0 ? read_speed : 0;
+
+	return 0;
+}
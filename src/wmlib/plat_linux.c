@@ -31,6 +31,9 @@
 #include "include/wm_cdrom.h"
 #include "include/wm_scsi.h"
 #include "include/wm_helpers.h"
+#include "include/wm_stats.h"
+#include "include/wm_sched.h"
+#include "include/wm_trace.h"
 
 #include <errno.h>
 #include <stdio.h>
@@ -93,6 +96,50 @@ typedef unsigned long long __u64;
 
 #define WM_MSG_CLASS WM_MSG_CLASS_PLATFORM
 
+static enum wm_sched_class ioctl_class(unsigned long request)
+{
+	switch (request) {
+	case CDROMREADAUDIO:
+		return WM_SCHED_AUDIO;
+	case CDROMSUBCHNL:
+	case CDROM_DRIVE_STATUS:
+	case CDROM_DISC_STATUS:
+	case CDROM_MEDIA_CHANGED:
+	case CDROMVOLREAD:
+		return WM_SCHED_STATUS;
+	case CDROMREADTOCHDR:
+	case CDROMREADTOCENTRY:
+	case CDROM_GET_CAPABILITY:
+	case CDROM_GET_MCN:
+	case CDROM_CHANGER_NSLOTS:
+		return WM_SCHED_METADATA;
+	default:
+		/* SCSI passthrough has been scheduled by sendscsi() already */
+		return WM_SCHED_CONTROL;
+	}
+}
+
+/*
+ * All ioctls on the drive go through here to be counted and to wait
+ * for their turn.
+ */
+static int drive_ioctl(struct wm_drive *d, unsigned long request, void *arg)
+{
+	long long start;
+	int ret, err;
+
+	wm_sched_enter(d, ioctl_class(request));
+	start = wm_monotonic_nsec();
+	ret = ioctl(d->fd, request, arg);
+	err = errno;
+	wm_sched_leave(d);
+	errno = err;
+
+	wm_stats_ioctl(d->stats, request);
+	WM_TRACE_SPAN("ioctl", start, request);
+	return ret;
+}
+
 #ifdef LINUX_SCSI_PASSTHROUGH
 /* this is from <scsi/scsi_ioctl.h> */
 # define SCSI_IOCTL_SEND_COMMAND 1
@@ -105,8 +152,75 @@ typedef unsigned long long __u64;
  *
  *
  *-------------------------------------------------------*/
+static int linux_get_slots(struct wm_drive *d, int *slots, int *current)
+{
+	int ret = drive_ioctl(d, CDROM_CHANGER_NSLOTS, 0);
+
+	if (ret < 0)
+		return -1;
+
+	/* the kernel doesn't tell which one is loaded */
+	*slots = ret;
+	*current = ret > 1 ? wm_scsi_get_current_slot(d) : 0;
+	if (*current < 0)
+		*current = 0;
+
+	return 0;
+}
+
+static int linux_get_slot_status(struct wm_drive *d, int slot, int *changed)
+{
+	int ret;
+
+	ret = drive_ioctl(d, CDROM_MEDIA_CHANGED, (void *)(long)slot);
+	*changed = ret > 0;
+
+	ret = drive_ioctl(d, CDROM_DRIVE_STATUS, (void *)(long)slot);
+	if (ret < 0)
+		return -1;
+
+	return ret == CDS_DISC_OK ? WM_CDM_STOPPED : WM_CDM_NO_DISC;
+}
+
+/* CDROM_SELECT_DISC comes back before the disc is spun up */
+static int linux_select_slot(struct wm_drive *d, int slot)
+{
+	int i;
+
+	if (drive_ioctl(d, CDROM_SELECT_DISC, (void *)(long)slot) < 0)
+		return -1;
+
+	for (i = 0; i < 100; i++) {
+		if (drive_ioctl(d, CDROM_DRIVE_STATUS, (void *)(long)CDSL_CURRENT) != CDS_DRIVE_NOT_READY)
+			break;
+		wm_susleep(100000);
+	}
+
+	return 0;
+}
+
+/* the control nibble of the TOC entry, the bits of Q */
+static int linux_get_trackcontrol(struct wm_drive *d, int track, int *control)
+{
+	struct cdrom_tocentry entry;
+
+	entry.cdte_track = track;
+	entry.cdte_format = CDROM_MSF;
+
+	if(drive_ioctl(d, CDROMREADTOCENTRY, &entry))
+		return -1;
+
+	*control = entry.cdte_ctrl;
+	return 0;
+}
+
 int gen_init(struct wm_drive *d)
 {
+	d->proto.get_trackcontrol = linux_get_trackcontrol;
+	d->proto.get_slots = linux_get_slots;
+	d->proto.get_slot_status = linux_get_slot_status;
+	d->proto.select_slot = linux_select_slot;
+
 	return 0;
 }
 
@@ -168,13 +282,13 @@ int gen_get_drive_status(struct wm_drive *d, int oldmode, int *mode, int *pos, i
 	/* Try to get rid of the door locking    */
 	/* Don't care about return value. If it  */
 	/* works - fine. If not - ...            */
-	ioctl(d->fd, CDROM_LOCKDOOR, 0);
+	drive_ioctl(d, CDROM_LOCKDOOR, 0);
 
 	*mode = WM_CDM_UNKNOWN;
 
 	sc.cdsc_format = CDROM_MSF;
 
-	if(!ioctl(d->fd, CDROMSUBCHNL, &sc)) {
+	if(!drive_ioctl(d, CDROMSUBCHNL, &sc)) {
 		switch (sc.cdsc_audiostatus) {
 		case CDROM_AUDIO_PLAY:
 			*mode = WM_CDM_PLAYING;
@@ -223,9 +337,9 @@ int gen_get_drive_status(struct wm_drive *d, int oldmode, int *mode, int *pos, i
 
 	if(WM_CDS_NO_DISC(*mode)) {
 		/* verify status of drive */
-		ret = ioctl(d->fd, CDROM_DRIVE_STATUS, 0/* slot */);
+		ret = drive_ioctl(d, CDROM_DRIVE_STATUS, (void *)(long)CDSL_CURRENT);
 		if(ret == CDS_DISC_OK)
-			ret = ioctl(d->fd, CDROM_DISC_STATUS, 0);
+			ret = drive_ioctl(d, CDROM_DISC_STATUS, 0);
 
 		switch(ret) {
 		case CDS_NO_DISC:
@@ -259,7 +373,7 @@ int gen_get_trackcount(struct wm_drive *d, int *tracks)
 {
 	struct cdrom_tochdr hdr;
 
-	if(ioctl(d->fd, CDROMREADTOCHDR, &hdr))
+	if(drive_ioctl(d, CDROMREADTOCHDR, &hdr))
 		return -1;
 
 	*tracks = hdr.cdth_trk1;
@@ -276,7 +390,7 @@ int gen_get_trackinfo(struct wm_drive *d, int track, int *data, int *startframe)
 	entry.cdte_track = track;
 	entry.cdte_format = CDROM_MSF;
 
-	if(ioctl(d->fd, CDROMREADTOCENTRY, &entry))
+	if(drive_ioctl(d, CDROMREADTOCENTRY, &entry))
 		return -1;
 
 	*startframe = entry.cdte_addr.msf.minute * 60 * 75 +
@@ -311,10 +425,10 @@ int gen_play(struct wm_drive *d, int start, int end)
 	msf.cdmsf_sec1 = (end % (60*75)) / 75;
 	msf.cdmsf_frame1 = end % 75;
 
-	if(ioctl(d->fd, CDROMPLAYMSF, &msf)) {
-		if(ioctl(d->fd, CDROMSTART))
+	if(drive_ioctl(d, CDROMPLAYMSF, &msf)) {
+		if(drive_ioctl(d, CDROMSTART, 0))
 			return -1;
-		if(ioctl(d->fd, CDROMPLAYMSF, &msf))
+		if(drive_ioctl(d, CDROMPLAYMSF, &msf))
 			return -2;
 	}
 
@@ -326,7 +440,7 @@ int gen_play(struct wm_drive *d, int start, int end)
  *---------------*/
 int gen_pause(struct wm_drive *d)
 {
-	return ioctl(d->fd, CDROMPAUSE);
+	return drive_ioctl(d, CDROMPAUSE, 0);
 }
 
 /*-------------------------------------------------*
@@ -334,7 +448,7 @@ int gen_pause(struct wm_drive *d)
  *-------------------------------------------------*/
 int gen_resume(struct wm_drive *d)
 {
-	return ioctl(d->fd, CDROMRESUME);
+	return drive_ioctl(d, CDROMRESUME, 0);
 }
 
 /*--------------*
@@ -342,7 +456,7 @@ int gen_resume(struct wm_drive *d)
  *--------------*/
 int gen_stop(struct wm_drive *d)
 {
-	return ioctl(d->fd, CDROMSTOP);
+	return drive_ioctl(d, CDROMSTOP, 0);
 }
 
 /*----------------------------------------*
@@ -398,9 +512,9 @@ int gen_eject(struct wm_drive *d)
 	endmntent (fp);
 #endif /* BSD_MOUNTTEST */
 
-	ioctl(d->fd, CDROM_LOCKDOOR, 0);
+	drive_ioctl(d, CDROM_LOCKDOOR, 0);
 
-	if(ioctl(d->fd, CDROMEJECT)) {
+	if(drive_ioctl(d, CDROMEJECT, 0)) {
 		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS, "eject failed (%s).\n", strerror(errno));
 		return -1;
 	}
@@ -429,7 +543,7 @@ int gen_closetray(struct wm_drive *d)
 {
 #ifdef CDROMCLOSETRAY
 	wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS, "CDROMCLOSETRAY closing tray...\n");
-	return ioctl(d->fd, CDROMCLOSETRAY);
+	return drive_ioctl(d, CDROMCLOSETRAY, 0);
 #else
 	return -1;
 #endif /* CDROMCLOSETRAY */
@@ -476,7 +590,7 @@ int gen_set_volume(struct wm_drive *d, int left, int right)
 	v.channel0 = v.channel2 = left < 0 ? 0 : left > 255 ? 255 : left;
 	v.channel1 = v.channel3 = right < 0 ? 0 : right > 255 ? 255 : right;
 
-	return (ioctl(d->fd, CDROMVOLCTRL, &v));
+	return (drive_ioctl(d, CDROMVOLCTRL, &v));
 }
 
 /*---------------------------------------------------------------------*
@@ -488,7 +602,7 @@ int gen_get_volume(struct wm_drive *d, int *left, int *right)
 	struct cdrom_volctrl v;
 
 #if defined(CDROMVOLREAD)
-	if(!ioctl(d->fd, CDROMVOLREAD, &v)) {
+	if(!drive_ioctl(d, CDROMVOLREAD, &v)) {
 		*left = (v.channel0 + v.channel2)/2;
 		*right = (v.channel1 + v.channel3)/2;
 	} else
@@ -549,7 +663,7 @@ int gen_scsi(struct wm_drive *d, unsigned char *cdb, int cdblen,
 	if(retbuf && !getreply)
 		memcpy(cmd + 2*sizeof(int) + cdblen, retbuf, retbuflen);
 
-	if(ioctl(d->fd, SCSI_IOCTL_SEND_COMMAND, cmd)) {
+	if(drive_ioctl(d, SCSI_IOCTL_SEND_COMMAND, cmd)) {
 		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "%s: ioctl(SCSI_IOCTL_SEND_COMMAND) failure\n", __FILE__);
 		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "command buffer is:\n");
 		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "%02x %02x %02x %02x %02x %02x\n",
@@ -577,7 +691,7 @@ int gen_scsi(struct wm_drive *d, unsigned char *cdb, int cdblen,
 
 	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS, "wm_scsi over CDROM_SEND_PACKET entered\n");
 
-	capability = ioctl(d->fd, CDROM_GET_CAPABILITY);
+	capability = drive_ioctl(d, CDROM_GET_CAPABILITY, 0);
 
 	if(!(capability & CDC_GENERIC_PACKET)) {
 		wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
@@ -597,7 +711,7 @@ int gen_scsi(struct wm_drive *d, unsigned char *cdb, int cdblen,
 	cdc.data_direction = getreply?CGC_DATA_READ:CGC_DATA_WRITE;
 
 	/* sendpacket_over_cdrom_interface() */
-	if((ret = ioctl(d->fd, CDROM_SEND_PACKET, &cdc)))
+	if((ret = drive_ioctl(d, CDROM_SEND_PACKET, &cdc)))
 		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
 			"ERROR: CDROM_SEND_PACKET %s\n", strerror(errno));
 	return ret;
@@ -649,7 +763,7 @@ int gen_cdda_open(struct wm_drive *d)
 	int i;
 	struct cdrom_read_audio cdda;
 
-	if (d->fd > -1)
+	if (d->fd < 0)
 		return -1;
 
 	for (i = 0; i < d->numblocks; i++) {
@@ -667,7 +781,7 @@ int gen_cdda_open(struct wm_drive *d)
 	cdda.buf = (unsigned char *)d->blocks[0].buf;
 
 	d->status = WM_CDM_STOPPED;
-	if((ioctl(d->fd, CDROMREADAUDIO, &cdda) < 0)) {
+	if((drive_ioctl(d, CDROMREADAUDIO, &cdda) < 0)) {
 		if (errno == ENXIO) {
 			/* CD ejected! */
 			d->status = WM_CDM_EJECTED;
@@ -710,7 +824,7 @@ int gen_cdda_read(struct wm_drive *d, struct wm_cdda_block *block)
 
 	cdda.buf = (unsigned char*)block->buf;
 
-	if (ioctl(d->fd, CDROMREADAUDIO, &cdda) < 0) {
+	if (drive_ioctl(d, CDROMREADAUDIO, &cdda) < 0) {
 		if (errno == ENXIO) {
 			/* CD ejected! */
 			block->status = WM_CDM_EJECTED;
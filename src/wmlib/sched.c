@@ -0,0 +1,248 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Per drive command scheduler.  The drive is handed over directly by
+ * the thread leaving it, so a waiter never has to compete with a new
+ * arrival of a lower class.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_helpers.h"
+#include "include/wm_sched.h"
+#include "include/wm_stats.h"
+#include "include/wm_trace.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+struct sched_waiter {
+	struct sched_waiter *next;
+	enum wm_sched_class class;
+	long long deadline;
+	pthread_t thread;
+	int granted;
+};
+
+struct wm_sched {
+	pthread_mutex_t lock;
+	pthread_cond_t granted;
+	struct sched_waiter *waiters;	/* in order of arrival */
+	int busy;
+	int depth;			/* entries of the holder */
+	pthread_t holder;
+
+	/* wm_sched_drive_status() */
+	pthread_cond_t status_done;
+	int status_busy;
+	int status_valid;
+	unsigned long status_gen;	/* bumped by wm_sched_invalidate() */
+	long long status_stamp;
+	int status_ret, status_oldmode, status_mode, status_pos, status_track, status_ind;
+};
+
+static const long long sched_deadline_usec[WM_SCHED_CLASSES] = WM_SCHED_DEADLINES;
+
+static const char *sched_wait_names[WM_SCHED_CLASSES] = {
+	"wait audio", "wait control", "wait status", "wait metadata", "wait background"
+};
+
+struct wm_sched *wm_sched_new(void)
+{
+	struct wm_sched *s = calloc(1, sizeof(struct wm_sched));
+
+	if (!s)
+		return NULL;
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->granted, NULL);
+	pthread_cond_init(&s->status_done, NULL);
+	return s;
+}
+
+void wm_sched_free(struct wm_sched *s)
+{
+	if (!s)
+		return;
+
+	pthread_cond_destroy(&s->status_done);
+	pthread_cond_destroy(&s->granted);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+/*
+ * The waiter past its deadline the longest if there is one, else the
+ * first one of the most urgent class.
+ */
+static struct sched_waiter **sched_pick(struct wm_sched *s, long long now)
+{
+	struct sched_waiter **w, **best = NULL;
+
+	for (w = &s->waiters; *w; w = &(*w)->next) {
+		if (!best)
+			best = w;
+		else if ((*w)->deadline <= now || (*best)->deadline <= now) {
+			if ((*w)->deadline < (*best)->deadline)
+				best = w;
+		} else if ((*w)->class < (*best)->class)
+			best = w;
+	}
+
+	return best;
+}
+
+void wm_sched_enter(struct wm_drive *d, enum wm_sched_class c)
+{
+	struct wm_sched *s = d->sched;
+	struct sched_waiter me, **w;
+	long long start, late;
+
+	if (!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->busy && pthread_equal(s->holder, pthread_self())) {
+		s->depth++;
+		pthread_mutex_unlock(&s->lock);
+		return;
+	}
+	if (!s->busy) {
+		s->busy = 1;
+		s->depth = 1;
+		s->holder = pthread_self();
+		pthread_mutex_unlock(&s->lock);
+		return;
+	}
+
+	start = wm_monotonic_nsec();
+	me.next = NULL;
+	me.class = c;
+	me.deadline = start + sched_deadline_usec[c] * 1000;
+	me.thread = pthread_self();
+	me.granted = 0;
+	for (w = &s->waiters; *w; w = &(*w)->next)
+		;
+	*w = &me;
+
+	while (!me.granted)
+		pthread_cond_wait(&s->granted, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+
+	wm_stats_add(d->stats, WM_STATS_SCHED_WAITS, 1);
+	if (c == WM_SCHED_AUDIO)
+		wm_stats_time(d->stats, WM_STATS_HIST_AUDIO_WAIT, start);
+	late = wm_monotonic_nsec() - me.deadline;
+	if (late > 0) {
+		wm_stats_add(d->stats, WM_STATS_SCHED_MISSES, 1);
+		WM_TRACE_INSTANT("deadline miss", c);
+	}
+	WM_TRACE_SPAN(sched_wait_names[c], start, late / 1000);
+}
+
+void wm_sched_leave(struct wm_drive *d)
+{
+	struct wm_sched *s = d->sched;
+	struct sched_waiter **w, *next;
+
+	if (!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	if (--s->depth > 0) {
+		pthread_mutex_unlock(&s->lock);
+		return;
+	}
+
+	if ((w = sched_pick(s, wm_monotonic_nsec()))) {
+		next = *w;
+		*w = next->next;
+		s->depth = 1;
+		s->holder = next->thread;
+		next->granted = 1;
+		pthread_cond_broadcast(&s->granted);
+	} else {
+		s->busy = 0;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+int wm_sched_drive_status(struct wm_drive *d, int oldmode, int *mode,
+	int *pos, int *track, int *ind)
+{
+	struct wm_sched *s = d->sched;
+	unsigned long gen;
+	int ret;
+
+	if (!s)
+		return d->proto.get_drive_status(d, oldmode, mode, pos, track, ind);
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		if (s->status_valid && s->status_oldmode == oldmode &&
+			wm_monotonic_nsec() - s->status_stamp < WM_SCHED_STATUS_REUSE * 1000LL) {
+			*mode = s->status_mode;
+			*pos = s->status_pos;
+			*track = s->status_track;
+			*ind = s->status_ind;
+			ret = s->status_ret;
+			pthread_mutex_unlock(&s->lock);
+			wm_stats_add(d->stats, WM_STATS_STATUS_COALESCED, 1);
+			return ret;
+		}
+		if (!s->status_busy)
+			break;
+		pthread_cond_wait(&s->status_done, &s->lock);
+	}
+	s->status_busy = 1;
+	gen = s->status_gen;
+	pthread_mutex_unlock(&s->lock);
+
+	ret = d->proto.get_drive_status(d, oldmode, mode, pos, track, ind);
+
+	pthread_mutex_lock(&s->lock);
+	/* a command in the meantime may have made the answer stale */
+	if (gen == s->status_gen && ret >= 0) {
+		s->status_valid = 1;
+		s->status_stamp = wm_monotonic_nsec();
+		s->status_ret = ret;
+		s->status_oldmode = oldmode;
+		s->status_mode = *mode;
+		s->status_pos = *pos;
+		s->status_track = *track;
+		s->status_ind = *ind;
+	}
+	s->status_busy = 0;
+	pthread_cond_broadcast(&s->status_done);
+	pthread_mutex_unlock(&s->lock);
+
+	return ret;
+}
+
+void wm_sched_invalidate(struct wm_drive *d)
+{
+	struct wm_sched *s = d->sched;
+
+	if (!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	s->status_valid = 0;
+	s->status_gen++;
+	pthread_mutex_unlock(&s->lock);
+}
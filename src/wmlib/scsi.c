@@ -34,6 +34,9 @@
 #include "include/wm_helpers.h"
 #include "include/wm_cdrom.h"
 #include "include/wm_cdtext.h"
+#include "include/wm_stats.h"
+#include "include/wm_sched.h"
+#include "include/wm_trace.h"
 
 #define SCMD_INQUIRY		0x12
 #define SCMD_MODE_SELECT	0x15
@@ -45,6 +48,40 @@
 #define SCMD_PLAY_AUDIO_MSF	0x47
 #define SCMD_PAUSE_RESUME	0x4b
 #define SCMD_SET_CD_SPEED       0xbb
+#define SCMD_SET_STREAMING	0xb6
+#define SCMD_MECHANISM_STATUS	0xbd
+#define SCMD_READ_CD		0xbe
+
+/*
+ * Scheduling class of a command, see wm_sched.h.  Reading the mode
+ * pages is how the volume gets polled.
+ */
+static enum wm_sched_class scsi_class(unsigned char opcode)
+{
+	switch (opcode) {
+	case 0x28:	/* READ(10) */
+	case 0xa8:	/* READ(12) */
+	case 0xb9:	/* READ CD MSF */
+	case SCMD_READ_CD:
+		return WM_SCHED_AUDIO;
+	case 0x00:	/* TEST UNIT READY */
+	case 0x03:	/* REQUEST SENSE */
+	case SCMD_MODE_SENSE:
+	case 0x5a:	/* MODE SENSE(10) */
+	case SCMD_READ_SUBCHANNEL:
+	case 0x4a:	/* GET EVENT STATUS NOTIFICATION */
+	case SCMD_MECHANISM_STATUS:
+		return WM_SCHED_STATUS;
+	case SCMD_INQUIRY:
+	case SCMD_READ_TOC:
+	case 0x46:	/* GET CONFIGURATION */
+	case 0x51:	/* READ DISC INFORMATION */
+	case 0x52:	/* READ TRACK INFORMATION */
+		return WM_SCHED_METADATA;
+	default:
+		return WM_SCHED_CONTROL;
+	}
+}
 
 #define SUBQ_STATUS_INVALID	0x00
 #define SUBQ_STATUS_PLAY	0x11
@@ -134,8 +171,18 @@ sendscsi( struct wm_drive *d, void *buf,
 		break;
 	}
 
-	if(d->proto.scsi)
-		return d->proto.scsi(d, cdb, cdblen, buf, len, dir);
+	if(d->proto.scsi) {
+		long long start;
+		int ret;
+
+		wm_sched_enter(d, scsi_class(cdb[0]));
+		start = wm_monotonic_nsec();
+		ret = d->proto.scsi(d, cdb, cdblen, buf, len, dir);
+		wm_sched_leave(d);
+		wm_stats_scsi(d->stats, cdb[0], start);
+		WM_TRACE_SPAN("scsi", start, cdb[0]);
+		return ret;
+	}
 	return -1;
 }
 
@@ -593,8 +640,8 @@ wm_scsi_get_cdtext(struct wm_drive *d, unsigned char **pp_buffer, int *p_buffer_
 		wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
 			"CDTEXT ERROR: READ_TOC(0x43) with format code 0x05 not implemented or broken. ret = %i!\n", ret);
 	} else {
-		cdtext_data_length = temp[0]*0xFF + temp[1] + 4 + 1; /* divide by 18 + 4 ? */
-    /* cdtext_data_length%18 == 0;? */
+		/* the length field counts the bytes after itself */
+		cdtext_data_length = (temp[0] << 8) + temp[1] + 2;
 		wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
 			"CDTEXT INFO: CDTEXT is %i byte(s) long\n", cdtext_data_length);
     /* cdc_buffer[2];  cdc_buffer[3]; reserwed */
@@ -612,12 +659,11 @@ wm_scsi_get_cdtext(struct wm_drive *d, unsigned char **pp_buffer, int *p_buffer_
 			wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
 				"CDTEXT ERROR: READ_TOC(0x43) with format code 0x05 not implemented or broken. ret = %i!\n", ret);
 		} else {
-			cdtext_data_length = temp[0]*0xFF + temp[1] + 4 + 1; /* divide by 18 + 4 ? */
 			wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
 				"CDTEXT INFO: read %i byte(s) of CDTEXT\n", cdtext_data_length);
 
-			/* send cdtext only 18 bytes packs * ? */
-			*(p_buffer_length) = cdtext_data_length - 4;
+			/* send cdtext only 18 bytes packs */
+			*(p_buffer_length) = (cdtext_data_length - 4) / 18 * 18;
 			*pp_buffer = malloc(*p_buffer_length);
 			if(!(*pp_buffer)) {
 				return -1;
@@ -639,7 +685,113 @@ wm_scsi_set_speed(struct wm_drive *d, int read_speed)
 	ret = sendscsi(d, NULL, 0, 0,
 		SCMD_SET_CD_SPEED, 0x00, (read_speed>>8) & 0xFF, read_speed & 0xFF, 0xFF, 0xFF,
 		0, 0, 0, 0, 0, 0);
-	wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
-		"wm_scsi_set_speed returns %i\n", ret);
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+		"wm_scsi_set_speed(%i) returns %i\n", read_speed, ret);
 	return ret;
 } /* wm_scsi_set_speed() */
+
+static void put_be32(unsigned char *p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xFF;
+	p[1] = (v >> 16) & 0xFF;
+	p[2] = (v >> 8) & 0xFF;
+	p[3] = v & 0xFF;
+}
+
+/*
+ * The same with SET STREAMING, for MMC drives that ignore SET CD SPEED
+ * while reading.  The performance descriptor covers the whole disc,
+ * read_speed is in kB/s as well, -1 asks for the fastest.
+ */
+int
+wm_scsi_set_streaming(struct wm_drive *d, int read_speed)
+{
+	unsigned char desc[28];
+	unsigned long size = read_speed < 0 ? 0xFFFFFFFFUL : (unsigned long)read_speed;
+	unsigned long end = d->thiscd.length > 0 ? d->thiscd.length * 75UL - 1 : 0xFFFFFFFFUL;
+	int ret;
+
+	memset(desc, 0, sizeof(desc));
+	put_be32(desc + 8, end);
+	put_be32(desc + 12, size);	/* kB per ... */
+	put_be32(desc + 16, 1000);	/* ... 1000 ms */
+	put_be32(desc + 20, size);
+	put_be32(desc + 24, 1000);
+
+	ret = sendscsi(d, desc, sizeof(desc), 0,
+		SCMD_SET_STREAMING, 0, 0, 0, 0, 0, 0, 0, 0, 0, sizeof(desc), 0);
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+		"wm_scsi_set_streaming(%i) returns %i\n", read_speed, ret);
+	return ret;
+} /* wm_scsi_set_streaming() */
+
+/*
+ * The slot a changer has loaded, from MECHANISM STATUS.  Only the header
+ * is asked for, the slot tables aren't needed.
+ */
+int
+wm_scsi_get_current_slot(struct wm_drive *d)
+{
+	unsigned char buf[8];
+	int ret;
+
+	memset(buf, 0, sizeof(buf));
+	ret = sendscsi(d, buf, sizeof(buf), 1,
+		SCMD_MECHANISM_STATUS, 0, 0, 0, 0, 0, 0, 0, 0, sizeof(buf), 0, 0);
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+		"wm_scsi_get_current_slot() returns %i\n", ret);
+	if (ret)
+		return -1;
+
+	return (buf[0] & 0x1f) | ((buf[1] & 0x07) << 5);
+} /* wm_scsi_get_current_slot() */
+
+/*
+ * The Q subchannel of frames on their own, without the audio: READ CD
+ * with no main channel and formatted Q, 16 bytes per frame.
+ */
+int
+wm_scsi_read_subq(struct wm_drive *d, int lba, int frames, unsigned char *buf)
+{
+	return sendscsi(d, buf, frames * 16, 1,
+		SCMD_READ_CD, 0,
+		(lba >> 24) & 0xFF, (lba >> 16) & 0xFF, (lba >> 8) & 0xFF, lba & 0xFF,
+		(frames >> 16) & 0xFF, (frames >> 8) & 0xFF, frames & 0xFF,
+		0, 0x02, 0);
+} /* wm_scsi_read_subq() */
+
+/*
+ * READ SUB-CHANNEL for the media catalogue number (format 2) and the
+ * ISRC of a track (format 3).  The drive looks for them itself, they
+ * are 0 if the disc has none.
+ */
+static int
+read_subchannel_code(struct wm_drive *d, int format, int track, char *code, int len)
+{
+	unsigned char buf[24];
+
+	memset(buf, 0, sizeof(buf));
+	if (sendscsi(d, buf, sizeof(buf), 1, SCMD_READ_SUBCHANNEL, 0, 0x40, format,
+		0, 0, track, 0, sizeof(buf), 0, 0, 0))
+		return -1;
+
+	code[0] = '\0';
+	if (buf[8] & 0x80) {
+		memcpy(code, buf + 9, len);
+		code[len] = '\0';
+	}
+
+	return 0;
+}
+
+int
+wm_scsi_get_mcn(struct wm_drive *d, char *mcn)
+{
+	return read_subchannel_code(d, 2, 0, mcn, 13);
+} /* wm_scsi_get_mcn() */
+
+int
+wm_scsi_get_isrc(struct wm_drive *d, int track, char *isrc)
+{
+	return read_subchannel_code(d, 3, track, isrc, 12);
+} /* wm_scsi_get_isrc() */
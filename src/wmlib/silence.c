@@ -0,0 +1,273 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Silence detection.  The ranges of a disc are kept in one array in
+ * the order of the disc, the run being followed is merged into it
+ * whenever it ends or somebody asks.  Merging takes the union of
+ * overlapping ranges, so playing a part of the disc again finds the
+ * same ranges without adding any.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_silence.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SILENCE_NEON
+#endif
+
+/* 16 bit samples of one frame, both channels */
+#define SILENCE_SAMPLES (588 * 2)
+
+struct silence_range {
+	int track;
+	int start;
+	int length;		/* frames, 0 is none */
+};
+
+struct wm_silence {
+	pthread_mutex_t lock;
+	int threshold;
+	int min_frames;
+	unsigned long discid;
+	int ntracks;
+	int *starts;		/* ntracks + 1 with the lead-out */
+	int next;		/* frame after the last one fed */
+	struct silence_range run;	/* being followed */
+	struct silence_range *ranges;
+	int nranges, size;
+};
+
+/*
+ * 1 if no sample of the frame is further from zero than thr.  The
+ * vector loops OR together the lanes above thr or below -thr and test
+ * the result once at the end, a frame has no tail for the scalar loop
+ * there.
+ */
+static int silence_frame(const short *pcm, int thr)
+{
+	int i = 0, loud = 0;
+#ifdef __SSE2__
+	const __m128i hi = _mm_set1_epi16((short)thr), lo = _mm_set1_epi16((short)-thr);
+	__m128i v, acc = _mm_setzero_si128();
+
+	for (; i + 8 <= SILENCE_SAMPLES; i += 8) {
+		v = _mm_loadu_si128((const __m128i *)(pcm + i));
+		acc = _mm_or_si128(acc, _mm_or_si128(_mm_cmpgt_epi16(v, hi), _mm_cmplt_epi16(v, lo)));
+	}
+	loud = _mm_movemask_epi8(acc);
+#elif defined(SILENCE_NEON)
+	const int16x8_t hi = vdupq_n_s16((short)thr), lo = vdupq_n_s16((short)-thr);
+	uint16x8_t acc = vdupq_n_u16(0);
+	int16x8_t v;
+
+	for (; i + 8 <= SILENCE_SAMPLES; i += 8) {
+		v = vld1q_s16(pcm + i);
+		acc = vorrq_u16(acc, vorrq_u16(vcgtq_s16(v, hi), vcltq_s16(v, lo)));
+	}
+	loud = vmaxvq_u16(acc);
+#endif
+
+	for (; i < SILENCE_SAMPLES && !loud; i++)
+		loud = pcm[i] > thr || pcm[i] < -thr;
+
+	return !loud;
+}
+
+/* add r to the ranges if it is long enough, lock held */
+static void silence_keep(struct wm_silence *s, const struct silence_range *r)
+{
+	struct silence_range m = *r, *tmp;
+	int i, end;
+
+	if (m.length < s->min_frames)
+		return;
+
+	/* swallow what overlaps or touches it */
+	for (i = 0; i < s->nranges; i++) {
+		if (s->ranges[i].track != m.track || s->ranges[i].start > m.start + m.length ||
+		    s->ranges[i].start + s->ranges[i].length < m.start)
+			continue;
+		end = s->ranges[i].start + s->ranges[i].length;
+		if (end < m.start + m.length)
+			end = m.start + m.length;
+		if (m.start > s->ranges[i].start)
+			m.start = s->ranges[i].start;
+		m.length = end - m.start;
+
+		memmove(&s->ranges[i], &s->ranges[i + 1], (s->nranges - i - 1) * sizeof(m));
+		s->nranges--;
+		i--;
+	}
+
+	if (s->nranges == s->size) {
+		tmp = realloc(s->ranges, (s->size ? s->size * 2 : 16) * sizeof(m));
+		if (!tmp)
+			return;
+		s->ranges = tmp;
+		s->size = s->size ? s->size * 2 : 16;
+	}
+
+	for (i = s->nranges; i > 0 && s->ranges[i - 1].start > m.start; i--)
+		s->ranges[i] = s->ranges[i - 1];
+	s->ranges[i] = m;
+	s->nranges++;
+}
+
+/* the run is over, lock held */
+static void silence_end(struct wm_silence *s)
+{
+	silence_keep(s, &s->run);
+	s->run.length = 0;
+}
+
+struct wm_silence *wm_silence_new(int threshold, int min_frames)
+{
+	struct wm_silence *s = calloc(1, sizeof(*s));
+
+	if (!s)
+		return NULL;
+
+	pthread_mutex_init(&s->lock, NULL);
+	s->threshold = threshold < 0 ? 0 : threshold > 32767 ? 32767 : threshold;
+	s->min_frames = min_frames > 0 ? min_frames : 1;
+	s->next = -1;
+	return s;
+}
+
+void wm_silence_free(struct wm_silence *s)
+{
+	if (!s)
+		return;
+
+	pthread_mutex_destroy(&s->lock);
+	free(s->starts);
+	free(s->ranges);
+	free(s);
+}
+
+void wm_silence_disc(struct wm_silence *s, unsigned long discid,
+	int ntracks, const int *starts)
+{
+	int *tmp;
+
+	(void) pthread_mutex_lock(&s->lock);
+	silence_end(s);
+	s->next = -1;
+
+	if (discid != s->discid || ntracks != s->ntracks) {
+		s->nranges = 0;
+		s->discid = discid;
+		s->ntracks = 0;
+		tmp = realloc(s->starts, (ntracks + 1) * sizeof(*tmp));
+		if (tmp) {
+			s->starts = tmp;
+			memcpy(s->starts, starts, (ntracks + 1) * sizeof(*tmp));
+			s->ntracks = ntracks;
+		}
+	}
+	(void) pthread_mutex_unlock(&s->lock);
+}
+
+int wm_silence_feed(struct wm_silence *s, int frame, const void *buf, int nframes)
+{
+	const short *pcm = (const short *)buf;
+	int i, t, silent = 0;
+
+	(void) pthread_mutex_lock(&s->lock);
+
+	/* a seek, what came before is all there is of that run */
+	if (frame != s->next)
+		silence_end(s);
+
+	/* track t is [starts[t - 1], starts[t]), the pregap of track 1 is its */
+	for (t = 1; t < s->ntracks && frame >= s->starts[t]; t++)
+		;
+	if (!s->ntracks)
+		t = 0;
+
+	for (i = 0; i < nframes; i++, pcm += SILENCE_SAMPLES) {
+		if (t && t < s->ntracks && frame + i >= s->starts[t])
+			t++;
+
+		if (!silence_frame(pcm, s->threshold)) {
+			silence_end(s);
+			continue;
+		}
+		silent++;
+
+		if (s->run.length && s->run.track == t) {
+			s->run.length++;
+			continue;
+		}
+		silence_end(s);
+		s->run.track = t;
+		s->run.start = frame + i;
+		s->run.length = 1;
+	}
+	s->next = frame + nframes;
+
+	(void) pthread_mutex_unlock(&s->lock);
+	return silent;
+}
+
+int wm_silence_ranges(struct wm_silence *s, int track, int *starts, int *lengths, int max)
+{
+	int i, n = 0;
+
+	(void) pthread_mutex_lock(&s->lock);
+	/* the run goes on, it's merged again as it grows */
+	silence_keep(s, &s->run);
+
+	for (i = 0; i < s->nranges; i++) {
+		if (s->ranges[i].track != track)
+			continue;
+		if (n < max) {
+			starts[n] = s->ranges[i].start;
+			lengths[n] = s->ranges[i].length;
+		}
+		n++;
+	}
+	(void) pthread_mutex_unlock(&s->lock);
+
+	return n;
+}
+
+int wm_silence_at(struct wm_silence *s, int frame)
+{
+	int i, start = -1;
+
+	(void) pthread_mutex_lock(&s->lock);
+	silence_keep(s, &s->run);
+
+	for (i = 0; i < s->nranges && s->ranges[i].start <= frame; i++) {
+		if (frame < s->ranges[i].start + s->ranges[i].length) {
+			start = s->ranges[i].start;
+			break;
+		}
+	}
+	(void) pthread_mutex_unlock(&s->lock);
+
+	return start;
+}
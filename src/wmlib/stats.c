@@ -0,0 +1,263 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Per drive performance counters.  The reader, the player and the thread
+ * polling wm_cd_status() normally end up in different shards, so counting
+ * costs an uncontended add and no shared cache line.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_helpers.h"
+#include "include/wm_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WM_STATS_SHARDS 4
+
+struct wm_stats {
+	struct wm_stats_snapshot shard[WM_STATS_SHARDS];
+};
+
+#ifdef __GNUC__
+static __thread int stats_slot = -1;
+static __thread struct wm_stats *stats_bound = NULL;
+static int stats_next_slot = 0;
+
+#define STATS_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#else
+static int stats_slot = 0;
+static struct wm_stats *stats_bound = NULL;
+
+#define STATS_ADD(p, v) (*(p) += (v))
+#endif
+
+static const char *counter_names[WM_STATS_COUNTERS] = {
+	"reads",
+	"read_errors",
+	"bytes_read",
+	"retries",
+	"concealed",
+	"ring_fill",
+	"ring_samples",
+	"underruns",
+	"xruns",
+	"ioctls",
+	"scsi_commands",
+	"init_usec",
+	"cdda_starts",
+	"cdda_start_usec",
+	"switches",
+	"switch_usec",
+	"sched_waits",
+	"sched_misses",
+	"status_coalesced",
+	"speed_changes",
+	"cache_hits",
+	"cache_misses",
+	"cache_prefetched",
+	"cache_evictions",
+	"slots_scanned",
+	"slot_switches",
+	"slot_toc_reused",
+	"subq_reads",
+	"subq_scan_usec",
+	"silent_frames",
+	"deemphasized_frames"
+};
+
+static const char *hist_names[WM_STATS_HISTS] = {
+	"read",
+	"scsi",
+	"status",
+	"metadata",
+	"audio_wait",
+	"sink_callback"
+};
+
+static struct wm_stats_snapshot *stats_shard(struct wm_stats *s)
+{
+#ifdef __GNUC__
+	if (stats_slot < 0)
+		stats_slot = __atomic_fetch_add(&stats_next_slot, 1, __ATOMIC_RELAXED) % WM_STATS_SHARDS;
+#endif
+	return &s->shard[stats_slot];
+}
+
+/*
+ * 0..7 usec get a bucket each, above that 8 buckets per power of two.
+ */
+static int stats_bucket(long long usec)
+{
+	int high = 0, b;
+
+	if (usec < 8)
+		return usec < 0 ? 0 : (int)usec;
+
+#ifdef __GNUC__
+	high = 63 - __builtin_clzll((unsigned long long)usec);
+#else
+	while ((usec >> (high + 1)) > 0)
+		high++;
+#endif
+	b = (high - 2) * 8 + (int)((usec >> (high - 3)) & 7);
+	return b < WM_STATS_BUCKETS ? b : WM_STATS_BUCKETS - 1;
+}
+
+long long wm_stats_bucket_low(int bucket)
+{
+	if (bucket < 8)
+		return bucket;
+	return (long long)(8 + bucket % 8) << (bucket / 8 - 1);
+}
+
+long long wm_stats_bucket_high(int bucket)
+{
+	if (bucket < 8)
+		return bucket + 1;
+	return (long long)(9 + bucket % 8) << (bucket / 8 - 1);
+}
+
+long long wm_stats_percentile(const long long *hist, double p)
+{
+	long long total = 0, seen = 0;
+	int i;
+
+	for (i = 0; i < WM_STATS_BUCKETS; i++)
+		total += hist[i];
+	if (!total)
+		return 0;
+
+	for (i = 0; i < WM_STATS_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= total * p)
+			return wm_stats_bucket_high(i) - 1;
+	}
+
+	return wm_stats_bucket_high(WM_STATS_BUCKETS - 1) - 1;
+}
+
+struct wm_stats *wm_stats_new(void)
+{
+	return calloc(1, sizeof(struct wm_stats));
+}
+
+void wm_stats_free(struct wm_stats *s)
+{
+	free(s);
+}
+
+void wm_stats_add(struct wm_stats *s, enum wm_stats_counter c, long long v)
+{
+	if (s)
+		STATS_ADD(&stats_shard(s)->counter[c], v);
+}
+
+void wm_stats_time(struct wm_stats *s, enum wm_stats_hist h, long long start_nsec)
+{
+	if (s)
+		STATS_ADD(&stats_shard(s)->hist[h][stats_bucket((wm_monotonic_nsec() - start_nsec) / 1000)], 1);
+}
+
+void wm_stats_scsi(struct wm_stats *s, unsigned char opcode, long long start_nsec)
+{
+	struct wm_stats_snapshot *shard;
+
+	if (!s)
+		return;
+
+	shard = stats_shard(s);
+	STATS_ADD(&shard->counter[WM_STATS_SCSI], 1);
+	STATS_ADD(&shard->scsi[opcode], 1);
+	STATS_ADD(&shard->hist[WM_STATS_HIST_SCSI][stats_bucket((wm_monotonic_nsec() - start_nsec) / 1000)], 1);
+}
+
+void wm_stats_ioctl(struct wm_stats *s, unsigned long request)
+{
+	struct wm_stats_snapshot *shard;
+
+	if (!s)
+		return;
+
+	shard = stats_shard(s);
+	STATS_ADD(&shard->counter[WM_STATS_IOCTLS], 1);
+	/* the CDROM* ioctls are 0x53xx */
+	if ((request & ~0xffUL) == 0x5300)
+		STATS_ADD(&shard->ioctl[request & 0xff], 1);
+	else
+		STATS_ADD(&shard->ioctl[WM_STATS_IOCTL_OTHER], 1);
+}
+
+void wm_stats_bind(struct wm_stats *s)
+{
+	stats_bound = s;
+}
+
+void wm_stats_xrun(void)
+{
+	wm_stats_add(stats_bound, WM_STATS_XRUNS, 1);
+}
+
+void wm_stats_sink_time(long long start_nsec)
+{
+	wm_stats_time(stats_bound, WM_STATS_HIST_SINK_CALLBACK, start_nsec);
+}
+
+const char *wm_stats_counter_name(int c)
+{
+	return (c >= 0 && c < WM_STATS_COUNTERS) ? counter_names[c] : NULL;
+}
+
+const char *wm_stats_hist_name(int h)
+{
+	return (h >= 0 && h < WM_STATS_HISTS) ? hist_names[h] : NULL;
+}
+
+int wm_cd_get_stats(void *p, struct wm_stats_snapshot *snap)
+{
+	struct wm_drive *d = (struct wm_drive *)p;
+	const long long *src;
+	long long *dst;
+	size_t i, n = sizeof(*snap) / sizeof(long long);
+	int j;
+
+	memset(snap, 0, sizeof(*snap));
+	if (!d || !d->stats)
+		return -1;
+
+	dst = (long long *)snap;
+	for (j = 0; j < WM_STATS_SHARDS; j++) {
+		src = (const long long *)&d->stats->shard[j];
+		for (i = 0; i < n; i++)
+			dst[i] += src[i];
+	}
+
+	return 0;
+}
+
+int wm_cd_reset_stats(void *p)
+{
+	struct wm_drive *d = (struct wm_drive *)p;
+
+	if (!d || !d->stats)
+		return -1;
+
+	memset(d->stats, 0, sizeof(*d->stats));
+	return 0;
+}
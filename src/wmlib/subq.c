@@ -0,0 +1,345 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Index map of the disc from the Q subchannel, see wm_subq.h.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_cdrom.h"
+#include "include/wm_cddb.h"
+#include "include/wm_helpers.h"
+#include "include/wm_scsi.h"
+#include "include/wm_stats.h"
+#include "include/wm_subq.h"
+#include "include/wm_trace.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_MISC
+
+/*
+ * Frames read per probe.  Up to one frame in ten carries the MCN or an
+ * ISRC instead of the position, a burst always has a position.
+ */
+#define SUBQ_BURST 8
+
+/* track and index in one number that grows along the disc */
+#define SUBQ_KEY(track, index) ((track) * 100 + (index))
+
+struct subq_pos {
+	int frame;
+	int key;
+	int control;
+};
+
+static int bcd(unsigned char b)
+{
+	return (b >> 4) * 10 + (b & 0x0f);
+}
+
+/*
+ * The positions of the burst of frames from frame on, in q.  Returns
+ * how many there are, -1 if the drive can't read them.
+ */
+static int subq_probe(struct wm_drive *d, int frame, int leadout, struct subq_pos *q)
+{
+	unsigned char buf[SUBQ_BURST * 16];
+	const unsigned char *p;
+	int i, n = 0, frames = SUBQ_BURST;
+
+	if (frame + frames > leadout)
+		frames = leadout - frame;
+	if (frames <= 0)
+		return -1;
+
+	wm_stats_add(d->stats, WM_STATS_SUBQ_READS, 1);
+	if (wm_scsi_read_subq(d, frame - 150, frames, buf))
+		return -1;
+
+	for (i = 0; i < frames; i++) {
+		p = buf + i * 16;
+		if ((p[0] & 0x0f) != 1)
+			continue;
+		q[n].frame = bcd(p[7]) * 60 * 75 + bcd(p[8]) * 75 + bcd(p[9]);
+		q[n].key = SUBQ_KEY(bcd(p[1]), bcd(p[2]));
+		q[n].control = p[0] >> 4;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * The first frame in (lo, hi] at or past key, with lo known to be
+ * before and hi at or past it.  -1 if the drive can't tell.
+ */
+static int subq_search(struct wm_drive *d, int lo, int hi, int leadout, int key)
+{
+	struct subq_pos q[SUBQ_BURST];
+	int mid, n, i, moved;
+
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if ((n = subq_probe(d, mid, leadout, q)) < 0)
+			return -1;
+
+		moved = 0;
+		for (i = 0; i < n; i++) {
+			if (q[i].frame <= lo || q[i].frame >= hi)
+				continue;
+			moved = 1;
+			if (q[i].key >= key) {
+				hi = q[i].frame;
+				break;
+			}
+			lo = q[i].frame;
+		}
+		/* no position up to hi, the boundary can't be told closer */
+		if (!moved)
+			lo = mid;
+	}
+
+	return hi;
+}
+
+/* the last position of track up to frame, -1 if none */
+static int subq_last(struct wm_drive *d, int first, int frame, int leadout,
+	int track, struct subq_pos *last)
+{
+	struct subq_pos q[SUBQ_BURST];
+	int n, i, found = -1;
+
+	n = subq_probe(d, frame - SUBQ_BURST + 1 > first ? frame - SUBQ_BURST + 1 : first,
+		leadout, q);
+	for (i = 0; i < n; i++) {
+		if (q[i].frame <= frame && q[i].key / 100 == track) {
+			*last = q[i];
+			found = i;
+		}
+	}
+
+	return found;
+}
+
+void wm_subq_free(struct wm_drive *d)
+{
+	free(d->subq);
+	d->subq = NULL;
+}
+
+int wm_cd_scan_subq(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	const struct wm_trackinfo *trk = pdrive->thiscd.trk;
+	struct wm_subq_track *t;
+	struct wm_subq *m;
+	struct subq_pos last;
+	long long start = wm_monotonic_nsec();
+	unsigned long discid;
+	int ntracks, i, k, b, end;
+
+	ntracks = wm_cd_getcountoftracks(pdrive);
+	if (ntracks < 1 || !trk || !pdrive->proto.scsi)
+		return -1;
+
+	discid = cddb_discid(pdrive);
+	if (pdrive->subq && pdrive->subq->discid == discid)
+		return 0;
+
+	m = calloc(1, sizeof(*m) + ntracks * sizeof(m->tracks[0]));
+	if (!m)
+		return -1;
+	m->tracks = (struct wm_subq_track *)(m + 1);
+	m->discid = discid;
+	m->ntracks = ntracks;
+	m->leadout = trk[ntracks].start;
+
+	/* all zeroes is how many discs say they have none */
+	if (wm_scsi_get_mcn(pdrive, m->mcn) || strspn(m->mcn, "0") == strlen(m->mcn))
+		m->mcn[0] = '\0';
+
+	/* where INDEX 00 begins, track 1's from 00:00:00 */
+	for (i = 0; i < ntracks; i++) {
+		t = &m->tracks[i];
+		t->nindex = 1;
+		t->index[0] = trk[i].start;
+		t->control = trk[i].data ? WM_SUBQ_DATA : 0;
+
+		if (i == 0) {
+			t->pregap = trk[0].start;
+			continue;
+		}
+		b = subq_search(pdrive, trk[i - 1].start, trk[i].start, m->leadout,
+			SUBQ_KEY(i + 1, 0));
+		if (b < 0)
+			wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
+				"subq: no pregap of track %i\n", i + 1);
+		t->pregap = b < 0 ? 0 : trk[i].start - b;
+	}
+
+	/* the last frame of a track has its control bits and last index */
+	for (i = 0; i < ntracks; i++) {
+		t = &m->tracks[i];
+		end = (i + 1 < ntracks ? m->tracks[i + 1].index[0] - m->tracks[i + 1].pregap :
+			m->leadout) - 1;
+
+		if (subq_last(pdrive, t->index[0], end, m->leadout, i + 1, &last) >= 0) {
+			t->control = last.control;
+			/* Q is what counts, also where the TOC had no control bits */
+			pdrive->thiscd.trk[i].preemphasis =
+				(t->control & (WM_SUBQ_PREEMPHASIS|WM_SUBQ_DATA)) == WM_SUBQ_PREEMPHASIS;
+			for (k = 2; k <= last.key % 100 && k <= WM_SUBQ_MAX_INDEX; k++) {
+				b = subq_search(pdrive, t->index[t->nindex - 1], last.frame,
+					m->leadout, SUBQ_KEY(i + 1, k));
+				if (b < 0)
+					break;
+				t->index[t->nindex++] = b;
+			}
+		}
+
+		if (!(t->control & WM_SUBQ_DATA) && wm_scsi_get_isrc(pdrive, i + 1, t->isrc))
+			t->isrc[0] = '\0';
+	}
+
+	free(pdrive->subq);
+	pdrive->subq = m;
+
+	wm_stats_add(pdrive->stats, WM_STATS_SUBQ_SCAN_USEC, (wm_monotonic_nsec() - start) / 1000);
+	WM_TRACE_SPAN("subq scan", start, ntracks);
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS,
+		"subq: %i tracks scanned in %lld msec\n", ntracks,
+		(wm_monotonic_nsec() - start) / 1000000);
+
+	return 0;
+}
+
+const struct wm_subq *wm_cd_get_subq(void *p)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+
+	return pdrive->subq;
+}
+
+/*--------------------------------------------------------------------------*
+ * CUE sheet
+ *--------------------------------------------------------------------------*/
+
+struct cue_buf {
+	char *text;
+	size_t len, size;
+	int failed;
+};
+
+#ifdef __GNUC__
+static void cue_printf(struct cue_buf *cue, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+#endif
+
+static void cue_printf(struct cue_buf *cue, const char *fmt, ...)
+{
+	va_list ap;
+	char *tmp;
+	int n;
+
+	if (cue->failed)
+		return;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(cue->text + cue->len, cue->size - cue->len, fmt, ap);
+		va_end(ap);
+		if (n < 0) {
+			cue->failed = 1;
+			return;
+		}
+		if (cue->len + n < cue->size)
+			break;
+
+		tmp = realloc(cue->text, cue->size * 2 + n);
+		if (!tmp) {
+			cue->failed = 1;
+			return;
+		}
+		cue->text = tmp;
+		cue->size = cue->size * 2 + n;
+	}
+	cue->len += n;
+}
+
+/* frame of the disc as a time in the file, which begins at 00:02:00 */
+static void cue_index(struct cue_buf *cue, int index, int frame)
+{
+	frame -= 150;
+	cue_printf(cue, "    INDEX %02i %02i:%02i:%02i\n", index,
+		frame / (60 * 75), frame / 75 % 60, frame % 75);
+}
+
+char *wm_cd_cue_sheet(void *p, const char *file_name)
+{
+	struct wm_drive *pdrive = (struct wm_drive *)p;
+	const struct wm_subq *m;
+	const struct wm_subq_track *t;
+	struct cue_buf cue = { NULL, 0, 256, 0 };
+	int i, k;
+
+	if (wm_cd_scan_subq(pdrive))
+		return NULL;
+	m = pdrive->subq;
+
+	cue.text = malloc(cue.size);
+	if (!cue.text)
+		return NULL;
+	cue.text[0] = '\0';
+
+	if (m->mcn[0])
+		cue_printf(&cue, "CATALOG %s\n", m->mcn);
+	cue_printf(&cue, "FILE \"%s\" WAVE\n", file_name);
+
+	for (i = 0; i < m->ntracks; i++) {
+		t = &m->tracks[i];
+
+		cue_printf(&cue, "  TRACK %02i %s\n", i + 1,
+			(t->control & WM_SUBQ_DATA) ? "MODE1/2352" : "AUDIO");
+		if (t->control & (WM_SUBQ_PREEMPHASIS|WM_SUBQ_COPY|WM_SUBQ_FOUR_CHANNEL))
+			cue_printf(&cue, "    FLAGS%s%s%s\n",
+				(t->control & WM_SUBQ_COPY) ? " DCP" : "",
+				(t->control & WM_SUBQ_FOUR_CHANNEL) ? " 4CH" : "",
+				(t->control & WM_SUBQ_PREEMPHASIS) ? " PRE" : "");
+		if (t->isrc[0])
+			cue_printf(&cue, "    ISRC %s\n", t->isrc);
+
+		/* the 2 seconds before track 1 aren't in the file */
+		if (i == 0 && t->pregap > 150)
+			cue_index(&cue, 0, 150);
+		else if (i > 0 && t->pregap > 0)
+			cue_index(&cue, 0, t->index[0] - t->pregap);
+		for (k = 0; k < t->nindex; k++)
+			cue_index(&cue, k + 1, t->index[k]);
+	}
+
+	if (cue.failed) {
+		free(cue.text);
+		return NULL;
+	}
+
+	return cue.text;
+}
@@ -0,0 +1,342 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Shared memory PCM tap, see wm_tap.h for the layout.
+ *
+ * Publishing a block is a copy into the ring, a few stores and one
+ * FUTEX_WAKE, the same with no reader or a hundred.  The file is sealed
+ * against resizing, so a reader can't make the player fault.
+ */
+
+#define _GNU_SOURCE /* memfd_create, F_ADD_SEALS */
+
+#include "include/wm_config.h"
+#include "include/wm_struct.h"
+#include "include/wm_helpers.h"
+#include "include/wm_tap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_MISC
+
+#if defined(__linux__) && defined(__GNUC__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct wm_tap {
+	int fd;
+	size_t size;
+	unsigned char *map;
+	struct wm_tap_header *h;
+	uint64_t head;
+	long block_bytes;
+};
+
+struct wm_tap_reader {
+	size_t size;
+	const unsigned char *map;
+	const struct wm_tap_header *h;
+	uint64_t next;
+	long long skipped;
+};
+
+static struct wm_tap_slot *tap_slot(const struct wm_tap_header *h, uint64_t n)
+{
+	return (struct wm_tap_slot *)((char *)h + WM_TAP_HEADER_SIZE +
+		(size_t)(n % h->slots) * h->slot_size);
+}
+
+struct wm_tap *wm_tap_new(long block_bytes)
+{
+	struct wm_tap *t;
+	struct wm_tap_header *h;
+	size_t slot_size;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	/* keep every slot on its own cache lines */
+	slot_size = (sizeof(struct wm_tap_slot) + 63) & ~(size_t)63;
+	slot_size = (slot_size + block_bytes + 63) & ~(size_t)63;
+	t->size = WM_TAP_HEADER_SIZE + WM_TAP_SLOTS * slot_size;
+	t->block_bytes = block_bytes;
+
+	t->fd = memfd_create("kcompactdisc-pcm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (t->fd < 0) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"tap: memfd_create failed: %s\n", strerror(errno));
+		free(t);
+		return NULL;
+	}
+
+	if (ftruncate(t->fd, t->size) ||
+	    fcntl(t->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"tap: can't size the ring: %s\n", strerror(errno));
+		close(t->fd);
+		free(t);
+		return NULL;
+	}
+
+	t->map = mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+	if (t->map == MAP_FAILED) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"tap: mmap failed: %s\n", strerror(errno));
+		close(t->fd);
+		free(t);
+		return NULL;
+	}
+
+	h = t->h = (struct wm_tap_header *)t->map;
+	h->slots = WM_TAP_SLOTS;
+	h->slot_size = slot_size;
+	h->data_offset = (sizeof(struct wm_tap_slot) + 63) & ~(size_t)63;
+	h->rate = 44100;
+	h->channels = 2;
+	h->bits = 16;
+	h->version = WM_TAP_VERSION;
+	__atomic_store_n(&h->magic, WM_TAP_MAGIC, __ATOMIC_RELEASE);
+
+	wm_lib_message(WM_MSG_LEVEL_DEBUG|WM_MSG_CLASS,
+		"tap: %lu bytes in fd %d\n", (unsigned long)t->size, t->fd);
+	return t;
+}
+
+void wm_tap_free(struct wm_tap *t)
+{
+	if (!t)
+		return;
+
+	munmap(t->map, t->size);
+	close(t->fd);
+	free(t);
+}
+
+int wm_tap_fd(struct wm_tap *t)
+{
+	return t ? t->fd : -1;
+}
+
+void wm_tap_publish(struct wm_tap *t, const struct wm_cdda_block *block, long long stamp)
+{
+	struct wm_tap_slot *s = tap_slot(t->h, t->head);
+	uint64_t n = t->head;
+	long bytes = block->buflen < t->block_bytes ? block->buflen : t->block_bytes;
+
+	__atomic_store_n(&s->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy((char *)s + t->h->data_offset, block->buf, bytes);
+	s->stamp = stamp;
+	s->frame = block->frame;
+	s->bytes = bytes;
+	s->track = block->track;
+	s->index = block->index;
+
+	__atomic_store_n(&s->seq, 2 * n + 2, __ATOMIC_RELEASE);
+	t->head = n + 1;
+	__atomic_store_n(&t->h->head, t->head, __ATOMIC_RELEASE);
+
+	__atomic_add_fetch(&t->h->wake, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &t->h->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+struct wm_tap_reader *wm_tap_attach(int fd)
+{
+	struct wm_tap_reader *r;
+	const struct wm_tap_header *h;
+	struct stat st;
+	void *map;
+
+	if (fstat(fd, &st) || st.st_size < WM_TAP_HEADER_SIZE)
+		return NULL;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	h = map;
+	if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != WM_TAP_MAGIC ||
+	    h->version != WM_TAP_VERSION || !h->slots || h->data_offset >= h->slot_size ||
+	    WM_TAP_HEADER_SIZE + (uint64_t)h->slots * h->slot_size > (uint64_t)st.st_size) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	r->size = st.st_size;
+	r->map = map;
+	r->h = h;
+	r->next = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+	return r;
+}
+
+void wm_tap_detach(struct wm_tap_reader *r)
+{
+	if (!r)
+		return;
+
+	munmap((void *)r->map, r->size);
+	free(r);
+}
+
+int wm_tap_next(struct wm_tap_reader *r, struct wm_tap_block *b)
+{
+	const struct wm_tap_slot *s;
+	uint64_t head;
+
+	for (;;) {
+		head = __atomic_load_n(&r->h->head, __ATOMIC_ACQUIRE);
+		if (r->next >= head)
+			return 0;
+
+		/* the slot of block head may be written right now */
+		if (head - r->next >= r->h->slots) {
+			r->skipped += head - r->h->slots + 1 - r->next;
+			r->next = head - r->h->slots + 1;
+		}
+
+		s = tap_slot(r->h, r->next);
+		if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) == 2 * r->next + 2)
+			break;
+
+		r->skipped++;
+		r->next++;
+	}
+
+	b->data = (const char *)s + r->h->data_offset;
+	b->bytes = s->bytes;
+	if (b->bytes > r->h->slot_size - r->h->data_offset)
+		b->bytes = r->h->slot_size - r->h->data_offset;
+	b->frame = s->frame;
+	b->track = s->track;
+	b->index = s->index;
+	b->stamp = s->stamp;
+	b->seq = r->next++;
+	return 1;
+}
+
+int wm_tap_valid(struct wm_tap_reader *r, const struct wm_tap_block *b)
+{
+	const struct wm_tap_slot *s = tap_slot(r->h, b->seq);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == 2 * b->seq + 2)
+		return 1;
+
+	r->skipped++;
+	return 0;
+}
+
+int wm_tap_wait(struct wm_tap_reader *r, int msec)
+{
+	struct timespec ts;
+	uint32_t wake;
+
+	wake = __atomic_load_n(&r->h->wake, __ATOMIC_ACQUIRE);
+	if (r->next < __atomic_load_n(&r->h->head, __ATOMIC_ACQUIRE))
+		return 1;
+
+	ts.tv_sec = msec / 1000;
+	ts.tv_nsec = (msec % 1000) * 1000000L;
+	syscall(SYS_futex, &r->h->wake, FUTEX_WAIT, wake, &ts, NULL, 0);
+
+	return r->next < __atomic_load_n(&r->h->head, __ATOMIC_ACQUIRE);
+}
+
+long long wm_tap_skipped(struct wm_tap_reader *r)
+{
+	return r->skipped;
+}
+
+#else /* !__linux__ */
+
+struct wm_tap *wm_tap_new(long block_bytes)
+{
+	(void)block_bytes;
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS, "tap: not supported here\n");
+	return NULL;
+}
+
+void wm_tap_free(struct wm_tap *t)
+{
+	(void)t;
+}
+
+int wm_tap_fd(struct wm_tap *t)
+{
+	(void)t;
+	return -1;
+}
+
+void wm_tap_publish(struct wm_tap *t, const struct wm_cdda_block *block, long long stamp)
+{
+	(void)t; (void)block; (void)stamp;
+}
+
+struct wm_tap_reader *wm_tap_attach(int fd)
+{
+	(void)fd;
+	return NULL;
+}
+
+void wm_tap_detach(struct wm_tap_reader *r)
+{
+	(void)r;
+}
+
+int wm_tap_next(struct wm_tap_reader *r, struct wm_tap_block *b)
+{
+	(void)r; (void)b;
+	return 0;
+}
+
+int wm_tap_valid(struct wm_tap_reader *r, const struct wm_tap_block *b)
+{
+	(void)r; (void)b;
+	return 0;
+}
+
+int wm_tap_wait(struct wm_tap_reader *r, int msec)
+{
+	(void)r; (void)msec;
+	return 0;
+}
+
+long long wm_tap_skipped(struct wm_tap_reader *r)
+{
+	(void)r;
+	return 0;
+}
+
+#endif /* __linux__ */
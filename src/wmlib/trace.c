@@ -0,0 +1,280 @@
+/*
+ * This file is part of WorkMan, the civilized CD player library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * Per thread trace rings and the Chrome trace event exporter.
+ *
+ * Only the owning thread writes a ring and publishes its head with a
+ * release store.  The exporter copies the rings without stopping the
+ * writers and drops the records a writer may have overwritten meanwhile.
+ */
+
+#include "include/wm_config.h"
+#include "include/wm_helpers.h"
+#include "include/wm_trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WM_MSG_CLASS WM_MSG_CLASS_MISC
+
+#define TRACE_MASK (WM_TRACE_RING - 1)
+
+struct trace_record {
+	long long ts;
+	long long dur;
+	long long arg;
+	const char *name;
+	char phase;
+};
+
+struct trace_ring {
+	unsigned long head;	/* records ever written */
+	int tid;
+	int retired;		/* owning thread has exited */
+	char name[32];
+	struct trace_record rec[WM_TRACE_RING];
+};
+
+int wm_trace_on = 0;
+
+#ifdef __GNUC__
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+static struct trace_ring *trace_rings[WM_TRACE_THREADS];
+static int trace_next_tid = 1;
+static long long trace_origin;
+
+static __thread struct trace_ring *trace_ring = NULL;
+static __thread char trace_name[32];
+
+static void trace_retire(void *p)
+{
+	struct trace_ring *r = p;
+
+	pthread_mutex_lock(&trace_lock);
+	r->retired = 1;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_init_key(void)
+{
+	pthread_key_create(&trace_key, trace_retire);
+}
+
+/*
+ * Find a ring for the calling thread: a new one while there are free
+ * slots, else the one of a thread which has gone away.
+ */
+static struct trace_ring *trace_attach(void)
+{
+	struct trace_ring *r = NULL;
+	int i;
+
+	pthread_once(&trace_once, trace_init_key);
+
+	pthread_mutex_lock(&trace_lock);
+	for (i = 0; i < WM_TRACE_THREADS; i++) {
+		if (!trace_rings[i]) {
+			r = trace_rings[i] = calloc(1, sizeof(struct trace_ring));
+			break;
+		}
+	}
+	for (i = 0; !r && i < WM_TRACE_THREADS; i++) {
+		if (trace_rings[i]->retired) {
+			r = trace_rings[i];
+			__atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+		}
+	}
+	if (r) {
+		r->retired = 0;
+		r->tid = trace_next_tid++;
+		if (trace_name[0])
+			strcpy(r->name, trace_name);
+		else
+			snprintf(r->name, sizeof(r->name), "thread %d", r->tid);
+	}
+	pthread_mutex_unlock(&trace_lock);
+
+	if (r)
+		pthread_setspecific(trace_key, r);
+	return r;
+}
+
+void wm_trace_event(char phase, const char *name, long long start, long long arg)
+{
+	struct trace_record *rec;
+	struct trace_ring *r = trace_ring;
+	unsigned long head;
+	long long now = wm_monotonic_nsec();
+
+	if (!r && !(r = trace_ring = trace_attach()))
+		return;
+
+	head = r->head;
+	rec = &r->rec[head & TRACE_MASK];
+	rec->phase = phase;
+	rec->name = name;
+	rec->arg = arg;
+	if (phase == 'X') {
+		rec->ts = start;
+		rec->dur = now - start;
+	} else {
+		rec->ts = now;
+		rec->dur = 0;
+	}
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void wm_trace_thread_name(const char *name)
+{
+	snprintf(trace_name, sizeof(trace_name), "%s", name);
+
+	if (trace_ring) {
+		pthread_mutex_lock(&trace_lock);
+		strcpy(trace_ring->name, trace_name);
+		pthread_mutex_unlock(&trace_lock);
+	}
+}
+
+/*
+ * Records from before the start are left in the rings and skipped by
+ * the exporter, resetting a ring under a running writer would race.
+ */
+void wm_trace_start(void)
+{
+	pthread_mutex_lock(&trace_lock);
+	trace_origin = wm_monotonic_nsec();
+	pthread_mutex_unlock(&trace_lock);
+
+	__atomic_store_n(&wm_trace_on, 1, __ATOMIC_RELAXED);
+}
+
+void wm_trace_stop(void)
+{
+	__atomic_store_n(&wm_trace_on, 0, __ATOMIC_RELAXED);
+}
+
+static void trace_time(FILE *f, const char *key, long long nsec)
+{
+	fprintf(f, ",\"%s\":%lld.%03lld", key, nsec / 1000, nsec % 1000);
+}
+
+static void trace_export_ring(FILE *f, struct trace_ring *r, struct trace_record *copy, int pid)
+{
+	unsigned long first, last, valid, i;
+	struct trace_record *rec;
+
+	fprintf(f, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+		"\"args\":{\"name\":\"%s\"}}", pid, r->tid, r->name);
+
+	last = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	first = last > WM_TRACE_RING ? last - WM_TRACE_RING : 0;
+	for (i = first; i < last; i++)
+		copy[i & TRACE_MASK] = r->rec[i & TRACE_MASK];
+
+	/* everything the writer got to since then may be torn */
+	valid = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	if (valid + 1 > first + WM_TRACE_RING)
+		first = valid + 1 - WM_TRACE_RING;
+
+	for (i = first; i < last; i++) {
+		rec = &copy[i & TRACE_MASK];
+		if (rec->ts < trace_origin)
+			continue;
+
+		fprintf(f, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d",
+			rec->phase, rec->name, pid, r->tid);
+		trace_time(f, "ts", rec->ts - trace_origin);
+		if (rec->phase == 'X')
+			trace_time(f, "dur", rec->dur);
+		else if (rec->phase == 'i')
+			fputs(",\"s\":\"t\"", f);
+		fprintf(f, ",\"args\":{\"%s\":%lld}}",
+			rec->phase == 'C' ? "value" : "arg", rec->arg);
+	}
+}
+
+int wm_trace_export(const char *path)
+{
+	struct trace_record *copy;
+	FILE *f;
+	int i, pid = getpid(), ret = 0;
+
+	if (!(copy = malloc(sizeof(struct trace_record) * WM_TRACE_RING)))
+		return -1;
+
+	if (!(f = fopen(path, "w"))) {
+		wm_lib_message(WM_MSG_LEVEL_ERROR|WM_MSG_CLASS,
+			"trace: cannot write %s\n", path);
+		free(copy);
+		return -1;
+	}
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	fprintf(f, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+		"\"args\":{\"name\":\"libworkman\"}}", pid);
+
+	pthread_mutex_lock(&trace_lock);
+	for (i = 0; i < WM_TRACE_THREADS && trace_rings[i]; i++) {
+		fputs(",\n", f);
+		trace_export_ring(f, trace_rings[i], copy, pid);
+	}
+	pthread_mutex_unlock(&trace_lock);
+
+	fputs("\n]}\n", f);
+	if (fclose(f))
+		ret = -1;
+	free(copy);
+
+	wm_lib_message(WM_MSG_LEVEL_INFO|WM_MSG_CLASS, "trace: wrote %s\n", path);
+	return ret;
+}
+
+#else /* !__GNUC__ */
+
+void wm_trace_event(char phase, const char *name, long long start, long long arg)
+{
+	(void)phase; (void)name; (void)start; (void)arg;
+}
+
+void wm_trace_thread_name(const char *name)
+{
+	(void)name;
+}
+
+void wm_trace_start(void)
+{
+}
+
+void wm_trace_stop(void)
+{
+}
+
+int wm_trace_export(const char *path)
+{
+	(void)path;
+	return -1;
+}
+
+#endif /* __GNUC__ */
@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <sys/time.h>
+#include <time.h>
 #include "include/workman_defs.h"
 #include "include/wm_config.h"
 #include "include/wm_helpers.h"
@@ -195,10 +196,11 @@ int wm_lib_get_verbosity( void )
  * defined in each module to reflect the correct message class.
  *
  */
-void wm_lib_message( unsigned int level, const char *fmt, ... )
+void (wm_lib_message)( unsigned int level, const char *fmt, ... )
 {
 	va_list ap;
-	
+	char buf[512], *msg = buf;
+	int len;
 	unsigned int l, c, vl, vc;
 	/* verbosity level */
 	vl = wm_lib_verbosity & WM_MSG_LEVEL_ALL;
@@ -213,10 +215,23 @@ void wm_lib_message( unsigned int level, const char *fmt, ... )
 	 */
 	if( (l <= vl) && (vc & c) )
 	{
-		fprintf(stderr, "libWorkMan: ");
+		/* one write, so messages of different threads don't mix */
 		va_start(ap, fmt);
-		vfprintf(stderr, fmt, ap);
+		len = vsnprintf(buf, sizeof(buf), fmt, ap);
 		va_end(ap);
+		if (len < 0)
+			return;
+		/* longer ones, e.g. CD-TEXT dumps, get a buffer of their own */
+		if ((size_t)len >= sizeof(buf) && (msg = malloc(len + 1))) {
+			va_start(ap, fmt);
+			vsnprintf(msg, len + 1, fmt, ap);
+			va_end(ap);
+		} else if (!msg) {
+			msg = buf;
+		}
+		fprintf(stderr, "libWorkMan: %s", msg);
+		if (msg != buf)
+			free(msg);
 	}
 } /* wm_lib_message() */
 
@@ -234,4 +249,16 @@ wm_susleep( int usec )
 	return (select(0, NULL, NULL, NULL, &tv));
 } /* wm_susleep() */
 
+/*
+ * Monotonic timestamp for latency measurements.
+ */
+long long
+wm_monotonic_nsec( void )
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+} /* wm_monotonic_nsec() */
+
 
@@ -20,9 +20,15 @@
 
 #include "wmlib_interface.h"
 
+#include <QFile>
+#include <QMutexLocker>
 #include <QtGlobal>
 
-#include <KLocalizedString>
+#include <cstdlib>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 extern "C"
 {
@@ -31,28 +37,78 @@ extern "C"
 	#include "wmlib/include/wm_cdrom.h"
 	#include "wmlib/include/wm_cdtext.h"
 	#include "wmlib/include/wm_helpers.h"
+	#include "wmlib/include/wm_stats.h"
+	#include "wmlib/include/wm_subq.h"
 }
 
-#define TRACK_VALID(track) ((track) && (track <= m_tracks))
+#define TRACK_VALID(track, tracks) ((track) && (track) <= (tracks))
+
+namespace
+{
+	// what wm_cd_scan_subq() found, carried from the drive's thread
+	struct Subchannel
+	{
+		unsigned discId = 0;
+		QString mcn;
+		QStringList isrcs;
+		QList<unsigned> pregaps;
+		QList<QList<unsigned>> indexes;
+	};
+}
 
 KWMLibCompactDiscPrivate::KWMLibCompactDiscPrivate(KCompactDisc *p,
 	const QString &dev, const QString &audioSystem, const QString &audioDevice) :
 	KCompactDiscPrivate(p, dev),
 	m_handle(nullptr),
 	m_audioSystem(audioSystem),
-	m_audioDevice(audioDevice)
+	m_audioDevice(audioDevice),
+	m_changerSerial(0),
+	m_silenceSkipped(-1),
+	m_volume(0),
+	m_balance(50),
+	m_slotCount(1),
+	m_currentSlot(0),
+	m_tapFd(-1)
 {
 	m_interface = m_audioSystem;
 }
 
 KWMLibCompactDiscPrivate::~KWMLibCompactDiscPrivate()
 {
+	m_worker.finish();
+
+	if (m_tapFd >= 0)
+		close(m_tapFd);
 	if (m_handle) {
 		wm_cd_destroy(m_handle);
 	}
 }
 
 bool KWMLibCompactDiscPrivate::createInterface()
+{
+	bool ok;
+
+	{
+		QMutexLocker locker(m_worker.lock());
+		ok = openHandle();
+	}
+	if (ok)
+		handleOpened();
+
+	return ok;
+}
+
+QFuture<bool> KWMLibCompactDiscPrivate::createInterfaceAsync()
+{
+	return m_worker.run([this]() { return openHandle(); }).then(this, [this](bool ok) {
+		if (ok)
+			handleOpened();
+		return ok;
+	});
+}
+
+// on the drive thread or with its lock held
+bool KWMLibCompactDiscPrivate::openHandle()
 {
 	const QString devicePath = KCompactDisc::cdromDeviceUrl(m_deviceName).path();
 
@@ -69,42 +125,129 @@ bool KWMLibCompactDiscPrivate::createInterface()
 		&m_handle);
 
 	if(!WM_CDS_ERROR(status)) {
-		m_deviceVendor = QLatin1String(wm_drive_vendor(m_handle));
-		m_deviceModel = QLatin1String(wm_drive_model(m_handle));
-		m_deviceRevision = QLatin1String(wm_drive_revision(m_handle));
-
-		Q_Q(KCompactDisc);
-		Q_EMIT q->discChanged(0);
-
-		if (m_infoMode == KCompactDisc::Asynchronous) {
-			timerExpired();
-		} else {
-			QTimer::singleShot(1000, this, SLOT(timerExpired()));
-		}
-
+		m_slotCount = (unsigned)wm_cd_changer_slots(m_handle);
 		return true;
 	}
+
 	m_handle = nullptr;
 	return false;
 }
 
+void KWMLibCompactDiscPrivate::handleOpened()
+{
+	Q_Q(KCompactDisc);
+	Q_EMIT q->discChanged(0);
+
+	if (slotCount() > 1)
+		scanSlots();
+
+	if (m_infoMode == KCompactDisc::Asynchronous) {
+		timerExpired();
+	} else {
+		QTimer::singleShot(1000, this, SLOT(timerExpired()));
+	}
+}
+
+/*
+ * The sound sink and the CDDA threads stay, only the drive is closed
+ * and the new one opened, see wm_cd_switch_device().
+ */
+bool KWMLibCompactDiscPrivate::switchDevice(const QString &deviceName,
+	const QString &audioSystem, const QString &audioDevice)
+{
+	bool ok;
+
+	if (!m_handle || audioSystem != m_audioSystem || audioDevice != m_audioDevice)
+		return false;
+
+	{
+		QMutexLocker locker(m_worker.lock());
+		ok = moveHandle(deviceName);
+	}
+	if (ok)
+		handleMoved(deviceName);
+
+	return ok;
+}
+
+QFuture<bool> KWMLibCompactDiscPrivate::switchDeviceAsync(const QString &deviceName,
+	const QString &audioSystem, const QString &audioDevice)
+{
+	if (!m_handle || audioSystem != m_audioSystem || audioDevice != m_audioDevice)
+		return QtFuture::makeReadyValueFuture(false);
+
+	return m_worker.run([this, deviceName]() { return moveHandle(deviceName); })
+		.then(this, [this, deviceName](bool ok) {
+			if (ok)
+				handleMoved(deviceName);
+			return ok;
+		});
+}
+
+bool KWMLibCompactDiscPrivate::moveHandle(const QString &deviceName)
+{
+	const QString devicePath = KCompactDisc::cdromDeviceUrl(deviceName).path();
+
+	if (WM_CDS_ERROR(wm_cd_switch_device(m_handle, devicePath.toLatin1().data())))
+		return false;
+
+	m_slotCount = (unsigned)wm_cd_changer_slots(m_handle);
+	return true;
+}
+
+void KWMLibCompactDiscPrivate::handleMoved(const QString &deviceName)
+{
+	m_deviceName = deviceName;
+	m_deviceVendor.clear();
+	m_deviceModel.clear();
+	m_deviceRevision.clear();
+	m_currentSlot = 0;
+	m_slotInfos.clear();
+
+	// let the next timerExpired() pick up the disc in the new drive
+	m_status = KCompactDisc::NoDisc;
+	clearDiscInfo();
+
+	if (slotCount() > 1)
+		scanSlots();
+}
+
+QFuture<void> KWMLibCompactDiscPrivate::runCommand(std::function<void()> command)
+{
+	return m_worker.run(std::move(command));
+}
+
+/*
+ * The GUI thread asks these, they come from the table of contents it
+ * has, the worker may hold the drive for seconds.  Seconds are counted
+ * like wmlib does, from the starts in whole seconds.
+ */
 unsigned KWMLibCompactDiscPrivate::trackLength(unsigned track)
 {
-	return (unsigned)wm_cd_gettracklen(m_handle, track);
+	const QList<unsigned> &frames = m_disc.trackStartFrames();
+
+	if (!track || track >= (unsigned)frames.size())
+		return 0;
+	return FRAMES2SEC(frames[track]) - FRAMES2SEC(frames[track - 1]);
 }
 
 bool KWMLibCompactDiscPrivate::isTrackAudio(unsigned track)
 {
-	return !wm_cd_gettrackdata(m_handle, track);
+	return !(m_disc.trackFlags(track) & KCompactDiscInfo::DataTrack);
 }
 
+/*
+ * Runs on the worker, with its lock held.  m_tracks belongs to the GUI
+ * thread, so the drive is asked how many tracks there are.
+ */
 void KWMLibCompactDiscPrivate::playTrackPosition(unsigned track, unsigned position)
 {
 	unsigned firstTrack, lastTrack;
+	const unsigned tracks = wm_cd_getcountoftracks(m_handle);
 
-	firstTrack = TRACK_VALID(track) ? track : 1;
+	firstTrack = TRACK_VALID(track, tracks) ? track : 1;
 	lastTrack = firstTrack + 1;
-	lastTrack = TRACK_VALID(lastTrack) ? lastTrack : WM_ENDTRACK;
+	lastTrack = TRACK_VALID(lastTrack, tracks) ? lastTrack : WM_ENDTRACK;
 
     qDebug() << "play track " << firstTrack << " position "
                  << position;
@@ -152,19 +295,32 @@ void KWMLibCompactDiscPrivate::setBalance(unsigned balance)
 	wm_cd_volume(m_handle, vol, bal);
 }
 
+/*
+ * From here on the GUI thread only tries the drive lock, while the
+ * worker has the drive it gets what it got last time.
+ */
 unsigned KWMLibCompactDiscPrivate::volume()
 {
+	if (!m_worker.lock()->tryLock())
+		return m_volume;
+
 	int vol = wm_cd_getvolume(m_handle);
-	unsigned volume = RANGE2PERCENT(vol, WM_VOLUME_MUTE, WM_VOLUME_MAXIMAL);
-	return volume;
+	m_worker.lock()->unlock();
+
+	m_volume = RANGE2PERCENT(vol, WM_VOLUME_MUTE, WM_VOLUME_MAXIMAL);
+	return m_volume;
 }
 
 unsigned KWMLibCompactDiscPrivate::balance()
 {
+	if (!m_worker.lock()->tryLock())
+		return m_balance;
+
 	int bal = wm_cd_getbalance(m_handle);
-	unsigned balance = RANGE2PERCENT(bal, WM_BALANCE_ALL_LEFTS, WM_BALANCE_ALL_RIGHTS);
+	m_worker.lock()->unlock();
 
-	return balance;
+	m_balance = RANGE2PERCENT(bal, WM_BALANCE_ALL_LEFTS, WM_BALANCE_ALL_RIGHTS);
+	return m_balance;
 }
 
 void KWMLibCompactDiscPrivate::queryMetadata()
@@ -173,6 +329,289 @@ void KWMLibCompactDiscPrivate::queryMetadata()
 	//cddb();
 }
 
+// known since the drive was opened
+unsigned KWMLibCompactDiscPrivate::slotCount()
+{
+	return m_handle ? m_slotCount : 1;
+}
+
+unsigned KWMLibCompactDiscPrivate::currentSlot()
+{
+	if (!m_handle)
+		return 0;
+
+	if (m_worker.lock()->tryLock()) {
+		m_currentSlot = (unsigned)wm_cd_changer_current(m_handle);
+		m_worker.lock()->unlock();
+	}
+	return m_currentSlot;
+}
+
+/*
+ * The slots come from the changer scan of wmlib, the drive isn't asked.
+ * The scan knows the table of contents only, the texts of a disc are
+ * read once it is loaded.
+ */
+KCompactDiscInfo KWMLibCompactDiscPrivate::slotInfo(unsigned slot)
+{
+	int starts[100], data[100];
+	unsigned long discId = 0;
+	QList<unsigned> frames;
+	QList<KCompactDiscInfo::TrackFlags> flags;
+	int tracks, i;
+
+	if (!m_handle)
+		return KCompactDiscPrivate::slotInfo(slot);
+
+	if (slot == currentSlot())
+		return m_disc;
+
+	// what the scan found doesn't change until the serial does
+	if (m_slotInfos.contains(slot) || !m_worker.lock()->tryLock())
+		return m_slotInfos.value(slot);
+
+	tracks = wm_cd_changer_slot_toc(m_handle, slot, &discId, starts, data, 100);
+	m_worker.lock()->unlock();
+	if (tracks <= 0 || tracks > 99)
+		return KCompactDiscInfo();
+
+	frames.reserve(tracks + 1);
+	flags.reserve(tracks);
+	for (i = 0; i < tracks; ++i) {
+		frames.append(starts[i]);
+		flags.append(data[i] ?
+			KCompactDiscInfo::TrackFlags(KCompactDiscInfo::DataTrack) :
+			KCompactDiscInfo::TrackFlags());
+	}
+	frames.append(starts[tracks]);
+
+	m_slotInfos.insert(slot, KCompactDiscInfo(tracks, discId, frames, flags));
+	return m_slotInfos.value(slot);
+}
+
+QFuture<void> KWMLibCompactDiscPrivate::selectSlotAsync(unsigned slot)
+{
+	if (!m_handle)
+		return QtFuture::makeReadyVoidFuture();
+
+	return m_worker.run([this, slot]() {
+		if (slot == (unsigned)wm_cd_changer_current(m_handle))
+			return false;
+		return wm_cd_changer_select(m_handle, slot) >= 0;
+	}).then(this, [this](bool loaded) {
+		// the next timerExpired() takes the slot's disc as a new one
+		if (loaded) {
+			m_status = KCompactDisc::NoDisc;
+			clearDiscInfo();
+		}
+	});
+}
+
+// the scan loads every slot, slotsChanged() tells when it's done
+void KWMLibCompactDiscPrivate::scanSlots()
+{
+	if (!m_handle)
+		return;
+
+	runCommand([this]() { wm_cd_changer_scan(m_handle); });
+}
+
+QFuture<void> KWMLibCompactDiscPrivate::scanSubchannelAsync()
+{
+	if (!m_handle)
+		return QtFuture::makeReadyVoidFuture();
+
+	return m_worker.run([this]() {
+		const struct wm_subq *subq;
+		Subchannel sub;
+
+		if (wm_cd_scan_subq(m_handle) || !(subq = wm_cd_get_subq(m_handle)))
+			return sub;
+
+		sub.discId = subq->discid;
+		sub.mcn = QString::fromLatin1(subq->mcn);
+		for (int i = 0; i < subq->ntracks; ++i) {
+			const struct wm_subq_track &t = subq->tracks[i];
+			QList<unsigned> indexes;
+
+			for (int k = 0; k < t.nindex; ++k)
+				indexes.append(t.index[k]);
+			sub.isrcs.append(QString::fromLatin1(t.isrc));
+			sub.pregaps.append(t.pregap);
+			sub.indexes.append(indexes);
+		}
+		return sub;
+	}).then(this, [this](const Subchannel &sub) {
+		// unless the disc went meanwhile
+		if (sub.discId && sub.discId == m_disc.discId())
+			setDiscInfo(m_disc.withSubchannel(sub.mcn, sub.isrcs, sub.pregaps, sub.indexes),
+				KCompactDisc::Subchannel);
+	});
+}
+
+QFuture<QString> KWMLibCompactDiscPrivate::cueSheetAsync(const QString &fileName)
+{
+	if (!m_handle)
+		return QtFuture::makeReadyValueFuture(QString());
+
+	return m_worker.run([this, fileName]() {
+		char *cue = wm_cd_cue_sheet(m_handle, QFile::encodeName(fileName).constData());
+		const QString sheet = QString::fromUtf8(cue);
+
+		free(cue);
+		return sheet;
+	});
+}
+
+// a copy of the tap is kept for when the worker has the drive
+int KWMLibCompactDiscPrivate::pcmTap()
+{
+	if (!m_handle)
+		return -1;
+
+	if (m_worker.lock()->tryLock()) {
+		const int fd = wm_cd_get_cdda_tap(m_handle);
+		if (m_tapFd >= 0)
+			close(m_tapFd);
+		m_tapFd = fd < 0 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		m_worker.lock()->unlock();
+	}
+	return m_tapFd < 0 ? -1 : fcntl(m_tapFd, F_DUPFD_CLOEXEC, 0);
+}
+
+// only stored, the reader takes it when it starts
+void KWMLibCompactDiscPrivate::setSilenceDetection(int threshold, unsigned minLength)
+{
+	if (!m_handle)
+		return;
+
+	wm_cd_set_cdda_silence(m_handle, threshold, (int)qMin(minLength, 3600000u));
+}
+
+QList<QPair<unsigned, unsigned>> KWMLibCompactDiscPrivate::silenceRanges(unsigned track)
+{
+	QList<QPair<unsigned, unsigned>> ranges;
+	QList<int> starts, lengths;
+	int n;
+
+	if (!m_handle)
+		return ranges;
+
+	if (!m_worker.lock()->tryLock())
+		return m_silenceRanges.value(track);
+
+	// the reader may add some in between
+	n = wm_cd_get_cdda_silence(m_handle, track, nullptr, nullptr, 0);
+	if (n > 0) {
+		starts.resize(n);
+		lengths.resize(n);
+		n = qMin(wm_cd_get_cdda_silence(m_handle, track, starts.data(), lengths.data(), n), n);
+	}
+	m_worker.lock()->unlock();
+
+	for (int i = 0; i < n; ++i)
+		ranges.append(qMakePair(unsigned(starts[i]), unsigned(lengths[i])));
+	m_silenceRanges.insert(track, ranges);
+	return ranges;
+}
+
+QVariantMap KWMLibCompactDiscPrivate::statistics()
+{
+	QVariantMap stats;
+	if (!m_handle)
+		return stats;
+
+	auto snap = std::make_unique<wm_stats_snapshot>();
+	if (wm_cd_get_stats(m_handle, snap.get()))
+		return stats;
+
+	QVariantMap counters;
+	for (int i = 0; i < WM_STATS_COUNTERS; ++i)
+		counters[QLatin1String(wm_stats_counter_name(i))] = snap->counter[i];
+	stats[QStringLiteral("counters")] = counters;
+
+	if (snap->counter[WM_STATS_RING_SAMPLES])
+		stats[QStringLiteral("ring_occupancy")] =
+			double(snap->counter[WM_STATS_RING_FILL]) / snap->counter[WM_STATS_RING_SAMPLES];
+
+	int speed, refill;
+	if (!wm_cd_get_cdda_speed(m_handle, &speed, &refill)) {
+		stats[QStringLiteral("read_speed")] = speed;
+		stats[QStringLiteral("refill_kbps")] = refill;
+	}
+
+	long cached, budget;
+	if (!wm_cd_get_cdda_cache(m_handle, &cached, &budget) && budget) {
+		stats[QStringLiteral("cache_bytes")] = qlonglong(cached);
+		stats[QStringLiteral("cache_budget")] = qlonglong(budget);
+	}
+
+	QVariantMap scsi;
+	for (int i = 0; i < 256; ++i) {
+		if (snap->scsi[i])
+			scsi[QStringLiteral("0x%1").arg(i, 2, 16, QLatin1Char('0'))] = snap->scsi[i];
+	}
+	stats[QStringLiteral("scsi")] = scsi;
+
+	QVariantMap ioctls;
+	for (int i = 0; i < WM_STATS_IOCTL_OTHER; ++i) {
+		if (snap->ioctl[i])
+			ioctls[QStringLiteral("0x53%1").arg(i, 2, 16, QLatin1Char('0'))] = snap->ioctl[i];
+	}
+	if (snap->ioctl[WM_STATS_IOCTL_OTHER])
+		ioctls[QStringLiteral("other")] = snap->ioctl[WM_STATS_IOCTL_OTHER];
+	stats[QStringLiteral("ioctl")] = ioctls;
+
+	QVariantMap histograms;
+	for (int h = 0; h < WM_STATS_HISTS; ++h) {
+		const long long *hist = snap->hist[h];
+		QVariantList buckets;
+		qlonglong count = 0;
+
+		for (int b = 0; b < WM_STATS_BUCKETS; ++b) {
+			if (!hist[b])
+				continue;
+			count += hist[b];
+			buckets.append(QVariant(QVariantList{ wm_stats_bucket_low(b), wm_stats_bucket_high(b), hist[b] }));
+		}
+
+		QVariantMap histogram;
+		histogram[QStringLiteral("count")] = count;
+		histogram[QStringLiteral("p50_us")] = wm_stats_percentile(hist, 0.5);
+		histogram[QStringLiteral("p90_us")] = wm_stats_percentile(hist, 0.9);
+		histogram[QStringLiteral("p99_us")] = wm_stats_percentile(hist, 0.99);
+		histogram[QStringLiteral("max_us")] = wm_stats_percentile(hist, 1.0);
+		histogram[QStringLiteral("buckets")] = buckets;
+		histograms[QLatin1String(wm_stats_hist_name(h))] = histogram;
+	}
+	stats[QStringLiteral("histograms")] = histograms;
+
+	return stats;
+}
+
+void KWMLibCompactDiscPrivate::resetStatistics()
+{
+	if (m_handle)
+		wm_cd_reset_stats(m_handle);
+}
+
+/*
+ * Asking the drive for its name is an INQUIRY, which can take a while
+ * on a spinning down drive, so it is left until somebody wants it.
+ * While the worker has the drive the name stays empty, the next call
+ * asks again.
+ */
+void KWMLibCompactDiscPrivate::identifyDevice()
+{
+	if (!m_handle || !m_deviceVendor.isEmpty() || !m_worker.lock()->tryLock())
+		return;
+
+	m_deviceVendor = QLatin1String(wm_drive_vendor(m_handle));
+	m_deviceModel = QLatin1String(wm_drive_model(m_handle));
+	m_deviceRevision = QLatin1String(wm_drive_revision(m_handle));
+	m_worker.lock()->unlock();
+}
+
 KCompactDisc::DiscStatus KWMLibCompactDiscPrivate::discStatusTranslate(int status)
 {
 	switch (status) {
@@ -198,14 +637,59 @@ KCompactDisc::DiscStatus KWMLibCompactDiscPrivate::discStatusTranslate(int statu
 	}
 }
 
+/*
+ * What the drive says is read with its lock held, the state is updated
+ * and the signals sent after it's let go.  A slot may wait for the
+ * worker, which needs the lock.
+ */
 void KWMLibCompactDiscPrivate::timerExpired()
 {
 	KCompactDisc::DiscStatus status;
-	unsigned track, i;
+	unsigned track = 0, trackPosition = 0, discPosition = 0, tracks, i, serial;
+	unsigned long discId = 0;
+	int silent = -1, trackStart = 0;
+	QList<unsigned> frames;
+	QList<KCompactDiscInfo::TrackFlags> flags;
+	bool newDisc = false, positionChanged = false, trackChanged = false;
 	Q_Q(KCompactDisc);
 
+	// a command is at the drive, ask again when it's done
+	if (!m_worker.lock()->tryLock()) {
+		QTimer::singleShot(100, this, SLOT(timerExpired()));
+		return;
+	}
+
 	status = discStatusTranslate(wm_cd_status(m_handle));
 
+	tracks = m_tracks ? 0 : wm_cd_getcountoftracks(m_handle);
+	if(tracks > 0) {
+		frames.reserve(tracks + 1);
+		flags.reserve(tracks);
+		for(i = 1; i <= tracks; ++i) {
+			KCompactDiscInfo::TrackFlags trackFlags;
+
+			frames.append(wm_cd_gettrackstart(m_handle, i));
+			if(wm_cd_gettrackdata(m_handle, i))
+				trackFlags |= KCompactDiscInfo::DataTrack;
+			if(wm_cd_gettrackpreemphasis(m_handle, i))
+				trackFlags |= KCompactDiscInfo::PreEmphasis;
+			flags.append(trackFlags);
+		}
+		frames.append(wm_cd_gettrackstart(m_handle, i));
+		discId = wm_cddb_discid(m_handle);
+	}
+
+	if(status == KCompactDisc::Playing) {
+		trackPosition = wm_get_cur_pos_rel(m_handle);
+		discPosition = wm_get_cur_pos_abs(m_handle);
+		track = wm_cd_getcurtrack(m_handle);
+		silent = wm_cd_get_cdda_silence_at(m_handle);
+		trackStart = wm_cd_gettrackstart(m_handle, track);
+	}
+
+	serial = wm_cd_changer_serial(m_handle);
+	m_worker.lock()->unlock();
+
 	if(m_status != status) {
 		if(skipStatusChange(status))
 			goto timerExpiredExit;
@@ -215,42 +699,24 @@ void KWMLibCompactDiscPrivate::timerExpired()
 		switch(m_status) {
 		case KCompactDisc::Ejected:
 		case KCompactDisc::NoDisc:
+			m_silenceRanges.clear();
 			clearDiscInfo();
 			break;
 		default:
-			if(m_tracks == 0) {
-				m_tracks = wm_cd_getcountoftracks(m_handle);
-				if(m_tracks > 0) {
-                    qDebug() << "New disc with " << m_tracks << " tracks";
-					m_discId = wm_cddb_discid(m_handle);
-
-					for(i = 1; i <= m_tracks; ++i) {
-						m_trackStartFrames.append(wm_cd_gettrackstart(m_handle, i));
-					}
-					m_trackStartFrames.append(wm_cd_gettrackstart(m_handle, i));
-
-					m_discLength = FRAMES2SEC(m_trackStartFrames[m_tracks] -
-						m_trackStartFrames[0]);
+			if(m_tracks == 0 && tracks > 0) {
+				m_tracks = tracks;
+                qDebug() << "New disc with " << m_tracks << " tracks";
 
-					make_playlist();
+				m_disc = KCompactDiscInfo(m_tracks, discId, frames, flags);
+				m_discLength = FRAMES2SEC(m_disc.length());
+				m_silenceRanges.clear();
 
-					m_trackArtists.append(i18n("Unknown Artist"));
-					m_trackTitles.append(i18n("Unknown Title"));
-					for(i = 1; i <= m_tracks; ++i) {
-						m_trackArtists.append(i18n("Unknown Artist"));
-						m_trackTitles.append(ki18n("Track %1").subs(i, 2).toString());
-					}
+				make_playlist();
 
 qDebug() << "m_tracks " << m_tracks;
-qDebug() << "m_trackStartFrames " << m_trackStartFrames;
-qDebug() << "m_trackArtists " << m_trackArtists;
-qDebug() << "m_trackTitles " << m_trackTitles;
+qDebug() << "track start frames " << m_disc.trackStartFrames();
 
-					Q_EMIT q->discChanged(m_tracks);
-
-					if(m_autoMetadata)
-						queryMetadata();
-				}
+				newDisc = true;
 			}
 			break;
 		}
@@ -258,8 +724,8 @@ qDebug() << "m_trackTitles " << m_trackTitles;
 
 	switch(m_status) {
 	case KCompactDisc::Playing:
-		m_trackPosition = wm_get_cur_pos_rel(m_handle);
-		m_discPosition = wm_get_cur_pos_abs(m_handle) - FRAMES2SEC(m_trackStartFrames[0]);
+		m_trackPosition = trackPosition;
+		m_discPosition = discPosition - FRAMES2SEC(m_disc.trackStartFrames().value(0));
 		// Update the current playing position.
 		if(m_seek) {
             qDebug() << "seek: " << m_seek << " trackPosition " << m_trackPosition;
@@ -269,23 +735,35 @@ qDebug() << "m_trackTitles " << m_trackTitles;
 				m_seek = abs((long)(m_trackExpectedPosition - m_trackPosition));
 		}
 
-		if(!m_seek) {
-			Q_EMIT q->playoutPositionChanged(m_trackPosition);
-			//Q_EMIT q->playoutDiscPositionChanged(m_discPosition);
-		}
+		positionChanged = !m_seek;
 
 		// Per-event processing.
-		track = wm_cd_getcurtrack(m_handle);
-
 		if(m_track != track) {
 			m_track = track;
-			Q_EMIT q->playoutTrackChanged(m_track);
+			m_silenceSkipped = -1;
+			trackChanged = true;
+		}
+
+		// silence right where the track starts is played, it may be all there is
+		if(m_autoSkipSilence && m_track) {
+			if(silent > trackStart && silent != m_silenceSkipped) {
+				m_silenceSkipped = silent;
+				track = getNextTrackInPlaylist();
+				if(track) {
+					m_statusExpected = KCompactDisc::Playing;
+					runCommand([this, track]() { playTrackPosition(track, 0); });
+				} else {
+					m_statusExpected = KCompactDisc::Stopped;
+					runCommand([this]() { stop(); });
+				}
+			}
 		}
 		break;
 
 	case KCompactDisc::Stopped:
 		m_seek = 0;
 		m_track = 0;
+		m_silenceSkipped = -1;
 		break;
 
 	default:
@@ -293,36 +771,71 @@ qDebug() << "m_trackTitles " << m_trackTitles;
 	}
 
 timerExpiredExit:
+	publishState();
+
+	if(newDisc) {
+		Q_EMIT q->discChanged(m_tracks);
+		Q_EMIT q->discInfoChanged(m_disc);
+
+		if(m_autoMetadata)
+			queryMetadata();
+	}
+	if(positionChanged) {
+		Q_EMIT q->playoutPositionChanged(m_trackPosition);
+		//Q_EMIT q->playoutDiscPositionChanged(m_discPosition);
+	}
+	if(trackChanged)
+		Q_EMIT q->playoutTrackChanged(m_track);
+
+	if (serial != m_changerSerial) {
+		m_changerSerial = serial;
+		m_slotInfos.clear();
+		Q_EMIT q->slotsChanged();
+	}
+
 	// Now that we have incurred any delays caused by the signals, we'll start the timer.
 	QTimer::singleShot(1000, this, SLOT(timerExpired()));
 }
 
+/*
+ * Reading the texts is a trip to the drive, the worker makes it and the
+ * disc gets them unless it went meanwhile.
+ */
 void KWMLibCompactDiscPrivate::cdtext()
 {
-	struct cdtext_info *info;
-	unsigned i;
-	Q_Q(KCompactDisc);
+	const unsigned tracks = m_tracks;
+	const unsigned discId = m_disc.discId();
 
-	info = wm_cd_get_cdtext(m_handle);
-
-	if(!info || !info->valid || (unsigned)info->count_of_entries != (m_tracks + 1)) {
-        qDebug() << "no or invalid CDTEXT";
+	if (!m_handle || !tracks)
 		return;
-	}
 
-	m_trackArtists[0] = QLatin1String( reinterpret_cast<char*>(info->blocks[0]->performer[0]) );
-	m_trackTitles[0] = QLatin1String( reinterpret_cast<char*>(info->blocks[0]->name[0]) );
+	m_worker.run([this, tracks]() {
+		QPair<QStringList, QStringList> texts;
+		struct cdtext_info *info;
+		unsigned i;
 
-	for(i = 1; i <= m_tracks; ++i) {
-            m_trackArtists[i] = QLatin1String( reinterpret_cast<char*>(info->blocks[0]->performer[i]) );
-            m_trackTitles[i] =QLatin1String( reinterpret_cast<char*>(info->blocks[0]->name[i]) );
-	}
+		info = wm_cd_get_cdtext(m_handle);
+
+		if(!info || !info->valid || (unsigned)info->count_of_entries != (tracks + 1)) {
+            qDebug() << "no or invalid CDTEXT";
+			return texts;
+		}
+
+		for(i = 0; i <= tracks; ++i) {
+            texts.first.append(QLatin1String( reinterpret_cast<char*>(info->blocks[0]->performer[i]) ));
+            texts.second.append(QLatin1String( reinterpret_cast<char*>(info->blocks[0]->name[i]) ));
+		}
+		return texts;
+	}).then(this, [this, discId](const QPair<QStringList, QStringList> &texts) {
+		if (texts.first.isEmpty() || discId != m_disc.discId())
+			return;
 
-    qDebug() << "CDTEXT";
-    qDebug() << "m_trackArtists " << m_trackArtists;
-    qDebug() << "m_trackTitles " << m_trackTitles;
+        qDebug() << "CDTEXT";
+        qDebug() << "artists " << texts.first;
+        qDebug() << "titles " << texts.second;
 
-	Q_EMIT q->discInformation(KCompactDisc::Cdtext);
+		setDiscInfo(m_disc.withTexts(texts.first, texts.second), KCompactDisc::Cdtext);
+	});
 }
 
 #include "moc_wmlib_interface.cpp"
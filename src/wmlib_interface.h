@@ -22,6 +22,9 @@
 #define WMLIB_INTERFACE_H
 
 #include "kcompactdisc_p.h"
+#include "drive_worker.h"
+
+#include <QHash>
 
 class KWMLibCompactDiscPrivate : public KCompactDiscPrivate
 {
@@ -32,6 +35,10 @@ class KWMLibCompactDiscPrivate : public KCompactDiscPrivate
 		~KWMLibCompactDiscPrivate() override;
 
 		bool createInterface() override;
+		QFuture<bool> createInterfaceAsync() override;
+		bool switchDevice(const QString &, const QString &, const QString &) override;
+		QFuture<bool> switchDeviceAsync(const QString &, const QString &, const QString &) override;
+		QFuture<void> runCommand(std::function<void()>) override;
 
 		unsigned trackLength(unsigned) override;
 		bool isTrackAudio(unsigned) override;
@@ -48,12 +55,48 @@ class KWMLibCompactDiscPrivate : public KCompactDiscPrivate
 	
 		void queryMetadata() override;
 
+		unsigned slotCount() override;
+		unsigned currentSlot() override;
+		KCompactDiscInfo slotInfo(unsigned) override;
+		QFuture<void> selectSlotAsync(unsigned) override;
+		void scanSlots() override;
+
+		QFuture<void> scanSubchannelAsync() override;
+		QFuture<QString> cueSheetAsync(const QString &) override;
+
+		int pcmTap() override;
+		void setSilenceDetection(int, unsigned) override;
+		QList<QPair<unsigned, unsigned>> silenceRanges(unsigned) override;
+		QVariantMap statistics() override;
+		void resetStatistics() override;
+		void identifyDevice() override;
+
 
 	private:
 		KCompactDisc::DiscStatus discStatusTranslate(int);
+		bool openHandle();
+		void handleOpened();
+		bool moveHandle(const QString &);
+		void handleMoved(const QString &);
+
+		// calls on m_handle which touch the drive hold m_worker.lock()
+		DriveWorker m_worker;
 		void *m_handle;
 		QString m_audioSystem;
 		QString m_audioDevice;
+		// wm_cd_changer_serial() as slotsChanged() was last sent for
+		unsigned m_changerSerial;
+		// the silent range auto skip left, so it's done once
+		int m_silenceSkipped;
+
+		// what the GUI thread got last, for while the worker has the drive
+		unsigned m_volume;
+		unsigned m_balance;
+		unsigned m_slotCount;		// set where the drive is opened
+		unsigned m_currentSlot;
+		int m_tapFd;
+		QHash<unsigned, KCompactDiscInfo> m_slotInfos;	// until the changer serial changes
+		QHash<unsigned, QList<QPair<unsigned, unsigned>>> m_silenceRanges;	// of this disc
 
 	
 	private Q_SLOTS:
@@ -0,0 +1,436 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Benchmarks of the libworkman internals.
+ *
+ * Run with -o results.xml,xml (or -csv) for machine readable output.
+ * Cases needing a real drive read KCOMPACTDISC_BENCH_DEVICE and are
+ * skipped without it, all others run against a generated disc image
+ * played into the "null" soundsystem.  cddaRead compares the io_uring
+ * engine with the cdda_read hook on both.
+ */
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <cstdlib>
+
+extern "C"
+{
+	#include "wmlib/include/wm_config.h"
+	#include "wmlib/include/wm_struct.h"
+	#include "wmlib/include/wm_cdrom.h"
+	#include "wmlib/include/wm_cddb.h"
+	#include "wmlib/include/wm_cdtext.h"
+	#include "wmlib/include/wm_fault.h"
+	#include "wmlib/include/wm_helpers.h"
+	#include "wmlib/include/wm_stats.h"
+	#include "wmlib/include/wm_uring.h"
+	#include "wmlib/audio/audio.h"
+}
+
+// 30 seconds of audio per iteration
+static const int BenchFrames = 30 * 75;
+
+// generated image: 10 tracks of 10 seconds
+static const int ImageTracks = 10;
+static const int ImageTrackFrames = 10 * 75;
+static const int FrameSize = 2352;
+
+class BenchKCD : public QObject
+{
+    Q_OBJECT
+
+    private:
+
+    void *mDrive = nullptr;
+    void *mImage = nullptr;
+    QTemporaryDir mDir;
+
+    // one playback for all rows of handoffLatency
+    audio_null_stats mHandoff = {};
+
+    wm_drive *openDrive()
+    {
+        const char *device = getenv("KCOMPACTDISC_BENCH_DEVICE");
+        if (!device)
+            return nullptr;
+
+        if (!mDrive && wm_cd_init(device, "cdin", nullptr, nullptr, &mDrive) < 0)
+            mDrive = nullptr;
+
+        return static_cast<wm_drive *>(mDrive);
+    }
+
+    static void putLE(QByteArray &a, quint32 v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            a.append(char((v >> (8 * i)) & 0xff));
+    }
+
+    bool writeImage(const QString &wav, const QString &cue)
+    {
+        const quint32 dataSize = quint32(ImageTracks) * ImageTrackFrames * FrameSize;
+
+        QByteArray header("RIFF");
+        putLE(header, 36 + dataSize, 4);
+        header.append("WAVEfmt ");
+        putLE(header, 16, 4);
+        putLE(header, 1, 2);        // PCM
+        putLE(header, 2, 2);        // channels
+        putLE(header, 44100, 4);
+        putLE(header, 44100 * 4, 4);
+        putLE(header, 4, 2);
+        putLE(header, 16, 2);
+        header.append("data");
+        putLE(header, dataSize, 4);
+
+        QFile file(wav);
+        if (!file.open(QIODevice::WriteOnly) || file.write(header) != header.size())
+            return false;
+
+        QByteArray frame(FrameSize, Qt::Uninitialized);
+        for (int i = 0; i < ImageTracks * ImageTrackFrames; i++) {
+            for (int j = 0; j < FrameSize; j++)
+                frame[j] = char(i + j);
+            if (file.write(frame) != frame.size())
+                return false;
+        }
+        file.close();
+
+        QByteArray sheet("CATALOG 0123456789012\n"
+                         "PERFORMER \"KCompactDisc\"\n"
+                         "TITLE \"Benchmark\"\n"
+                         "FILE \"bench.wav\" WAVE\n");
+        for (int t = 0; t < ImageTracks; t++) {
+            const int seconds = t * ImageTrackFrames / 75;
+            sheet += QStringLiteral("  TRACK %1 AUDIO\n"
+                                    "    TITLE \"Track %2\"\n"
+                                    "    PERFORMER \"Artist %2\"\n"
+                                    "    INDEX 01 %3:%4:00\n")
+                         .arg(t + 1, 2, 10, QLatin1Char('0'))
+                         .arg(t + 1)
+                         .arg(seconds / 60, 2, 10, QLatin1Char('0'))
+                         .arg(seconds % 60, 2, 10, QLatin1Char('0'))
+                         .toLatin1();
+        }
+
+        QFile sheetFile(cue);
+        return sheetFile.open(QIODevice::WriteOnly) && sheetFile.write(sheet) == sheet.size();
+    }
+
+    // Plays the whole image, returns the wall time in nanoseconds.
+    qint64 playImage(audio_null_stats *stats)
+    {
+        audio_null_get_stats(nullptr, 1);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if (wm_cd_play(mImage, 1, 0, ImageTracks) < 0)
+            return -1;
+        while (wm_cd_status(mImage) == WM_CDM_PLAYING)
+            wm_susleep(200);
+
+        const qint64 elapsed = timer.nsecsElapsed();
+        audio_null_get_stats(stats, 1);
+        return elapsed;
+    }
+
+    private Q_SLOTS:
+
+    void initTestCase()
+    {
+        QVERIFY(mDir.isValid());
+
+        const QString cue = mDir.filePath(QStringLiteral("bench.cue"));
+        QVERIFY(writeImage(mDir.filePath(QStringLiteral("bench.wav")), cue));
+        QVERIFY(wm_cd_init(QFile::encodeName(cue).constData(), "null", nullptr, nullptr, &mImage) >= 0);
+        QCOMPARE(wm_cd_getcountoftracks(mImage), ImageTracks);
+    }
+
+    void cleanupTestCase()
+    {
+        if (mDrive)
+            wm_cd_destroy(mDrive);
+        if (mImage)
+            wm_cd_destroy(mImage);
+    }
+
+    // blocks per second through cdda_fct_read and cdda_fct_play
+    void cddaPlayback()
+    {
+        audio_null_stats stats;
+        const qint64 elapsed = playImage(&stats);
+
+        QVERIFY(elapsed > 0);
+        QCOMPARE(stats.bytes, qint64(ImageTracks) * ImageTrackFrames * FrameSize);
+        QTest::setBenchmarkResult(stats.blocks * 1e9 / elapsed, QTest::FramesPerSecond);
+    }
+
+    void cddaPlaybackFaults_data()
+    {
+        QTest::addColumn<QByteArray>("spec");
+
+        QTest::newRow("latency") << QByteArray("seed=1,latency=normal:1000:300");
+        QTest::newRow("stalls") << QByteArray("seed=1,stall=0.02:50000");
+        QTest::newRow("eio") << QByteArray("seed=1,eio=0.05");
+        QTest::newRow("bad") << QByteArray("bad=3000-3020");
+    }
+
+    // blocks per second with retries and concealment at work
+    void cddaPlaybackFaults()
+    {
+        QFETCH(QByteArray, spec);
+
+        QCOMPARE(wm_cd_fault_config(mImage, spec.constData()), 0);
+        audio_null_stats stats;
+        const qint64 elapsed = playImage(&stats);
+        wm_cd_fault_config(mImage, "");
+
+        QVERIFY(elapsed > 0);
+        QCOMPARE(stats.bytes, qint64(ImageTracks) * ImageTrackFrames * FrameSize);
+        QTest::setBenchmarkResult(stats.blocks * 1e9 / elapsed, QTest::FramesPerSecond);
+    }
+
+    void handoffLatency_data()
+    {
+        QTest::addColumn<bool>("worst");
+
+        QTest::newRow("mean") << false;
+        QTest::newRow("max") << true;
+    }
+
+    // time from the reader filling a block to the player handing it over
+    void handoffLatency()
+    {
+        QFETCH(bool, worst);
+
+        if (!mHandoff.blocks)
+            QVERIFY(playImage(&mHandoff) > 0);
+        QVERIFY(mHandoff.blocks > 0);
+
+        QTest::setBenchmarkResult(worst ? mHandoff.latency_max : mHandoff.latency_sum / mHandoff.blocks,
+                                  QTest::WalltimeNanoseconds);
+    }
+
+    // wm_cd_init() until the first status, no sink or threads yet
+    void timeToStatus()
+    {
+        const QByteArray cue = QFile::encodeName(mDir.filePath(QStringLiteral("bench.cue")));
+        wm_stats_snapshot *snap = new wm_stats_snapshot;
+        qint64 total = 0;
+        const int runs = 20;
+
+        for (int i = 0; i < runs; ++i) {
+            void *h = nullptr;
+            QElapsedTimer timer;
+            timer.start();
+            QVERIFY(wm_cd_init(cue.constData(), "null", nullptr, nullptr, &h) >= 0);
+            total += timer.nsecsElapsed();
+
+            QCOMPARE(wm_cd_get_stats(h, snap), 0);
+            QCOMPARE(snap->counter[WM_STATS_CDDA_STARTS], 0LL);
+            wm_cd_destroy(h);
+        }
+        delete snap;
+
+        QTest::setBenchmarkResult(total / runs, QTest::WalltimeNanoseconds);
+    }
+
+    void switchLatency_data()
+    {
+        QTest::addColumn<bool>("reinit");
+
+        QTest::newRow("switch") << false;
+        QTest::newRow("reinit") << true;
+    }
+
+    // moving a playing CDDA handle to another drive, against starting over
+    void switchLatency()
+    {
+        QFETCH(bool, reinit);
+
+        const QString first = mDir.filePath(QStringLiteral("bench.cue"));
+        const QString second = mDir.filePath(QStringLiteral("bench2.cue"));
+        if (!QFile::exists(second))
+            QVERIFY(QFile::copy(first, second));
+
+        void *h = nullptr;
+        QVERIFY(wm_cd_init(QFile::encodeName(first).constData(), "null", nullptr, nullptr, &h) >= 0);
+
+        qint64 total = 0;
+        const int runs = 20;
+
+        for (int i = 0; i < runs; ++i) {
+            const QByteArray next = QFile::encodeName(i & 1 ? first : second);
+
+            // sink and threads up
+            QVERIFY(wm_cd_play(h, 1, 0, 2) >= 0);
+
+            QElapsedTimer timer;
+            timer.start();
+            if (reinit) {
+                wm_cd_destroy(h);
+                QVERIFY(wm_cd_init(next.constData(), "null", nullptr, nullptr, &h) >= 0);
+            } else {
+                QVERIFY(wm_cd_switch_device(h, next.constData()) >= 0);
+            }
+            QVERIFY(wm_cd_play(h, 1, 0, 2) >= 0);
+            total += timer.nsecsElapsed();
+
+            QCOMPARE(wm_cd_getcountoftracks(h), ImageTracks);
+            wm_cd_stop(h);
+        }
+        wm_cd_destroy(h);
+
+        QTest::setBenchmarkResult(total / runs, QTest::WalltimeNanoseconds);
+    }
+
+    void driveStatus()
+    {
+        QBENCHMARK {
+            wm_cd_status(mImage);
+        }
+    }
+
+    void readToc()
+    {
+        QBENCHMARK {
+            wm_cd_read_toc(mImage);
+        }
+    }
+
+    // includes fetching the packs through the READ TOC emulation
+    void cdtextParse()
+    {
+        wm_drive *d = static_cast<wm_drive *>(mImage);
+        QVERIFY(get_glob_cdtext(d, 1)->valid);
+
+        QBENCHMARK {
+            get_glob_cdtext(d, 1);
+        }
+    }
+
+    void cddbDiscid()
+    {
+        wm_drive *d = static_cast<wm_drive *>(mImage);
+
+        QBENCHMARK {
+            cddb_discid(d);
+        }
+    }
+
+    void cddaRead_data()
+    {
+        QTest::addColumn<bool>("drive");
+        QTest::addColumn<bool>("uring");
+
+        QTest::newRow("image ioctl") << false << false;
+        QTest::newRow("image uring") << false << true;
+        QTest::newRow("drive ioctl") << true << false;
+        QTest::newRow("drive uring") << true << true;
+    }
+
+    // the cdda_read hook against the io_uring engine, on the generated
+    // image or on KCOMPACTDISC_BENCH_DEVICE
+    void cddaRead()
+    {
+        QFETCH(bool, drive);
+        QFETCH(bool, uring);
+
+        void *image = nullptr;
+        wm_drive *d;
+        if (drive) {
+            d = openDrive();
+            if (!d)
+                QSKIP("set KCOMPACTDISC_BENCH_DEVICE to an audio CD drive");
+        } else {
+            // a handle of its own, mImage has the CDDA thread attached
+            const QByteArray cue = QFile::encodeName(mDir.filePath(QStringLiteral("bench.cue")));
+            QVERIFY(wm_cd_init(cue.constData(), "null", nullptr, nullptr, &image) >= 0);
+            d = static_cast<wm_drive *>(image);
+        }
+
+        int track = 1;
+        while (track <= d->thiscd.ntracks && wm_cd_gettrackdata(d, track))
+            track++;
+        if (track > d->thiscd.ntracks) {
+            if (image)
+                wm_cd_destroy(image);
+            QSKIP("no audio track on the disc");
+        }
+
+        wm_cdda_block block = {};
+        d->blocks = &block;
+        d->numblocks = 1;
+        d->frames_at_once = 15;
+        QVERIFY(d->proto.cdda_open(d) == 0);
+
+        wm_uring *engine = nullptr;
+        if (uring) {
+            engine = wm_uring_open(d, WM_URING_DEPTH);
+            if (!engine) {
+                d->proto.cdda_close(d);
+                if (image)
+                    wm_cd_destroy(image);
+                QSKIP("io_uring engine unavailable");
+            }
+        }
+
+        // all of the image, BenchFrames of the drive
+        const int start = wm_cd_gettrackstart(d, track);
+        const int end = image ? d->thiscd.trk[d->thiscd.ntracks].start
+                              : qMin(start + BenchFrames, wm_cd_gettrackstart(d, track + 1));
+        qint64 bytes = 0;
+        QElapsedTimer timer;
+        timer.start();
+
+        d->current_position = start;
+        d->ending_position = end;
+        while (d->current_position < end) {
+            const long ret = engine ? wm_uring_read(engine, d, &block)
+                                    : d->proto.cdda_read(d, &block);
+            if (ret <= 0)
+                break;
+            bytes += ret;
+        }
+
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        wm_uring_close(engine);
+        d->proto.cdda_close(d);
+        d->blocks = nullptr;
+        d->numblocks = 0;
+        const int position = d->current_position;
+        if (image)
+            wm_cd_destroy(image);
+
+        QCOMPARE(position, end);
+        QCOMPARE(bytes, qint64(end - start) * FrameSize);
+        QTest::setBenchmarkResult(bytes * 1e9 / qMax<qint64>(elapsed, 1), QTest::BytesPerSecond);
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchKCD)
+
+#include "benchkcd.moc"
@@ -0,0 +1,159 @@
+/*
+ *  KCompactDisc - A CD drive interface for the KDE Project.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Tests of KCompactDiscInfo, the texts kept in one pool in particular.
+ */
+
+#include <QObject>
+#include <QTest>
+
+#include "kcompactdiscinfo.h"
+
+// three tracks of 10, 20 and 30 seconds after the 2 second pregap
+static const QList<unsigned> Frames{ 150, 900, 2400, 4650 };
+
+class InfoKCD : public QObject
+{
+    Q_OBJECT
+
+    private:
+
+    static KCompactDiscInfo disc()
+    {
+        return KCompactDiscInfo(3, 0x1b070803, Frames,
+                                { KCompactDiscInfo::TrackFlags(),
+                                  KCompactDiscInfo::PreEmphasis,
+                                  KCompactDiscInfo::DataTrack });
+    }
+
+    private Q_SLOTS:
+
+    void noDisc()
+    {
+        const KCompactDiscInfo info;
+
+        QVERIFY(info.isEmpty());
+        QCOMPARE(info.tracks(), 0u);
+        QCOMPARE(info.length(), 0u);
+        QVERIFY(info.trackTitle(1).isNull());
+        QVERIFY(info.withText(0, QStringLiteral("Artist"), QStringLiteral("Title")).isEmpty());
+    }
+
+    void tableOfContents()
+    {
+        const KCompactDiscInfo info = disc();
+
+        QVERIFY(!info.isEmpty());
+        QCOMPARE(info.tracks(), 3u);
+        QCOMPARE(info.discId(), 0x1b070803u);
+        QCOMPARE(info.trackStartFrames(), Frames);
+        QCOMPARE(info.length(), 4500u);
+        QCOMPARE(info.trackLength(1), 750u);
+        QCOMPARE(info.trackLength(3), 2250u);
+        QCOMPARE(info.trackFlags(2), KCompactDiscInfo::TrackFlags(KCompactDiscInfo::PreEmphasis));
+        QCOMPARE(info.trackFlags(3), KCompactDiscInfo::TrackFlags(KCompactDiscInfo::DataTrack));
+        QCOMPARE(info.trackIndexes(2), QList<unsigned>{ 900 });
+    }
+
+    // a disc without CD-TEXT shows the defaults
+    void defaultTexts()
+    {
+        const KCompactDiscInfo info = disc();
+
+        QCOMPARE(info.artist(), QStringLiteral("Unknown Artist"));
+        QCOMPARE(info.title(), QStringLiteral("Unknown Title"));
+        QCOMPARE(info.trackArtist(2), QStringLiteral("Unknown Artist"));
+        QVERIFY(info.trackTitle(2).startsWith(QStringLiteral("Track")));
+        QVERIFY(info.trackTitle(2).endsWith(QLatin1Char('2')));
+
+        // empty strings fall back to the defaults as well
+        const KCompactDiscInfo empty = info.withTexts({ QString(), QString() }, { QString() });
+        QCOMPARE(empty.artist(), QStringLiteral("Unknown Artist"));
+        QCOMPARE(empty.trackTitle(1), info.trackTitle(1));
+    }
+
+    void trackTexts()
+    {
+        const KCompactDiscInfo info = disc().withTexts(
+            { QStringLiteral("The Artist"), QStringLiteral("First Artist"), QString(), QStringLiteral("Third Artist") },
+            { QStringLiteral("The Album"), QStringLiteral("First"), QStringLiteral("Second") });
+
+        QCOMPARE(info.artist(), QStringLiteral("The Artist"));
+        QCOMPARE(info.title(), QStringLiteral("The Album"));
+        QCOMPARE(info.trackArtist(1), QStringLiteral("First Artist"));
+        QCOMPARE(info.trackTitle(1), QStringLiteral("First"));
+        QCOMPARE(info.trackArtist(2), QStringLiteral("Unknown Artist"));
+        QCOMPARE(info.trackTitle(2), QStringLiteral("Second"));
+        QCOMPARE(info.trackArtist(3), QStringLiteral("Third Artist"));
+        QCOMPARE(info.trackTitle(3), disc().trackTitle(3));
+        QVERIFY(info.isSameDisc(disc()));
+    }
+
+    // a copy shares the data, changing its texts leaves the original alone
+    void withTextShared()
+    {
+        const KCompactDiscInfo original = disc().withTexts(
+            { QStringLiteral("The Artist") }, { QStringLiteral("The Album"), QStringLiteral("First") });
+        const KCompactDiscInfo copy = original;
+
+        const KCompactDiscInfo track = copy.withText(2, QStringLiteral("Guest"), QStringLiteral("Second"));
+        QCOMPARE(track.trackArtist(2), QStringLiteral("Guest"));
+        QCOMPARE(track.trackTitle(2), QStringLiteral("Second"));
+        QCOMPARE(track.trackTitle(1), QStringLiteral("First"));
+        QCOMPARE(track.title(), QStringLiteral("The Album"));
+
+        const KCompactDiscInfo album = copy.withText(0, QStringLiteral("Other"), QStringLiteral("Other Album"));
+        QCOMPARE(album.artist(), QStringLiteral("Other"));
+        QCOMPARE(album.title(), QStringLiteral("Other Album"));
+        QCOMPARE(album.trackTitle(1), QStringLiteral("First"));
+
+        for (const KCompactDiscInfo &info : { original, copy }) {
+            QCOMPARE(info.artist(), QStringLiteral("The Artist"));
+            QCOMPARE(info.title(), QStringLiteral("The Album"));
+            QCOMPARE(info.trackArtist(2), QStringLiteral("Unknown Artist"));
+            QCOMPARE(info.trackTitle(2), disc().trackTitle(2));
+        }
+    }
+
+    void outOfRange()
+    {
+        const KCompactDiscInfo info = disc().withTexts({ QStringLiteral("The Artist") },
+                                                       { QStringLiteral("The Album"), QStringLiteral("First") });
+
+        for (unsigned track : { 0u, 4u, 99u }) {
+            QVERIFY(info.trackArtist(track).isNull());
+            QVERIFY(info.trackTitle(track).isNull());
+            QCOMPARE(info.trackLength(track), 0u);
+            QCOMPARE(info.trackFlags(track), KCompactDiscInfo::TrackFlags());
+            QVERIFY(info.trackIsrc(track).isNull());
+            QCOMPARE(info.trackPregap(track), 0u);
+            QVERIFY(info.trackIndexes(track).isEmpty());
+        }
+
+        // no such track, the disc stays as it is
+        const KCompactDiscInfo same = info.withText(4, QStringLiteral("Nobody"), QStringLiteral("Nothing"));
+        QCOMPARE(same.artist(), QStringLiteral("The Artist"));
+        QCOMPARE(same.trackTitle(1), QStringLiteral("First"));
+        QVERIFY(same.trackTitle(4).isNull());
+    }
+};
+
+QTEST_GUILESS_MAIN(InfoKCD)
+
+#include "infokcd.moc"
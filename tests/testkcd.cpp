@@ -2,8 +2,15 @@
 #include <QDebug>
 #include <QMetaObject>
 #include <QCoreApplication>
+#include <QDataStream>
+#include <QDeadlineTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThread>
 #include <QtGlobal>
 
+#include <thread>
+
 #include "kcompactdisc.h"
 
 class TestKCD : public QObject
@@ -49,11 +56,80 @@ class TestKCD : public QObject
         qDebug() << "The number of tracks in the disc:" << mKcd->tracks();
         qDebug() << "The current track no:" << mKcd->trackPosition();
 
-        qApp->exit();
+        bool ok = checkSnapshot();
+
+        // a one track image, picking up its disc publishes a new state
+        QTemporaryDir dir;
+        const QString image = dir.filePath(QStringLiteral("disc.wav"));
+        const quint64 serial = mKcd->snapshot().serial;
+        if (!writeImage(image) || !mKcd->setDevice(image, 50, false)) {
+            qWarning() << "FAIL: cannot play the image" << image;
+            ok = false;
+        } else {
+            const QDeadlineTimer deadline(5000);
+            while (mKcd->tracks() != 1 && !deadline.hasExpired()) {
+                QCoreApplication::processEvents();
+                QThread::msleep(50);
+            }
+            if (mKcd->tracks() != 1) {
+                qWarning() << "FAIL: the image shows" << mKcd->tracks() << "tracks";
+                ok = false;
+            }
+            if (mKcd->snapshot().serial <= serial) {
+                qWarning() << "FAIL: serial" << mKcd->snapshot().serial << "after a publish, was" << serial;
+                ok = false;
+            }
+            ok = checkSnapshot() && ok;
+        }
+
+        qDebug() << (ok ? "PASS" : "FAIL");
+        qApp->exit(ok ? 0 : 1);
     }
 
     private:
 
+    // the state another thread sees is the one of this thread
+    bool checkSnapshot()
+    {
+        const KCompactDisc::DiscStatus status = mKcd->discStatus();
+        const unsigned tracks = mKcd->tracks();
+        const QString deviceName = mKcd->deviceName();
+        KCompactDisc::DiscState state;
+
+        std::thread([this, &state]() { state = mKcd->snapshot(); }).join();
+
+        if (state.status != status || state.tracks != tracks || state.deviceName != deviceName) {
+            qWarning() << "FAIL: snapshot" << state.serial << "has status" << state.status
+                       << "tracks" << state.tracks << "device" << state.deviceName
+                       << ", expected" << status << tracks << deviceName;
+            return false;
+        }
+        return true;
+    }
+
+    // one second of silence as 44.1 kHz stereo 16 bit WAVE
+    static bool writeImage(const QString &fileName)
+    {
+        const quint32 size = 44100 * 4;
+        QFile file(fileName);
+        QDataStream out(&file);
+
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+
+        out.setByteOrder(QDataStream::LittleEndian);
+        out.writeRawData("RIFF", 4);
+        out << quint32(36 + size);
+        out.writeRawData("WAVEfmt ", 8);
+        out << quint32(16) << quint16(1) << quint16(2) << quint32(44100)
+            << quint32(44100 * 4) << quint16(4) << quint16(16);
+        out.writeRawData("data", 4);
+        out << size;
+        file.write(QByteArray(size, 0));
+
+        return out.status() == QDataStream::Ok && file.error() == QFileDevice::NoError;
+    }
+
     KCompactDisc *mKcd;
 };
 